@@ -0,0 +1,98 @@
+#ifndef BOOT_TIMING_H
+#define BOOT_TIMING_H
+
+/*************************************************************
+  Boot timing and late clock sync
+
+  BootTimeline records when each phase of the boot finished (first
+  reading on the OLED, storage mounted, WiFi up, clock synced...),
+  in microseconds since the app started, for the serial log and
+  /metrics. Phases are marked from several tasks; each claims its
+  own slot, so marking never blocks.
+
+  ClockSync notices the first time the system clock carries a real
+  date. Readings taken before that are stamped in seconds since
+  boot; its offset turns those stamps into epoch seconds.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#ifndef BOOT_PHASES_MAX
+#define BOOT_PHASES_MAX 16
+#endif
+#define CLOCK_SYNC_MIN_EPOCH 1577836800UL   // 2020-01-01; anything earlier is uptime
+
+struct BootPhase {
+  const char *name;
+  uint32_t micros;        // Since the app started
+};
+
+class BootTimeline {
+public:
+  /**
+   * Record that phase `name` (a string literal) finished at micros.
+   * Only the first mark of a name counts; false for the others.
+   */
+  bool mark(const char *name, uint32_t micros) {
+    if (at(name) != 0) return false;
+    uint8_t slot = next.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= BOOT_PHASES_MAX) return false;
+    times[slot] = micros ? micros : 1;
+    names[slot].store(name, std::memory_order_release);
+    return true;
+  }
+
+  // Microseconds at which name finished, 0 if it has not yet
+  uint32_t at(const char *name) const {
+    for (size_t i = 0; i < count(); i++) {
+      const char *n = names[i].load(std::memory_order_acquire);
+      if (n == name) return times[i];
+    }
+    return 0;
+  }
+
+  size_t count() const {
+    uint8_t n = next.load(std::memory_order_relaxed);
+    return n < BOOT_PHASES_MAX ? n : BOOT_PHASES_MAX;
+  }
+
+  // Phase i in marking order; name is nullptr while it is being written
+  BootPhase phase(size_t i) const {
+    BootPhase p = { names[i].load(std::memory_order_acquire), times[i] };
+    return p;
+  }
+
+private:
+  uint32_t times[BOOT_PHASES_MAX] = {};
+  std::atomic<const char *> names[BOOT_PHASES_MAX] = {};
+  std::atomic<uint8_t> next{0};
+};
+
+class ClockSync {
+public:
+  /**
+   * Feed the clock reading now and the seconds since boot at the same
+   * moment. True exactly once: at the first reading with a real date.
+   */
+  bool update(uint32_t now, uint32_t uptimeS) {
+    if (synced || now < CLOCK_SYNC_MIN_EPOCH) return false;
+    synced = true;
+    offset = now - uptimeS;
+    return true;
+  }
+
+  bool isSynced() const { return synced; }
+  uint32_t offsetS() const { return offset; }
+
+  // A stamp taken before the sync, in epoch seconds (unchanged after it)
+  uint32_t toEpoch(uint32_t stamp) const {
+    return synced && stamp < CLOCK_SYNC_MIN_EPOCH ? stamp + offset : stamp;
+  }
+
+private:
+  bool synced = false;
+  uint32_t offset = 0;
+};
+
+#endif
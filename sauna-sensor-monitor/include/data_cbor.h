@@ -0,0 +1,124 @@
+#ifndef DATA_CBOR_H
+#define DATA_CBOR_H
+
+/*************************************************************
+  /data CBOR body
+
+  The binary twin of serializeData() (data_json.h), in the format
+  described in lib/SaunaCbor/src/sauna_cbor.h. It carries the same
+  readings with raw timestamps instead of formatted labels, and
+  delta-encoded history. Shared by the web handler and the host
+  simulator.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "sauna_cbor.h"
+#include "history.h"
+#include "eta_model.h"
+#include "snapshot.h"
+#include "session_stats.h"
+
+inline void writeCborMinutes(CborWriter &w, int16_t minutes) {
+  if (minutes < 0) w.null();
+  else w.integer(minutes);
+}
+
+/**
+ * Write the /data CBOR body: the reading with sequence number seq (and
+ * each sensor if there are several), session minutes, the prediction,
+ * the session analytics and the given history points (oldest first). Values are rounded as
+ * in the JSON body. Returns the body length (cut short if buf is too
+ * small, see CborWriter).
+ */
+inline size_t serializeDataCbor(uint8_t *buf, size_t len, uint32_t seq, float temperature,
+                                float humidity, uint32_t sessionMinutes, const EtaPrediction &eta,
+                                const HistoryPoint *points, size_t count, uint32_t now,
+                                const SensorFrame *sensors = nullptr,
+                                const SessionSummary *session = nullptr) {
+  bool perSensor = sensors && sensors->count > 1;
+  bool stats = session && session->valid;
+  CborWriter w(buf, len);
+  w.beginMap(12 + (perSensor ? 2 : 0) + (stats ? 8 : 0));
+  w.uinteger(SAUNA_CBOR_KEY_VERSION);
+  w.uinteger(SAUNA_CBOR_VERSION);
+  w.uinteger(SAUNA_CBOR_KEY_SEQ);
+  w.uinteger(seq);
+  w.uinteger(SAUNA_CBOR_KEY_TIME);
+  w.uinteger(now);
+  w.uinteger(SAUNA_CBOR_KEY_TEMPERATURE);
+  w.integer(lroundf(temperature * 10.0f));
+  w.uinteger(SAUNA_CBOR_KEY_HUMIDITY);
+  w.integer(int(humidity));
+  w.uinteger(SAUNA_CBOR_KEY_SESSION);
+  w.uinteger(sessionMinutes);
+  w.uinteger(SAUNA_CBOR_KEY_READY_IN);
+  writeCborMinutes(w, eta.readyMinutes);
+  w.uinteger(SAUNA_CBOR_KEY_COOL_IN);
+  writeCborMinutes(w, eta.coolMinutes);
+  w.uinteger(SAUNA_CBOR_KEY_ETA_CONFIDENCE);
+  w.uinteger(eta.confidence);
+
+  // History: first value absolute, then the change from the previous point
+  w.uinteger(SAUNA_CBOR_KEY_TIMES);
+  w.beginArray(count);
+  int64_t prev = 0;
+  for (size_t i = 0; i < count; i++) {
+    w.integer((int64_t)points[i].time - prev);
+    prev = points[i].time;
+  }
+  w.uinteger(SAUNA_CBOR_KEY_TEMPS);
+  w.beginArray(count);
+  prev = 0;
+  for (size_t i = 0; i < count; i++) {
+    int64_t deci = lroundf(points[i].tempMean * 10.0f);
+    w.integer(deci - prev);
+    prev = deci;
+  }
+  w.uinteger(SAUNA_CBOR_KEY_HUMS);
+  w.beginArray(count);
+  prev = 0;
+  for (size_t i = 0; i < count; i++) {
+    int64_t hum = int(points[i].humMean);
+    w.integer(hum - prev);
+    prev = hum;
+  }
+
+  if (perSensor) {
+    w.uinteger(SAUNA_CBOR_KEY_SENSOR_TEMPS);
+    w.beginArray(sensors->count);
+    for (uint8_t i = 0; i < sensors->count; i++) {
+      if (sensors->hold[i]) w.integer(lroundf(sensors->temperature[i] * 10.0f));
+      else w.null();
+    }
+    w.uinteger(SAUNA_CBOR_KEY_SENSOR_HUMS);
+    w.beginArray(sensors->count);
+    for (uint8_t i = 0; i < sensors->count; i++) {
+      if (sensors->hold[i]) w.integer(int(sensors->humidity[i]));
+      else w.null();
+    }
+  }
+
+  if (stats) {
+    w.uinteger(SAUNA_CBOR_KEY_STATS_ACTIVE);
+    w.uinteger(session->active ? 1 : 0);
+    w.uinteger(SAUNA_CBOR_KEY_MEAN_TEMP);
+    w.integer(lroundf(session->meanTemp * 10.0f));
+    w.uinteger(SAUNA_CBOR_KEY_TEMP_SD);
+    w.uinteger(lroundf(session->tempStdDev * 10.0f));
+    w.uinteger(SAUNA_CBOR_KEY_ABOVE_60);
+    w.uinteger(session->above60S / 60);
+    w.uinteger(SAUNA_CBOR_KEY_ABOVE_80);
+    w.uinteger(session->above80S / 60);
+    w.uinteger(SAUNA_CBOR_KEY_HUMIDITY_MINUTES);
+    w.uinteger(lroundf(session->humidityMinutes));
+    w.uinteger(SAUNA_CBOR_KEY_HEAT_DOSE);
+    w.uinteger(lroundf(session->heatDose));
+    w.uinteger(SAUNA_CBOR_KEY_THROWS);
+    w.uinteger(session->throws);
+  }
+  return w.length();
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef DATA_JSON_H
+#define DATA_JSON_H
+
+/*************************************************************
+  /data and live-update JSON bodies
+
+  Shared by the web handlers and the host simulator. Everything is
+  written into caller-provided buffers with JsonWriter.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "json_writer.h"
+#include "history.h"
+#include "eta_model.h"
+#include "snapshot.h"
+#include "session_stats.h"
+
+// Shape and buffer sizes of the bodies, shared with the simulator's checks
+const size_t DATA_HISTORY_POINTS = 10;       // Points returned by /data
+const size_t DATA_HISTORY_STRIDE = 5;        // Every 5th raw sample (10 s apart)
+const size_t DATA_JSON_BUFFER_SIZE = 640;    // Worst case /data body is ~480 bytes, ~590 with 8 sensors
+const size_t DATA_CBOR_BUFFER_SIZE = 256;    // Worst case CBOR body is ~180 bytes (~230 with 8 sensors), typically ~100
+const size_t LIVE_HISTORY_POINTS = 90;       // Raw points in the snapshot sent on connect (3 min)
+const size_t LIVE_JSON_BUFFER_SIZE = 2304;   // ~2.1 KB worst case with 8 sensors and the session analytics
+const size_t SAMPLE_JSON_BUFFER_SIZE = 240;  // Live/MQTT delta, ~200 bytes with 8 sensors
+
+/**
+ * Chart label for a history point: wall-clock time when the clock is
+ * synced, otherwise the age relative to now
+ */
+inline void formatHistoryLabel(char *buf, size_t len, uint32_t stamp, uint32_t now) {
+  const uint32_t EPOCH_2020 = 1577836800UL;
+  if (stamp >= EPOCH_2020) {
+    time_t t = stamp;
+    struct tm tmInfo;
+    localtime_r(&t, &tmInfo);
+    strftime(buf, len, "%H:%M:%S", &tmInfo);
+  } else {
+    snprintf(buf, len, "%lus ago", (unsigned long)(now >= stamp ? now - stamp : 0));
+  }
+}
+
+// Minutes, or null when unknown
+inline void writeEtaMinutes(JsonWriter &w, int16_t minutes) {
+  if (minutes < 0) w.null();
+  else w.integer(minutes);
+}
+
+/**
+ * Per-sensor readings as "sensorTemps" and "sensorHums" arrays, null for
+ * a sensor without a current reading. Only written with several sensors.
+ */
+inline void writeSensorArrays(JsonWriter &w, const SensorFrame *sensors) {
+  if (!sensors || sensors->count < 2) return;
+  w.key("sensorTemps");
+  w.beginArray();
+  for (uint8_t i = 0; i < sensors->count; i++) {
+    if (sensors->hold[i]) w.fixed(sensors->temperature[i], 1);
+    else w.null();
+  }
+  w.endArray();
+  w.key("sensorHums");
+  w.beginArray();
+  for (uint8_t i = 0; i < sensors->count; i++) {
+    if (sensors->hold[i]) w.integer(int(sensors->humidity[i]));
+    else w.null();
+  }
+  w.endArray();
+}
+
+/**
+ * Session analytics as "session": {"active", "meanTemp", "tempSd",
+ * "above60", "above80" (minutes), "humidityMin" (%·min), "heatDose"
+ * (°C·min), "throws"}, null before the first session. Only written
+ * when the caller has the analytics.
+ */
+inline void writeSessionSummary(JsonWriter &w, const SessionSummary *session) {
+  if (!session) return;
+  w.key("session");
+  if (!session->valid) {
+    w.null();
+    return;
+  }
+  w.beginObject();
+  w.key("active");
+  w.boolean(session->active);
+  w.key("meanTemp");
+  w.fixed(session->meanTemp, 1);
+  w.key("tempSd");
+  w.fixed(session->tempStdDev, 1);
+  w.key("above60");
+  w.uinteger(session->above60S / 60);
+  w.key("above80");
+  w.uinteger(session->above80S / 60);
+  w.key("humidityMin");
+  w.uinteger((uint32_t)lroundf(session->humidityMinutes));
+  w.key("heatDose");
+  w.uinteger((uint32_t)lroundf(session->heatDose));
+  w.key("throws");
+  w.uinteger(session->throws);
+  w.endObject();
+}
+
+/**
+ * Write the /data JSON body: current readings (the aggregate, and each
+ * sensor if there are several), session minutes, the heat-up /
+ * cool-down prediction, the session analytics and the given history
+ * points (oldest first). Returns the body length (truncated if buf is
+ * too small).
+ */
+inline size_t serializeData(char *buf, size_t len, float temperature, float humidity,
+                            uint32_t sessionMinutes, const EtaPrediction &eta,
+                            const HistoryPoint *points, size_t count, uint32_t now,
+                            const SensorFrame *sensors = nullptr,
+                            const SessionSummary *session = nullptr) {
+  JsonWriter w(buf, len);
+  w.beginObject();
+
+  w.key("temperature");
+  w.fixed(temperature, 1);          // Force 1 decimal place
+  w.key("humidity");
+  w.integer(int(humidity));         // Humidity as integer
+  w.key("sessionTime");
+  w.uinteger(sessionMinutes);
+  w.key("readyIn");
+  writeEtaMinutes(w, eta.readyMinutes);
+  w.key("coolIn");
+  writeEtaMinutes(w, eta.coolMinutes);
+  w.key("etaConfidence");
+  w.uinteger(eta.confidence);
+  writeSensorArrays(w, sensors);
+  writeSessionSummary(w, session);
+
+  w.key("labels");
+  w.beginArray();
+  for (size_t i = 0; i < count; i++) {
+    char label[16];
+    formatHistoryLabel(label, sizeof(label), points[i].time, now);
+    w.string(label);
+  }
+  w.endArray();
+
+  w.key("tempHistory");
+  w.beginArray();
+  for (size_t i = 0; i < count; i++) {
+    w.fixed(points[i].tempMean, 1);
+  }
+  w.endArray();
+
+  w.key("humHistory");
+  w.beginArray();
+  for (size_t i = 0; i < count; i++) {
+    w.integer(int(points[i].humMean));
+  }
+  w.endArray();
+
+  w.endObject();
+  return w.length();
+}
+
+/**
+ * Write one live-update delta: sequence number, label and readings
+ */
+inline size_t serializeSample(char *buf, size_t len, uint32_t seq, float temperature,
+                              float humidity, uint32_t sessionMinutes, uint32_t now,
+                              const SensorFrame *sensors = nullptr) {
+  char label[16];
+  formatHistoryLabel(label, sizeof(label), now, now);
+
+  JsonWriter w(buf, len);
+  w.beginObject();
+  w.key("seq");
+  w.uinteger(seq);
+  w.key("label");
+  w.string(label);
+  w.key("temperature");
+  w.fixed(temperature, 1);
+  w.key("humidity");
+  w.integer(int(humidity));
+  w.key("sessionTime");
+  w.uinteger(sessionMinutes);
+  writeSensorArrays(w, sensors);
+  w.endObject();
+  return w.length();
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef ETA_MODEL_H
+#define ETA_MODEL_H
+
+/*************************************************************
+  Heat-up / cool-down prediction
+
+  Newton's law of heating and cooling: the room approaches a
+  final temperature T∞ exponentially, dT/dt = k (T∞ - T). That is
+  linear in T, dT/dt = a + b T, so a and b are fitted online by
+  recursive least squares on the session detector's smoothed
+  level and slope (sauna_state.h). Each sample costs a 2x2 update
+  in single precision; nothing is stored per sample.
+
+  One fit is run per phase: heating from the start of a climb,
+  cooling once the session detector has seen a sustained fall.
+  From the fit:
+    ready in  ln((T∞ - T) / (T∞ - target)) / k    while heating
+    cool in   ln((T - T∞) / (cool - T∞)) / k      while cooling
+  The confidence (0..100) combines the fit's recent relative error
+  with the number of samples behind it.
+*************************************************************/
+#include <stdint.h>
+#include <math.h>
+
+#include "sauna_state.h"
+
+#ifndef ETA_READY_TEMP
+#define ETA_READY_TEMP        70.0f     // °C counted as ready
+#endif
+#ifndef ETA_COOL_TEMP
+#define ETA_COOL_TEMP         30.0f     // °C counted as cooled down
+#endif
+#define ETA_FORGET            0.998f    // RLS forgetting factor per sample
+#define ETA_ERROR_ALPHA       0.05f     // Smoothing of the error statistics
+#define ETA_MIN_SAMPLES       30        // Samples before full confidence
+#define ETA_COOL_HOLD_MS      120000UL  // Fall needed before switching to the cooling fit
+#define ETA_MAX_MINUTES       600       // Longer predictions are reported as unknown
+
+enum EtaPhase : uint8_t {
+  ETA_PHASE_IDLE,
+  ETA_PHASE_HEATING,
+  ETA_PHASE_COOLING
+};
+
+// Published prediction; minutes are -1 when unknown or not applicable
+struct EtaPrediction {
+  EtaPhase phase;
+  int16_t readyMinutes;    // Until ETA_READY_TEMP, 0 once reached
+  int16_t coolMinutes;     // Until ETA_COOL_TEMP
+  float finalTemp;         // Fitted T∞, °C
+  uint8_t confidence;      // 0..100
+};
+
+/**
+ * Two-parameter recursive least squares for dT/dt = a + b u, with the
+ * temperature scaled to u = (T - 50) / 25 to keep P well conditioned
+ */
+class NewtonRls {
+public:
+  void reset() {
+    a = b = 0;
+    p00 = p11 = 1000.0f;
+    p01 = 0;
+    errVar = 0;
+    sigVar = 0;
+    samples = 0;
+  }
+
+  void update(float temp, float slope) {
+    float u = (temp - 50.0f) / 25.0f;
+    float e = slope - (a + b * u);   // A priori error
+
+    float px0 = p00 + p01 * u;
+    float px1 = p01 + p11 * u;
+    float denom = ETA_FORGET + px0 + u * px1;
+    float k0 = px0 / denom, k1 = px1 / denom;
+    a += k0 * e;
+    b += k1 * e;
+    p00 = (p00 - k0 * px0) / ETA_FORGET;
+    p01 = (p01 - k0 * px1) / ETA_FORGET;
+    p11 = (p11 - k1 * px1) / ETA_FORGET;
+    // Without excitation (steady temperature) P grows; keep it bounded
+    if (p00 + p11 > 2000.0f) {
+      p00 *= 0.5f; p01 *= 0.5f; p11 *= 0.5f;
+    }
+
+    errVar += ETA_ERROR_ALPHA * (e * e - errVar);
+    sigVar += ETA_ERROR_ALPHA * (slope * slope - sigVar);
+    if (samples < 0xFFFF) samples++;
+  }
+
+  // Rate constant k in 1/min; <= 0 when the fit is not physical
+  float rate() const { return -b / 25.0f; }
+  float finalTemp() const { return b != 0 ? 50.0f - 25.0f * a / b : 0; }
+
+  uint8_t confidence() const {
+    if (samples < 2 || sigVar <= 0 || rate() <= 0) return 0;
+    float fit = 1.0f - sqrtf(errVar / sigVar);
+    if (fit < 0) fit = 0;
+    float weight = samples >= ETA_MIN_SAMPLES ? 1.0f : (float)samples / ETA_MIN_SAMPLES;
+    return (uint8_t)(fit * weight * 100.0f + 0.5f);
+  }
+
+private:
+  float a = 0, b = 0;
+  float p00 = 1000.0f, p01 = 0, p11 = 1000.0f;
+  float errVar = 0, sigVar = 0;
+  uint16_t samples = 0;
+};
+
+// Minutes for an exponential approach from `from` towards final to pass target
+inline int16_t etaMinutes(float from, float target, float final, float rate) {
+  if (rate <= 0) return -1;
+  float ratio = (final - from) / (final - target);
+  if (ratio <= 1.0f) return 0;
+  float minutes = logf(ratio) / rate;
+  if (!(minutes < ETA_MAX_MINUTES)) return -1;
+  return (int16_t)(minutes + 0.999f);   // Round up
+}
+
+class EtaModel {
+public:
+  /**
+   * Feed the session detector state after each valid sample
+   */
+  void update(const SaunaState &sauna, uint64_t nowMs) {
+    float temp = saunaLevelC(sauna);
+    float slope = saunaSlopeCPerMin(sauna);
+
+    // Phase follows the detector, switching to cooling only after a sustained fall
+    EtaPhase next = phase;
+    bool heating = sauna.rising || (sauna.active && !sauna.cooling);
+    bool falling = sauna.active && sauna.cooling && nowMs - sauna.coolSince >= ETA_COOL_HOLD_MS;
+    if (sauna.rising && phase != ETA_PHASE_HEATING) next = ETA_PHASE_HEATING;
+    else if (falling || (phase == ETA_PHASE_HEATING && !heating && !sauna.active)) next = ETA_PHASE_COOLING;
+    else if (phase == ETA_PHASE_COOLING && temp <= ETA_COOL_TEMP) next = ETA_PHASE_IDLE;
+    if (next != phase) {
+      phase = next;
+      fit.reset();
+    }
+    if (phase != ETA_PHASE_IDLE) fit.update(temp, slope);
+
+    EtaPrediction p;
+    p.phase = phase;
+    p.readyMinutes = -1;
+    p.coolMinutes = -1;
+    p.finalTemp = fit.finalTemp();
+    p.confidence = phase == ETA_PHASE_IDLE ? 0 : fit.confidence();
+    if (phase == ETA_PHASE_HEATING) {
+      p.readyMinutes = temp >= ETA_READY_TEMP ? 0
+          : p.finalTemp > ETA_READY_TEMP ? etaMinutes(temp, ETA_READY_TEMP, p.finalTemp, fit.rate())
+          : -1;
+    } else if (phase == ETA_PHASE_COOLING && p.finalTemp < ETA_COOL_TEMP) {
+      p.coolMinutes = etaMinutes(temp, ETA_COOL_TEMP, p.finalTemp, fit.rate());
+    }
+    if (p.confidence == 0) p.readyMinutes = p.coolMinutes = -1;
+    current = p;
+  }
+
+  const EtaPrediction &prediction() const { return current; }
+
+private:
+  EtaPhase phase = ETA_PHASE_IDLE;
+  NewtonRls fit;
+  EtaPrediction current = { ETA_PHASE_IDLE, -1, -1, 0, 0 };
+};
+
+#endif
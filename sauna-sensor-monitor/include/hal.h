@@ -0,0 +1,373 @@
+#ifndef HAL_H
+#define HAL_H
+
+/*************************************************************
+  Hardware abstraction layer
+
+  The firmware logic talks to the hardware only through these
+  interfaces. ESP32 implementations are in hal_esp32.h, host
+  mocks for the native build and simulator in hal_mock.h.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+
+#include "oled_diff.h"
+#include "snapshot.h"
+#include "wifi_manager.h"
+#include "power_mode.h"
+
+#ifndef ACQUIRE_DEADLINE_MARGIN_MS
+#define ACQUIRE_DEADLINE_MARGIN_MS 20   // Past a conversion's worst case before the sensor counts as failed
+#endif
+
+class ClockHal {
+public:
+  virtual ~ClockHal() {}
+  virtual uint32_t millis() = 0;      // Monotonic, wraps after ~49.7 days
+  virtual uint64_t millis64() = 0;    // Monotonic, never wraps
+  virtual uint32_t micros() = 0;
+  virtual uint32_t epoch() = 0;       // Seconds; epoch once NTP synced, uptime before
+};
+
+enum SensorChannel : uint8_t {
+  SENSOR_TEMPERATURE,
+  SENSOR_HUMIDITY
+};
+
+// Conversion resolution: HIGH = 14-bit T / 12-bit RH, FAST = 11-bit T / 11-bit RH
+enum SensorResolution : uint8_t {
+  SENSOR_RES_HIGH,
+  SENSOR_RES_FAST
+};
+
+class SensorHal {
+public:
+  virtual ~SensorHal() {}
+  // One fused temperature + humidity conversion. False on bus/sensor error.
+  virtual bool read(float &temperature, float &humidity) = 0;
+
+  // Split conversion: start a channel, check it, then fetch the result
+  virtual bool request(SensorChannel channel) = 0;
+  virtual bool ready(SensorChannel channel) = 0;
+  virtual bool collect(SensorChannel channel, float &value) = 0;
+
+  virtual bool setResolution(SensorResolution resolution) = 0;
+  // Worst-case conversion time of a channel at the current resolution
+  virtual uint32_t conversionMs(SensorChannel channel) = 0;
+};
+
+class DisplayHal {
+public:
+  virtual ~DisplayHal() {}
+  virtual uint8_t *framebuffer() = 0;  // SSD1306 page layout, width * pages bytes
+  virtual void beginFlush() {}
+  // Send one page window; returns the bytes put on the bus
+  virtual size_t writeWindow(const OledWindow &window, const uint8_t *data) = 0;
+  virtual void endFlush() {}
+  virtual void setDimmed(bool) {}  // Lower contrast in idle mode
+};
+
+class NetworkHal {
+public:
+  virtual ~NetworkHal() {}
+  virtual void connect() = 0;
+  virtual void disconnect() = 0;
+  // Next pending driver event, if any
+  virtual bool pollEvent(WifiEvent &event) = 0;
+};
+
+// MQTT 3.1.1 client, QoS 0
+class MqttHal {
+public:
+  virtual ~MqttHal() {}
+  // Blocks for at most the transport's connect timeout; user may be null
+  virtual bool connect(const char *clientId, const char *user, const char *pass,
+                       const char *willTopic, const char *willPayload) = 0;
+  virtual bool connected() = 0;
+  virtual bool publish(const char *topic, const uint8_t *payload, size_t len, bool retain) = 0;
+  virtual void loop() = 0;   // Keepalive and socket housekeeping
+};
+
+class PowerHal {
+public:
+  virtual ~PowerHal() {}
+  // Radio and CPU power settings for a mode
+  virtual void apply(PowerMode mode) = 0;
+  // True if the CPU light-sleeps between samples in the current mode
+  virtual bool lightSleep() = 0;
+};
+
+/**
+ * The inactive app partition that an update is written to
+ */
+class FirmwareHal {
+public:
+  virtual ~FirmwareHal() {}
+  // Start an image of unknown size; false if the partition is busy
+  virtual bool begin() = 0;
+  virtual bool write(const uint8_t *data, size_t len) = 0;
+  // Validate the image and boot from it next time
+  virtual bool end() = 0;
+  virtual void abort() = 0;
+};
+
+/**
+ * Send the changed windows of the display's framebuffer.
+ * Returns the bytes put on the bus (0 when nothing changed).
+ */
+template <uint8_t WIDTH, uint8_t PAGES>
+size_t flushFrame(OledDiff<WIDTH, PAGES> &diff, DisplayHal &display) {
+  OledWindow windows[OledDiff<WIDTH, PAGES>::MAX_WINDOWS];
+  const uint8_t *frame = display.framebuffer();
+  size_t count = diff.update(frame, windows);
+  if (count == 0) return 0;
+
+  size_t bytes = 0;
+  display.beginFlush();
+  for (size_t i = 0; i < count; i++) {
+    const OledWindow &w = windows[i];
+    bytes += display.writeWindow(w, frame + (size_t)w.page * WIDTH + w.colStart);
+  }
+  display.endFlush();
+  return bytes;
+}
+
+/**
+ * Build the next snapshot from the previous one and the raw readings
+ * of every sensor (tempRead / humRead: bit i set if sensor i returned
+ * that channel). A sensor with a bad reading keeps its last good
+ * values, which count in the aggregate for SENSOR_HOLD_SAMPLES more
+ * samples. The aggregate is the mean of the counted sensors; `valid`
+ * is set if at least one sensor was read.
+ */
+inline SensorSnapshot makeSample(ClockHal &clock, const SensorSnapshot &last, const SensorFrame &raw,
+                                 uint32_t tempRead, uint32_t humRead) {
+  SensorSnapshot sample = last;
+  SensorFrame &frame = sample.sensors;
+  frame.count = raw.count;
+  frame.validMask = 0;
+  float tempSum = 0, humSum = 0;
+  uint8_t counted = 0;
+  for (uint8_t i = 0; i < raw.count; i++) {
+    // Check if reading is valid (finite and within the sensor range)
+    float t = raw.temperature[i], h = raw.humidity[i];
+    bool tempOk = (tempRead >> i & 1) && t == t && t > -100.0f && t < 200.0f;
+    bool humOk = (humRead >> i & 1) && h == h && h >= 0.0f && h <= 100.0f;
+    if (tempOk && humOk) {
+      frame.temperature[i] = t;
+      frame.humidity[i] = h;
+      frame.hold[i] = SENSOR_HOLD_SAMPLES + 1;
+      frame.validMask |= 1UL << i;
+    } else if (frame.hold[i] > 0) {
+      frame.hold[i]--;
+    }
+    if (frame.hold[i] > 0) {
+      tempSum += frame.temperature[i];
+      humSum += frame.humidity[i];
+      counted++;
+    }
+  }
+  if (counted > 0) {
+    sample.temperature = tempSum / counted;
+    sample.humidity = humSum / counted;
+  }
+  sample.valid = frame.validMask != 0;
+  sample.timestamp = clock.epoch();
+  sample.millis = clock.millis();
+  sample.seq = last.seq + 1;
+  return sample;
+}
+
+/**
+ * I2C multiplexer (TCA9548A style) in front of sensors that share an
+ * address
+ */
+class SensorMuxHal {
+public:
+  virtual ~SensorMuxHal() {}
+  // Connect downstream port `port` to the bus. False on bus error.
+  virtual bool select(uint8_t port) = 0;
+};
+
+// Where a sensor sits: its driver and, behind a mux, the port to open first
+struct SensorPort {
+  SensorHal *sensor;
+  SensorMuxHal *mux;      // nullptr when the sensor is directly on its bus
+  uint8_t muxPort;
+};
+
+inline bool selectSensor(const SensorPort &port) {
+  return !port.mux || port.mux->select(port.muxPort);
+}
+
+/**
+ * Take one sample with a blocking read of each sensor in turn and build
+ * the next snapshot. busMicros (optional) receives the time spent in
+ * the sensor reads.
+ */
+inline SensorSnapshot acquireSample(const SensorPort *ports, uint8_t count, ClockHal &clock,
+                                    const SensorSnapshot &last, uint32_t *busMicros) {
+  SensorFrame raw = SensorFrame();
+  raw.count = count;
+  uint32_t ok = 0;
+  uint32_t start = clock.micros();
+  for (uint8_t i = 0; i < count; i++) {
+    if (selectSensor(ports[i]) && ports[i].sensor->read(raw.temperature[i], raw.humidity[i])) {
+      ok |= 1UL << i;
+    }
+  }
+  if (busMicros) *busMicros = clock.micros() - start;
+  return makeSample(clock, last, raw, ok, ok);
+}
+
+// Timing of one split acquisition
+struct AcquireTiming {
+  uint32_t latencyUs;   // First request to last result
+  uint32_t busUs;       // Time spent inside sensor and mux calls
+  uint32_t freedUs;     // Latency the caller could spend on other work
+};
+
+/**
+ * Non-blocking, batched acquisition of every sensor: temperature
+ * conversions are started on all sensors back to back, collected once
+ * the slowest has had its conversion time, then the same for humidity.
+ * The sensors convert in parallel, so a sample takes about one
+ * sensor's conversion time plus a few bus transactions per sensor
+ * instead of N conversion times. The caller runs step() whenever
+ * waitMs() has passed and does other work (or sleeps) in between.
+ * A sensor that is still not ready ACQUIRE_DEADLINE_MARGIN_MS after
+ * its conversion time fails for this sample, so the hold in
+ * makeSample() covers it and the batch moves on without it.
+ */
+class AsyncAcquisition {
+public:
+  enum Step : uint8_t { BUSY, DONE };
+
+  // The ports must outlive the acquisition; at most SENSOR_MAX_CHANNELS
+  void attach(const SensorPort *sensorPorts, uint8_t count) {
+    ports = sensorPorts;
+    portCount = count < SENSOR_MAX_CHANNELS ? count : SENSOR_MAX_CHANNELS;
+    resolutionSet = false;
+  }
+
+  uint8_t sensors() const { return portCount; }
+
+  // Applied to every sensor, only when it changes
+  bool setResolution(SensorResolution res) {
+    if (resolutionSet && res == resolution) return true;
+    bool ok = true;
+    for (uint8_t i = 0; i < portCount; i++) {
+      ok = selectSensor(ports[i]) && ports[i].sensor->setResolution(res) && ok;
+    }
+    resolution = res;
+    resolutionSet = ok;
+    return ok;
+  }
+
+  void start(ClockHal &clock) {
+    startUs = clock.micros();
+    timing.busUs = 0;
+    raw.count = portCount;
+    tempOk = humOk = 0;
+    channel = SENSOR_TEMPERATURE;
+    state = CONVERTING;
+    requestAll(clock);
+  }
+
+  Step step(ClockHal &clock) {
+    if (state == IDLE) return DONE;
+    uint32_t t0 = clock.micros();
+    for (uint8_t i = 0; i < portCount; i++) {
+      uint32_t bit = 1UL << i;
+      if (!(pending & bit)) continue;
+      const SensorPort &port = ports[i];
+      if (!selectSensor(port)) {
+        pending &= ~bit;            // Failed for this sample
+        continue;
+      }
+      if (!port.sensor->ready(channel)) {
+        if ((int32_t)(t0 - deadlineUs[i]) >= 0) {
+          pending &= ~bit;          // Stuck converting: failed for this sample
+          timeouts++;
+        }
+        continue;
+      }
+      float *out = channel == SENSOR_TEMPERATURE ? raw.temperature : raw.humidity;
+      if (port.sensor->collect(channel, out[i])) collected |= bit;
+      pending &= ~bit;
+    }
+    timing.busUs += clock.micros() - t0;
+    if (pending) {
+      waitFor = 1;   // Not quite done yet (clock granularity), check again shortly
+      return BUSY;
+    }
+    if (channel == SENSOR_TEMPERATURE) {
+      tempOk = collected;
+      channel = SENSOR_HUMIDITY;
+      requestAll(clock);
+      return BUSY;
+    }
+    humOk = collected;
+    state = IDLE;
+    timing.latencyUs = clock.micros() - startUs;
+    timing.freedUs = timing.latencyUs > timing.busUs ? timing.latencyUs - timing.busUs : 0;
+    return DONE;
+  }
+
+  // How long to wait before the next step()
+  uint32_t waitMs() const { return waitFor; }
+
+  SensorSnapshot result(ClockHal &clock, const SensorSnapshot &last) const {
+    return makeSample(clock, last, raw, tempOk, humOk);
+  }
+
+  const AcquireTiming &lastTiming() const { return timing; }
+
+  // Conversions given up on since boot
+  uint32_t timedOut() const { return timeouts; }
+
+private:
+  enum State : uint8_t { IDLE, CONVERTING };
+
+  // Start the current channel on every sensor; wait for the slowest
+  void requestAll(ClockHal &clock) {
+    uint32_t t0 = clock.micros();
+    pending = collected = 0;
+    waitFor = 0;
+    for (uint8_t i = 0; i < portCount; i++) {
+      const SensorPort &port = ports[i];
+      if (!selectSensor(port) || !port.sensor->request(channel)) continue;
+      pending |= 1UL << i;
+      uint32_t ms = port.sensor->conversionMs(channel);
+      deadlineUs[i] = clock.micros() + (ms + ACQUIRE_DEADLINE_MARGIN_MS) * 1000;
+      if (ms > waitFor) waitFor = ms;
+    }
+    timing.busUs += clock.micros() - t0;
+  }
+
+  const SensorPort *ports = nullptr;
+  uint8_t portCount = 0;
+  SensorResolution resolution = SENSOR_RES_HIGH;
+  bool resolutionSet = false;
+  State state = IDLE;
+  SensorChannel channel = SENSOR_TEMPERATURE;
+  uint32_t startUs = 0;
+  uint32_t waitFor = 0;
+  uint32_t pending = 0, collected = 0;   // Sensors converting / read in this phase
+  uint32_t deadlineUs[SENSOR_MAX_CHANNELS] = {};   // micros() a pending sensor fails at
+  uint32_t timeouts = 0;
+  uint32_t tempOk = 0, humOk = 0;
+  SensorFrame raw = SensorFrame();
+  AcquireTiming timing = { 0, 0, 0 };
+};
+
+/**
+ * Fast conversions while tracking a heat-up, where the trend matters
+ * more than the last 0.01°C; full resolution the rest of the time
+ */
+inline SensorResolution resolutionFor(const PowerStatus &power) {
+  bool heating = power.mode == POWER_MODE_ACTIVE && power.slope >= POWER_HEATUP_SLOPE;
+  return heating ? SENSOR_RES_FAST : SENSOR_RES_HIGH;
+}
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef HAL_ESP32_H
+#define HAL_ESP32_H
+
+/*************************************************************
+  ESP32 implementations of the HAL interfaces
+*************************************************************/
+#include <Arduino.h>
+#include <Wire.h>
+#include <WiFi.h>
+#include <Adafruit_SSD1306.h>
+#include <time.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <esp_idf_version.h>
+
+#include <PubSubClient.h>
+#include <Update.h>
+#include "SHT2x.h"
+#include "hal.h"
+#include "rtos_port.h"
+
+class Esp32Clock : public ClockHal {
+public:
+  uint32_t millis() override { return ::millis(); }
+  uint64_t millis64() override { return (uint64_t)esp_timer_get_time() / 1000; }
+  uint32_t micros() override { return ::micros(); }
+  uint32_t epoch() override { return (uint32_t)time(nullptr); }
+};
+
+/**
+ * SHT2x on an I2C bus. Behind a multiplexer every sensor has the same
+ * address, so each one gets its own driver object (the library keeps
+ * the pending request in it); select the mux port before begin().
+ */
+class Esp32Sensor : public SensorHal {
+public:
+  explicit Esp32Sensor(TwoWire &bus = Wire) : sht(&bus) {}
+
+  bool begin() { return sht.begin(); }
+  uint8_t status() { return sht.getStatus(); }
+
+  bool read(float &temperature, float &humidity) override {
+    bool ok = sht.read();   // Converts both channels
+    temperature = sht.getTemperature();
+    humidity = sht.getHumidity();
+    return ok;
+  }
+
+  bool request(SensorChannel channel) override {
+    return channel == SENSOR_TEMPERATURE ? sht.requestTemperature() : sht.requestHumidity();
+  }
+
+  bool ready(SensorChannel channel) override {
+    return channel == SENSOR_TEMPERATURE ? sht.reqTempReady() : sht.reqHumReady();
+  }
+
+  bool collect(SensorChannel channel, float &value) override {
+    if (channel == SENSOR_TEMPERATURE) {
+      if (!sht.readTemperature()) return false;
+      value = sht.getTemperature();
+    } else {
+      if (!sht.readHumidity()) return false;
+      value = sht.getHumidity();
+    }
+    return true;
+  }
+
+  // SHT2x user register: 0 = RH12/T14, 3 = RH11/T11
+  bool setResolution(SensorResolution res) override {
+    if (res == current) return true;
+    if (!sht.setResolution(res == SENSOR_RES_FAST ? 3 : 0)) return false;
+    current = res;
+    return true;
+  }
+
+  // Datasheet maximum conversion times
+  uint32_t conversionMs(SensorChannel channel) override {
+    if (current == SENSOR_RES_FAST) return channel == SENSOR_TEMPERATURE ? 11 : 15;
+    return channel == SENSOR_TEMPERATURE ? 85 : 29;
+  }
+
+private:
+  SHT2x sht;
+  SensorResolution current = SENSOR_RES_HIGH;   // Power-on default
+};
+
+/**
+ * TCA9548A 8-port I2C multiplexer. The open port is remembered, so
+ * staying on the same sensor costs no bus traffic.
+ */
+class Esp32Tca9548a : public SensorMuxHal {
+public:
+  static const uint8_t PORTS = 8;
+
+  Esp32Tca9548a(TwoWire &bus, uint8_t address) : wire(bus), addr(address) {}
+
+  bool select(uint8_t port) override {
+    if (port == current) return true;
+    if (port >= PORTS) return false;
+    wire.beginTransmission(addr);
+    wire.write((uint8_t)(1 << port));       // One bit per downstream port
+    bool ok = wire.endTransmission() == 0;
+    current = ok ? port : (uint8_t)NONE;    // Unknown after an error, rewrite next time
+    return ok;
+  }
+
+private:
+  static const uint8_t NONE = 0xFF;
+  TwoWire &wire;
+  uint8_t addr;
+  uint8_t current = NONE;
+};
+
+/**
+ * SSD1306 on I2C: renders with Adafruit GFX, flushes windows directly
+ */
+class Esp32Display : public DisplayHal {
+public:
+  static const size_t I2C_CHUNK = 64;   // Framebuffer bytes per I2C transaction
+
+  Esp32Display(Adafruit_SSD1306 &oled, TwoWire &bus, uint8_t address)
+    : display(oled), wire(bus), addr(address) {}
+
+  uint8_t *framebuffer() override { return display.getBuffer(); }
+
+  void beginFlush() override { wire.setClock(400000); }  // Same fast clock Adafruit uses
+  void endFlush() override { wire.setClock(100000); }
+  void setDimmed(bool dimmed) override { display.dim(dimmed); }
+
+  size_t writeWindow(const OledWindow &w, const uint8_t *data) override {
+    // Address window: columns colStart..colEnd of a single page
+    wire.beginTransmission(addr);
+    wire.write((uint8_t)0x00);  // Co = 0, D/C = 0: command stream
+    wire.write((uint8_t)SSD1306_COLUMNADDR);
+    wire.write(w.colStart);
+    wire.write(w.colEnd);
+    wire.write((uint8_t)SSD1306_PAGEADDR);
+    wire.write(w.page);
+    wire.write(w.page);
+    wire.endTransmission();
+    size_t bytes = 8;
+
+    // Window contents
+    size_t remaining = w.colEnd - w.colStart + 1;
+    while (remaining > 0) {
+      size_t chunk = remaining < I2C_CHUNK ? remaining : I2C_CHUNK;
+      wire.beginTransmission(addr);
+      wire.write((uint8_t)0x40);  // Co = 0, D/C = 1: data stream
+      wire.write(data, chunk);
+      wire.endTransmission();
+      bytes += chunk + 2;
+      data += chunk;
+      remaining -= chunk;
+    }
+    return bytes;
+  }
+
+private:
+  Adafruit_SSD1306 &display;
+  TwoWire &wire;
+  uint8_t addr;
+};
+
+/**
+ * WiFi station. Driver events arrive in the WiFi event task and are
+ * queued until the network task polls them.
+ */
+class Esp32Network : public NetworkHal {
+public:
+  Esp32Network(const char *ssid, const char *pass) : ssid(ssid), pass(pass) {}
+
+  void begin(const char *hostname) {
+    instance = this;
+    WiFi.setHostname(hostname);  // Must be set before the station starts
+    WiFi.onEvent(onEvent);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);  // Reconnects are paced by WifiManager
+  }
+
+  void connect() override { WiFi.begin(ssid, pass); }
+  void disconnect() override { WiFi.disconnect(); }
+  bool pollEvent(WifiEvent &event) override { return events.receive(event, 0); }
+
+private:
+  static void onEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+    if (!instance) return;
+    switch (event) {
+      case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        instance->events.send(WIFI_EVENT_GOT_IP, 0);
+        break;
+      case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        instance->events.send(WIFI_EVENT_DISCONNECTED, 0);
+        break;
+      case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        instance->events.send(WIFI_EVENT_LOST_IP, 0);
+        break;
+      default:
+        break;
+    }
+  }
+
+  static Esp32Network *instance;
+  const char *ssid;
+  const char *pass;
+  RtosQueue<WifiEvent, 8> events;
+};
+
+/**
+ * PubSubClient over a plain WiFiClient. The socket timeout bounds how
+ * long a connect to an unreachable broker can block the caller.
+ */
+class Esp32Mqtt : public MqttHal {
+public:
+  Esp32Mqtt(const char *host, uint16_t port) : client(wifiClient) {
+    client.setServer(host, port);
+    client.setBufferSize(768);     // Home Assistant discovery payloads
+    client.setSocketTimeout(2);
+    client.setKeepAlive(30);
+  }
+
+  bool connect(const char *clientId, const char *user, const char *pass,
+               const char *willTopic, const char *willPayload) override {
+    return client.connect(clientId, user, pass, willTopic, 0, true, willPayload);
+  }
+  bool connected() override { return client.connected(); }
+  bool publish(const char *topic, const uint8_t *payload, size_t len, bool retain) override {
+    return client.publish(topic, payload, len, retain);
+  }
+  void loop() override { client.loop(); }
+
+private:
+  WiFiClient wifiClient;
+  PubSubClient client;
+};
+
+/**
+ * Idle: WiFi in maximum modem sleep, CPU scaled down and allowed to
+ * light-sleep whenever all tasks are blocked. Active: the defaults.
+ * Automatic light sleep needs CONFIG_PM_ENABLE in the SDK build; if
+ * it is missing esp_pm_configure() fails and only modem sleep applies.
+ */
+class Esp32Power : public PowerHal {
+public:
+  void apply(PowerMode mode) override {
+    bool idle = mode == POWER_MODE_IDLE;
+    WiFi.setSleep(idle ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+
+#if CONFIG_IDF_TARGET_ESP32C3
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_pm_config_t config;
+#else
+    esp_pm_config_esp32c3_t config;
+#endif
+    config.max_freq_mhz = 160;
+    config.min_freq_mhz = idle ? 40 : 160;
+    config.light_sleep_enable = idle;
+    sleeping = esp_pm_configure(&config) == ESP_OK && idle;
+#else
+    sleeping = false;
+#endif
+  }
+
+  bool lightSleep() override { return sleeping; }
+
+private:
+  bool sleeping = false;
+};
+
+/**
+ * Arduino Updater on the next OTA partition. Sectors are erased as
+ * the write position reaches them, so each call blocks only briefly.
+ */
+class Esp32Firmware : public FirmwareHal {
+public:
+  bool begin() override { return !Update.isRunning() && Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH); }
+  bool write(const uint8_t *data, size_t len) override {
+    return Update.write(const_cast<uint8_t *>(data), len) == len;
+  }
+  bool end() override { return Update.end(true); }
+  void abort() override { Update.abort(); }
+};
+
+// Defined once here; this header is only included by main.cpp
+Esp32Network *Esp32Network::instance = nullptr;
+
+#endif
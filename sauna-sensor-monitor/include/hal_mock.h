@@ -0,0 +1,284 @@
+#ifndef HAL_MOCK_H
+#define HAL_MOCK_H
+
+/*************************************************************
+  Mock HAL implementations for the native build and simulator
+
+  Everything is driven explicitly by the caller: the clock only
+  moves when told to, the sensor returns whatever was queued,
+  the display counts what would have gone over I2C.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "hal.h"
+
+class MockClock : public ClockHal {
+public:
+  // startMillis lets a run begin just before the 32-bit millis() wrap
+  explicit MockClock(uint32_t startMillis = 0, uint32_t startEpoch = 0)
+    : nowMicros((uint64_t)startMillis * 1000), epochBase(startEpoch) {}
+
+  uint32_t millis() override { return (uint32_t)(nowMicros / 1000); }
+  uint64_t millis64() override { return nowMicros / 1000; }
+  uint32_t micros() override { return (uint32_t)nowMicros; }
+  uint32_t epoch() override { return epochBase + (uint32_t)(elapsedMicros / 1000000); }
+
+  void advanceMillis(uint32_t ms) { advanceMicros((uint64_t)ms * 1000); }
+  void advanceMicros(uint64_t us) {
+    nowMicros += us;
+    elapsedMicros += us;
+  }
+  void setEpoch(uint32_t epoch) {
+    epochBase = epoch;
+    elapsedMicros = 0;
+  }
+
+private:
+  uint64_t nowMicros;
+  uint64_t elapsedMicros = 0;
+  uint32_t epochBase;
+};
+
+/**
+ * Sensor that returns whatever was queued. Without a clock conversions
+ * complete instantly. With one (see timed()) it behaves like an SHT2x
+ * on a 100 kHz bus: bus calls advance the clock, a fused read() blocks
+ * for both conversions, ready() only turns true once the conversion
+ * time has passed.
+ */
+class MockSensor : public SensorHal {
+public:
+  void set(float temperature, float humidity) {
+    nextTemp = temperature;
+    nextHum = humidity;
+    failNext = false;
+  }
+  void fail() { failNext = true; }
+  // Conversions never finish (ready() stays false) until unstuck
+  void stick(bool stuck) { stuckNext = stuck; }
+
+  void timed(MockClock *c, uint32_t requestBusUs = 180, uint32_t collectBusUs = 360) {
+    clock = c;
+    requestUs = requestBusUs;
+    collectUs = collectBusUs;
+  }
+
+  bool read(float &temperature, float &humidity) override {
+    reads++;
+    if (clock) {
+      clock->advanceMicros(2 * (requestUs + collectUs) +
+                           (uint64_t)1000 * (conversionMs(SENSOR_TEMPERATURE) +
+                                             conversionMs(SENSOR_HUMIDITY)));
+    }
+    temperature = nextTemp;
+    humidity = nextHum;
+    return !failNext;
+  }
+
+  bool request(SensorChannel) override {
+    if (clock) {
+      clock->advanceMicros(requestUs);
+      requestedAt = clock->millis64();
+    }
+    return !failNext;
+  }
+  bool ready(SensorChannel channel) override {
+    if (stuckNext) return false;
+    return !clock || clock->millis64() - requestedAt >= conversionMs(channel);
+  }
+  bool collect(SensorChannel channel, float &value) override {
+    if (clock) clock->advanceMicros(collectUs);
+    if (channel == SENSOR_TEMPERATURE) reads++;
+    value = channel == SENSOR_TEMPERATURE ? nextTemp : nextHum;
+    return !failNext;
+  }
+
+  bool setResolution(SensorResolution res) override {
+    resolution = res;
+    return true;
+  }
+  // SHT2x datasheet maximums when timed
+  uint32_t conversionMs(SensorChannel channel) override {
+    if (!clock) return 0;
+    if (resolution == SENSOR_RES_FAST) return channel == SENSOR_TEMPERATURE ? 11 : 15;
+    return channel == SENSOR_TEMPERATURE ? 85 : 29;
+  }
+
+  uint32_t reads = 0;
+  SensorResolution resolution = SENSOR_RES_HIGH;
+
+private:
+  float nextTemp = 25.0f;
+  float nextHum = 50.0f;
+  bool failNext = false;
+  bool stuckNext = false;
+  MockClock *clock = nullptr;
+  uint32_t requestUs = 0, collectUs = 0;
+  uint64_t requestedAt = 0;
+};
+
+// Multiplexer that counts port switches (each one bus write when timed)
+class MockMux : public SensorMuxHal {
+public:
+  explicit MockMux(MockClock *c = nullptr, uint32_t selectBusUs = 180)
+    : clock(c), selectUs(selectBusUs) {}
+
+  bool select(uint8_t port) override {
+    if (port == current) return true;
+    if (clock) clock->advanceMicros(selectUs);
+    current = port;
+    switches++;
+    return true;
+  }
+
+  uint32_t switches = 0;
+
+private:
+  MockClock *clock;
+  uint32_t selectUs;
+  uint8_t current = 0xFF;
+};
+
+template <uint8_t WIDTH, uint8_t PAGES>
+class MockDisplay : public DisplayHal {
+public:
+  MockDisplay() { memset(frame, 0, sizeof(frame)); memset(panel, 0, sizeof(panel)); }
+
+  uint8_t *framebuffer() override { return frame; }
+
+  void beginFlush() override { flushes++; }
+
+  size_t writeWindow(const OledWindow &w, const uint8_t *data) override {
+    size_t len = w.colEnd - w.colStart + 1;
+    memcpy(panel + (size_t)w.page * WIDTH + w.colStart, data, len);
+    windows++;
+    pageWindows[w.page]++;
+    size_t bytes = 8 + len + 2 * ((len + 63) / 64);  // Same framing as Esp32Display
+    totalBytes += bytes;
+    return bytes;
+  }
+
+  // What the physical panel would show after the flushes so far
+  const uint8_t *panelContents() const { return panel; }
+  void setDimmed(bool d) override { dimmed = d; }
+  bool dimmed = false;
+
+  uint32_t flushes = 0;
+  uint32_t windows = 0;
+  uint32_t pageWindows[PAGES] = {};
+  uint64_t totalBytes = 0;
+
+private:
+  uint8_t frame[(size_t)WIDTH * PAGES];
+  uint8_t panel[(size_t)WIDTH * PAGES];
+};
+
+// Writes the image into a caller-owned buffer standing in for the partition
+class MockFirmware : public FirmwareHal {
+public:
+  MockFirmware(uint8_t *buffer, size_t capacity) : buffer(buffer), capacity(capacity) {}
+
+  bool begin() override {
+    if (running) return false;
+    running = true;
+    committed = false;
+    size = 0;
+    return true;
+  }
+  bool write(const uint8_t *data, size_t len) override {
+    if (!running || len > capacity - size) return false;
+    memcpy(buffer + size, data, len);
+    size += len;
+    writes++;
+    return true;
+  }
+  bool end() override {
+    committed = running && size > 0;
+    running = false;
+    return committed;
+  }
+  void abort() override { running = false; }
+
+  uint8_t *buffer;
+  size_t capacity;
+  size_t size = 0;
+  uint32_t writes = 0;
+  bool running = false;
+  bool committed = false;
+};
+
+class MockPower : public PowerHal {
+public:
+  void apply(PowerMode m) override {
+    mode = m;
+    changes++;
+  }
+  bool lightSleep() override { return mode == POWER_MODE_IDLE; }
+
+  PowerMode mode = POWER_MODE_ACTIVE;
+  uint32_t changes = 0;
+};
+
+class MockNetwork : public NetworkHal {
+public:
+  void connect() override { connects++; }
+  void disconnect() override { disconnects++; }
+
+  // Queue an event as if it came from the WiFi driver
+  bool inject(WifiEvent event) {
+    if (count == QUEUE_SIZE) return false;
+    queue[(head + count) % QUEUE_SIZE] = event;
+    count++;
+    return true;
+  }
+
+  bool pollEvent(WifiEvent &event) override {
+    if (count == 0) return false;
+    event = queue[head];
+    head = (head + 1) % QUEUE_SIZE;
+    count--;
+    return true;
+  }
+
+  uint32_t connects = 0;
+  uint32_t disconnects = 0;
+
+private:
+  static const size_t QUEUE_SIZE = 8;
+  WifiEvent queue[QUEUE_SIZE];
+  size_t head = 0, count = 0;
+};
+
+class MockMqtt : public MqttHal {
+public:
+  bool connect(const char *, const char *, const char *, const char *, const char *) override {
+    connects++;
+    isConnected = reachable;
+    return isConnected;
+  }
+  bool connected() override { return isConnected && reachable; }
+  bool publish(const char *topic, const uint8_t *payload, size_t len, bool retain) override {
+    if (!connected()) return false;
+    published++;
+    if (onPublish) onPublish(topic, payload, len, retain, context);
+    return true;
+  }
+  void loop() override {
+    if (!reachable) isConnected = false;
+  }
+
+  // Broker reachability; dropping it disconnects on the next loop()
+  bool reachable = true;
+  uint32_t connects = 0;
+  uint32_t published = 0;
+  void (*onPublish)(const char *topic, const uint8_t *payload, size_t len, bool retain,
+                    void *context) = nullptr;
+  void *context = nullptr;
+
+private:
+  bool isConnected = false;
+};
+
+#endif
@@ -0,0 +1,409 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/*************************************************************
+  Multi-resolution sensor history
+
+  Three tiers, filled from the sampling path:
+  - raw:  every sample (2 s cadence)        -> 22 h to 13 days (series_store.h)
+  - 1m:   min/mean/max per minute           -> last 24 hours
+  - 15m:  min/mean/max per 15 minutes       -> last 7 days
+
+  Each tier is rolled up incrementally from the one below, so
+  add() is O(1). Values are stored as centi-units in int16_t to
+  keep the rings inside HISTORY_RAM_BUDGET. The raw tier lives in
+  the compressed archive; the last few minutes of it are also kept
+  in a plain ring for tail(), which the live views call on every
+  sample. No heap.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+
+#include "series_store.h"
+
+#define HISTORY_RAW_SLOTS   150     // 150 x 2 s   = 5 min
+#define HISTORY_1M_SLOTS    1440    // 1440 x 1 min = 24 h
+#define HISTORY_15M_SLOTS   672     // 672 x 15 min = 7 days
+#define HISTORY_RAM_BUDGET  40960   // Hard upper bound in bytes, rings and buckets
+// With the raw archive: ~99 KB in all, the largest block of static RAM
+#define HISTORY_TOTAL_RAM_BUDGET (HISTORY_RAM_BUDGET + SERIES_RAM_BUDGET)
+
+enum HistoryTier : uint8_t {
+  HISTORY_RAW = 0,
+  HISTORY_1M  = 1,
+  HISTORY_15M = 2
+};
+
+// One point as returned to consumers (raw samples have min == mean == max)
+struct HistoryPoint {
+  uint32_t time;                  // Seconds (epoch once NTP synced, uptime before)
+  float tempMin, tempMean, tempMax;
+  float humMin, humMean, humMax;
+};
+
+/**
+ * Fixed-capacity ring buffer, overwrites the oldest entry when full
+ */
+template <typename T, size_t N>
+class HistoryRing {
+public:
+  void push(const T &item) {
+    items[head] = item;
+    head = (head + 1) % N;
+    if (count < N) count++;
+    pushed++;
+  }
+
+  size_t size() const { return count; }
+
+  // Sequence numbers: every push gets the next one, starting at 0
+  uint32_t firstSeq() const { return pushed - (uint32_t)count; }
+  uint32_t nextSeq() const { return pushed; }
+  static constexpr size_t capacity() { return N; }
+
+  // Logical index: 0 is the oldest stored entry
+  const T &at(size_t i) const {
+    return items[(head + N - count + i) % N];
+  }
+  T &at(size_t i) {
+    return items[(head + N - count + i) % N];
+  }
+
+  void clear(uint32_t firstSeq = 0) { head = 0; count = 0; pushed = firstSeq; }
+
+private:
+  T items[N];
+  size_t head = 0;
+  size_t count = 0;
+  uint32_t pushed = 0;
+};
+
+class History {
+public:
+  /**
+   * Record one sample. Called once per sampling period.
+   */
+  void add(uint32_t time, float temperature, float humidity) {
+    int16_t t = toCenti(temperature);
+    int16_t h = toCenti(humidity);
+
+    RawSample s = { time, t, h };
+    raw.push(s);
+    archive.append(time, t, h);
+
+    // Close the minute bucket when the sample falls into a new minute
+    uint32_t minute = time / 60;
+    if (minuteAcc.count > 0 && minute != minuteAcc.period) {
+      Rollup r = minuteAcc.finish(minuteAcc.period * 60);
+      oneMinute.push(r);
+      foldIntoQuarter(r);
+    }
+    if (minuteAcc.count == 0) {
+      minuteAcc.period = minute;
+    }
+    minuteAcc.add(t, t, t, h, h, h);
+    lastTime = time;
+  }
+
+  size_t size(HistoryTier tier) const {
+    switch (tier) {
+      case HISTORY_RAW: return archive.size();
+      case HISTORY_1M:  return oneMinute.size();
+      default:          return quarterHour.size();
+    }
+  }
+
+  /**
+   * Copy up to maxPoints points with time in [from, to] into out,
+   * oldest first. Start is found by binary search, so the cost is
+   * O(log n + k) (plus one archive block for the raw tier).
+   */
+  size_t query(HistoryTier tier, uint32_t from, uint32_t to,
+               HistoryPoint *out, size_t maxPoints) const {
+    if (tier == HISTORY_RAW) {
+      uint32_t first;
+      uint32_t seq = from == 0 ? archive.firstSeq() : archive.seqAfter(from - 1);
+      size_t n = readSeq(tier, seq, out, maxPoints, &first);
+      size_t written = 0;
+      while (written < n && out[written].time <= to) written++;
+      return written;
+    }
+    size_t n = size(tier);
+    size_t i = lowerBound(tier, from);
+    size_t written = 0;
+    while (i < n && written < maxPoints) {
+      HistoryPoint p = point(tier, i++);
+      if (p.time > to) break;
+      out[written++] = p;
+    }
+    return written;
+  }
+
+  /**
+   * Sequence number of the oldest stored point of a tier, and the one
+   * the next point will get. Sequence numbers never repeat, so they
+   * work as a resume cursor even when the wall clock jumps.
+   */
+  uint32_t firstSeq(HistoryTier tier) const {
+    switch (tier) {
+      case HISTORY_RAW: return archive.firstSeq();
+      case HISTORY_1M:  return oneMinute.firstSeq();
+      default:          return quarterHour.firstSeq();
+    }
+  }
+
+  uint32_t nextSeq(HistoryTier tier) const {
+    switch (tier) {
+      case HISTORY_RAW: return archive.nextSeq();
+      case HISTORY_1M:  return oneMinute.nextSeq();
+      default:          return quarterHour.nextSeq();
+    }
+  }
+
+  // Sequence number of the first point with time > after (nextSeq if none)
+  uint32_t seqAfter(HistoryTier tier, uint32_t after) const {
+    if (tier == HISTORY_RAW) return archive.seqAfter(after);
+    size_t i = after == UINT32_MAX ? size(tier) : lowerBound(tier, after + 1);
+    return firstSeq(tier) + (uint32_t)i;
+  }
+
+  /**
+   * Copy up to maxPoints points starting at sequence number seq into
+   * out, oldest first. Points that have already been overwritten are
+   * skipped; *first receives the sequence number of out[0].
+   */
+  size_t readSeq(HistoryTier tier, uint32_t seq, HistoryPoint *out, size_t maxPoints,
+                 uint32_t *first) const {
+    if (tier == HISTORY_RAW) return readArchive(seq, out, maxPoints, first);
+    uint32_t oldest = firstSeq(tier);
+    if ((int32_t)(seq - oldest) < 0) seq = oldest;
+    *first = seq;
+    size_t i = seq - oldest;
+    size_t n = size(tier);
+    size_t written = 0;
+    while (i < n && written < maxPoints) {
+      out[written++] = point(tier, i++);
+    }
+    return written;
+  }
+
+  /**
+   * Copy the newest `points` entries of a tier, taking every
+   * `stride`-th entry counting back from the latest. Oldest first.
+   * Raw points come from the recent ring, so at most
+   * HISTORY_RAW_SLOTS / stride of them.
+   */
+  size_t tail(HistoryTier tier, size_t points, size_t stride,
+              HistoryPoint *out) const {
+    bool recent = tier == HISTORY_RAW;
+    size_t n = recent ? raw.size() : size(tier);
+    if (stride == 0) stride = 1;
+    size_t available = n == 0 ? 0 : (n - 1) / stride + 1;
+    if (points > available) points = available;
+    for (size_t k = 0; k < points; k++) {
+      size_t i = n - 1 - (points - 1 - k) * stride;
+      out[k] = recent ? recentPoint(i) : point(tier, i);
+    }
+    return points;
+  }
+
+  uint32_t latestTime() const { return lastTime; }
+
+  // The raw tier in full, for its fill level
+  const SampleArchive &rawArchive() const { return archive; }
+
+  /**
+   * Add offset to every time before `before`: points stamped in
+   * seconds since boot, before the clock was set, become epoch
+   * seconds. They are the oldest ones, so the tiers stay sorted. The
+   * buckets still being filled move along. Returns the points changed.
+   */
+  size_t rebase(uint32_t before, uint32_t offset) {
+    rebaseRing(raw, before, offset);   // Its points are in the archive as well
+    size_t changed = archive.rebase(before, offset) + rebaseRing(oneMinute, before, offset) +
+                     rebaseRing(quarterHour, before, offset);
+    if (minuteAcc.count > 0 && minuteAcc.period * 60 < before) {
+      minuteAcc.period = (minuteAcc.period * 60 + offset) / 60;
+    }
+    if (quarterAcc.count > 0 && quarterAcc.period * 900 < before) {
+      quarterAcc.period = (quarterAcc.period * 900 + offset) / 900;
+    }
+    if (lastTime < before) lastTime += offset;
+    return changed;
+  }
+
+  /**
+   * Drop all points. Every tier numbers its points on from firstSeq;
+   * the simulator starts just below 2^32 to test the wrap.
+   */
+  void clear(uint32_t firstSeq = 0) {
+    raw.clear(firstSeq);
+    archive.clear(firstSeq);
+    oneMinute.clear(firstSeq);
+    quarterHour.clear(firstSeq);
+    minuteAcc = Accumulator();
+    quarterAcc = Accumulator();
+    lastTime = 0;
+  }
+
+  /**
+   * Point i of a tier, i < size(tier); 0 is the oldest stored entry.
+   * A raw point is decoded from the archive, which costs a seek: use
+   * readSeq() or tail() for runs of them.
+   */
+  HistoryPoint point(HistoryTier tier, size_t i) const {
+    HistoryPoint p;
+    if (tier == HISTORY_RAW) {
+      uint32_t first;
+      readArchive(archive.firstSeq() + (uint32_t)i, &p, 1, &first);
+      return p;
+    }
+    const Rollup &r = (tier == HISTORY_1M) ? oneMinute.at(i) : quarterHour.at(i);
+    p.time = r.time;
+    p.tempMin = fromCenti(r.tempMin);
+    p.tempMean = fromCenti(r.tempMean);
+    p.tempMax = fromCenti(r.tempMax);
+    p.humMin = fromCenti(r.humMin);
+    p.humMean = fromCenti(r.humMean);
+    p.humMax = fromCenti(r.humMax);
+    return p;
+  }
+
+private:
+  struct RawSample {
+    uint32_t time;
+    int16_t temp;
+    int16_t hum;
+  };
+
+  struct Rollup {
+    uint32_t time;                // Start of the bucket
+    int16_t tempMin, tempMean, tempMax;
+    int16_t humMin, humMean, humMax;
+  };
+
+  // Running min/max/sum for the bucket currently being filled
+  struct Accumulator {
+    uint32_t period = 0;
+    uint16_t count = 0;
+    int32_t tempSum = 0, humSum = 0;
+    int16_t tempMin = 0, tempMax = 0, humMin = 0, humMax = 0;
+
+    void add(int16_t tMin, int16_t tMean, int16_t tMax,
+             int16_t hMin, int16_t hMean, int16_t hMax) {
+      if (count == 0) {
+        tempMin = tMin; tempMax = tMax;
+        humMin = hMin; humMax = hMax;
+      } else {
+        if (tMin < tempMin) tempMin = tMin;
+        if (tMax > tempMax) tempMax = tMax;
+        if (hMin < humMin) humMin = hMin;
+        if (hMax > humMax) humMax = hMax;
+      }
+      tempSum += tMean;
+      humSum += hMean;
+      count++;
+    }
+
+    Rollup finish(uint32_t startTime) {
+      Rollup r;
+      r.time = startTime;
+      r.tempMin = tempMin;
+      r.tempMax = tempMax;
+      r.tempMean = (int16_t)(tempSum / count);
+      r.humMin = humMin;
+      r.humMax = humMax;
+      r.humMean = (int16_t)(humSum / count);
+      count = 0;
+      tempSum = humSum = 0;
+      return r;
+    }
+  };
+
+  void foldIntoQuarter(const Rollup &r) {
+    uint32_t quarter = r.time / 900;
+    if (quarterAcc.count > 0 && quarter != quarterAcc.period) {
+      quarterHour.push(quarterAcc.finish(quarterAcc.period * 900));
+    }
+    if (quarterAcc.count == 0) {
+      quarterAcc.period = quarter;
+    }
+    quarterAcc.add(r.tempMin, r.tempMean, r.tempMax, r.humMin, r.humMean, r.humMax);
+  }
+
+  size_t readArchive(uint32_t seq, HistoryPoint *out, size_t maxPoints, uint32_t *first) const {
+    SeriesSample chunk[16];
+    size_t written = 0;
+    while (written < maxPoints) {
+      size_t want = maxPoints - written < 16 ? maxPoints - written : 16;
+      uint32_t at;
+      size_t n = archive.read(seq, chunk, want, &at);
+      if (written == 0) *first = at;
+      for (size_t k = 0; k < n; k++) out[written++] = rawPoint(chunk[k].time, chunk[k].temp, chunk[k].hum);
+      if (n < want) break;
+      seq = at + n;
+    }
+    return written;
+  }
+
+  // Point i of the recent ring, the newest HISTORY_RAW_SLOTS raw samples
+  HistoryPoint recentPoint(size_t i) const {
+    const RawSample &s = raw.at(i);
+    return rawPoint(s.time, s.temp, s.hum);
+  }
+
+  static HistoryPoint rawPoint(uint32_t time, int16_t temp, int16_t hum) {
+    HistoryPoint p;
+    p.time = time;
+    p.tempMin = p.tempMean = p.tempMax = fromCenti(temp);
+    p.humMin = p.humMean = p.humMax = fromCenti(hum);
+    return p;
+  }
+
+  template <typename Ring>
+  static size_t rebaseRing(Ring &ring, uint32_t before, uint32_t offset) {
+    size_t i = 0;
+    for (; i < ring.size() && ring.at(i).time < before; i++) ring.at(i).time += offset;
+    return i;
+  }
+
+  // Rollup tiers only; the archive does its own seeks
+  uint32_t timeAt(HistoryTier tier, size_t i) const {
+    return tier == HISTORY_1M ? oneMinute.at(i).time : quarterHour.at(i).time;
+  }
+
+  size_t lowerBound(HistoryTier tier, uint32_t from) const {
+    size_t lo = 0, hi = size(tier);
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (timeAt(tier, mid) < from) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+  static int16_t toCenti(float v) {
+    float c = v * 100.0f;
+    if (c > 32767.0f) c = 32767.0f;
+    if (c < -32768.0f) c = -32768.0f;
+    return (int16_t)(c < 0 ? c - 0.5f : c + 0.5f);
+  }
+
+  static float fromCenti(int16_t v) { return v / 100.0f; }
+
+  HistoryRing<RawSample, HISTORY_RAW_SLOTS> raw;     // Newest part of the archive, for tail()
+  SampleArchive archive;
+  HistoryRing<Rollup, HISTORY_1M_SLOTS> oneMinute;
+  HistoryRing<Rollup, HISTORY_15M_SLOTS> quarterHour;
+  Accumulator minuteAcc;
+  Accumulator quarterAcc;
+  uint32_t lastTime = 0;
+};
+
+static_assert(sizeof(History) - sizeof(SampleArchive) <= HISTORY_RAM_BUDGET,
+              "History rings exceed their RAM budget");
+// The archive has its own bound (SERIES_RAM_BUDGET, series_store.h); this one is the total
+static_assert(sizeof(History) <= HISTORY_TOTAL_RAM_BUDGET,
+              "History with its raw archive exceeds its RAM budget");
+
+#endif
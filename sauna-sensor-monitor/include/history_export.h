@@ -0,0 +1,195 @@
+#ifndef HISTORY_EXPORT_H
+#define HISTORY_EXPORT_H
+
+/*************************************************************
+  Incremental history export
+
+  Streams the points of one history tier from a sequence number
+  up to a fixed end, as CSV or as compact binary records, in
+  pieces of whatever size the transport asks for. Points are
+  fetched a few at a time through a caller-supplied reader (which
+  takes the history lock), so memory use does not depend on the
+  range.
+
+  CSV:  seq,time,temperature,humidity                       (raw)
+        seq,time,temp_min,temp_mean,temp_max,hum_min,hum_mean,hum_max
+  bin:  8-byte header "SHX1", version, tier, record size (u16)
+        raw:    seq u32, time u32, temp i16, hum i16          (12 B)
+        rollup: seq u32, time u32, temp min/mean/max i16,
+                hum min/mean/max i16                          (20 B)
+  All binary fields little endian, values in centi-units.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+
+#define HISTORY_EXPORT_VERSION 1
+
+enum HistoryFormat : uint8_t {
+  HISTORY_FORMAT_CSV,
+  HISTORY_FORMAT_BIN
+};
+
+/**
+ * Resume point for /history. "s<seq>-<boot>" as handed out by the
+ * device, "s<seq>" without the boot id, or plain epoch seconds.
+ */
+struct HistoryCursor {
+  bool isSeq;          // value is a sequence number, else epoch seconds
+  bool sameBoot;       // false if the cursor names another boot
+  uint32_t value;
+};
+
+inline bool parseHistoryCursor(const char *text, uint32_t bootId, HistoryCursor &cursor) {
+  char *end;
+  cursor.isSeq = text[0] == 's';
+  cursor.sameBoot = true;
+  if (cursor.isSeq) text++;
+  if (*text < '0' || *text > '9') return false;
+  cursor.value = strtoul(text, &end, 10);
+  if (cursor.isSeq && *end == '-') {
+    const char *boot = end + 1;
+    uint32_t id = strtoul(boot, &end, 16);
+    if (end == boot) return false;
+    cursor.sameBoot = id == bootId;
+  }
+  return *end == '\0';
+}
+
+inline void formatHistoryCursor(char *buf, size_t len, uint32_t seq, uint32_t bootId) {
+  snprintf(buf, len, "s%lu-%08lx", (unsigned long)seq, (unsigned long)bootId);
+}
+
+// Copies up to max points from seq on, sets *first to the seq of out[0]
+typedef size_t (*HistoryReader)(HistoryTier tier, uint32_t seq, HistoryPoint *out,
+                                size_t max, uint32_t *first);
+
+class HistoryExportStream {
+public:
+  HistoryExportStream(HistoryReader reader, HistoryTier tier, HistoryFormat format,
+                      uint32_t fromSeq, uint32_t endSeq)
+    : reader(reader), tier(tier), format(format), next(fromSeq), end(endSeq) {}
+
+  // Write up to maxLen bytes; returns 0 once the export is complete
+  size_t fill(uint8_t *buf, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+      if (textPos == textLen && !produce()) break;
+      size_t n = textLen - textPos;
+      if (n > maxLen - written) n = maxLen - written;
+      memcpy(buf + written, text + textPos, n);
+      textPos += n;
+      written += n;
+    }
+    return written;
+  }
+
+  static size_t recordSize(HistoryTier tier) { return tier == HISTORY_RAW ? 12 : 20; }
+
+private:
+  static const size_t BATCH = 16;
+
+  // Format the header or the next point into text; false when done
+  bool produce() {
+    textPos = textLen = 0;
+    if (!started) {
+      started = true;
+      textLen = writeHeader();
+      return true;
+    }
+    if (batchPos == batchCount) {
+      if ((int32_t)(end - next) <= 0) return false;
+      size_t want = end - next < BATCH ? end - next : BATCH;
+      batchCount = reader(tier, next, batch, want, &batchSeq);
+      batchPos = 0;
+      if (batchCount == 0 || (int32_t)(batchSeq - end) >= 0) return false;
+      if ((int32_t)(batchSeq + batchCount - end) > 0) batchCount = end - batchSeq;
+      next = batchSeq + batchCount;
+    }
+    uint32_t seq = batchSeq + batchPos;
+    textLen = format == HISTORY_FORMAT_CSV ? writeCsvRow(seq, batch[batchPos])
+                                           : writeRecord(seq, batch[batchPos]);
+    batchPos++;
+    return true;
+  }
+
+  size_t writeHeader() {
+    if (format == HISTORY_FORMAT_CSV) {
+      const char *header = tier == HISTORY_RAW
+          ? "seq,time,temperature,humidity\n"
+          : "seq,time,temp_min,temp_mean,temp_max,hum_min,hum_mean,hum_max\n";
+      size_t len = strlen(header);
+      memcpy(text, header, len);
+      return len;
+    }
+    memcpy(text, "SHX1", 4);
+    text[4] = HISTORY_EXPORT_VERSION;
+    text[5] = tier;
+    size_t size = recordSize(tier);
+    text[6] = size;
+    text[7] = size >> 8;
+    return 8;
+  }
+
+  size_t writeCsvRow(uint32_t seq, const HistoryPoint &p) {
+    int len;
+    if (tier == HISTORY_RAW) {
+      len = snprintf((char *)text, sizeof(text), "%lu,%lu,%.2f,%.2f\n",
+                     (unsigned long)seq, (unsigned long)p.time, p.tempMean, p.humMean);
+    } else {
+      len = snprintf((char *)text, sizeof(text), "%lu,%lu,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+                     (unsigned long)seq, (unsigned long)p.time,
+                     p.tempMin, p.tempMean, p.tempMax, p.humMin, p.humMean, p.humMax);
+    }
+    return len < 0 ? 0 : (size_t)len < sizeof(text) ? (size_t)len : sizeof(text) - 1;
+  }
+
+  size_t writeRecord(uint32_t seq, const HistoryPoint &p) {
+    size_t len = 0;
+    putU32(len, seq);
+    putU32(len, p.time);
+    if (tier == HISTORY_RAW) {
+      putCenti(len, p.tempMean);
+      putCenti(len, p.humMean);
+    } else {
+      putCenti(len, p.tempMin);
+      putCenti(len, p.tempMean);
+      putCenti(len, p.tempMax);
+      putCenti(len, p.humMin);
+      putCenti(len, p.humMean);
+      putCenti(len, p.humMax);
+    }
+    return len;
+  }
+
+  void putU32(size_t &len, uint32_t v) {
+    text[len++] = v;
+    text[len++] = v >> 8;
+    text[len++] = v >> 16;
+    text[len++] = v >> 24;
+  }
+
+  // History stores centi-units, so this round trip is exact
+  void putCenti(size_t &len, float v) {
+    int16_t c = (int16_t)(v < 0 ? v * 100.0f - 0.5f : v * 100.0f + 0.5f);
+    text[len++] = (uint16_t)c;
+    text[len++] = (uint16_t)c >> 8;
+  }
+
+  HistoryReader reader;
+  HistoryTier tier;
+  HistoryFormat format;
+  uint32_t next, end;
+  HistoryPoint batch[BATCH];
+  uint32_t batchSeq = 0;
+  size_t batchCount = 0, batchPos = 0;
+  bool started = false;
+  uint8_t text[96];
+  size_t textLen = 0, textPos = 0;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+/*************************************************************
+  Minimal JSON writer
+
+  Writes into a caller-provided fixed buffer, never allocates.
+  Commas are inserted automatically. If the buffer is too small
+  the output is truncated and overflowed() returns true.
+
+    char buf[128];
+    JsonWriter w(buf, sizeof(buf));
+    w.beginObject();
+    w.key("temperature"); w.fixed(82.46f, 1);   // -> 82.5
+    w.endObject();
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#define JSON_WRITER_MAX_DEPTH 8
+
+class JsonWriter {
+public:
+  JsonWriter(char *buffer, size_t capacity)
+    : buf(buffer), cap(capacity), len(0), depth(0), overflow(false), afterKey(false) {
+    terminate();
+  }
+
+  void beginObject() { separator(); put('{'); push(); }
+  void endObject()   { pop(); put('}'); }
+  void beginArray()  { separator(); put('['); push(); }
+  void endArray()    { pop(); put(']'); }
+
+  void key(const char *name) {
+    separator();
+    putString(name);
+    put(':');
+    afterKey = true;
+  }
+
+  void string(const char *value) {
+    separator();
+    putString(value);
+  }
+
+  void integer(int32_t value) {
+    separator();
+    putInteger(value);
+  }
+
+  void uinteger(uint32_t value) {
+    separator();
+    putUnsigned(value);
+  }
+
+  void boolean(bool value) {
+    separator();
+    putRaw(value ? "true" : "false");
+  }
+
+  void null() {
+    separator();
+    putRaw("null");
+  }
+
+  /**
+   * Fixed-point number with `decimals` digits after the point, rounded
+   * half away from zero (same output as Arduino String(value, decimals)).
+   * Non-finite values are written as null.
+   */
+  void fixed(float value, uint8_t decimals) {
+    separator();
+    if (isnan(value) || isinf(value)) {
+      putRaw("null");
+      return;
+    }
+    uint32_t scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+    bool negative = value < 0;
+    double scaled = (negative ? -(double)value : (double)value) * scale + 0.5;
+    if (scaled >= 4294967295.0) scaled = 4294967295.0;
+    uint32_t units = (uint32_t)scaled;
+    if (negative) put('-');
+    putUnsigned(units / scale);
+    if (decimals > 0) {
+      put('.');
+      uint32_t frac = units % scale;
+      for (uint32_t div = scale / 10; div > 0; div /= 10) {
+        put('0' + (frac / div) % 10);
+      }
+    }
+  }
+
+  size_t length() const { return len; }
+  const char *c_str() const { return buf; }
+  bool overflowed() const { return overflow; }
+
+private:
+  void put(char c) {
+    if (len + 1 < cap) {
+      buf[len++] = c;
+      buf[len] = '\0';
+    } else {
+      overflow = true;
+    }
+  }
+
+  void putRaw(const char *s) {
+    while (*s) put(*s++);
+  }
+
+  void putString(const char *s) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    put('"');
+    for (; *s; s++) {
+      char c = *s;
+      if (c == '"' || c == '\\') {
+        put('\\');
+        put(c);
+      } else if ((uint8_t)c < 0x20) {
+        putRaw("\\u00");
+        put(HEX_DIGITS[(c >> 4) & 0xF]);
+        put(HEX_DIGITS[c & 0xF]);
+      } else {
+        put(c);
+      }
+    }
+    put('"');
+  }
+
+  void putUnsigned(uint32_t v) {
+    char digits[10];
+    uint8_t n = 0;
+    do {
+      digits[n++] = '0' + (v % 10);
+      v /= 10;
+    } while (v > 0);
+    while (n > 0) put(digits[--n]);
+  }
+
+  void putInteger(int32_t v) {
+    if (v < 0) {
+      put('-');
+      putUnsigned((uint32_t)(-(int64_t)v));
+    } else {
+      putUnsigned((uint32_t)v);
+    }
+  }
+
+  // Emit a comma before every value except the first in a container
+  void separator() {
+    if (afterKey) {
+      afterKey = false;
+      return;
+    }
+    if (depth > 0) {
+      if (hasItems[depth - 1]) put(',');
+      hasItems[depth - 1] = true;
+    }
+  }
+
+  void push() {
+    if (depth < JSON_WRITER_MAX_DEPTH) {
+      hasItems[depth++] = false;
+    } else {
+      overflow = true;
+    }
+  }
+
+  void pop() {
+    if (depth > 0) depth--;
+  }
+
+  void terminate() {
+    if (cap > 0) buf[0] = '\0';
+    else overflow = true;
+  }
+
+  char *buf;
+  size_t cap;
+  size_t len;
+  uint8_t depth;
+  bool overflow;
+  bool afterKey;
+  bool hasItems[JSON_WRITER_MAX_DEPTH];
+};
+
+#endif
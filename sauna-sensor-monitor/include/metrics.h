@@ -0,0 +1,113 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*************************************************************
+  Runtime performance counters
+
+  Fixed-bucket latency histograms and counters for /metrics
+  (Prometheus text format). Each metric has a single writer task,
+  so an update is a relaxed atomic load and store per field: no
+  locks, no read-modify-write, no allocation. Readers on other
+  tasks may see a histogram mid-update (count one ahead of a
+  bucket), which a scrape tolerates.
+
+  Build with -DMETRICS_ENABLED=0 to compile all of it out: the
+  METRIC_* macros then expand to nothing and do not evaluate their
+  arguments.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#ifndef METRICS_ENABLED
+#define METRICS_ENABLED 1
+#endif
+
+#ifndef METRICS_NOW_US
+#define METRICS_NOW_US() micros()
+#endif
+
+#define METRIC_BUCKETS 12
+
+// Upper bounds in µs, from a 50 µs I2C transaction to a 250 ms handler
+static const uint32_t METRIC_BUCKET_US[METRIC_BUCKETS] = {
+  50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+};
+
+class MetricCounter {
+public:
+  void inc(uint32_t n = 1) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  uint32_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint32_t> value{0};
+};
+
+class LatencyHistogram {
+public:
+  void observe(uint32_t us) {
+    uint8_t i = 0;
+    while (i < METRIC_BUCKETS && us > METRIC_BUCKET_US[i]) i++;
+    bump(buckets[i], 1);          // Bucket METRIC_BUCKETS is +Inf
+    // Sum kept as ms + µs remainder so it lasts 49 days instead of 71 minutes
+    uint32_t frac = sumFracUs.load(std::memory_order_relaxed) + us % 1000;
+    uint32_t ms = us / 1000 + frac / 1000;
+    sumFracUs.store(frac % 1000, std::memory_order_relaxed);
+    if (ms) bump(sumMs, ms);
+  }
+
+  /**
+   * Prometheus histogram lines. labels is either empty or "key=\"value\""
+   * and out needs printf().
+   */
+  template <typename Out>
+  void write(Out &out, const char *name, const char *labels) const {
+    const char *sep = labels[0] ? "," : "";
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i < METRIC_BUCKETS; i++) {
+      cumulative += buckets[i].load(std::memory_order_relaxed);
+      out.printf("%s_bucket{%s%sle=\"%lu.%06lu\"} %lu\n", name, labels, sep,
+                 (unsigned long)(METRIC_BUCKET_US[i] / 1000000),
+                 (unsigned long)(METRIC_BUCKET_US[i] % 1000000), (unsigned long)cumulative);
+    }
+    cumulative += buckets[METRIC_BUCKETS].load(std::memory_order_relaxed);
+    out.printf("%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, sep, (unsigned long)cumulative);
+    uint32_t ms = sumMs.load(std::memory_order_relaxed);
+    uint32_t frac = sumFracUs.load(std::memory_order_relaxed);
+    const char *open = labels[0] ? "{" : "";
+    const char *close = labels[0] ? "}" : "";
+    out.printf("%s_sum%s%s%s %lu.%03lu%03lu\n", name, open, labels, close,
+               (unsigned long)(ms / 1000), (unsigned long)(ms % 1000), (unsigned long)frac);
+    out.printf("%s_count%s%s%s %lu\n", name, open, labels, close, (unsigned long)cumulative);
+  }
+
+private:
+  static void bump(std::atomic<uint32_t> &v, uint32_t n) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint32_t> buckets[METRIC_BUCKETS + 1] = {};
+  std::atomic<uint32_t> sumMs{0};
+  std::atomic<uint32_t> sumFracUs{0};
+};
+
+template <typename Out>
+void writeMetricHeader(Out &out, const char *name, const char *type, const char *help) {
+  out.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+#if METRICS_ENABLED
+#define METRIC_START(var)          uint32_t var = METRICS_NOW_US()
+#define METRIC_OBSERVE(hist, us)   (hist).observe(us)
+#define METRIC_SINCE(hist, var)    (hist).observe(METRICS_NOW_US() - (var))
+#define METRIC_INC(counter)        (counter).inc()
+#else
+#define METRIC_START(var)          do {} while (0)
+#define METRIC_OBSERVE(hist, us)   do {} while (0)
+#define METRIC_SINCE(hist, var)    do {} while (0)
+#define METRIC_INC(counter)        do {} while (0)
+#endif
+
+#endif
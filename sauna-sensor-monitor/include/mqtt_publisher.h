@@ -0,0 +1,306 @@
+#ifndef MQTT_PUBLISHER_H
+#define MQTT_PUBLISHER_H
+
+/*************************************************************
+  MQTT publisher
+
+  Topics, with <base> = sauna/<device id>:
+    <base>/state    batched readings     {"seq","time","period","t":[],"h":[],
+                                          "active","session","readyIn"}
+    <base>/event    session start / end  {"event","time","duration","peak","humidity",
+                                          "spread" (several sensors), "meanTemp",
+                                          "above80", "heatDose", "throws"}
+    <base>/health   device health        (see serializeHealth)
+    <base>/status   "online", retained; "offline" as the last will
+  plus retained Home Assistant discovery configs under
+  homeassistant/ on every connect.
+
+  Readings are batched so that a publish goes out about every
+  MQTT_BATCH_MS: several samples per message at 2 s sampling, one
+  per message at 30 s. Everything goes through MqttQueue, so an
+  unreachable broker only grows the queue; it drains in order once
+  the connection is back. All calls are made from one task except
+  event(), which only touches the (locked) queue.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "hal.h"
+#include "mqtt_queue.h"
+#include "json_writer.h"
+#include "sauna_state.h"
+#include "session_stats.h"
+
+#define MQTT_BATCH_MAX          5
+#define MQTT_BATCH_MS           10000UL   // Longest a reading waits before publishing
+#define MQTT_DRAIN_BURST        8         // Queued messages published per service()
+#define MQTT_BACKOFF_BASE_MS    1000UL
+#define MQTT_BACKOFF_MAX_MS     60000UL
+
+// Snapshot of the device state for <base>/health
+struct DeviceHealth {
+  uint32_t uptime;          // Seconds
+  int32_t rssi;             // dBm
+  uint32_t freeHeap;
+  uint32_t bootId;
+  bool idle;                // Power mode
+  uint32_t queueDepth;
+  uint32_t queueDropped;
+};
+
+inline size_t serializeHealth(char *buf, size_t len, const DeviceHealth &h) {
+  char boot[9];
+  snprintf(boot, sizeof(boot), "%08lx", (unsigned long)h.bootId);
+  JsonWriter w(buf, len);
+  w.beginObject();
+  w.key("uptime");
+  w.uinteger(h.uptime);
+  w.key("rssi");
+  w.integer(h.rssi);
+  w.key("heap");
+  w.uinteger(h.freeHeap);
+  w.key("boot");
+  w.string(boot);
+  w.key("mode");
+  w.string(h.idle ? "idle" : "active");
+  w.key("queued");
+  w.uinteger(h.queueDepth);
+  w.key("dropped");
+  w.uinteger(h.queueDropped);
+  w.endObject();
+  return w.length();
+}
+
+class MqttPublisher {
+public:
+  MqttPublisher(MqttHal &mqtt, MqttQueue &queue) : mqtt(mqtt), queue(queue) {}
+
+  /**
+   * deviceId names the topics and the Home Assistant device; user and
+   * pass may be null. The strings must outlive the publisher.
+   */
+  void begin(const char *deviceId, const char *user, const char *pass) {
+    id = deviceId;
+    this->user = user;
+    this->pass = pass;
+    snprintf(base, sizeof(base), "sauna/%s", deviceId);
+    topic(statusTopic, sizeof(statusTopic), "status");
+  }
+
+  /**
+   * Add one reading to the current batch. periodMs is the sampling
+   * period, which decides how many readings go into one message.
+   */
+  void sample(uint32_t seq, uint32_t time, float temperature, float humidity,
+              bool active, uint32_t sessionMinutes, int16_t readyMinutes,
+              uint32_t periodMs, uint32_t nowMs) {
+    if (batchCount > 0 && seq != batchSeq + batchCount) flushBatch(nowMs);  // Gap
+    if (batchCount == 0) {
+      batchSeq = seq;
+      batchTime = time;
+      batchStartMs = nowMs;
+      batchPeriod = periodMs;
+    }
+    batchTemp[batchCount] = temperature;
+    batchHum[batchCount] = humidity;
+    batchCount++;
+    batchActive = active;
+    batchSession = sessionMinutes;
+    batchReady = readyMinutes;
+
+    size_t perMessage = periodMs >= MQTT_BATCH_MS ? 1 : MQTT_BATCH_MS / periodMs;
+    if (perMessage > MQTT_BATCH_MAX) perMessage = MQTT_BATCH_MAX;
+    if (batchCount >= perMessage) flushBatch(nowMs);
+  }
+
+  /**
+   * Queue a session start / end (callable from another task); stats is
+   * the finished session's summary, if there is one
+   */
+  void event(SaunaEvent event, const SaunaState &sauna, uint32_t epoch, uint32_t nowMs,
+             const SessionSummary *stats = nullptr) {
+    MqttMessage msg;
+    msg.kind = MQTT_KIND_EVENT;
+    msg.retain = false;
+    JsonWriter w(msg.payload, sizeof(msg.payload));
+    w.beginObject();
+    w.key("event");
+    w.string(event == SAUNA_EVENT_STARTED ? "started" : "ended");
+    w.key("time");
+    w.uinteger(epoch);
+    if (event == SAUNA_EVENT_ENDED) {
+      w.key("duration");
+      w.uinteger(sauna.lastDuration / 1000);
+      w.key("peak");
+      w.fixed(sauna.lastPeakTemp, 1);
+      w.key("humidity");
+      w.fixed(sauna.lastMeanHumidity, 1);
+      if (sauna.lastPeakSpread > 0) {
+        w.key("spread");            // Several sensors: largest bench-to-floor difference
+        w.fixed(sauna.lastPeakSpread, 1);
+      }
+      if (stats && stats->valid) {
+        w.key("meanTemp");
+        w.fixed(stats->meanTemp, 1);
+        w.key("above80");           // Minutes
+        w.uinteger(stats->above80S / 60);
+        w.key("heatDose");          // °C·min
+        w.uinteger((uint32_t)lroundf(stats->heatDose));
+        w.key("throws");
+        w.uinteger(stats->throws);
+      }
+    }
+    w.endObject();
+    msg.len = w.length();
+    queue.push(msg, nowMs);
+  }
+
+  void health(const DeviceHealth &h, uint32_t nowMs) {
+    MqttMessage msg;
+    msg.kind = MQTT_KIND_HEALTH;
+    msg.retain = true;
+    msg.len = serializeHealth(msg.payload, sizeof(msg.payload), h);
+    queue.push(msg, nowMs);
+  }
+
+  /**
+   * Connection upkeep and queue drain, call often from the network
+   * task. networkUp is false while WiFi is down.
+   */
+  void service(bool networkUp, uint32_t nowMs) {
+    if (batchCount > 0 && nowMs - batchStartMs >= MQTT_BATCH_MS) flushBatch(nowMs);
+
+    bool online = networkUp && mqtt.connected();
+    if (networkUp && !online && nowMs - lastAttemptMs >= backoffMs) {
+      lastAttemptMs = nowMs;
+      online = mqtt.connect(id, user, pass, statusTopic, "offline");
+      if (online) {
+        backoffMs = 0;
+        connectCount++;
+        announce();
+      } else {
+        backoffMs = backoffMs == 0 ? MQTT_BACKOFF_BASE_MS : backoffMs * 2;
+        if (backoffMs > MQTT_BACKOFF_MAX_MS) backoffMs = MQTT_BACKOFF_MAX_MS;
+      }
+    }
+    if (online) {
+      mqtt.loop();
+      drain();
+    }
+    queue.service(online, nowMs);
+  }
+
+  bool connected() { return mqtt.connected(); }
+  uint32_t connects() const { return connectCount; }
+
+private:
+  void topic(char *buf, size_t len, const char *suffix) {
+    snprintf(buf, len, "%s/%s", base, suffix);
+  }
+
+  void flushBatch(uint32_t nowMs) {
+    if (batchCount == 0) return;
+    MqttMessage msg;
+    msg.kind = MQTT_KIND_STATE;
+    msg.retain = false;
+    JsonWriter w(msg.payload, sizeof(msg.payload));
+    w.beginObject();
+    w.key("seq");
+    w.uinteger(batchSeq);
+    w.key("time");
+    w.uinteger(batchTime);
+    w.key("period");
+    w.uinteger(batchPeriod / 1000);
+    w.key("t");
+    w.beginArray();
+    for (size_t i = 0; i < batchCount; i++) w.fixed(batchTemp[i], 1);
+    w.endArray();
+    w.key("h");
+    w.beginArray();
+    for (size_t i = 0; i < batchCount; i++) w.integer((int32_t)batchHum[i]);
+    w.endArray();
+    w.key("active");
+    w.boolean(batchActive);
+    w.key("session");
+    w.uinteger(batchSession);
+    w.key("readyIn");
+    if (batchReady < 0) w.null();
+    else w.integer(batchReady);
+    w.endObject();
+    msg.len = w.length();
+    batchCount = 0;
+    queue.push(msg, nowMs);
+  }
+
+  // Publish queued messages in order, stop at the first failure
+  void drain() {
+    MqttMessage msg;
+    char name[64];
+    static const char *const SUFFIX[] = { "state", "event", "health" };
+    for (size_t i = 0; i < MQTT_DRAIN_BURST && queue.peek(msg); i++) {
+      topic(name, sizeof(name), SUFFIX[msg.kind <= MQTT_KIND_HEALTH ? msg.kind : 0]);
+      if (!mqtt.publish(name, (const uint8_t *)msg.payload, msg.len, msg.retain)) break;
+      queue.pop();
+    }
+    queue.commit();
+  }
+
+  // Availability and Home Assistant discovery, sent on every connect
+  void announce() {
+    mqtt.publish(statusTopic, (const uint8_t *)"online", 6, true);
+    discovery("sensor", "temperature", "Temperature", "state",
+              "{{ value_json.t[-1] }}", "\"unit_of_measurement\":\"°C\",\"device_class\":\"temperature\"");
+    discovery("sensor", "humidity", "Humidity", "state",
+              "{{ value_json.h[-1] }}", "\"unit_of_measurement\":\"%\",\"device_class\":\"humidity\"");
+    discovery("binary_sensor", "session", "Session", "state",
+              "{{ 'ON' if value_json.active else 'OFF' }}", "\"device_class\":\"heat\"");
+    discovery("sensor", "session_time", "Session time", "state",
+              "{{ value_json.session }}", "\"unit_of_measurement\":\"min\"");
+    discovery("sensor", "ready_in", "Ready in", "state",
+              "{{ value_json.readyIn }}", "\"unit_of_measurement\":\"min\"");
+    discovery("sensor", "rssi", "WiFi signal", "health",
+              "{{ value_json.rssi }}",
+              "\"unit_of_measurement\":\"dBm\",\"device_class\":\"signal_strength\","
+              "\"entity_category\":\"diagnostic\"");
+  }
+
+  void discovery(const char *component, const char *object, const char *name,
+                 const char *stateSuffix, const char *valueTemplate, const char *extra) {
+    char configTopic[96];
+    snprintf(configTopic, sizeof(configTopic), "homeassistant/%s/%s_%s/config",
+             component, id, object);
+    char payload[512];
+    int len = snprintf(payload, sizeof(payload),
+        "{\"name\":\"%s\",\"unique_id\":\"%s_%s\",\"state_topic\":\"%s/%s\","
+        "\"value_template\":\"%s\",\"availability_topic\":\"%s\",%s,"
+        "\"device\":{\"identifiers\":[\"%s\"],\"name\":\"Sauna Sensor\","
+        "\"model\":\"ESP32-C3 + SHT2x\",\"manufacturer\":\"DIY\"}}",
+        name, id, object, base, stateSuffix, valueTemplate, statusTopic, extra, id);
+    if (len > 0 && (size_t)len < sizeof(payload)) {
+      mqtt.publish(configTopic, (const uint8_t *)payload, len, true);
+    }
+  }
+
+  MqttHal &mqtt;
+  MqttQueue &queue;
+  const char *id = "sauna";
+  const char *user = nullptr;
+  const char *pass = nullptr;
+  char base[40] = "sauna/sauna";
+  char statusTopic[48] = "sauna/sauna/status";
+
+  uint32_t lastAttemptMs = 0;
+  uint32_t backoffMs = 0;
+  uint32_t connectCount = 0;
+
+  float batchTemp[MQTT_BATCH_MAX];
+  float batchHum[MQTT_BATCH_MAX];
+  size_t batchCount = 0;
+  uint32_t batchSeq = 0, batchTime = 0, batchStartMs = 0, batchPeriod = 0;
+  bool batchActive = false;
+  uint32_t batchSession = 0;
+  int16_t batchReady = -1;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef MQTT_QUEUE_H
+#define MQTT_QUEUE_H
+
+/*************************************************************
+  Store-and-forward queue for MQTT messages
+
+  Messages wait in a small RAM ring. While the broker is away they
+  are moved in batches to a ring file on flash (LittleFS on the
+  device, any file on the host), so an outage survives reboots
+  and can outlast the RAM ring by far. Delivery order is always
+  flash first, then RAM: everything in RAM is newer than anything
+  spilled before it.
+
+  Flash file:
+    offset  size  field
+    0       4     magic "MQQ1"
+    4       4     head        slot of the oldest message
+    8       4     count       messages stored
+    12      4     crc         CRC-32 of bytes 0..11
+    16 + i * 192  slot i:
+                  kind u8, retain u8, len u16, payload[184],
+                  crc u32 of the first 188 bytes
+  All fields little endian. The header is rewritten after each
+  spill and drain burst; a reboot in between re-sends the burst
+  (at-least-once). When the file is full the oldest message is
+  dropped and counted.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rtos_port.h"
+#include "session_log.h"    // sessionCrc32, putLe32 / getLe32
+
+#define MQTT_PAYLOAD_MAX        184
+#define MQTT_RECORD_SIZE        192
+#define MQTT_QUEUE_HEADER_SIZE  16
+#define MQTT_RAM_MESSAGES       16
+#define MQTT_FLASH_MESSAGES     1024      // 192 KB of flash
+#define MQTT_SPILL_BATCH        4         // Offline: spill once this many wait in RAM
+#define MQTT_SPILL_MS           60000UL   // ... or once the oldest has waited this long
+
+enum MqttKind : uint8_t {
+  MQTT_KIND_STATE,        // Batched readings
+  MQTT_KIND_EVENT,        // Session started / ended
+  MQTT_KIND_HEALTH        // Device health
+};
+
+struct MqttMessage {
+  MqttKind kind;
+  bool retain;
+  uint16_t len;
+  char payload[MQTT_PAYLOAD_MAX];
+};
+
+class MqttQueue {
+public:
+  /**
+   * Open (or create) the spill file at path and pick up messages left
+   * from before a reboot. Without a file the queue is RAM only.
+   */
+  bool begin(const char *path) {
+    RtosLock lock(mutex);
+    file = fopen(path, "r+b");
+    if (!file) file = fopen(path, "w+b");
+    if (!file) return false;
+
+    uint8_t header[MQTT_QUEUE_HEADER_SIZE];
+    bool valid = fread(header, 1, sizeof(header), file) == sizeof(header) &&
+                 memcmp(header, "MQQ1", 4) == 0 &&
+                 getLe32(header + 12) == sessionCrc32(header, 12);
+    flashHead = valid ? getLe32(header + 4) % MQTT_FLASH_MESSAGES : 0;
+    flashCount = valid ? getLe32(header + 8) : 0;
+    if (flashCount > MQTT_FLASH_MESSAGES) flashCount = 0;
+    return valid || writeHeader();
+  }
+
+  // Close the spill file (queued messages stay in it)
+  void end() {
+    RtosLock lock(mutex);
+    if (file) fclose(file);
+    file = nullptr;
+  }
+
+  /**
+   * Queue a message. Only touches flash if the RAM ring is full
+   * (broker away and the owner not calling service()).
+   */
+  bool push(const MqttMessage &msg, uint32_t nowMs) {
+    RtosLock lock(mutex);
+    if (ramCount == MQTT_RAM_MESSAGES && !spillLocked()) {
+      // No flash: make room by dropping the oldest
+      ramHead = (ramHead + 1) % MQTT_RAM_MESSAGES;
+      ramCount--;
+      droppedCount++;
+    }
+    if (ramCount == 0) firstRamMs = nowMs;
+    ram[(ramHead + ramCount) % MQTT_RAM_MESSAGES] = msg;
+    ramCount++;
+    return true;
+  }
+
+  /**
+   * While offline, move waiting messages to flash in batches so a
+   * reboot does not lose them
+   */
+  void service(bool online, uint32_t nowMs) {
+    RtosLock lock(mutex);
+    if (online || ramCount == 0) return;
+    if (ramCount >= MQTT_SPILL_BATCH || nowMs - firstRamMs >= MQTT_SPILL_MS) spillLocked();
+  }
+
+  // Oldest message, false when empty. Skips records that fail their CRC.
+  bool peek(MqttMessage &msg) {
+    RtosLock lock(mutex);
+    while (flashCount > 0) {
+      if (readSlot(flashHead, msg)) return true;
+      popFlash();
+      droppedCount++;
+    }
+    if (ramCount == 0) return false;
+    msg = ram[ramHead];
+    return true;
+  }
+
+  // Remove the message returned by the last peek()
+  void pop() {
+    RtosLock lock(mutex);
+    if (flashCount > 0) {
+      popFlash();
+      headerDirty = true;
+    } else if (ramCount > 0) {
+      ramHead = (ramHead + 1) % MQTT_RAM_MESSAGES;
+      ramCount--;
+    }
+  }
+
+  // Persist the flash head after a drain burst
+  void commit() {
+    RtosLock lock(mutex);
+    if (headerDirty) writeHeader();
+  }
+
+  size_t depth() {
+    RtosLock lock(mutex);
+    return flashCount + ramCount;
+  }
+  size_t flashDepth() {
+    RtosLock lock(mutex);
+    return flashCount;
+  }
+  uint32_t dropped() const { return droppedCount; }
+
+private:
+  void popFlash() {
+    flashHead = (flashHead + 1) % MQTT_FLASH_MESSAGES;
+    flashCount--;
+    if (flashCount == 0) flashHead = 0;
+  }
+
+  bool spillLocked() {
+    if (!file) return false;
+    while (ramCount > 0) {
+      if (flashCount == MQTT_FLASH_MESSAGES) {
+        popFlash();             // Full: the oldest message goes
+        droppedCount++;
+      }
+      uint32_t slot = (flashHead + flashCount) % MQTT_FLASH_MESSAGES;
+      if (!writeSlot(slot, ram[ramHead])) return false;
+      flashCount++;
+      ramHead = (ramHead + 1) % MQTT_RAM_MESSAGES;
+      ramCount--;
+    }
+    return writeHeader();
+  }
+
+  bool writeSlot(uint32_t slot, const MqttMessage &msg) {
+    uint8_t rec[MQTT_RECORD_SIZE] = {};
+    rec[0] = msg.kind;
+    rec[1] = msg.retain;
+    uint16_t len = msg.len > MQTT_PAYLOAD_MAX ? MQTT_PAYLOAD_MAX : msg.len;
+    rec[2] = len;
+    rec[3] = len >> 8;
+    memcpy(rec + 4, msg.payload, len);
+    putLe32(rec + 188, sessionCrc32(rec, 188));
+    if (fseek(file, MQTT_QUEUE_HEADER_SIZE + (long)slot * MQTT_RECORD_SIZE, SEEK_SET) != 0) {
+      return false;
+    }
+    return fwrite(rec, 1, sizeof(rec), file) == sizeof(rec);
+  }
+
+  bool readSlot(uint32_t slot, MqttMessage &msg) {
+    uint8_t rec[MQTT_RECORD_SIZE];
+    if (fseek(file, MQTT_QUEUE_HEADER_SIZE + (long)slot * MQTT_RECORD_SIZE, SEEK_SET) != 0) {
+      return false;
+    }
+    if (fread(rec, 1, sizeof(rec), file) != sizeof(rec)) return false;
+    if (getLe32(rec + 188) != sessionCrc32(rec, 188)) return false;
+    msg.kind = (MqttKind)rec[0];
+    msg.retain = rec[1] != 0;
+    msg.len = rec[2] | (rec[3] << 8);
+    if (msg.len > MQTT_PAYLOAD_MAX) return false;
+    memcpy(msg.payload, rec + 4, msg.len);
+    return true;
+  }
+
+  bool writeHeader() {
+    uint8_t header[MQTT_QUEUE_HEADER_SIZE];
+    memcpy(header, "MQQ1", 4);
+    putLe32(header + 4, flashHead);
+    putLe32(header + 8, flashCount);
+    putLe32(header + 12, sessionCrc32(header, 12));
+    headerDirty = false;
+    if (fseek(file, 0, SEEK_SET) != 0) return false;
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) return false;
+    return fflush(file) == 0;
+  }
+
+  RtosMutex mutex;
+  FILE *file = nullptr;
+  uint32_t flashHead = 0, flashCount = 0;
+  bool headerDirty = false;
+  MqttMessage ram[MQTT_RAM_MESSAGES];
+  size_t ramHead = 0, ramCount = 0;
+  uint32_t firstRamMs = 0;
+  uint32_t droppedCount = 0;
+};
+
+#endif
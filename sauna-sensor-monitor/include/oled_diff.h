@@ -0,0 +1,95 @@
+#ifndef OLED_DIFF_H
+#define OLED_DIFF_H
+
+/*************************************************************
+  OLED framebuffer diff
+
+  The SSD1306 framebuffer is organised as 8-pixel-high pages,
+  one byte per column (buffer[x + page * width]). OledDiff keeps
+  a shadow copy of what the panel currently shows and, for a new
+  frame, returns the column runs per page that changed, so only
+  those windows need to be sent with page/column addressing.
+
+  Runs in the same page separated by fewer than OLED_DIFF_MIN_GAP
+  unchanged columns are merged: resending a few unchanged bytes
+  is cheaper than another address setup.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define OLED_DIFF_MIN_GAP 8          // Unchanged columns worth a new window
+#define OLED_DIFF_MAX_RUNS_PER_PAGE 4
+
+struct OledWindow {
+  uint8_t page;
+  uint8_t colStart;    // Inclusive
+  uint8_t colEnd;      // Inclusive
+};
+
+template <uint8_t WIDTH, uint8_t PAGES>
+class OledDiff {
+public:
+  static const size_t MAX_WINDOWS = (size_t)PAGES * OLED_DIFF_MAX_RUNS_PER_PAGE;
+
+  /**
+   * Compare frame with the shadow copy, write the changed windows to
+   * out (room for MAX_WINDOWS) and adopt frame as the new shadow.
+   * Returns the number of windows; 0 means nothing to send.
+   */
+  size_t update(const uint8_t *frame, OledWindow *out) {
+    size_t count = 0;
+    for (uint8_t page = 0; page < PAGES; page++) {
+      const uint8_t *row = frame + (size_t)page * WIDTH;
+      uint8_t *shadowRow = shadow + (size_t)page * WIDTH;
+
+      if (!valid) {
+        OledWindow w = { page, 0, (uint8_t)(WIDTH - 1) };
+        out[count++] = w;
+        continue;
+      }
+
+      size_t firstRun = count;
+      int start = -1, last = -1;
+      for (int col = 0; col < WIDTH; col++) {
+        if (row[col] == shadowRow[col]) continue;
+        if (start >= 0 && col - last > OLED_DIFF_MIN_GAP &&
+            count - firstRun < OLED_DIFF_MAX_RUNS_PER_PAGE - 1) {
+          OledWindow w = { page, (uint8_t)start, (uint8_t)last };
+          out[count++] = w;
+          start = -1;
+        }
+        if (start < 0) start = col;
+        last = col;
+      }
+      if (start >= 0) {
+        OledWindow w = { page, (uint8_t)start, (uint8_t)last };
+        out[count++] = w;
+      }
+    }
+    memcpy(shadow, frame, sizeof(shadow));
+    valid = true;
+    return count;
+  }
+
+  /**
+   * Forget what the panel shows, e.g. after something else wrote to it.
+   * The next update() returns the whole screen.
+   */
+  void invalidate() { valid = false; }
+
+  // Number of framebuffer bytes covered by a set of windows
+  static size_t payloadBytes(const OledWindow *windows, size_t count) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+      bytes += windows[i].colEnd - windows[i].colStart + 1;
+    }
+    return bytes;
+  }
+
+private:
+  uint8_t shadow[(size_t)WIDTH * PAGES];
+  bool valid = false;
+};
+
+#endif
@@ -0,0 +1,537 @@
+#ifndef OTA_DECODER_H
+#define OTA_DECODER_H
+
+/*************************************************************
+  Streaming firmware decompressors
+
+  Both decoders take the upload in whatever pieces the transport
+  delivers and hand the decompressed image to a sink as soon as it
+  exists. Nothing is buffered beyond a fixed history window (the
+  distance back-references may reach) and, for gzip, a small input
+  staging buffer, so memory use does not depend on image size.
+
+  gzip:        RFC 1952 member with RFC 1951 DEFLATE data. The
+               window must cover the compressor's: 32 KB for stock
+               gzip, or smaller with scripts/compress_firmware.py.
+               CRC-32 and length in the trailer are checked.
+  heatshrink:  LZSS bitstream as produced by heatshrink, behind a
+               4-byte header "HS", window bits, lookahead bits.
+               Literal: 1 + 8 bits. Back-reference: 0 + (offset - 1)
+               in window bits + (count - 1) in lookahead bits. Bits
+               MSB first.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <memory>
+#include <new>
+
+#ifndef OTA_GZIP_WINDOW_BITS
+#define OTA_GZIP_WINDOW_BITS 15          // 32 KB, accepts stock gzip output
+#endif
+#ifndef OTA_HEATSHRINK_MAX_WINDOW_BITS
+#define OTA_HEATSHRINK_MAX_WINDOW_BITS 12
+#endif
+#define OTA_INFLATE_STAGING 1024         // Holds the largest dynamic block header
+#define OTA_HEATSHRINK_HEADER_LEN 4
+
+// Receives decompressed bytes in order; false aborts the decode
+typedef bool (*OtaSink)(const uint8_t *data, size_t len, void *context);
+
+enum OtaDecodeResult : uint8_t {
+  OTA_DECODE_MORE,      // Consumed everything, wants more input
+  OTA_DECODE_DONE,      // End of stream reached
+  OTA_DECODE_ERROR
+};
+
+/**
+ * History ring shared by the decoders. Bytes reach the sink when the
+ * ring is about to overwrite them, or on flush().
+ */
+class OtaWindow {
+public:
+  explicit OtaWindow(uint8_t bits)
+    : buf(new (std::nothrow) uint8_t[(size_t)1 << bits]()), mask(((size_t)1 << bits) - 1) {}
+
+  bool ok() const { return buf != nullptr; }
+  size_t size() const { return mask + 1; }
+  uint64_t total() const { return pos; }
+
+  void setSink(OtaSink fn, void *ctx) {
+    sink = fn;
+    context = ctx;
+  }
+
+  bool put(uint8_t b) {
+    if (pos - flushed > mask && !flush()) return false;
+    buf[pos++ & mask] = b;
+    return true;
+  }
+
+  // Byte written distance (1..size()) positions ago
+  uint8_t back(size_t distance) const { return buf[(pos - distance) & mask]; }
+
+  // Repeat count bytes from distance back; may overlap
+  bool copy(size_t distance, size_t count) {
+    while (count--) {
+      if (!put(back(distance))) return false;
+    }
+    return true;
+  }
+
+  bool flush() {
+    while (flushed < pos) {
+      size_t start = flushed & mask;
+      size_t len = (size_t)(pos - flushed);
+      if (len > size() - start) len = size() - start;
+      if (!sink(buf.get() + start, len, context)) return false;
+      flushed += len;
+    }
+    return true;
+  }
+
+private:
+  std::unique_ptr<uint8_t[]> buf;
+  size_t mask;
+  uint64_t pos = 0, flushed = 0;
+  OtaSink sink = nullptr;
+  void *context = nullptr;
+};
+
+/**
+ * gzip decoder. Input is staged so that a block header or one
+ * length/distance pair is decoded as a unit: when the input runs out
+ * part way, the bit reader rewinds to the last unit boundary and the
+ * rest is kept for the next call.
+ */
+class GzipDecoder {
+public:
+  GzipDecoder(uint8_t windowBits, OtaSink sink, void *context) : window(windowBits) {
+    window.setSink(sink, context);
+  }
+
+  bool ok() const { return window.ok(); }
+  const char *error() const { return err; }
+  uint64_t total() const { return window.total(); }
+
+  OtaDecodeResult write(const uint8_t *data, size_t len) {
+    if (err) return OTA_DECODE_ERROR;
+    if (state == DONE) return OTA_DECODE_DONE;
+    for (;;) {
+      if (inPos > 0) {
+        memmove(in, in + inPos, inLen - inPos);
+        inLen -= inPos;
+        inPos = 0;
+      }
+      size_t take = len < sizeof(in) - inLen ? len : sizeof(in) - inLen;
+      memcpy(in + inLen, data, take);
+      inLen += take;
+      data += take;
+      len -= take;
+      run();
+      if (err) return OTA_DECODE_ERROR;
+      if (state == DONE) return window.flush() ? OTA_DECODE_DONE : fail("flash write failed");
+      if (len == 0) break;
+      if (inPos == 0 && inLen == sizeof(in)) return fail("unit exceeds staging buffer");
+    }
+    return window.flush() ? OTA_DECODE_MORE : fail("flash write failed");
+  }
+
+  // End of input: true if the stream was complete and checked out
+  bool finish() {
+    if (!err && state != DONE) fail("truncated stream");
+    return !err;
+  }
+
+private:
+  enum State : uint8_t { HEADER, BLOCK, STORED, CODES, TRAILER, DONE };
+
+  struct Huffman {
+    uint16_t count[16];
+    uint16_t symbol[288];
+  };
+
+  struct Mark {
+    size_t inPos;
+    uint32_t bitBuf;
+    uint8_t bitCnt;
+  };
+
+  static const int NEED_INPUT = -1;
+  static const int BAD_CODE = -2;
+
+  OtaDecodeResult fail(const char *message) {
+    if (!err) err = message;
+    return OTA_DECODE_ERROR;
+  }
+
+  Mark mark() const { Mark m = { inPos, bitBuf, bitCnt }; return m; }
+  void rewind(const Mark &m) {
+    inPos = m.inPos;
+    bitBuf = m.bitBuf;
+    bitCnt = m.bitCnt;
+  }
+
+  // n <= 16 bits, LSB first; false if the staged input runs out
+  bool bits(uint8_t n, uint32_t &value) {
+    while (bitCnt < n) {
+      if (inPos == inLen) return false;
+      bitBuf |= (uint32_t)in[inPos++] << bitCnt;
+      bitCnt += 8;
+    }
+    value = bitBuf & ((1UL << n) - 1);
+    bitBuf >>= n;
+    bitCnt -= n;
+    return true;
+  }
+
+  void alignByte() {
+    bitBuf >>= bitCnt & 7;
+    bitCnt -= bitCnt & 7;
+  }
+
+  // Canonical decode, one bit at a time from a preloaded bit buffer
+  int decode(const Huffman &h) {
+    while (bitCnt <= 24 && inPos < inLen) {
+      bitBuf |= (uint32_t)in[inPos++] << bitCnt;
+      bitCnt += 8;
+    }
+    uint32_t buf = bitBuf;
+    uint8_t avail = bitCnt;
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= 15; len++) {
+      if (avail == 0) return NEED_INPUT;
+      code |= buf & 1;
+      buf >>= 1;
+      avail--;
+      int count = h.count[len];
+      if (code - count < first) {
+        bitBuf = buf;
+        bitCnt = avail;
+        return h.symbol[index + (code - first)];
+      }
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+    return BAD_CODE;
+  }
+
+  // False if the lengths over-subscribe the code space
+  static bool build(Huffman &h, const uint8_t *lengths, int n) {
+    uint16_t offs[16];
+    memset(h.count, 0, sizeof(h.count));
+    for (int i = 0; i < n; i++) h.count[lengths[i]]++;
+    int left = 1;
+    for (int len = 1; len <= 15; len++) {
+      left = (left << 1) - h.count[len];
+      if (left < 0) return false;
+    }
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++) offs[len + 1] = offs[len] + h.count[len];
+    for (int i = 0; i < n; i++) {
+      if (lengths[i]) h.symbol[offs[lengths[i]]++] = i;
+    }
+    h.count[0] = 0;
+    return true;
+  }
+
+  void crcUpdate(uint8_t b) {
+    static const uint32_t NIBBLE[16] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+      0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+    crc ^= b;
+    crc = (crc >> 4) ^ NIBBLE[crc & 0x0F];
+    crc = (crc >> 4) ^ NIBBLE[crc & 0x0F];
+  }
+
+  bool emit(uint8_t b) {
+    crcUpdate(b);
+    return window.put(b);
+  }
+
+  // Header fields up to the first block; false waits for more input
+  bool readHeader() {
+    uint32_t v, flags;
+    if (!bits(16, v)) return false;
+    if (v != 0x8B1F) { fail("not gzip"); return true; }
+    if (!bits(8, v)) return false;
+    if (v != 8) { fail("not deflate"); return true; }
+    if (!bits(8, flags)) return false;
+    for (int i = 0; i < 6; i++) {              // mtime, xfl, os
+      if (!bits(8, v)) return false;
+    }
+    if (flags & 0x04) {                        // FEXTRA
+      uint32_t xlen;
+      if (!bits(16, xlen)) return false;
+      while (xlen--) if (!bits(8, v)) return false;
+    }
+    for (uint32_t flag = 0x08; flag <= 0x10; flag <<= 1) {   // FNAME, FCOMMENT
+      if (!(flags & flag)) continue;
+      do {
+        if (!bits(8, v)) return false;
+      } while (v != 0);
+    }
+    if ((flags & 0x02) && !bits(16, v)) return false;       // FHCRC
+    state = BLOCK;
+    return true;
+  }
+
+  // Block type and, for dynamic blocks, the code tables
+  bool readBlockHeader() {
+    uint32_t type;
+    if (!bits(1, last) || !bits(2, type)) return false;
+    if (type == 0) {
+      uint32_t len, nlen;
+      alignByte();
+      if (!bits(16, len) || !bits(16, nlen)) return false;
+      if ((len ^ 0xFFFF) != nlen) { fail("bad stored block"); return true; }
+      storedLeft = len;
+      state = STORED;
+      return true;
+    }
+    if (type == 1) {
+      uint8_t *l = lengths;
+      memset(l, 8, 144);
+      memset(l + 144, 9, 112);
+      memset(l + 256, 7, 24);
+      memset(l + 280, 8, 8);
+      build(lencode, l, 288);
+      memset(l, 5, 30);
+      build(distcode, l, 30);
+      state = CODES;
+      return true;
+    }
+    if (type == 3) { fail("bad block type"); return true; }
+
+    static const uint8_t ORDER[19] = {
+      16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+    uint32_t nlen, ndist, ncode, v;
+    if (!bits(5, nlen) || !bits(5, ndist) || !bits(4, ncode)) return false;
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > 286 || ndist > 30) { fail("bad code counts"); return true; }
+    memset(lengths, 0, 19);
+    for (uint32_t i = 0; i < ncode; i++) {
+      if (!bits(3, v)) return false;
+      lengths[ORDER[i]] = v;
+    }
+    if (!build(lencode, lengths, 19)) { fail("bad code lengths"); return true; }
+    uint32_t index = 0;
+    while (index < nlen + ndist) {
+      int symbol = decode(lencode);
+      if (symbol == NEED_INPUT) return false;
+      if (symbol < 0) { fail("bad code lengths"); return true; }
+      if (symbol < 16) {
+        lengths[index++] = symbol;
+        continue;
+      }
+      uint8_t len = 0;
+      uint32_t repeat;
+      if (symbol == 16) {
+        if (index == 0) { fail("repeat without length"); return true; }
+        len = lengths[index - 1];
+        if (!bits(2, repeat)) return false;
+        repeat += 3;
+      } else if (symbol == 17) {
+        if (!bits(3, repeat)) return false;
+        repeat += 3;
+      } else {
+        if (!bits(7, repeat)) return false;
+        repeat += 11;
+      }
+      if (index + repeat > nlen + ndist) { fail("too many lengths"); return true; }
+      while (repeat--) lengths[index++] = len;
+    }
+    if (lengths[256] == 0) { fail("no end-of-block code"); return true; }
+    if (!build(lencode, lengths, nlen) || !build(distcode, lengths + nlen, ndist)) {
+      fail("bad code lengths");
+      return true;
+    }
+    state = CODES;
+    return true;
+  }
+
+  // One literal, end of block or length/distance pair
+  bool readCode() {
+    static const uint16_t LBASE[29] = {
+      3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static const uint8_t LEXT[29] = {
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    static const uint16_t DBASE[30] = {
+      1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+      257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    static const uint8_t DEXT[30] = {
+      0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+    int symbol = decode(lencode);
+    if (symbol == NEED_INPUT) return false;
+    if (symbol < 0) { fail("bad literal/length code"); return true; }
+    if (symbol < 256) {
+      if (!emit(symbol)) fail("flash write failed");
+      return true;
+    }
+    if (symbol == 256) {
+      state = last ? TRAILER : BLOCK;
+      return true;
+    }
+    symbol -= 257;
+    if (symbol >= 29) { fail("bad length symbol"); return true; }
+    uint32_t extra;
+    if (!bits(LEXT[symbol], extra)) return false;
+    uint32_t len = LBASE[symbol] + extra;
+    int dsym = decode(distcode);
+    if (dsym == NEED_INPUT) return false;
+    if (dsym < 0 || dsym >= 30) { fail("bad distance code"); return true; }
+    if (!bits(DEXT[dsym], extra)) return false;
+    uint32_t dist = DBASE[dsym] + extra;
+    if (dist > window.total()) { fail("distance before start"); return true; }
+    if (dist > window.size()) { fail("distance beyond window, recompress with a smaller window"); return true; }
+    while (len--) {
+      if (!emit(window.back(dist))) { fail("flash write failed"); return true; }
+    }
+    return true;
+  }
+
+  bool readTrailer() {
+    uint32_t lo, hi, sizeLo, sizeHi;
+    alignByte();
+    if (!bits(16, lo) || !bits(16, hi) || !bits(16, sizeLo) || !bits(16, sizeHi)) return false;
+    if ((lo | hi << 16) != (crc ^ 0xFFFFFFFFUL)) { fail("CRC mismatch"); return true; }
+    if ((sizeLo | sizeHi << 16) != (uint32_t)window.total()) { fail("length mismatch"); return true; }
+    state = DONE;
+    return true;
+  }
+
+  // Decode whole units until the staged input runs out
+  void run() {
+    while (!err && state != DONE) {
+      Mark start = mark();
+      bool complete;
+      switch (state) {
+        case HEADER:  complete = readHeader(); break;
+        case BLOCK:   complete = readBlockHeader(); break;
+        case CODES:   complete = readCode(); break;
+        case TRAILER: complete = readTrailer(); break;
+        case STORED: {
+          uint32_t b;
+          complete = true;
+          while (storedLeft && (complete = bits(8, b))) {
+            if (!emit(b)) { fail("flash write failed"); break; }
+            storedLeft--;
+          }
+          if (complete && !storedLeft) state = last ? TRAILER : BLOCK;
+          if (!complete) return;            // Bytes already emitted stay consumed
+          continue;
+        }
+        default: complete = true; break;
+      }
+      if (!complete) {
+        rewind(start);
+        return;
+      }
+    }
+  }
+
+  OtaWindow window;
+  State state = HEADER;
+  const char *err = nullptr;
+  uint8_t in[OTA_INFLATE_STAGING];
+  size_t inPos = 0, inLen = 0;
+  uint32_t bitBuf = 0;
+  uint8_t bitCnt = 0;
+  uint32_t last = 0;
+  uint32_t storedLeft = 0;
+  uint32_t crc = 0xFFFFFFFFUL;
+  Huffman lencode, distcode;
+  uint8_t lengths[288 + 32];
+};
+
+/**
+ * heatshrink decoder. Every field fits the bit buffer, so it simply
+ * resumes where the previous piece of input stopped.
+ */
+class HeatshrinkDecoder {
+public:
+  HeatshrinkDecoder(uint8_t windowBits, uint8_t lookaheadBits, OtaSink sink, void *context)
+    : window(windowBits), windowBits(windowBits), lookaheadBits(lookaheadBits) {
+    window.setSink(sink, context);
+  }
+
+  // Window and lookahead bits from the 4-byte header; false if invalid
+  static bool parseHeader(const uint8_t *header, uint8_t &windowBits, uint8_t &lookaheadBits) {
+    if (header[0] != 'H' || header[1] != 'S') return false;
+    windowBits = header[2];
+    lookaheadBits = header[3];
+    return windowBits >= 4 && windowBits <= OTA_HEATSHRINK_MAX_WINDOW_BITS &&
+           lookaheadBits >= 3 && lookaheadBits < windowBits;
+  }
+
+  bool ok() const { return window.ok(); }
+  const char *error() const { return err; }
+  uint64_t total() const { return window.total(); }
+
+  OtaDecodeResult write(const uint8_t *data, size_t len) {
+    if (err) return OTA_DECODE_ERROR;
+    const uint8_t *end = data + len;
+    for (;;) {
+      uint8_t need = state == TAG ? 1 : state == LITERAL ? 8 : state == INDEX ? windowBits : lookaheadBits;
+      while (bitCnt < need && data < end) {
+        bitBuf = bitBuf << 8 | *data++;
+        bitCnt += 8;
+      }
+      if (bitCnt < need) break;
+      uint32_t value = (bitBuf >> (bitCnt - need)) & ((1UL << need) - 1);
+      bitCnt -= need;
+      switch (state) {
+        case TAG:
+          state = value ? LITERAL : INDEX;
+          break;
+        case LITERAL:
+          if (!window.put(value)) return fail("flash write failed");
+          state = TAG;
+          break;
+        case INDEX:
+          distance = value + 1;
+          state = COUNT;
+          break;
+        case COUNT:
+          if (!window.copy(distance, value + 1)) return fail("flash write failed");
+          state = TAG;
+          break;
+      }
+    }
+    return window.flush() ? OTA_DECODE_MORE : fail("flash write failed");
+  }
+
+  // Only the zero padding of the last byte may be left over
+  bool finish() {
+    if (!err && state != TAG && state != INDEX) fail("truncated stream");
+    return !err;
+  }
+
+private:
+  enum State : uint8_t { TAG, LITERAL, INDEX, COUNT };
+
+  OtaDecodeResult fail(const char *message) {
+    if (!err) err = message;
+    return OTA_DECODE_ERROR;
+  }
+
+  OtaWindow window;
+  uint8_t windowBits, lookaheadBits;
+  State state = TAG;
+  const char *err = nullptr;
+  uint32_t bitBuf = 0;
+  uint8_t bitCnt = 0;
+  uint32_t distance = 0;
+};
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+/*************************************************************
+  Streaming firmware update
+
+  Takes an upload piece by piece: the first bytes tell a raw ESP
+  image (0xE9) from a gzip or heatshrink one, compressed images are
+  decompressed on the fly, and the image is hashed and written to
+  the inactive partition as it comes out. Nothing else is held, so
+  sampling and the web server keep running while the new image goes
+  in. finish() checks the SHA-256 (when the uploader gave one)
+  before the partition is made bootable.
+
+  Not thread safe: call from the task that receives the upload.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <new>
+
+#include "hal.h"
+#include "ota_decoder.h"
+#include "sha256.h"
+
+#define OTA_IMAGE_MAGIC 0xE9       // First byte of an ESP application image
+#define OTA_RESULT_JSON 320
+
+enum OtaFormat : uint8_t {
+  OTA_FORMAT_UNKNOWN,
+  OTA_FORMAT_RAW,
+  OTA_FORMAT_GZIP,
+  OTA_FORMAT_HEATSHRINK
+};
+
+static const char *const OTA_FORMAT_NAMES[] = { "unknown", "raw", "gzip", "heatshrink" };
+
+class OtaUpdate {
+public:
+  explicit OtaUpdate(FirmwareHal &firmware) : firmware(firmware) {}
+
+  /**
+   * Start an upload. expectedSha is the SHA-256 of the decompressed
+   * image, or nullptr to skip the check (not allowed for heatshrink).
+   * False if the partition is busy (e.g. an ElegantOTA upload is
+   * running).
+   */
+  bool begin(uint32_t nowMs, const uint8_t *expectedSha) {
+    if (running) return false;
+    release();
+    err = nullptr;
+    fmt = OTA_FORMAT_UNKNOWN;
+    headLen = 0;
+    receivedBytes = writtenBytes = 0;
+    startMs = nowMs;
+    elapsed = 0;
+    checkSha = expectedSha != nullptr;
+    if (checkSha) memcpy(expected, expectedSha, sizeof(expected));
+    sha.begin();
+    if (!firmware.begin()) {
+      err = "flash busy";
+      return false;
+    }
+    running = true;
+    return true;
+  }
+
+  // Next piece of the upload; false once the update has failed
+  bool write(const uint8_t *data, size_t len) {
+    if (!running) return false;
+    receivedBytes += len;
+    while (fmt == OTA_FORMAT_UNKNOWN && len > 0) {
+      head[headLen++] = *data++;
+      len--;
+      if (headLen < sizeof(head)) continue;
+      if (!detect()) return false;
+      // heatshrink's header is not part of its bitstream
+      if (fmt != OTA_FORMAT_HEATSHRINK && !feed(head, sizeof(head))) return false;
+    }
+    return len == 0 || feed(data, len);
+  }
+
+  /**
+   * End of the upload: checks the stream and the hash, then makes the
+   * image bootable. False (with error()) if anything did not add up.
+   */
+  bool finish(uint32_t nowMs) {
+    if (!running) return false;
+    elapsed = nowMs - startMs;
+    if (fmt == OTA_FORMAT_UNKNOWN) return fail("image too short");
+    if (gzip && !gzip->finish()) return fail(gzip->error());
+    if (heatshrink && !heatshrink->finish()) return fail(heatshrink->error());
+    sha.finish(actual);
+    if (checkSha && memcmp(actual, expected, sizeof(actual)) != 0) return fail("SHA-256 mismatch");
+    release();
+    running = false;
+    if (!firmware.end()) {
+      err = "image rejected";
+      return false;
+    }
+    return true;
+  }
+
+  // Drop a running update, e.g. when the uploader disconnects
+  void abort(const char *reason) {
+    if (running) fail(reason);
+  }
+
+  bool active() const { return running; }
+  const char *error() const { return err; }
+  OtaFormat format() const { return fmt; }
+  uint32_t received() const { return receivedBytes; }
+  uint32_t written() const { return writtenBytes; }
+  uint32_t elapsedMs() const { return elapsed; }
+  const uint8_t *digest() const { return actual; }
+
+  /**
+   * Transfer time compression saved: the extra image bytes at the
+   * rate the upload actually arrived
+   */
+  uint32_t savedMs() const {
+    if (receivedBytes == 0 || writtenBytes <= receivedBytes) return 0;
+    return (uint32_t)((uint64_t)elapsed * (writtenBytes - receivedBytes) / receivedBytes);
+  }
+
+private:
+  bool fail(const char *reason) {
+    if (!err) err = reason ? reason : "update failed";
+    if (running) firmware.abort();
+    running = false;
+    release();
+    return false;
+  }
+
+  void release() {
+    gzip.reset();
+    heatshrink.reset();
+  }
+
+  bool detect() {
+    if (head[0] == OTA_IMAGE_MAGIC) {
+      fmt = OTA_FORMAT_RAW;
+      return true;
+    }
+    if (head[0] == 0x1F && head[1] == 0x8B) {
+      fmt = OTA_FORMAT_GZIP;
+      gzip.reset(new (std::nothrow) GzipDecoder(OTA_GZIP_WINDOW_BITS, sink, this));
+      return (gzip && gzip->ok()) || fail("out of memory");
+    }
+    uint8_t windowBits, lookaheadBits;
+    if (HeatshrinkDecoder::parseHeader(head, windowBits, lookaheadBits)) {
+      fmt = OTA_FORMAT_HEATSHRINK;
+      // No checksum of its own, only the hash catches corruption
+      if (!checkSha) return fail("heatshrink needs sha256");
+      heatshrink.reset(new (std::nothrow) HeatshrinkDecoder(windowBits, lookaheadBits, sink, this));
+      return (heatshrink && heatshrink->ok()) || fail("out of memory");
+    }
+    return fail("unknown image format");
+  }
+
+  bool feed(const uint8_t *data, size_t len) {
+    if (len == 0) return true;
+    switch (fmt) {
+      case OTA_FORMAT_RAW:
+        return sink(data, len, this) || fail("flash write failed");
+      case OTA_FORMAT_GZIP:
+        return gzip->write(data, len) != OTA_DECODE_ERROR || fail(gzip->error());
+      case OTA_FORMAT_HEATSHRINK:
+        return heatshrink->write(data, len) != OTA_DECODE_ERROR || fail(heatshrink->error());
+      default:
+        return fail("unknown image format");
+    }
+  }
+
+  static bool sink(const uint8_t *data, size_t len, void *context) {
+    OtaUpdate *self = static_cast<OtaUpdate *>(context);
+    self->sha.update(data, len);
+    self->writtenBytes += len;
+    return self->firmware.write(data, len);
+  }
+
+  FirmwareHal &firmware;
+  bool running = false;
+  const char *err = nullptr;
+  OtaFormat fmt = OTA_FORMAT_UNKNOWN;
+  uint8_t head[OTA_HEATSHRINK_HEADER_LEN];
+  size_t headLen = 0;
+  std::unique_ptr<GzipDecoder> gzip;
+  std::unique_ptr<HeatshrinkDecoder> heatshrink;
+  Sha256 sha;
+  bool checkSha = false;
+  uint8_t expected[SHA256_DIGEST_LEN];
+  uint8_t actual[SHA256_DIGEST_LEN] = {};
+  uint32_t receivedBytes = 0, writtenBytes = 0;
+  uint32_t startMs = 0, elapsed = 0;
+};
+
+/**
+ * {"ok":..,"format":..,"received":..,"image":..,"ms":..,"savedMs":..,
+ *  "sha256":..,"error":..} for the uploader
+ */
+inline size_t serializeOtaResult(char *buf, size_t len, const OtaUpdate &ota, bool ok) {
+  char hex[SHA256_HEX_LEN];
+  sha256Hex(ota.digest(), hex);
+  int n = snprintf(buf, len,
+                   "{\"ok\":%s,\"format\":\"%s\",\"received\":%lu,\"image\":%lu,"
+                   "\"ms\":%lu,\"savedMs\":%lu,\"sha256\":\"%s\",\"error\":",
+                   ok ? "true" : "false", OTA_FORMAT_NAMES[ota.format()],
+                   (unsigned long)ota.received(), (unsigned long)ota.written(),
+                   (unsigned long)ota.elapsedMs(), (unsigned long)ota.savedMs(),
+                   ok ? hex : "");
+  if (n < 0 || (size_t)n >= len) return 0;
+  int m = ota.error() ? snprintf(buf + n, len - n, "\"%s\"}", ota.error())
+                      : snprintf(buf + n, len - n, "null}");
+  if (m < 0 || (size_t)(n + m) >= len) return 0;
+  return n + m;
+}
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef POWER_MODE_H
+#define POWER_MODE_H
+
+/*************************************************************
+  Adaptive sampling / power mode
+
+  The sauna is cold most of the time, so outside a session the
+  device samples slowly with WiFi in deep modem sleep, automatic
+  light sleep and a dimmed OLED (IDLE). It switches to 2 s
+  sampling (ACTIVE) as soon as the temperature climbs fast enough
+  to look like a heat-up, and drops back once no session is
+  running and the temperature has been flat for a while.
+
+  Time per mode and an estimated average current are tracked so
+  the savings can be checked against a bench meter. The current
+  figures below are estimates for an ESP32-C3 with an SSD1306;
+  calibrate them with a meter for a specific board.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sauna_state.h"
+#include "json_writer.h"
+
+#define POWER_ACTIVE_PERIOD_MS   2000
+#define POWER_IDLE_PERIOD_MS     30000
+#define POWER_HEATUP_SLOPE       0.5f      // °C per minute that counts as heating up
+#define POWER_SLOPE_WINDOW_MS    60000UL   // Slope measured over at least a minute
+#define POWER_IDLE_HOLD_MS       600000UL  // Flat for 10 min before going idle
+
+// Current model (mA)
+#define POWER_CPU_AWAKE_MA       22.0f     // CPU running at 160 MHz
+#define POWER_CPU_SLEEP_MA       0.8f      // Automatic light sleep between samples
+#define POWER_WIFI_ACTIVE_MA     8.0f      // Station, minimum modem sleep (average)
+#define POWER_WIFI_IDLE_MA       2.0f      // Station, maximum modem sleep
+#define POWER_OLED_ACTIVE_MA     9.0f
+#define POWER_OLED_IDLE_MA       3.0f      // Dimmed
+
+enum PowerMode : uint8_t {
+  POWER_MODE_ACTIVE,
+  POWER_MODE_IDLE
+};
+
+class PowerManager {
+public:
+  /**
+   * Feed one valid reading taken at nowMs together with the session
+   * state after it. Returns true if the mode changed.
+   */
+  bool update(float temperature, const SaunaState &sauna, uint32_t nowMs) {
+    // Sample-to-sample differences are mostly sensor noise at 2 s,
+    // so the slope is taken against a reference at least a window old
+    if (!haveRef) {
+      refTemp = temperature;
+      refMs = nowMs;
+      haveRef = true;
+    } else if (nowMs - refMs >= POWER_SLOPE_WINDOW_MS) {
+      lastSlope = (temperature - refTemp) * 60000.0f / (float)(nowMs - refMs);
+      refTemp = temperature;
+      refMs = nowMs;
+    }
+    float slope = lastSlope;
+
+    // Heat-up: a fast climb, or a slower one the session detector is already tracking
+    bool heating = slope >= POWER_HEATUP_SLOPE ||
+                   (sauna.rising && slope >= POWER_HEATUP_SLOPE / 2);
+    if (sauna.active || heating) quietSinceMs = nowMs;
+
+    PowerMode want = current;
+    if (current == POWER_MODE_IDLE && (sauna.active || heating)) {
+      want = POWER_MODE_ACTIVE;
+    } else if (current == POWER_MODE_ACTIVE && nowMs - quietSinceMs >= POWER_IDLE_HOLD_MS) {
+      want = POWER_MODE_IDLE;
+    }
+    return setMode(want, nowMs);
+  }
+
+  /**
+   * Account the time spent doing work (awake) in the current mode,
+   * used for the duty-cycle estimate
+   */
+  void addAwake(uint32_t micros) { awakeUs[current] += micros; }
+
+  // Bring the mode time up to nowMs; call before reading the stats
+  void tick(uint32_t nowMs) {
+    modeMs[current] += nowMs - sinceMs;
+    sinceMs = nowMs;
+  }
+
+  void begin(PowerMode mode, uint32_t nowMs) {
+    current = mode;
+    sinceMs = quietSinceMs = nowMs;
+  }
+
+  PowerMode mode() const { return current; }
+  uint32_t periodMs() const {
+    return current == POWER_MODE_IDLE ? POWER_IDLE_PERIOD_MS : POWER_ACTIVE_PERIOD_MS;
+  }
+  float slope() const { return lastSlope; }
+  uint32_t transitions() const { return switches; }
+  uint64_t timeInMode(PowerMode mode) const { return modeMs[mode]; }
+
+  // Fraction of the time the CPU was awake in a mode (0..1)
+  float dutyCycle(PowerMode mode) const {
+    if (modeMs[mode] == 0) return 0;
+    float duty = (float)awakeUs[mode] / 1000.0f / (float)modeMs[mode];
+    return duty > 1 ? 1 : duty;
+  }
+
+  // Estimated average current of a mode, CPU asleep outside its duty cycle
+  float modeCurrentMa(PowerMode mode, bool lightSleep) const {
+    float duty = dutyCycle(mode);
+    float cpuSleep = lightSleep && mode == POWER_MODE_IDLE ? POWER_CPU_SLEEP_MA : POWER_CPU_AWAKE_MA;
+    float cpu = duty * POWER_CPU_AWAKE_MA + (1 - duty) * cpuSleep;
+    if (mode == POWER_MODE_IDLE) return cpu + POWER_WIFI_IDLE_MA + POWER_OLED_IDLE_MA;
+    return cpu + POWER_WIFI_ACTIVE_MA + POWER_OLED_ACTIVE_MA;
+  }
+
+  // Estimated average current over the whole uptime
+  float averageCurrentMa(bool lightSleep) const {
+    uint64_t total = modeMs[POWER_MODE_ACTIVE] + modeMs[POWER_MODE_IDLE];
+    if (total == 0) return modeCurrentMa(current, lightSleep);
+    return (modeCurrentMa(POWER_MODE_ACTIVE, lightSleep) * modeMs[POWER_MODE_ACTIVE] +
+            modeCurrentMa(POWER_MODE_IDLE, lightSleep) * modeMs[POWER_MODE_IDLE]) / total;
+  }
+
+private:
+  bool setMode(PowerMode mode, uint32_t nowMs) {
+    if (mode == current) return false;
+    tick(nowMs);
+    current = mode;
+    switches++;
+    return true;
+  }
+
+  PowerMode current = POWER_MODE_ACTIVE;
+  uint32_t sinceMs = 0;
+  uint32_t quietSinceMs = 0;
+  bool haveRef = false;
+  float refTemp = 0;
+  uint32_t refMs = 0;
+  float lastSlope = 0;                 // °C per minute
+  uint32_t switches = 0;
+  uint64_t modeMs[2] = { 0, 0 };
+  uint64_t awakeUs[2] = { 0, 0 };
+};
+
+/**
+ * The mode as other tasks see it. PowerManager belongs to the task
+ * that samples; the network task and the display read a copy of this
+ * through a SeqLock (snapshot.h) instead of the manager itself.
+ */
+struct PowerStatus {
+  PowerMode mode;
+  uint32_t periodMs;     // Sample period of the mode
+  float slope;           // °C per minute
+};
+
+inline PowerStatus powerStatus(const PowerManager &power) {
+  PowerStatus status;
+  status.mode = power.mode();
+  status.periodMs = power.periodMs();
+  status.slope = power.slope();
+  return status;
+}
+
+/**
+ * Write the /power JSON body. Call tick() first.
+ */
+inline size_t serializePowerStats(char *buf, size_t len, const PowerManager &power,
+                                  bool lightSleep) {
+  JsonWriter w(buf, len);
+  w.beginObject();
+  w.key("mode");
+  w.string(power.mode() == POWER_MODE_IDLE ? "idle" : "active");
+  w.key("periodMs");
+  w.uinteger(power.periodMs());
+  w.key("slope");
+  w.fixed(power.slope(), 2);
+  w.key("lightSleep");
+  w.boolean(lightSleep);
+  w.key("transitions");
+  w.uinteger(power.transitions());
+
+  const PowerMode modes[2] = { POWER_MODE_ACTIVE, POWER_MODE_IDLE };
+  const char *names[2] = { "active", "idle" };
+  for (size_t i = 0; i < 2; i++) {
+    w.key(names[i]);
+    w.beginObject();
+    w.key("seconds");
+    w.uinteger((uint32_t)(power.timeInMode(modes[i]) / 1000));
+    w.key("dutyPercent");
+    w.fixed(power.dutyCycle(modes[i]) * 100.0f, 3);
+    w.key("currentMa");
+    w.fixed(power.modeCurrentMa(modes[i], lightSleep), 2);
+    w.endObject();
+  }
+
+  w.key("averageCurrentMa");
+  w.fixed(power.averageCurrentMa(lightSleep), 2);
+  w.endObject();
+  return w.length();
+}
+
+#endif
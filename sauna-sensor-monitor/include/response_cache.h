@@ -0,0 +1,98 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+/*************************************************************
+  Serialize-once response cache
+
+  Polled bodies like /data only change with a new sample. The
+  cache keeps the body of the latest sample and hands it out as a
+  shared, immutable buffer: every request until the next sample
+  reuses it, and a response still being sent keeps its buffer
+  alive through the reference count. The buffer is rebuilt in
+  place when no response holds it any more, so the steady state
+  allocates nothing.
+
+  The ETag is "<boot id>-<sequence>-<tag>", so a client that sends
+  it back in If-None-Match gets a 304 without the body being built
+  at all. Call from one task (the AsyncTCP task on the device).
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+
+#define RESPONSE_CACHE_BODY_MAX 640
+#define RESPONSE_CACHE_ETAG_LEN 24
+
+struct CachedBody {
+  uint32_t seq;                          // Sample the body was built from
+  size_t len;
+  char etag[RESPONSE_CACHE_ETAG_LEN];
+  uint8_t data[RESPONSE_CACHE_BODY_MAX];
+};
+
+class ResponseCache {
+public:
+  /**
+   * bootId keeps ETags from colliding across reboots, tag tells the
+   * cached variants of one URL apart (e.g. 'j' JSON, 'c' CBOR)
+   */
+  ResponseCache(uint32_t bootId, char tag) : bootId(bootId), tag(tag) {}
+
+  void setBootId(uint32_t id) {
+    bootId = id;
+    built = false;
+  }
+
+  // ETag of the body for sample seq, quotes included
+  void etagFor(uint32_t seq, char *buf, size_t len) const {
+    snprintf(buf, len, "\"%08lx-%lu-%c\"", (unsigned long)bootId, (unsigned long)seq, tag);
+  }
+
+  /**
+   * True if an If-None-Match header value names the body for seq
+   */
+  bool notModified(const char *ifNoneMatch, uint32_t seq) const {
+    if (!ifNoneMatch || !*ifNoneMatch) return false;
+    char etag[RESPONSE_CACHE_ETAG_LEN];
+    etagFor(seq, etag, sizeof(etag));
+    return strstr(ifNoneMatch, etag) != nullptr || strcmp(ifNoneMatch, "*") == 0;
+  }
+
+  /**
+   * Body for sample seq. build(uint8_t *buf, size_t cap) -> length is
+   * only called when the cached body belongs to an older sample.
+   */
+  template <typename Build>
+  std::shared_ptr<const CachedBody> get(uint32_t seq, Build build) {
+    if (built && body->seq == seq) {
+      hitCount++;
+      return body;
+    }
+    // Responses still sending the old body keep it; otherwise reuse it
+    if (!body || body.use_count() > 1) {
+      body = std::make_shared<CachedBody>();
+      allocationCount++;
+    }
+    body->len = build(body->data, sizeof(body->data));
+    body->seq = seq;
+    etagFor(seq, body->etag, sizeof(body->etag));
+    built = true;
+    buildCount++;
+    return body;
+  }
+
+  uint32_t builds() const { return buildCount; }
+  uint32_t hits() const { return hitCount; }
+  uint32_t allocations() const { return allocationCount; }
+
+private:
+  uint32_t bootId;
+  char tag;
+  bool built = false;
+  std::shared_ptr<CachedBody> body;
+  uint32_t buildCount = 0, hitCount = 0, allocationCount = 0;
+};
+
+#endif
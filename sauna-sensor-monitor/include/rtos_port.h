@@ -0,0 +1,229 @@
+#ifndef RTOS_PORT_H
+#define RTOS_PORT_H
+
+/*************************************************************
+  RTOS port
+
+  The few RTOS primitives the firmware's task graph uses, with
+  two backends:
+  - ESP32: FreeRTOS tasks, queues, semaphores, vTaskDelayUntil
+  - Host:  POSIX threads via <thread>/<mutex>, so the task graph
+           and its timing logic build and run on Linux
+
+  Priorities and stack sizes are honoured on the ESP32 only.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(ESP_PLATFORM)
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+typedef TickType_t RtosTicks;
+typedef TaskHandle_t RtosTask;
+
+inline RtosTicks rtosNow() { return xTaskGetTickCount(); }
+inline uint32_t rtosTicksToMs(RtosTicks t) { return (uint32_t)(t * portTICK_PERIOD_MS); }
+inline void rtosDelay(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+
+/**
+ * Sleep until lastWake + periodMs and advance lastWake by one period,
+ * so the cadence does not drift with the work done in between
+ */
+inline void rtosDelayUntil(RtosTicks *lastWake, uint32_t periodMs) {
+  vTaskDelayUntil(lastWake, pdMS_TO_TICKS(periodMs));
+}
+
+inline bool rtosStartTask(void (*fn)(void *), const char *name, uint32_t stackBytes,
+                          uint8_t priority, void *arg, RtosTask *handle) {
+  return xTaskCreate(fn, name, stackBytes, arg, priority, handle) == pdPASS;
+}
+
+// Last call of a task function that returns; FreeRTOS tasks must not return
+inline void rtosEndTask() { vTaskDelete(NULL); }
+
+// Smallest amount of stack (bytes) the task has had left so far
+inline uint32_t rtosStackHighWater(RtosTask task) {
+  return task ? uxTaskGetStackHighWaterMark(task) : 0;
+}
+
+// Identity and name of the calling task
+inline uintptr_t rtosCurrentTaskId() { return (uintptr_t)xTaskGetCurrentTaskHandle(); }
+inline const char *rtosCurrentTaskName() { return pcTaskGetName(NULL); }
+
+class RtosMutex {
+public:
+  RtosMutex() : handle(xSemaphoreCreateMutex()) {}
+  void lock() { xSemaphoreTake(handle, portMAX_DELAY); }
+  void unlock() { xSemaphoreGive(handle); }
+private:
+  SemaphoreHandle_t handle;
+};
+
+// Binary "something happened" signal, like a task notification
+class RtosSignal {
+public:
+  RtosSignal() : handle(xSemaphoreCreateBinary()) {}
+  void give() { xSemaphoreGive(handle); }
+  bool take(uint32_t timeoutMs) { return xSemaphoreTake(handle, pdMS_TO_TICKS(timeoutMs)) == pdTRUE; }
+private:
+  SemaphoreHandle_t handle;
+};
+
+// Bounded FIFO of trivially copyable items
+template <typename T, size_t N>
+class RtosQueue {
+public:
+  RtosQueue() : handle(xQueueCreate(N, sizeof(T))) {}
+  bool send(const T &item, uint32_t timeoutMs) {
+    return xQueueSend(handle, &item, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+  }
+  bool receive(T &item, uint32_t timeoutMs) {
+    return xQueueReceive(handle, &item, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+  }
+private:
+  QueueHandle_t handle;
+};
+
+#else  // Host build
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+typedef std::chrono::steady_clock::time_point RtosTicks;
+typedef std::thread *RtosTask;
+
+inline RtosTicks rtosNow() { return std::chrono::steady_clock::now(); }
+inline uint32_t rtosTicksToMs(RtosTicks t) {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
+}
+inline void rtosDelay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+inline void rtosDelayUntil(RtosTicks *lastWake, uint32_t periodMs) {
+  *lastWake += std::chrono::milliseconds(periodMs);
+  std::this_thread::sleep_until(*lastWake);
+}
+
+inline bool rtosStartTask(void (*fn)(void *), const char *name, uint32_t stackBytes,
+                          uint8_t priority, void *arg, RtosTask *handle) {
+  (void)name; (void)stackBytes; (void)priority;
+  std::thread *t = new std::thread(fn, arg);
+  if (handle) *handle = t;
+  else t->detach();
+  return true;
+}
+
+inline void rtosEndTask() {}
+
+// Host only: wait for a task started with a handle to return
+inline void rtosJoinTask(RtosTask &task) {
+  if (!task) return;
+  task->join();
+  delete task;
+  task = nullptr;
+}
+
+inline uint32_t rtosStackHighWater(RtosTask) { return 0; }
+
+inline uintptr_t rtosCurrentTaskId() {
+  return (uintptr_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+}
+inline const char *rtosCurrentTaskName() { return "thread"; }
+
+class RtosMutex {
+public:
+  void lock() { m.lock(); }
+  void unlock() { m.unlock(); }
+private:
+  std::mutex m;
+};
+
+class RtosSignal {
+public:
+  void give() {
+    std::lock_guard<std::mutex> guard(m);
+    pending = true;
+    cv.notify_one();
+  }
+  bool take(uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> guard(m);
+    if (!cv.wait_for(guard, std::chrono::milliseconds(timeoutMs), [this] { return pending; })) {
+      return false;
+    }
+    pending = false;
+    return true;
+  }
+private:
+  std::mutex m;
+  std::condition_variable cv;
+  bool pending = false;
+};
+
+template <typename T, size_t N>
+class RtosQueue {
+public:
+  bool send(const T &item, uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> guard(m);
+    if (!notFull.wait_for(guard, std::chrono::milliseconds(timeoutMs), [this] { return count < N; })) {
+      return false;
+    }
+    items[(head + count) % N] = item;
+    count++;
+    notEmpty.notify_one();
+    return true;
+  }
+  bool receive(T &item, uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> guard(m);
+    if (!notEmpty.wait_for(guard, std::chrono::milliseconds(timeoutMs), [this] { return count > 0; })) {
+      return false;
+    }
+    item = items[head];
+    head = (head + 1) % N;
+    count--;
+    notFull.notify_one();
+    return true;
+  }
+private:
+  std::mutex m;
+  std::condition_variable notEmpty, notFull;
+  T items[N];
+  size_t head = 0, count = 0;
+};
+
+#endif
+
+/**
+ * Scoped lock for RtosMutex
+ */
+class RtosLock {
+public:
+  explicit RtosLock(RtosMutex &mutex) : m(mutex) { m.lock(); }
+  ~RtosLock() { m.unlock(); }
+private:
+  RtosMutex &m;
+};
+
+/**
+ * Tracks how late a periodic task wakes relative to its schedule
+ */
+struct PeriodStats {
+  uint32_t periods = 0;
+  uint32_t lastJitterMs = 0;
+  uint32_t maxJitterMs = 0;
+
+  void record(uint32_t expectedMs, uint32_t actualMs) {
+    uint32_t jitter = actualMs - expectedMs;   // Wraparound-safe
+    if (jitter > 0x7FFFFFFFUL) jitter = 0;     // Woke early (tick rounding)
+    lastJitterMs = jitter;
+    if (jitter > maxJitterMs) maxJitterMs = jitter;
+    periods++;
+  }
+};
+
+#endif
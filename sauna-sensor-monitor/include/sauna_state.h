@@ -0,0 +1,266 @@
+#ifndef SAUNA_STATE_H
+#define SAUNA_STATE_H
+
+/*************************************************************
+  Sauna session detection
+
+  Streaming detector, O(1) time and memory per sample, integer
+  arithmetic only:
+  - Temperature is smoothed with an EWMA (level) and the slope is
+    the EWMA of the level's rate of change (trend), i.e. Holt's
+    double exponential smoothing. Both use a time constant, so the
+    2 s and 30 s sampling periods give the same response.
+  - Start: the trend stays at or above startSlope for startHoldMs
+    and the level has risen by startRise since the climb began.
+    The session is dated from the beginning of the climb.
+  - End: the trend stays at or below -endSlope for endHoldMs with
+    the level at least endDrop below the session peak (heater
+    off), or the level falls to 30% of the peak. The session is
+    dated to end where the cool-down began.
+  - Single readings more than spikeLimit away from the level are
+    ignored (up to SAUNA_SPIKE_SAMPLES in a row), so glitches and
+    library fallback values do not start or end sessions.
+
+  Fixed point: temperatures in centi-°C, the level in centi-°C
+  * 256, slopes in centi-°C per minute * 256. Time is a 64-bit
+  monotonic millisecond clock that never wraps.
+
+  Pure logic: the caller supplies the time, so the same code runs
+  on the device and in the host simulator.
+*************************************************************/
+#include <stdint.h>
+
+// Defaults, can be overridden from build_flags
+#ifndef SAUNA_LEVEL_TAU_MS
+#define SAUNA_LEVEL_TAU_MS       20000     // Temperature smoothing time constant
+#endif
+#ifndef SAUNA_SLOPE_TAU_MS
+#define SAUNA_SLOPE_TAU_MS       40000     // Slope smoothing time constant
+#endif
+#ifndef SAUNA_START_SLOPE
+#define SAUNA_START_SLOPE        40        // centi-°C/min (0.4 °C/min)
+#endif
+#ifndef SAUNA_START_HOLD_MS
+#define SAUNA_START_HOLD_MS      60000
+#endif
+#ifndef SAUNA_START_RISE
+#define SAUNA_START_RISE         200       // centi-°C
+#endif
+#ifndef SAUNA_END_SLOPE
+#define SAUNA_END_SLOPE          30        // centi-°C/min
+#endif
+#ifndef SAUNA_END_HOLD_MS
+#define SAUNA_END_HOLD_MS        300000
+#endif
+#ifndef SAUNA_END_DROP
+#define SAUNA_END_DROP           500       // centi-°C below the peak
+#endif
+#ifndef SAUNA_SPIKE_LIMIT
+#define SAUNA_SPIKE_LIMIT        1500      // centi-°C away from the level
+#endif
+#define SAUNA_SPIKE_SAMPLES      2         // Rejected in a row before a jump is believed
+
+struct SaunaConfig {
+  uint32_t levelTauMs = SAUNA_LEVEL_TAU_MS;
+  uint32_t slopeTauMs = SAUNA_SLOPE_TAU_MS;
+  int32_t startSlope = SAUNA_START_SLOPE;   // centi-°C/min
+  uint32_t startHoldMs = SAUNA_START_HOLD_MS;
+  int32_t startRise = SAUNA_START_RISE;     // centi-°C
+  int32_t endSlope = SAUNA_END_SLOPE;       // centi-°C/min, magnitude of the fall
+  uint32_t endHoldMs = SAUNA_END_HOLD_MS;
+  int32_t endDrop = SAUNA_END_DROP;         // centi-°C
+  int32_t spikeLimit = SAUNA_SPIKE_LIMIT;   // centi-°C
+};
+
+struct SaunaState {
+  SaunaConfig config;
+
+  bool active = false;             // True if sauna session is active
+  bool rising = false;             // Sustained climb seen, session not confirmed yet
+  uint64_t startTime = 0;          // When the sauna session started (ms)
+  float highestTemp = 0.0;         // Peak temperature of the current session
+  float humiditySum = 0.0;         // Humidity accumulated over the current session
+  uint32_t humiditySamples = 0;
+  float highestSpread = 0.0;       // Largest bench-to-floor difference of the current session
+
+  // Summary of the last finished session
+  uint32_t lastDuration = 0;       // ms
+  float lastPeakTemp = 0.0;
+  float lastMeanHumidity = 0.0;
+  float lastPeakSpread = 0.0;      // °C, 0 with a single sensor
+  uint32_t lastDetectDelay = 0;    // ms from the real end to its detection
+
+  // Detector state
+  bool primed = false;             // level holds a reading
+  int32_t level = 0;               // centi-°C * 256
+  int32_t slope = 0;               // centi-°C/min * 256
+  uint64_t lastMs = 0;
+  uint64_t riseSince = 0;          // Start of the current climb
+  int32_t riseFrom = 0;            // Level at riseSince
+  bool cooling = false;
+  uint64_t coolSince = 0;          // Start of the current fall
+  int32_t peakLevel = 0;           // Highest level of the session
+  uint8_t spikes = 0;              // Consecutive rejected readings
+  uint32_t rejected = 0;           // Rejected readings in total
+};
+
+enum SaunaEvent : uint8_t {
+  SAUNA_EVENT_NONE,
+  SAUNA_EVENT_STARTED,
+  SAUNA_EVENT_ENDED
+};
+
+// Weight dt / (tau + dt) of a time-constant EWMA, Q16
+inline int32_t saunaAlpha(uint64_t dtMs, uint32_t tauMs) {
+  if (dtMs >= 0xFFFFFFFFULL - tauMs) return 65536;
+  return (int32_t)((dtMs << 16) / (dtMs + tauMs));
+}
+
+inline int32_t saunaEwma(int32_t value, int32_t target, int32_t alphaQ16) {
+  return value + (int32_t)(((int64_t)(target - value) * alphaQ16) >> 16);
+}
+
+inline float saunaLevelC(const SaunaState &state) { return state.level / 25600.0f; }
+inline float saunaSlopeCPerMin(const SaunaState &state) { return state.slope / 25600.0f; }
+
+/**
+ * Feed one valid reading taken at nowMs (64-bit monotonic ms). With
+ * several sensors currentTemp is their aggregate and spread the
+ * difference between the hottest and coldest (sensorSpread()).
+ * Returns whether a session started or ended with this reading.
+ */
+inline SaunaEvent updateSaunaState(SaunaState &state, float currentTemp, float humidity,
+                                   uint64_t nowMs, float spread = 0.0f) {
+  const SaunaConfig &cfg = state.config;
+  float centiF = currentTemp * 100.0f;
+  int32_t centi = (int32_t)(centiF + (centiF >= 0 ? 0.5f : -0.5f));
+  int32_t sample = centi * 256;
+
+  if (!state.primed) {
+    state.primed = true;
+    state.level = sample;
+    state.slope = 0;
+    state.lastMs = nowMs;
+    return SAUNA_EVENT_NONE;
+  }
+
+  // Isolated outliers never reach the filters
+  int32_t jump = centi - state.level / 256;
+  if ((jump > cfg.spikeLimit || jump < -cfg.spikeLimit) && state.spikes < SAUNA_SPIKE_SAMPLES) {
+    state.spikes++;
+    state.rejected++;
+    return SAUNA_EVENT_NONE;
+  }
+  state.spikes = 0;
+
+  uint64_t dt = nowMs - state.lastMs;
+  if (dt == 0) return SAUNA_EVENT_NONE;
+  state.lastMs = nowMs;
+
+  int32_t prevLevel = state.level;
+  state.level = saunaEwma(state.level, sample, saunaAlpha(dt, cfg.levelTauMs));
+  int64_t rate = (int64_t)(state.level - prevLevel) * 60000 / (int64_t)dt;
+  state.slope = saunaEwma(state.slope, (int32_t)rate, saunaAlpha(dt, cfg.slopeTauMs));
+  int32_t slopeCenti = state.slope / 256;
+  int32_t levelCenti = state.level / 256;
+
+  if (!state.active) {
+    // Track the current climb; any flattening restarts it
+    if (slopeCenti < cfg.startSlope) {
+      state.rising = false;
+      return SAUNA_EVENT_NONE;
+    }
+    if (!state.rising) {
+      state.rising = true;
+      state.riseSince = nowMs;
+      state.riseFrom = prevLevel / 256;
+    }
+    if (nowMs - state.riseSince < cfg.startHoldMs ||
+        levelCenti - state.riseFrom < cfg.startRise) {
+      return SAUNA_EVENT_NONE;
+    }
+    state.active = true;
+    state.rising = false;
+    state.cooling = false;
+    state.startTime = state.riseSince;
+    state.peakLevel = levelCenti;
+    state.highestTemp = currentTemp;
+    state.highestSpread = spread;
+    state.humiditySum = humidity;
+    state.humiditySamples = 1;
+    return SAUNA_EVENT_STARTED;
+  }
+
+  // If sauna is active, track highest temp and check for cooldown
+  if (currentTemp > state.highestTemp) state.highestTemp = currentTemp;
+  if (spread > state.highestSpread) state.highestSpread = spread;
+  if (levelCenti > state.peakLevel) state.peakLevel = levelCenti;
+
+  if (slopeCenti <= -cfg.endSlope) {
+    if (!state.cooling) {
+      state.cooling = true;
+      state.coolSince = nowMs;
+    }
+  } else {
+    state.cooling = false;
+  }
+
+  bool heaterOff = state.cooling && nowMs - state.coolSince >= cfg.endHoldMs &&
+                   levelCenti <= state.peakLevel - cfg.endDrop;
+  bool cold = levelCenti * 10 <= state.peakLevel * 3;
+  if (heaterOff || cold) {
+    uint64_t endMs = state.cooling ? state.coolSince : nowMs;
+    state.active = false;
+    state.cooling = false;
+    state.lastDuration = (uint32_t)(endMs - state.startTime);
+    state.lastDetectDelay = (uint32_t)(nowMs - endMs);
+    state.lastPeakTemp = state.highestTemp;
+    state.lastMeanHumidity = state.humiditySum / state.humiditySamples;
+    state.lastPeakSpread = state.highestSpread;
+
+    // Reset tracking
+    state.highestTemp = 0.0f;
+    state.highestSpread = 0.0f;
+    return SAUNA_EVENT_ENDED;
+  }
+  state.humiditySum += humidity;
+  state.humiditySamples++;
+  return SAUNA_EVENT_NONE;
+}
+
+/**
+ * The session as other tasks see it. SaunaState belongs to the task
+ * that feeds the detector; everyone else reads a copy of this through
+ * a SeqLock (snapshot.h), since the 64-bit start time can be read torn
+ * on a 32-bit core.
+ */
+struct SaunaStatus {
+  bool active;           // Session running
+  uint64_t startTime;    // ms, when it started; meaningful while active
+  float levelC;          // Smoothed temperature, °C
+  float slopeCPerMin;    // Its trend
+  uint32_t rejected;     // Readings rejected as spikes so far
+};
+
+inline SaunaStatus saunaStatus(const SaunaState &state) {
+  SaunaStatus status;
+  status.active = state.active;
+  status.startTime = state.startTime;
+  status.levelC = saunaLevelC(state);
+  status.slopeCPerMin = saunaSlopeCPerMin(state);
+  status.rejected = state.rejected;
+  return status;
+}
+
+/**
+ * Elapsed session time in ms (0 when no session)
+ */
+inline uint32_t saunaSessionMillis(const SaunaStatus &status, uint64_t nowMs) {
+  return status.active ? (uint32_t)(nowMs - status.startTime) : 0;
+}
+
+inline uint32_t saunaSessionMillis(const SaunaState &state, uint64_t nowMs) {
+  return saunaSessionMillis(saunaStatus(state), nowMs);
+}
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef SERIES_STORE_H
+#define SERIES_STORE_H
+
+/*************************************************************
+  Compressed raw sample archive
+
+  Keeps every sample (time, temperature and humidity in
+  centi-units) in a fixed amount of RAM, Gorilla style:
+  samples are bit-packed into fixed-size blocks, each sample as
+  - time: delta of the previous delta, so a steady cadence costs
+    one bit ('0'; '10' + 7 bits; '110' + 9; '1110' + 12; '1111' + 32)
+  - temperature, humidity: change from the previous sample ('0';
+    '10' + 4 bits; '110' + 6; '1110' + 9; '1111' + the 16-bit value)
+  The first sample of a block is kept whole in the block index,
+  next to its time and sequence number, so a time or sequence seek
+  is a binary search over the index plus decoding one block.
+  Lossless: samples come back exactly as they went in.
+
+  Capacity: the recorded traces take about 1.65 bytes per sample
+  with the index (simulator --bench), so the default 240 blocks
+  hold about 39,000 samples. That is 22 h of continuous 2 s
+  sampling, 13 days at the 30 s idle cadence, or about five days
+  of a few heated hours a day with the rest idle.
+
+  Blocks form a ring; when it is full the oldest block (a few
+  hundred samples) is dropped. Sequence numbers count samples from
+  clear() and never repeat, like the history rings. No heap.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef SERIES_BLOCK_BYTES
+#define SERIES_BLOCK_BYTES  256     // Decoding one block bounds a seek
+#endif
+#ifndef SERIES_BLOCKS
+#define SERIES_BLOCKS       240     // 60 KB of samples, 64 KB with the index
+#endif
+#define SERIES_RAM_BUDGET   65536   // Hard upper bound in bytes
+#define SERIES_READ_CURSORS 4       // Exports that can read on without a fresh seek
+
+struct SeriesSample {
+  uint32_t time;
+  int16_t temp;                   // Centi-units
+  int16_t hum;
+};
+
+template <size_t Blocks, size_t BlockBytes>
+class SeriesStore {
+public:
+  static_assert(Blocks >= 2, "SeriesStore needs at least two blocks");
+  static_assert(BlockBytes >= 16 && BlockBytes * 8 < 65536, "SeriesStore block size out of range");
+
+  void append(uint32_t time, int16_t temp, int16_t hum) {
+    if (open) {
+      uint32_t delta = time - tail.time;
+      int32_t dod = (int32_t)(delta - tail.delta);
+      int32_t dTemp = (int32_t)temp - tail.temp;
+      int32_t dHum = (int32_t)hum - tail.hum;
+      uint8_t cTime = codeClass(dod, TIME_WIDTHS);
+      uint8_t cTemp = codeClass(dTemp, VALUE_WIDTHS);
+      uint8_t cHum = codeClass(dHum, VALUE_WIDTHS);
+      size_t bits = codeBits(cTime, TIME_WIDTHS) + codeBits(cTemp, VALUE_WIDTHS) +
+                    codeBits(cHum, VALUE_WIDTHS);
+      if (tail.bitPos + bits <= BlockBytes * 8) {
+        uint8_t *data = blocks[tail.block % Blocks];
+        putCode(data, tail.bitPos, cTime, (uint32_t)dod, TIME_WIDTHS);
+        putCode(data, tail.bitPos, cTemp, cTemp == 4 ? (uint16_t)temp : (uint32_t)dTemp, VALUE_WIDTHS);
+        putCode(data, tail.bitPos, cHum, cHum == 4 ? (uint16_t)hum : (uint32_t)dHum, VALUE_WIDTHS);
+        index[tail.block % Blocks].count++;
+        tail.time = time;
+        tail.delta = delta;
+        tail.temp = temp;
+        tail.hum = hum;
+        pushed++;
+        return;
+      }
+    }
+    startBlock(time, temp, hum);
+  }
+
+  /**
+   * Close the block being filled; the next sample starts a new one.
+   * Used where the clock jumps, so no block spans the jump.
+   */
+  void seal() { open = false; }
+
+  /**
+   * Add offset to the times of the blocks that start before `before`
+   * (as History::rebase()). Seals the open block first, so it must
+   * hold only times before `before`. Returns the samples changed.
+   */
+  size_t rebase(uint32_t before, uint32_t offset) {
+    seal();
+    cursorCount = 0;          // Their times have moved
+    size_t changed = 0;
+    for (uint32_t b = firstBlock; b != nextBlock; b++) {
+      BlockInfo &info = index[b % Blocks];
+      if (info.firstTime >= before) break;
+      info.firstTime += offset;
+      changed += info.count;
+    }
+    return changed;
+  }
+
+  size_t size() const { return pushed - firstSeq(); }
+  uint32_t firstSeq() const { return firstBlock == nextBlock ? pushed : index[firstBlock % Blocks].firstSeq; }
+  uint32_t nextSeq() const { return pushed; }
+
+  // Time of the oldest sample, 0 when empty
+  uint32_t firstTime() const { return firstBlock == nextBlock ? 0 : index[firstBlock % Blocks].firstTime; }
+
+  // Bytes in use: blocks with samples (the open one to its last byte) and their index entries
+  size_t usedBytes() const {
+    size_t live = nextBlock - firstBlock;
+    if (live == 0) return 0;
+    size_t full = open ? live - 1 : live;
+    size_t last = open ? (tail.bitPos + 7) / 8 : 0;
+    return full * BlockBytes + last + live * sizeof(BlockInfo);
+  }
+
+  static constexpr size_t capacityBytes() { return Blocks * (BlockBytes + sizeof(BlockInfo)); }
+
+  /**
+   * Copy up to maxPoints samples starting at sequence number seq into
+   * out, oldest first. Samples already dropped are skipped; *first
+   * receives the sequence number of out[0]. Reading on from where an
+   * earlier call stopped (as an export does) continues decoding where
+   * it left off, for up to SERIES_READ_CURSORS exports at once;
+   * anywhere else costs a seek.
+   */
+  size_t read(uint32_t seq, SeriesSample *out, size_t maxPoints, uint32_t *first) const {
+    uint32_t oldest = firstSeq();
+    if ((int32_t)(seq - oldest) < 0) seq = oldest;
+    *first = seq;
+    if ((int32_t)(seq - pushed) >= 0) return 0;
+    uint8_t slot = 0;
+    while (slot < cursorCount && (cursors[slot].seq != seq || !live(cursors[slot].block))) slot++;
+    if (slot == cursorCount) {
+      if (cursorCount < SERIES_READ_CURSORS) cursorCount++;
+      slot = replaceCursor;   // Oldest seek first
+      replaceCursor = (replaceCursor + 1) % SERIES_READ_CURSORS;
+      cursors[slot] = seek(seq);
+    }
+    Cursor &cursor = cursors[slot];
+    size_t written = 0;
+    while (written < maxPoints && next(cursor, out[written])) written++;
+    return written;
+  }
+
+  // Sequence number of the first sample with time > after (nextSeq if none)
+  uint32_t seqAfter(uint32_t after) const {
+    if (firstBlock == nextBlock) return pushed;
+    // Last block starting at or before `after`; samples after it are all later
+    uint32_t lo = firstBlock, hi = nextBlock;
+    while (hi - lo > 1) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (index[mid % Blocks].firstTime <= after) lo = mid;
+      else hi = mid;
+    }
+    if (index[lo % Blocks].firstTime > after) return index[lo % Blocks].firstSeq;
+    Cursor c = startOf(lo);
+    SeriesSample s;
+    while (c.block == lo && next(c, s)) {
+      if (s.time > after) return c.seq - 1;
+    }
+    return c.seq;
+  }
+
+  // Drop everything; sequence numbers go on from firstSeq (the simulator tests the wrap)
+  void clear(uint32_t firstSeq = 0) {
+    firstBlock = nextBlock = 0;
+    pushed = firstSeq;
+    open = false;
+    cursorCount = 0;
+    replaceCursor = 0;
+  }
+
+private:
+  struct BlockInfo {
+    uint32_t firstTime;
+    uint32_t firstSeq;
+    uint16_t count;               // Samples in the block, the first one included
+    int16_t firstTemp, firstHum;
+  };
+
+  // Decoding position: the sample after (block, index)
+  struct Cursor {
+    uint32_t block;               // Counts blocks since clear(), slot is block % Blocks
+    uint32_t seq;                 // Of the next sample
+    uint16_t index;               // Samples of the block decoded so far
+    size_t bitPos;
+    uint32_t time, delta;
+    int16_t temp, hum;
+  };
+
+  // Payload widths per code class; class 0 is the value 0, class 4 the escape
+  static constexpr uint8_t TIME_WIDTHS[5] = { 0, 7, 9, 12, 32 };
+  static constexpr uint8_t VALUE_WIDTHS[5] = { 0, 4, 6, 9, 16 };
+
+  void startBlock(uint32_t time, int16_t temp, int16_t hum) {
+    if (nextBlock - firstBlock == Blocks) {
+      firstBlock++;               // Drop the oldest
+    }
+    size_t slot = nextBlock % Blocks;
+    memset(blocks[slot], 0, BlockBytes);
+    BlockInfo &info = index[slot];
+    info.firstTime = time;
+    info.firstSeq = pushed;
+    info.count = 1;
+    info.firstTemp = temp;
+    info.firstHum = hum;
+    tail.block = nextBlock;
+    tail.bitPos = 0;
+    tail.time = time;
+    tail.delta = 0;
+    tail.temp = temp;
+    tail.hum = hum;
+    nextBlock++;
+    pushed++;
+    open = true;
+  }
+
+  bool live(uint32_t block) const { return block - firstBlock < nextBlock - firstBlock; }
+
+  Cursor startOf(uint32_t block) const {
+    Cursor c = {};
+    c.block = block;
+    c.seq = index[block % Blocks].firstSeq;
+    return c;
+  }
+
+  // Cursor at sequence number seq, which must be stored
+  Cursor seek(uint32_t seq) const {
+    uint32_t lo = firstBlock, hi = nextBlock;
+    while (hi - lo > 1) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if ((int32_t)(index[mid % Blocks].firstSeq - seq) <= 0) lo = mid;
+      else hi = mid;
+    }
+    Cursor c = startOf(lo);
+    SeriesSample skipped;
+    while (c.seq != seq && next(c, skipped)) {}
+    return c;
+  }
+
+  // Decode the sample at c and step past it; false at the end of the data
+  bool next(Cursor &c, SeriesSample &out) const {
+    if (!live(c.block)) return false;
+    if (c.index == index[c.block % Blocks].count) {
+      if (c.block + 1 == nextBlock) return false;
+      c.block++;
+      c.index = 0;
+    }
+    const BlockInfo &info = index[c.block % Blocks];
+    if (c.index == 0) {
+      c.time = info.firstTime;
+      c.delta = 0;
+      c.temp = info.firstTemp;
+      c.hum = info.firstHum;
+      c.bitPos = 0;
+    } else {
+      const uint8_t *data = blocks[c.block % Blocks];
+      uint8_t cls;
+      uint32_t v = getCode(data, c.bitPos, cls, TIME_WIDTHS);
+      c.delta += v;
+      c.time += c.delta;
+      v = getCode(data, c.bitPos, cls, VALUE_WIDTHS);
+      c.temp = cls == 4 ? (int16_t)v : (int16_t)(c.temp + (int32_t)v);
+      v = getCode(data, c.bitPos, cls, VALUE_WIDTHS);
+      c.hum = cls == 4 ? (int16_t)v : (int16_t)(c.hum + (int32_t)v);
+    }
+    c.index++;
+    c.seq++;
+    out.time = c.time;
+    out.temp = c.temp;
+    out.hum = c.hum;
+    return true;
+  }
+
+  static uint8_t codeClass(int32_t v, const uint8_t *widths) {
+    if (v == 0) return 0;
+    for (uint8_t c = 1; c < 4; c++) {
+      int32_t half = (int32_t)1 << (widths[c] - 1);
+      if (v >= -half && v < half) return c;
+    }
+    return 4;
+  }
+
+  static size_t codeBits(uint8_t cls, const uint8_t *widths) {
+    return (cls < 4 ? cls + 1 : 4) + widths[cls];
+  }
+
+  // Class c < 4 is c ones and a zero, the escape four ones
+  static void putCode(uint8_t *data, size_t &pos, uint8_t cls, uint32_t payload,
+                      const uint8_t *widths) {
+    if (cls < 4) putBits(data, pos, (1u << (cls + 1)) - 2, cls + 1);
+    else putBits(data, pos, 0xF, 4);
+    if (cls > 0) putBits(data, pos, payload, widths[cls]);
+  }
+
+  // Payload sign-extended, except the escape's, which comes back as stored
+  static uint32_t getCode(const uint8_t *data, size_t &pos, uint8_t &cls, const uint8_t *widths) {
+    cls = 0;
+    while (cls < 4 && getBits(data, pos, 1)) cls++;
+    if (cls == 0) return 0;
+    uint8_t width = widths[cls];
+    uint32_t v = getBits(data, pos, width);
+    if (cls < 4 && (v >> (width - 1))) v |= ~0u << width;
+    return v;
+  }
+
+  // MSB first; the block is zeroed when started, so bits are ORed in
+  static void putBits(uint8_t *data, size_t &pos, uint32_t value, uint8_t bits) {
+    while (bits > 0) {
+      uint8_t room = 8 - (pos & 7);
+      uint8_t take = bits < room ? bits : room;
+      uint8_t chunk = (value >> (bits - take)) & ((1u << take) - 1);
+      data[pos >> 3] |= chunk << (room - take);
+      pos += take;
+      bits -= take;
+    }
+  }
+
+  static uint32_t getBits(const uint8_t *data, size_t &pos, uint8_t bits) {
+    uint32_t v = 0;
+    while (bits > 0) {
+      uint8_t avail = 8 - (pos & 7);
+      uint8_t take = bits < avail ? bits : avail;
+      v = (v << take) | ((data[pos >> 3] >> (avail - take)) & ((1u << take) - 1));
+      pos += take;
+      bits -= take;
+    }
+    return v;
+  }
+
+  uint8_t blocks[Blocks][BlockBytes];
+  BlockInfo index[Blocks];
+  uint32_t firstBlock = 0, nextBlock = 0;
+  uint32_t pushed = 0;
+  bool open = false;
+  Cursor tail = {};               // Last sample written
+  mutable Cursor cursors[SERIES_READ_CURSORS] = {};  // Where recent read()s stopped
+  mutable uint8_t cursorCount = 0, replaceCursor = 0;
+};
+
+template <size_t Blocks, size_t BlockBytes>
+constexpr uint8_t SeriesStore<Blocks, BlockBytes>::TIME_WIDTHS[5];
+template <size_t Blocks, size_t BlockBytes>
+constexpr uint8_t SeriesStore<Blocks, BlockBytes>::VALUE_WIDTHS[5];
+
+typedef SeriesStore<SERIES_BLOCKS, SERIES_BLOCK_BYTES> SampleArchive;
+
+static_assert(sizeof(SampleArchive) <= SERIES_RAM_BUDGET, "Sample archive exceeds its RAM budget");
+
+#endif
@@ -0,0 +1,363 @@
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+/*************************************************************
+  Append-only session log
+
+  One fixed 20-byte record per finished sauna session, appended
+  to a single file (LittleFS on the device, any file on the host):
+
+    offset  size  field
+    0       4     start        epoch seconds
+    4       4     duration     seconds
+    8       2     peakTemp     centi-°C, signed
+    10      2     meanHum      centi-%
+    12      1     throws       steam throws detected
+    13      1     above80      minutes at or above 80 °C, capped at 255
+    14      2     heatDose     °C·min above 37 °C (session_stats.h)
+    16      4     crc          CRC-32 of bytes 0..15
+
+  All fields little endian. Records are kept in start order, so
+  record i starts at i * 20 and a date lookup is a binary search
+  with one small read per step. Finished sessions are batched in
+  RAM and written together, because every append to a LittleFS
+  file rewrites its last block. A torn tail (power loss during
+  a flush) is found and cut off when the log is opened by
+  checking only the last records.
+
+  append() only queues, so the sensor task never waits on flash;
+  service() on the network task writes the batch once it is full
+  or its oldest record has waited SESSION_LOG_FLUSH_MS. If the
+  batch is full and cannot be written (write or fsync failed), the
+  oldest pending record is dropped and counted.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rtos_port.h"
+#include "json_writer.h"
+
+#define SESSION_RECORD_SIZE     20
+#define SESSION_LOG_BATCH       4         // Records kept in RAM, written at the next service() when full
+#define SESSION_LOG_FLUSH_MS    900000UL  // Oldest pending record is flushed after 15 min
+
+struct SessionRecord {
+  uint32_t start;          // Epoch seconds
+  uint32_t duration;       // Seconds
+  float peakTemp;          // °C
+  float meanHumidity;      // %
+  uint8_t throws;          // Steam throws
+  uint8_t above80Minutes;
+  uint16_t heatDose;       // °C·min
+};
+
+/**
+ * CRC-32 (IEEE 802.3, same as zlib.crc32), bitwise to stay table-free
+ */
+inline uint32_t sessionCrc32(const uint8_t *data, size_t len) {
+  uint32_t crc = 0xFFFFFFFFUL;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+inline void putLe32(uint8_t *p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+inline uint32_t getLe32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline void encodeSessionRecord(const SessionRecord &rec, uint8_t *out) {
+  float peak = rec.peakTemp * 100.0f;
+  float hum = rec.meanHumidity * 100.0f;
+  if (peak > 32767.0f) peak = 32767.0f;
+  if (peak < -32768.0f) peak = -32768.0f;
+  if (hum > 65535.0f) hum = 65535.0f;
+  if (hum < 0.0f) hum = 0.0f;
+  int16_t peakCenti = (int16_t)(peak + (peak >= 0 ? 0.5f : -0.5f));
+  uint16_t humCenti = (uint16_t)(hum + 0.5f);
+
+  putLe32(out, rec.start);
+  putLe32(out + 4, rec.duration);
+  out[8] = (uint16_t)peakCenti; out[9] = (uint16_t)peakCenti >> 8;
+  out[10] = humCenti; out[11] = humCenti >> 8;
+  out[12] = rec.throws;
+  out[13] = rec.above80Minutes;
+  out[14] = rec.heatDose; out[15] = rec.heatDose >> 8;
+  putLe32(out + 16, sessionCrc32(out, 16));
+}
+
+// False when the CRC does not match (torn or corrupted record)
+inline bool decodeSessionRecord(const uint8_t *in, SessionRecord &rec) {
+  if (getLe32(in + 16) != sessionCrc32(in, 16)) return false;
+  rec.start = getLe32(in);
+  rec.duration = getLe32(in + 4);
+  rec.peakTemp = (int16_t)(in[8] | (in[9] << 8)) / 100.0f;
+  rec.meanHumidity = (uint16_t)(in[10] | (in[11] << 8)) / 100.0f;
+  rec.throws = in[12];
+  rec.above80Minutes = in[13];
+  rec.heatDose = (uint16_t)(in[14] | (in[15] << 8));
+  return true;
+}
+
+class SessionLog {
+public:
+  ~SessionLog() {
+    if (file) fclose(file);
+  }
+
+  /**
+   * Open (or create) the log at path and drop a torn tail.
+   * Returns false if the file cannot be opened.
+   */
+  bool begin(const char *path) {
+    RtosLock lock(mutex);
+    file = fopen(path, "r+b");
+    if (!file) file = fopen(path, "w+b");
+    if (!file) return false;
+
+    fseek(file, 0, SEEK_END);
+    long bytes = ftell(file);
+    records = bytes > 0 ? (size_t)bytes / SESSION_RECORD_SIZE : 0;
+
+    // Only the tail can be torn: walk back over records that fail the CRC
+    SessionRecord rec = {};
+    while (records > 0 && !readLocked(records - 1, rec)) {
+      records--;
+      recovered++;
+    }
+    lastStart = records > 0 ? rec.start : 0;  // rec holds the last good record
+    if ((long)(records * SESSION_RECORD_SIZE) != bytes) {
+      fflush(file);
+      if (ftruncate(fileno(file), records * SESSION_RECORD_SIZE) != 0) {
+        fclose(file);          // Not opened, rather than open over a torn tail
+        file = nullptr;
+        records = 0;
+        lastStart = 0;
+        return false;
+      }
+      if (bytes % SESSION_RECORD_SIZE) recovered++;
+    }
+    return true;
+  }
+
+  /**
+   * Queue a finished session; never touches the file. Records must
+   * arrive in start order; out-of-order ones (clock stepped
+   * backwards) are rejected. A full batch that service() has not
+   * written yet loses its oldest record.
+   */
+  bool append(const SessionRecord &rec, uint32_t nowMs) {
+    RtosLock lock(mutex);
+    if (!file || rec.start < lastStart) return false;
+    if (pendingCount == SESSION_LOG_BATCH) {
+      memmove(pending, pending + 1, (SESSION_LOG_BATCH - 1) * sizeof(pending[0]));
+      pendingCount--;
+      dropped++;
+    }
+    if (pendingCount == 0) firstPendingMs = nowMs;
+    pending[pendingCount++] = rec;
+    lastStart = rec.start;
+    return true;
+  }
+
+  /**
+   * Write the pending records once the batch is full or the oldest
+   * has waited SESSION_LOG_FLUSH_MS. Network task.
+   */
+  void service(uint32_t nowMs) {
+    RtosLock lock(mutex);
+    if (pendingCount == SESSION_LOG_BATCH ||
+        (pendingCount > 0 && nowMs - firstPendingMs >= SESSION_LOG_FLUSH_MS)) {
+      flushLocked();
+    }
+  }
+
+  // Write all pending records now (e.g. before a reboot)
+  bool flush() {
+    RtosLock lock(mutex);
+    return flushLocked();
+  }
+
+  // Records on flash plus those still pending, in start order
+  size_t count() {
+    RtosLock lock(mutex);
+    return records + pendingCount;
+  }
+
+  /**
+   * Read up to max records starting at index first into out.
+   * Returns the number read; stops early at a corrupt record.
+   */
+  size_t read(size_t first, SessionRecord *out, size_t max) {
+    RtosLock lock(mutex);
+    size_t n = 0;
+    while (n < max && first + n < records + pendingCount) {
+      size_t i = first + n;
+      if (i >= records) out[n] = pending[i - records];
+      else if (!readLocked(i, out[n])) break;
+      n++;
+    }
+    return n;
+  }
+
+  /**
+   * Index of the first session starting at or after epoch
+   * (count() if none), O(log n) reads
+   */
+  size_t lowerBound(uint32_t epoch) {
+    RtosLock lock(mutex);
+    size_t lo = 0, hi = records + pendingCount;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      SessionRecord rec;
+      bool ok = mid >= records ? (rec = pending[mid - records], true) : readLocked(mid, rec);
+      if (ok && rec.start < epoch) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+  size_t recoveredRecords() const { return recovered; }
+  // Pending records lost because the batch was full and not yet written
+  uint32_t droppedRecords() const { return dropped; }
+  // Flushes whose fsync failed; their batch was kept pending
+  uint32_t syncFailureCount() const { return syncFailures; }
+
+private:
+  bool readLocked(size_t index, SessionRecord &rec) {
+    uint8_t buf[SESSION_RECORD_SIZE];
+    if (fseek(file, (long)(index * SESSION_RECORD_SIZE), SEEK_SET) != 0) return false;
+    if (fread(buf, 1, sizeof(buf), file) != sizeof(buf)) return false;
+    return decodeSessionRecord(buf, rec);
+  }
+
+  bool flushLocked() {
+    if (!file || pendingCount == 0) return true;
+    uint8_t buf[SESSION_LOG_BATCH * SESSION_RECORD_SIZE];
+    for (size_t i = 0; i < pendingCount; i++) {
+      encodeSessionRecord(pending[i], buf + i * SESSION_RECORD_SIZE);
+    }
+    size_t len = pendingCount * SESSION_RECORD_SIZE;
+
+    // One write and one sync per batch. On failure the batch stays
+    // pending and the next flush writes it again at the same offset.
+    if (fseek(file, (long)(records * SESSION_RECORD_SIZE), SEEK_SET) != 0) return false;
+    if (fwrite(buf, 1, len, file) != len) return false;
+    if (fflush(file) != 0) return false;
+    if (fsync(fileno(file)) != 0) {
+      syncFailures++;
+      return false;
+    }
+    records += pendingCount;
+    pendingCount = 0;
+    return true;
+  }
+
+  RtosMutex mutex;
+  FILE *file = nullptr;
+  size_t records = 0;                  // Complete records on flash
+  size_t recovered = 0;                // Torn records dropped by begin()
+  uint32_t dropped = 0;                // Pending records pushed out of a full batch
+  uint32_t syncFailures = 0;
+  uint32_t lastStart = 0;
+  SessionRecord pending[SESSION_LOG_BATCH];
+  size_t pendingCount = 0;
+  uint32_t firstPendingMs = 0;
+};
+
+/**
+ * Produces the JSON array of records [first, end) in pieces of any
+ * size, reading a few records at a time, so a response can be
+ * streamed from flash with a small, fixed amount of RAM.
+ */
+class SessionJsonStream {
+public:
+  SessionJsonStream(SessionLog &log, size_t first, size_t end)
+    : log(log), next(first), end(end) {}
+
+  // Write up to maxLen bytes; returns 0 once the array is complete
+  size_t fill(char *buf, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+      if (textPos == textLen && !produce()) break;
+      size_t n = textLen - textPos;
+      if (n > maxLen - written) n = maxLen - written;
+      memcpy(buf + written, text + textPos, n);
+      textPos += n;
+      written += n;
+    }
+    return written;
+  }
+
+private:
+  static const size_t BATCH = 8;
+
+  // Format the next piece of output into text; false when done
+  bool produce() {
+    textPos = textLen = 0;   // Also when done, or fill() would send the last piece again
+    if (!started) {
+      started = true;
+      text[0] = '[';
+      textLen = 1;
+      return true;
+    }
+    if (batchPos == batchCount && next < end) {
+      size_t want = end - next < BATCH ? end - next : BATCH;
+      batchCount = log.read(next, batch, want);
+      batchPos = 0;
+      next = batchCount == want ? next + batchCount : end;  // Stop at a corrupt record
+    }
+    if (batchPos < batchCount) {
+      const SessionRecord &rec = batch[batchPos++];
+      size_t offset = 0;
+      if (items++ > 0) text[offset++] = ',';
+      JsonWriter w(text + offset, sizeof(text) - offset);
+      w.beginObject();
+      w.key("start");
+      w.uinteger(rec.start);
+      w.key("duration");
+      w.uinteger(rec.duration);
+      w.key("peak");
+      w.fixed(rec.peakTemp, 1);
+      w.key("humidity");
+      w.fixed(rec.meanHumidity, 1);
+      w.key("throws");
+      w.uinteger(rec.throws);
+      w.key("above80");
+      w.uinteger(rec.above80Minutes);
+      w.key("heatDose");
+      w.uinteger(rec.heatDose);
+      w.endObject();
+      textLen = offset + w.length();
+      return true;
+    }
+    if (!finished) {
+      finished = true;
+      text[0] = ']';
+      textLen = 1;
+      return true;
+    }
+    return false;
+  }
+
+  SessionLog &log;
+  size_t next, end;
+  SessionRecord batch[BATCH];
+  size_t batchCount = 0, batchPos = 0;
+  size_t items = 0;
+  bool started = false, finished = false;
+  char text[160];
+  size_t textLen = 0, textPos = 0;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef SESSION_STATS_H
+#define SESSION_STATS_H
+
+/*************************************************************
+  Per-session analytics and steam-throw (löyly) detection
+
+  Streaming aggregates over the current session, O(1) memory:
+  time-weighted mean and variance of the temperature (West's
+  weighted form of Welford's update), time above 60 and 80 °C,
+  the humidity-time integral (%·min) and a heat dose, the
+  integral of the temperature above SESSION_DOSE_BASE_C (°C·min).
+  Each reading stands for the time since the previous one.
+
+  Steam throws: water on the stones shows at the sensor as a sharp
+  rise in humidity while the temperature dips. The last
+  SESSION_THROW_WINDOW_MS of readings are kept in a fixed ring; a
+  reading at least SESSION_THROW_RISE above the window's lowest
+  humidity and SESSION_THROW_DIP below its highest temperature is
+  a throw. The window is then emptied, so one throw is counted
+  once, and SESSION_THROW_REFRACTORY_MS must pass before the next.
+  At most SESSION_THROW_SLOTS readings are scanned per sample.
+
+  The detector dates a heater-off end to where the cool-down began
+  (sauna_state.h); the aggregates are checkpointed there so the
+  finished session leaves out the samples taken while the end was
+  being confirmed.
+
+  Pure logic: fed after updateSaunaState() with the same reading
+  and time, on the device and in the host simulator.
+*************************************************************/
+#include <stdint.h>
+#include <math.h>
+
+#include "sauna_state.h"
+#include "session_log.h"
+
+#ifndef SESSION_DOSE_BASE_C
+#define SESSION_DOSE_BASE_C          37.0f     // °C, body temperature: no heat load below
+#endif
+#ifndef SESSION_THROW_RISE
+#define SESSION_THROW_RISE           6.0f      // %RH above the window minimum
+#endif
+#ifndef SESSION_THROW_DIP
+#define SESSION_THROW_DIP            0.3f      // °C below the window maximum
+#endif
+#ifndef SESSION_THROW_WINDOW_MS
+#define SESSION_THROW_WINDOW_MS      60000UL
+#endif
+#ifndef SESSION_THROW_REFRACTORY_MS
+#define SESSION_THROW_REFRACTORY_MS  60000UL   // Quiet time after a throw
+#endif
+#define SESSION_THROW_SLOTS          32        // Window readings kept (60 s at 2 s)
+#define SESSION_MAX_STEP_MS          120000UL  // Longer gaps between readings count as this
+#define SESSION_HOT_C                60.0f
+#define SESSION_VERY_HOT_C           80.0f
+
+// Published summary: the running session, or the last finished one
+struct SessionSummary {
+  bool valid;              // A session has been seen since boot
+  bool active;             // Still running; false once finalized
+  uint32_t seconds;        // Time covered by the aggregates
+  float meanTemp;          // °C, time-weighted
+  float tempStdDev;        // °C
+  uint32_t above60S;       // Seconds at or above SESSION_HOT_C
+  uint32_t above80S;       // Seconds at or above SESSION_VERY_HOT_C
+  float humidityMinutes;   // %·min
+  float heatDose;          // °C·min above SESSION_DOSE_BASE_C
+  uint16_t throws;         // Steam throws detected
+  uint64_t lastThrowMs;    // Monotonic ms of the last throw, 0 if none
+  float lastThrowRise;     // %RH of the last throw
+};
+
+class SessionStats {
+public:
+  /**
+   * Feed one valid reading after updateSaunaState(), with the event it
+   * returned. Returns true when the reading is a steam throw.
+   */
+  bool update(const SaunaState &sauna, SaunaEvent event, float temp, float hum, uint64_t nowMs) {
+    if (event == SAUNA_EVENT_STARTED) {
+      acc = Aggregates();
+      acc.startMs = acc.lastMs = nowMs;
+      mark = acc;
+      markMs = 0;
+      windowCount = 0;
+      wasCooling = false;
+    } else if (event == SAUNA_EVENT_ENDED) {
+      // Dated back to the start of the cool-down: drop what came after
+      if (sauna.lastDetectDelay > 0 && markMs == sauna.coolSince) acc = mark;
+      publish(false);
+      return false;
+    }
+    if (!sauna.active) return false;
+    if (sauna.spikes > 0) return false;   // Rejected as an outlier by the detector
+
+    accumulate(temp, hum, nowMs);
+    bool thrown = detectThrow(temp, hum, nowMs);
+    if (sauna.cooling && !wasCooling) {
+      mark = acc;
+      markMs = sauna.coolSince;
+    }
+    wasCooling = sauna.cooling;
+    publish(true);
+    return thrown;
+  }
+
+  const SessionSummary &summary() const { return current; }
+
+private:
+  struct Aggregates {
+    uint64_t startMs = 0, lastMs = 0;
+    float weight = 0;            // Seconds
+    float mean = 0, m2 = 0;      // Weighted Welford state, °C and °C²·s
+    uint32_t above60Ms = 0, above80Ms = 0;
+    float humidityMinutes = 0, heatDose = 0;
+    uint16_t throws = 0;
+    uint64_t lastThrowMs = 0;
+    float lastThrowRise = 0;
+  };
+
+  struct WindowSlot {
+    uint32_t ms;                 // Low 32 bits of the monotonic clock
+    int16_t temp;                // centi-°C
+    int16_t hum;                 // centi-%RH
+  };
+
+  void accumulate(float temp, float hum, uint64_t nowMs) {
+    uint64_t step = nowMs - acc.lastMs;
+    if (step > SESSION_MAX_STEP_MS) step = SESSION_MAX_STEP_MS;
+    acc.lastMs = nowMs;
+    if (step == 0) return;
+    uint32_t dt = (uint32_t)step;
+    float w = dt / 1000.0f;
+    float minutes = dt / 60000.0f;
+
+    acc.weight += w;
+    float delta = temp - acc.mean;
+    acc.mean += delta * w / acc.weight;
+    acc.m2 += w * delta * (temp - acc.mean);
+    if (temp >= SESSION_HOT_C) acc.above60Ms += dt;
+    if (temp >= SESSION_VERY_HOT_C) acc.above80Ms += dt;
+    acc.humidityMinutes += hum * minutes;
+    if (temp > SESSION_DOSE_BASE_C) acc.heatDose += (temp - SESSION_DOSE_BASE_C) * minutes;
+  }
+
+  bool detectThrow(float temp, float hum, uint64_t nowMs) {
+    uint32_t now32 = (uint32_t)nowMs;
+    // Oldest first: drop readings that left the window
+    while (windowCount > 0 &&
+           now32 - window[windowHead].ms > SESSION_THROW_WINDOW_MS) {
+      windowHead = (windowHead + 1) % SESSION_THROW_SLOTS;
+      windowCount--;
+    }
+    int16_t tempCenti = toCenti(temp), humCenti = toCenti(hum);
+    int16_t minHum = humCenti, maxTemp = tempCenti;
+    for (uint8_t i = 0; i < windowCount; i++) {
+      const WindowSlot &s = window[(windowHead + i) % SESSION_THROW_SLOTS];
+      if (s.hum < minHum) minHum = s.hum;
+      if (s.temp > maxTemp) maxTemp = s.temp;
+    }
+
+    float rise = (humCenti - minHum) / 100.0f;
+    bool quiet = acc.throws == 0 || nowMs - acc.lastThrowMs >= SESSION_THROW_REFRACTORY_MS;
+    bool thrown = quiet && rise >= SESSION_THROW_RISE &&
+                  (maxTemp - tempCenti) / 100.0f >= SESSION_THROW_DIP;
+    if (thrown) {
+      acc.throws++;
+      acc.lastThrowMs = nowMs;
+      acc.lastThrowRise = rise;
+      windowCount = 0;     // The next throw needs a new baseline
+    }
+
+    if (windowCount == SESSION_THROW_SLOTS) {
+      windowHead = (windowHead + 1) % SESSION_THROW_SLOTS;
+      windowCount--;
+    }
+    WindowSlot &slot = window[(windowHead + windowCount) % SESSION_THROW_SLOTS];
+    slot.ms = now32;
+    slot.temp = tempCenti;
+    slot.hum = humCenti;
+    windowCount++;
+    return thrown;
+  }
+
+  static int16_t toCenti(float value) {
+    float centi = value * 100.0f;
+    if (centi > 32767.0f) return 32767;
+    if (centi < -32768.0f) return -32768;
+    return (int16_t)(centi + (centi >= 0 ? 0.5f : -0.5f));
+  }
+
+  void publish(bool active) {
+    SessionSummary s;
+    s.valid = true;
+    s.active = active;
+    s.seconds = (uint32_t)((acc.lastMs - acc.startMs) / 1000);
+    s.meanTemp = acc.mean;
+    s.tempStdDev = acc.weight > 0 && acc.m2 > 0 ? sqrtf(acc.m2 / acc.weight) : 0;
+    s.above60S = acc.above60Ms / 1000;
+    s.above80S = acc.above80Ms / 1000;
+    s.humidityMinutes = acc.humidityMinutes;
+    s.heatDose = acc.heatDose;
+    s.throws = acc.throws;
+    s.lastThrowMs = acc.lastThrowMs;
+    s.lastThrowRise = acc.lastThrowRise;
+    current = s;
+  }
+
+  Aggregates acc, mark;
+  uint64_t markMs = 0;         // coolSince the checkpoint was taken at
+  bool wasCooling = false;
+  WindowSlot window[SESSION_THROW_SLOTS];
+  uint8_t windowHead = 0, windowCount = 0;
+  SessionSummary current = SessionSummary();
+};
+
+/**
+ * Copy a finished session's analytics into its session log record,
+ * clamped to the record's field widths
+ */
+inline void setSessionRecordStats(SessionRecord &rec, const SessionSummary &s) {
+  uint32_t above80 = s.above80S / 60;
+  float dose = s.heatDose + 0.5f;
+  rec.throws = s.throws > 255 ? 255 : (uint8_t)s.throws;
+  rec.above80Minutes = above80 > 255 ? 255 : (uint8_t)above80;
+  rec.heatDose = dose >= 65535.0f ? 65535 : dose > 0 ? (uint16_t)dose : 0;
+}
+
+#endif
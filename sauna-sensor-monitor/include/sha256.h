@@ -0,0 +1,158 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+/*************************************************************
+  Incremental SHA-256
+
+  Hashes data as it arrives, so an image can be verified while it
+  streams into flash without a second pass. On the ESP32 this is
+  mbedtls (backed by the SHA peripheral); elsewhere a portable
+  implementation that the simulator checks and benchmarks.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SHA256_DIGEST_LEN 32
+#define SHA256_HEX_LEN (SHA256_DIGEST_LEN * 2 + 1)
+
+#if defined(ESP_PLATFORM)
+#include <mbedtls/sha256.h>
+
+class Sha256 {
+public:
+  Sha256() { mbedtls_sha256_init(&ctx); begin(); }
+  ~Sha256() { mbedtls_sha256_free(&ctx); }
+
+  void begin() { mbedtls_sha256_starts(&ctx, 0); }
+  void update(const uint8_t *data, size_t len) { mbedtls_sha256_update(&ctx, data, len); }
+  void finish(uint8_t digest[SHA256_DIGEST_LEN]) { mbedtls_sha256_finish(&ctx, digest); }
+
+private:
+  Sha256(const Sha256 &);
+  Sha256 &operator=(const Sha256 &);
+  mbedtls_sha256_context ctx;
+};
+
+#else
+
+class Sha256 {
+public:
+  Sha256() { begin(); }
+
+  void begin() {
+    static const uint32_t INIT[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(state, INIT, sizeof(state));
+    total = 0;
+    used = 0;
+  }
+
+  void update(const uint8_t *data, size_t len) {
+    total += len;
+    if (used) {
+      size_t take = len < 64 - used ? len : 64 - used;
+      memcpy(block + used, data, take);
+      used += take;
+      data += take;
+      len -= take;
+      if (used < 64) return;
+      compress(block);
+      used = 0;
+    }
+    for (; len >= 64; data += 64, len -= 64) compress(data);
+    memcpy(block, data, len);
+    used = len;
+  }
+
+  void finish(uint8_t digest[SHA256_DIGEST_LEN]) {
+    uint64_t bits = total * 8;
+    block[used++] = 0x80;
+    if (used > 56) {
+      memset(block + used, 0, 64 - used);
+      compress(block);
+      used = 0;
+    }
+    memset(block + used, 0, 56 - used);
+    for (int i = 0; i < 8; i++) block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+    compress(block);
+    for (int i = 0; i < 8; i++) {
+      digest[4 * i] = (uint8_t)(state[i] >> 24);
+      digest[4 * i + 1] = (uint8_t)(state[i] >> 16);
+      digest[4 * i + 2] = (uint8_t)(state[i] >> 8);
+      digest[4 * i + 3] = (uint8_t)state[i];
+    }
+  }
+
+private:
+  static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+  void compress(const uint8_t *p) {
+    static const uint32_t K[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+      0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+      0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+      0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+      0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+      0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+      w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+             (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+      uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+      uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  }
+
+  uint32_t state[8];
+  uint64_t total;
+  uint8_t block[64];
+  size_t used;
+};
+
+#endif
+
+// Lowercase hex, NUL terminated
+inline void sha256Hex(const uint8_t digest[SHA256_DIGEST_LEN], char out[SHA256_HEX_LEN]) {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+  for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+    out[2 * i] = HEX_DIGITS[digest[i] >> 4];
+    out[2 * i + 1] = HEX_DIGITS[digest[i] & 0x0F];
+  }
+  out[SHA256_DIGEST_LEN * 2] = '\0';
+}
+
+// 64 hex digits, either case; false on anything else
+inline bool parseSha256Hex(const char *text, uint8_t digest[SHA256_DIGEST_LEN]) {
+  for (int i = 0; i < SHA256_DIGEST_LEN * 2; i++) {
+    char c = text[i];
+    uint8_t v;
+    if (c >= '0' && c <= '9') v = c - '0';
+    else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+    else return false;
+    if (i & 1) digest[i / 2] |= v;
+    else digest[i / 2] = v << 4;
+  }
+  return text[SHA256_DIGEST_LEN * 2] == '\0';
+}
+
+#endif
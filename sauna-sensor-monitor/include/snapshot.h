@@ -0,0 +1,95 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/*************************************************************
+  Sensor snapshot
+
+  The acquisition stage publishes one SensorSnapshot per sample
+  through a SeqLock. Readers (display, session logic, web
+  handlers) copy the latest snapshot without blocking the writer
+  and without touching the I2C bus.
+
+  Single writer only. Readers retry if they raced a write.
+*************************************************************/
+#include <stdint.h>
+#include <atomic>
+
+#ifndef SENSOR_MAX_CHANNELS
+#define SENSOR_MAX_CHANNELS 8     // Sensors per sample, one TCA9548A's worth
+#endif
+#define SENSOR_HOLD_SAMPLES 3     // Failed reads a sensor's last value stays in the aggregate
+
+static_assert(SENSOR_MAX_CHANNELS >= 1 && SENSOR_MAX_CHANNELS <= 32,
+              "SENSOR_MAX_CHANNELS must fit the valid mask");
+
+/**
+ * Per-sensor readings of one sample as a struct of arrays, so the
+ * aggregate and the serializers each walk one contiguous array
+ */
+struct SensorFrame {
+  uint8_t count;                            // Sensors in use
+  uint32_t validMask;                       // Bit i: sensor i read OK in this sample
+  float temperature[SENSOR_MAX_CHANNELS];   // °C, last valid reading of each sensor
+  float humidity[SENSOR_MAX_CHANNELS];      // %RH, last valid reading
+  uint8_t hold[SENSOR_MAX_CHANNELS];        // Samples the last reading still counts, 0 = none
+};
+
+struct SensorSnapshot {
+  float temperature;     // °C, sauna temperature: mean of the sensors, last valid
+  float humidity;        // %RH, mean of the sensors, last valid
+  uint32_t timestamp;    // System clock seconds (epoch once NTP synced)
+  uint32_t millis;       // millis() when the sample was taken
+  uint32_t seq;          // Incremented for every published sample
+  bool valid;            // False if no sensor was read in this sample and values are stale
+  SensorFrame sensors;   // The individual sensors
+};
+
+/**
+ * Difference between the hottest and the coldest sensor still counted
+ * in the aggregate (bench versus floor); 0 with fewer than two
+ */
+inline float sensorSpread(const SensorFrame &frame) {
+  bool any = false;
+  float lo = 0, hi = 0;
+  for (uint8_t i = 0; i < frame.count; i++) {
+    if (!frame.hold[i]) continue;
+    float t = frame.temperature[i];
+    if (!any || t < lo) lo = t;
+    if (!any || t > hi) hi = t;
+    any = true;
+  }
+  return hi - lo;
+}
+
+template <typename T>
+class SeqLock {
+public:
+  SeqLock() : sequence(0), data() {}
+
+  void write(const T &value) {
+    uint32_t s = sequence.load(std::memory_order_relaxed);
+    sequence.store(s + 1, std::memory_order_relaxed);    // Odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    data = value;
+    std::atomic_thread_fence(std::memory_order_release);
+    sequence.store(s + 2, std::memory_order_relaxed);    // Even: stable
+  }
+
+  T read() const {
+    T copy;
+    uint32_t before, after;
+    do {
+      before = sequence.load(std::memory_order_acquire);
+      copy = data;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return copy;
+  }
+
+private:
+  std::atomic<uint32_t> sequence;
+  T data;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+/*************************************************************
+  Task graph
+
+  The firmware's three tasks and the hand-offs between them:
+  - sensor (highest priority): samples on a drift-free schedule,
+    publishes the snapshot, then queues the sample for the network
+    task and signals the display task without waiting on either
+  - display: redraws from the latest snapshot when signalled
+  - network: housekeeping on every wake-up, publishes the queued
+    samples; waiting on the queue is its idle delay
+
+  What each task does per iteration comes from a TaskWork: the
+  firmware's (main.cpp) on FreeRTOS, the simulator's on pthreads
+  (rtos_port.h host backend), so the simulator runs these loops
+  as the device does.
+*************************************************************/
+#include <stdint.h>
+#include <atomic>
+
+#include "rtos_port.h"
+#include "snapshot.h"
+#include "hal.h"
+#include "power_mode.h"
+
+// Task layout. The sensor task sits above AsyncTCP (priority 10) so a
+// busy web server cannot delay sampling; stack sizes are in bytes.
+const uint8_t  SENSOR_TASK_PRIORITY = 12;
+const uint32_t SENSOR_TASK_STACK = 4096;
+const uint8_t  DISPLAY_TASK_PRIORITY = 5;
+const uint32_t DISPLAY_TASK_STACK = 4096;
+const uint8_t  NETWORK_TASK_PRIORITY = 2;
+const uint32_t NETWORK_TASK_STACK = 8192;
+#define TASK_SAMPLE_QUEUE 4                // Samples the network task may fall behind by
+const uint32_t DISPLAY_WAIT_MS = POWER_IDLE_PERIOD_MS * 2;  // Longest display wait for a signal
+
+/**
+ * Per-iteration work of the tasks. Times are µs of work, waits excluded.
+ */
+class TaskWork {
+public:
+  virtual ~TaskWork() {}
+
+  // Sensor task: read the sensors and publish the snapshot
+  virtual SensorSnapshot acquire() = 0;
+  // Session logic, history and power mode, for valid samples only
+  virtual void process(const SensorSnapshot &sample) = 0;
+  // End of a sample; returns the period until the next one
+  virtual uint32_t sampled(uint32_t workUs) = 0;
+
+  // Display task; false while something else owns the screen
+  virtual bool displayEnabled() { return true; }
+  virtual void redraw(const SensorSnapshot &sample) = 0;
+  virtual void redrawn(uint32_t workUs) { (void)workUs; }
+
+  // Network task: connection upkeep on every wake-up, then the next sample
+  virtual void service() = 0;
+  virtual uint32_t pollMs() = 0;
+  virtual void publish(const SensorSnapshot &sample) = 0;
+  virtual void serviced(uint32_t workUs) { (void)workUs; }
+};
+
+class TaskGraph {
+public:
+  TaskGraph(TaskWork &work, ClockHal &clock, const SeqLock<SensorSnapshot> &snapshot)
+      : work(work), clock(clock), snapshot(snapshot), running(false), dropped(0) {}
+
+  /**
+   * Start the three tasks; the first sample follows after periodMs
+   */
+  bool start(uint32_t periodMs = POWER_ACTIVE_PERIOD_MS) {
+    firstPeriodMs = periodMs;
+    running.store(true, std::memory_order_relaxed);
+    return rtosStartTask(sensorEntry, "sensor", SENSOR_TASK_STACK, SENSOR_TASK_PRIORITY,
+                         this, &sensorHandle) &&
+           rtosStartTask(displayEntry, "display", DISPLAY_TASK_STACK, DISPLAY_TASK_PRIORITY,
+                         this, &displayHandle) &&
+           rtosStartTask(networkEntry, "network", NETWORK_TASK_STACK, NETWORK_TASK_PRIORITY,
+                         this, &networkHandle);
+  }
+
+#if !defined(ESP_PLATFORM)
+  /**
+   * Host only: let each task finish its iteration and wait for it.
+   * The device runs the tasks until it reboots.
+   */
+  void stop() {
+    running.store(false, std::memory_order_relaxed);
+    displaySignal.give();
+    rtosJoinTask(sensorHandle);
+    rtosJoinTask(displayHandle);
+    rtosJoinTask(networkHandle);
+  }
+#endif
+
+  // Redraw now, e.g. for OTA progress; any task
+  void wakeDisplay() { displaySignal.give(); }
+
+  const PeriodStats &sensorTiming() const { return timing; }
+  // Samples the network task never saw because the queue was full
+  uint32_t samplesDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+  RtosTask sensorTask() const { return sensorHandle; }
+  RtosTask displayTask() const { return displayHandle; }
+  RtosTask networkTask() const { return networkHandle; }
+
+private:
+  static void sensorEntry(void *arg) { static_cast<TaskGraph *>(arg)->sensorLoop(); rtosEndTask(); }
+  static void displayEntry(void *arg) { static_cast<TaskGraph *>(arg)->displayLoop(); rtosEndTask(); }
+  static void networkEntry(void *arg) { static_cast<TaskGraph *>(arg)->networkLoop(); rtosEndTask(); }
+
+  bool isRunning() const { return running.load(std::memory_order_relaxed); }
+
+  /**
+   * Samples on a fixed, drift-free schedule (2 s active, 30 s idle)
+   * and feeds the session logic and history. Hands off to the other
+   * tasks without waiting.
+   */
+  void sensorLoop() {
+    RtosTicks lastWake = rtosNow();
+    uint32_t periodMs = firstPeriodMs;
+    while (isRunning()) {
+      rtosDelayUntil(&lastWake, periodMs);
+      timing.record(rtosTicksToMs(lastWake), rtosTicksToMs(rtosNow()));
+      uint32_t workStart = clock.micros();
+
+      SensorSnapshot sample = work.acquire();
+      // Update sauna state logic and history only from real readings
+      if (sample.valid) work.process(sample);
+
+      if (!sampleQueue.send(sample, 0)) {   // Dropped if the network task is behind
+        dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      }
+      displaySignal.give();
+      periodMs = work.sampled(clock.micros() - workStart);
+    }
+  }
+
+  /**
+   * Redraws whenever the sensor task has published a new snapshot
+   */
+  void displayLoop() {
+    while (isRunning()) {
+      if (!displaySignal.take(DISPLAY_WAIT_MS) || !isRunning() || !work.displayEnabled()) {
+        continue;
+      }
+      uint32_t workStart = clock.micros();
+      work.redraw(snapshot.read());
+      work.redrawn(clock.micros() - workStart);
+    }
+  }
+
+  /**
+   * Connection upkeep, then publishes the next queued sample
+   */
+  void networkLoop() {
+    while (isRunning()) {
+      uint32_t workStart = clock.micros();
+      work.service();
+      uint32_t waitStart = clock.micros();
+      SensorSnapshot sample;
+      if (sampleQueue.receive(sample, work.pollMs())) {
+        uint32_t publishStart = clock.micros();
+        work.publish(sample);
+        work.serviced((waitStart - workStart) + (clock.micros() - publishStart));
+      } else {
+        work.serviced(waitStart - workStart);
+      }
+    }
+  }
+
+  TaskWork &work;
+  ClockHal &clock;
+  const SeqLock<SensorSnapshot> &snapshot;
+  std::atomic<bool> running;
+  std::atomic<uint32_t> dropped;     // Sensor task writes, load/store only
+  uint32_t firstPeriodMs = POWER_ACTIVE_PERIOD_MS;
+  PeriodStats timing;                // Sampling jitter relative to the schedule
+  RtosSignal displaySignal;          // Sensor / OTA -> display: a new snapshot or progress to draw
+  RtosQueue<SensorSnapshot, TASK_SAMPLE_QUEUE> sampleQueue;  // Sensor -> network
+  RtosTask sensorHandle = NULL;
+  RtosTask displayHandle = NULL;
+  RtosTask networkHandle = NULL;
+};
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+/*************************************************************
+  Hot-path trace recorder
+
+  A fixed ring of begin/end events, always recording, so the
+  timeline leading up to a stutter can be pulled afterwards and
+  opened in chrome://tracing or ui.perfetto.dev. Recording an
+  event is a timestamp read, a small per-task lookup and one
+  atomic slot claim; the oldest events are overwritten.
+
+  Timestamps come from esp_timer (µs) on the ESP32 and from the
+  steady clock (ns) on the host. The CPU cycle counter would be
+  cheaper, but it stops in light sleep and changes rate with the
+  idle mode's frequency scaling. Timestamps are 32 bit and are
+  unwrapped on export, which assumes consecutive events are less
+  than one wrap apart (71 minutes on the device, 4 s on the host).
+
+  Event names must be string literals (or otherwise outlive the
+  recorder) and need no JSON escaping. Build with -DTRACE_ENABLED=0
+  to compile the TRACE_* macros out.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#include "rtos_port.h"
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 512          // Power of two, 12 bytes each
+#endif
+#define TRACE_MAX_TRACKS 8        // Tasks with their own timeline row
+#define TRACE_TRACK_NAME_LEN 16
+#define TRACE_TRACK_OTHER 0xFF    // Tasks beyond TRACE_MAX_TRACKS
+
+#if defined(ESP_PLATFORM)
+#include <esp_timer.h>
+#define TRACE_TICKS_PER_US 1
+inline uint32_t traceTicks() { return (uint32_t)esp_timer_get_time(); }
+#else
+#include <chrono>
+#define TRACE_TICKS_PER_US 1000
+inline uint32_t traceTicks() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+struct TraceEvent {
+  uint32_t ticks;
+  const char *name;
+  char phase;               // 'B' begin, 'E' end, 'i' instant
+  uint8_t track;
+};
+
+template <size_t N>
+class TraceRecorder {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "TraceRecorder size must be a power of two");
+
+public:
+  void begin(const char *name) { record(name, 'B'); }
+  void end(const char *name) { record(name, 'E'); }
+  void instant(const char *name) { record(name, 'i'); }
+
+  void setEnabled(bool enabled) { on.store(enabled, std::memory_order_relaxed); }
+  bool enabled() const { return on.load(std::memory_order_relaxed); }
+
+  /**
+   * Copy the recorded events, oldest first, into out (room for N).
+   * Recording is paused during the copy; an event being written by
+   * another task at that moment may come out half updated.
+   */
+  size_t snapshot(TraceEvent *out) {
+    bool was = on.exchange(false, std::memory_order_acquire);
+    uint32_t last = head.load(std::memory_order_acquire);
+    size_t count = last < N ? last : N;
+    for (size_t i = 0; i < count; i++) out[i] = events[(last - count + i) & (N - 1)];
+    on.store(was, std::memory_order_release);
+    return count;
+  }
+
+  uint8_t tracks() const { return trackCount.load(std::memory_order_acquire); }
+  const char *trackName(uint8_t track) const {
+    return track < tracks() ? trackNames[track] : "other";
+  }
+
+private:
+  void record(const char *name, char phase) {
+    if (!on.load(std::memory_order_relaxed)) return;
+    uint32_t ticks = traceTicks();
+    uint8_t track = currentTrack();
+    TraceEvent &e = events[head.fetch_add(1, std::memory_order_relaxed) & (N - 1)];
+    e.ticks = ticks;
+    e.name = name;
+    e.phase = phase;
+    e.track = track;
+  }
+
+  // Row of the calling task, registered on its first event
+  uint8_t currentTrack() {
+    uintptr_t id = rtosCurrentTaskId();
+    uint8_t count = trackCount.load(std::memory_order_acquire);
+    for (uint8_t i = 0; i < count; i++) {
+      if (trackIds[i] == id) return i;
+    }
+    if (count == TRACE_MAX_TRACKS) return TRACE_TRACK_OTHER;
+    RtosLock lock(trackMutex);
+    count = trackCount.load(std::memory_order_relaxed);
+    for (uint8_t i = 0; i < count; i++) {
+      if (trackIds[i] == id) return i;
+    }
+    if (count == TRACE_MAX_TRACKS) return TRACE_TRACK_OTHER;
+    trackIds[count] = id;
+    // Copied, the task (e.g. Arduino's loopTask) may be gone by the export
+    snprintf(trackNames[count], TRACE_TRACK_NAME_LEN, "%s", rtosCurrentTaskName());
+    trackCount.store(count + 1, std::memory_order_release);
+    return count;
+  }
+
+  TraceEvent events[N];
+  std::atomic<uint32_t> head{0};
+  std::atomic<bool> on{true};
+
+  RtosMutex trackMutex;
+  uintptr_t trackIds[TRACE_MAX_TRACKS];
+  char trackNames[TRACE_MAX_TRACKS][TRACE_TRACK_NAME_LEN];
+  std::atomic<uint8_t> trackCount{0};
+};
+
+/**
+ * Begin on construction, end when leaving the scope
+ */
+template <typename Recorder>
+class TraceScope {
+public:
+  TraceScope(Recorder &recorder, const char *name) : recorder(recorder), name(name) {
+    recorder.begin(name);
+  }
+  ~TraceScope() { recorder.end(name); }
+
+private:
+  Recorder &recorder;
+  const char *name;
+};
+
+/**
+ * Chrome trace-event JSON of a snapshot, produced in pieces of at most
+ * maxLen bytes like SessionJsonStream. Holds its own copy of the
+ * events (N * 12 bytes), so recording carries on while it streams.
+ */
+template <size_t N>
+class TraceJsonStream {
+public:
+  explicit TraceJsonStream(TraceRecorder<N> &recorder) : recorder(recorder) {
+    count = recorder.snapshot(events);
+    if (count > 0) lastTicks = events[0].ticks;
+  }
+
+  // Write up to maxLen bytes; returns 0 once the document is complete
+  size_t fill(char *buf, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+      if (textPos == textLen && !produce()) break;
+      size_t n = textLen - textPos;
+      if (n > maxLen - written) n = maxLen - written;
+      memcpy(buf + written, text + textPos, n);
+      textPos += n;
+      written += n;
+    }
+    return written;
+  }
+
+  size_t eventCount() const { return count; }
+
+private:
+  // Format the next piece of output into text; false when done
+  bool produce() {
+    textPos = textLen = 0;
+    int len = 0;
+    if (step == 0) {
+      len = snprintf(text, sizeof(text),
+                     "{\"displayTimeUnit\":\"ms\",\"traceEvents\":["
+                     "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"sauna-sensor\"}}");
+      step++;
+    } else if (step == 1) {
+      // One thread_name record per track ("other" once the table is full)
+      uint8_t tracks = recorder.tracks();
+      if (track < tracks || (track == tracks && tracks == TRACE_MAX_TRACKS)) {
+        uint8_t id = track < tracks ? track : TRACE_TRACK_OTHER;
+        len = snprintf(text, sizeof(text),
+                       ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                       "\"args\":{\"name\":\"%s\"}}",
+                       (unsigned)id, recorder.trackName(id));
+        track++;
+      } else {
+        step++;
+      }
+    } else if (step == 2) {
+      if (next < count) {
+        const TraceEvent &e = events[next++];
+        offset += (int32_t)(e.ticks - lastTicks);   // Unwrap, tolerates small reordering
+        lastTicks = e.ticks;
+        uint64_t ticks = offset > 0 ? (uint64_t)offset : 0;
+        len = snprintf(text, sizeof(text),
+                       ",{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%u%s}",
+                       e.name, e.phase, (unsigned long long)(ticks / TRACE_TICKS_PER_US),
+                       (unsigned)(ticks % TRACE_TICKS_PER_US * 1000 / TRACE_TICKS_PER_US),
+                       (unsigned)e.track, e.phase == 'i' ? ",\"s\":\"t\"" : "");
+      } else {
+        step++;
+      }
+    } else if (step == 3) {
+      len = snprintf(text, sizeof(text), "]}\n");
+      step++;
+    } else {
+      return false;
+    }
+    textLen = len > 0 ? ((size_t)len < sizeof(text) ? (size_t)len : sizeof(text) - 1) : 0;
+    return true;
+  }
+
+  TraceRecorder<N> &recorder;
+  TraceEvent events[N];
+  size_t count = 0;
+  size_t next = 0;
+  uint8_t step = 0;
+  uint8_t track = 0;
+  uint32_t lastTicks = 0;
+  int64_t offset = 0;           // Ticks since the first event
+  char text[160];
+  size_t textPos = 0, textLen = 0;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if TRACE_ENABLED
+#define TRACE_SCOPE(recorder, name) \
+  TraceScope<decltype(recorder)> TRACE_CONCAT(traceScope, __LINE__)(recorder, name)
+#define TRACE_INSTANT(recorder, name) (recorder).instant(name)
+#else
+#define TRACE_SCOPE(recorder, name) do {} while (0)
+#define TRACE_INSTANT(recorder, name) do {} while (0)
+#endif
+
+#endif
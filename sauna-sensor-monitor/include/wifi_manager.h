@@ -0,0 +1,167 @@
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+/*************************************************************
+  WiFi connection manager
+
+  Event-driven state machine with exponential backoff and
+  jitter. It never blocks and never calls the WiFi driver
+  itself: the caller feeds it driver events with onEvent(),
+  calls poll() regularly and performs the returned action.
+  That keeps it testable on the host with a fake event source.
+
+    IDLE -> CONNECTING -> CONNECTED
+                 |  ^          |
+         timeout |  | backoff  | disconnected
+                 v  |          v
+                BACKOFF <------+
+*************************************************************/
+#include <stdint.h>
+
+// Firmware timing, shared with the simulator's WiFi scenario
+#ifndef WIFI_BACKOFF_BASE
+#define WIFI_BACKOFF_BASE     1000UL    // First retry after ~1 second
+#endif
+#ifndef WIFI_RETRY_INTERVAL
+#define WIFI_RETRY_INTERVAL   60000UL   // Longest backoff between attempts (1 minute)
+#endif
+#ifndef WIFI_CONNECT_TIMEOUT
+#define WIFI_CONNECT_TIMEOUT  10000UL   // 10 seconds timeout for WiFi connection
+#endif
+
+enum WifiEvent : uint8_t {
+  WIFI_EVENT_GOT_IP,
+  WIFI_EVENT_DISCONNECTED,
+  WIFI_EVENT_LOST_IP
+};
+
+enum WifiState : uint8_t {
+  WIFI_STATE_IDLE,
+  WIFI_STATE_CONNECTING,
+  WIFI_STATE_CONNECTED,
+  WIFI_STATE_BACKOFF
+};
+
+enum WifiAction : uint8_t {
+  WIFI_ACTION_NONE,
+  WIFI_ACTION_CONNECT,      // Call WiFi.begin()
+  WIFI_ACTION_DISCONNECT    // Abort the attempt, WiFi.disconnect()
+};
+
+class WifiManager {
+public:
+  WifiManager(uint32_t baseBackoffMs, uint32_t maxBackoffMs, uint32_t connectTimeoutMs,
+              uint32_t seed = 0x9E3779B9UL)
+    : baseBackoff(baseBackoffMs), maxBackoff(maxBackoffMs), connectTimeout(connectTimeoutMs),
+      rng(seed ? seed : 1) {}
+
+  /**
+   * Feed one driver event
+   */
+  void onEvent(WifiEvent event, uint32_t nowMs) {
+    switch (event) {
+      case WIFI_EVENT_GOT_IP:
+        if (state != WIFI_STATE_CONNECTED) {
+          if (everConnected) reconnectCount++;
+          state = WIFI_STATE_CONNECTED;
+          failures = 0;
+          if (!everConnected) {
+            everConnected = true;
+            firstConnectPending = true;
+          }
+        }
+        break;
+      case WIFI_EVENT_DISCONNECTED:
+      case WIFI_EVENT_LOST_IP:
+        // Disconnect events also arrive while an attempt is failing;
+        // only connected -> backoff needs handling here, attempts time out
+        if (state == WIFI_STATE_CONNECTED) {
+          enterBackoff(nowMs);
+        }
+        break;
+    }
+  }
+
+  /**
+   * Advance timers. Returns the driver call the caller should make now.
+   */
+  WifiAction poll(uint32_t nowMs) {
+    switch (state) {
+      case WIFI_STATE_IDLE:
+        return startAttempt(nowMs);
+      case WIFI_STATE_CONNECTING:
+        if (nowMs - stateSince >= connectTimeout) {
+          if (failures < 255) failures++;
+          enterBackoff(nowMs);
+          return WIFI_ACTION_DISCONNECT;
+        }
+        return WIFI_ACTION_NONE;
+      case WIFI_STATE_BACKOFF:
+        if (nowMs - stateSince >= backoffDelay) {
+          return startAttempt(nowMs);
+        }
+        return WIFI_ACTION_NONE;
+      default:
+        return WIFI_ACTION_NONE;
+    }
+  }
+
+  /**
+   * True exactly once, after the first successful connection
+   */
+  bool takeFirstConnect() {
+    bool pending = firstConnectPending;
+    firstConnectPending = false;
+    return pending;
+  }
+
+  WifiState getState() const { return state; }
+  bool isConnected() const { return state == WIFI_STATE_CONNECTED; }
+  uint32_t currentBackoff() const { return backoffDelay; }
+  uint32_t reconnects() const { return reconnectCount; }
+  uint32_t attempts() const { return attemptCount; }
+
+private:
+  WifiAction startAttempt(uint32_t nowMs) {
+    state = WIFI_STATE_CONNECTING;
+    stateSince = nowMs;
+    attemptCount++;
+    return WIFI_ACTION_CONNECT;
+  }
+
+  // Exponential backoff (base * 2^failures, capped) with +/-25% jitter
+  void enterBackoff(uint32_t nowMs) {
+    uint32_t delay = baseBackoff;
+    for (uint8_t i = 0; i < failures && delay < maxBackoff; i++) delay *= 2;
+    if (delay > maxBackoff) delay = maxBackoff;
+    uint32_t spread = delay / 2;
+    if (spread > 0) delay = delay - delay / 4 + nextRandom() % (spread + 1);
+    backoffDelay = delay;
+    state = WIFI_STATE_BACKOFF;
+    stateSince = nowMs;
+  }
+
+  // xorshift32, good enough to de-synchronize reconnect storms
+  uint32_t nextRandom() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+  }
+
+  uint32_t baseBackoff;
+  uint32_t maxBackoff;
+  uint32_t connectTimeout;
+  uint32_t rng;
+
+  WifiState state = WIFI_STATE_IDLE;
+  uint32_t stateSince = 0;
+  uint32_t backoffDelay = 0;
+  uint8_t failures = 0;
+  bool everConnected = false;
+  bool firstConnectPending = false;
+  uint32_t reconnectCount = 0;
+  uint32_t attemptCount = 0;
+};
+
+#endif
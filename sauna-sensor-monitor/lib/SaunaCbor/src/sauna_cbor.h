@@ -0,0 +1,426 @@
+#ifndef SAUNA_CBOR_H
+#define SAUNA_CBOR_H
+
+/*************************************************************
+  Binary /data readings (CBOR, RFC 8949)
+
+  Self-contained: the firmware encodes with CborWriter, collectors
+  copy this one header and decode with decodeSaunaReadings(). Only
+  <stdint.h>, <stddef.h> and <string.h> are needed.
+
+  The body is one CBOR map with small integer keys:
+    0   version        uint, SAUNA_CBOR_VERSION
+    1   seq            uint, sequence number of the current reading
+    2   time           uint, epoch seconds (seconds since boot before NTP)
+    3   temperature    int, 0.1 °C
+    4   humidity       int, %
+    5   session        uint, minutes of the current session
+    6   readyIn        int minutes or null
+    7   coolIn         int minutes or null
+    8   etaConfidence  uint, 0..100
+    9   times          array: first point's time, then deltas in seconds
+    10  temps          array: first point in 0.1 °C, then deltas
+    11  hums           array: first point in %, then deltas
+    12  sensorTemps    array: each sensor in 0.1 °C, or null (several sensors only)
+    13  sensorHums     array: each sensor in %, or null (several sensors only)
+    14  statsActive    uint, 1 while the session runs, 0 once it has ended
+    15  meanTemp       int, 0.1 °C, time-weighted over the session
+    16  tempSd         uint, 0.1 °C, standard deviation
+    17  above60        uint, minutes at or above 60 °C
+    18  above80        uint, minutes at or above 80 °C
+    19  humidityMin    uint, humidity-time integral in %·min
+    20  heatDose       uint, °C·min above 37 °C
+    21  throws         uint, steam throws detected
+  Keys 14..21 describe the current or last finished session and are
+  left out until the first session.
+  History points are oldest first. Consecutive readings differ by a
+  few tenths of a degree, so most deltas fit the one-byte CBOR
+  integer (-24..23). Decoders skip keys they do not know; a new
+  version number is only used for changes old decoders would
+  misread.
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SAUNA_CBOR_VERSION     1
+#define SAUNA_CBOR_MAX_POINTS  128    // History points a decoder accepts
+#define SAUNA_CBOR_MAX_SENSORS 32     // Sensors a decoder accepts
+#define SAUNA_CBOR_MAX_DEPTH   8      // Nesting skipped in unknown values
+
+enum SaunaCborKey : uint8_t {
+  SAUNA_CBOR_KEY_VERSION,
+  SAUNA_CBOR_KEY_SEQ,
+  SAUNA_CBOR_KEY_TIME,
+  SAUNA_CBOR_KEY_TEMPERATURE,
+  SAUNA_CBOR_KEY_HUMIDITY,
+  SAUNA_CBOR_KEY_SESSION,
+  SAUNA_CBOR_KEY_READY_IN,
+  SAUNA_CBOR_KEY_COOL_IN,
+  SAUNA_CBOR_KEY_ETA_CONFIDENCE,
+  SAUNA_CBOR_KEY_TIMES,
+  SAUNA_CBOR_KEY_TEMPS,
+  SAUNA_CBOR_KEY_HUMS,
+  SAUNA_CBOR_KEY_SENSOR_TEMPS,
+  SAUNA_CBOR_KEY_SENSOR_HUMS,
+  SAUNA_CBOR_KEY_STATS_ACTIVE,
+  SAUNA_CBOR_KEY_MEAN_TEMP,
+  SAUNA_CBOR_KEY_TEMP_SD,
+  SAUNA_CBOR_KEY_ABOVE_60,
+  SAUNA_CBOR_KEY_ABOVE_80,
+  SAUNA_CBOR_KEY_HUMIDITY_MINUTES,
+  SAUNA_CBOR_KEY_HEAT_DOSE,
+  SAUNA_CBOR_KEY_THROWS
+};
+
+/**
+ * Minimal CBOR writer into a caller-provided buffer, never allocates.
+ * If the buffer is too small the output is cut short and overflowed()
+ * returns true.
+ */
+class CborWriter {
+public:
+  CborWriter(uint8_t *buffer, size_t capacity) : buf(buffer), cap(capacity) {}
+
+  void uinteger(uint64_t value) { head(0, value); }
+  void integer(int64_t value) {
+    if (value < 0) head(1, (uint64_t)(-1 - value));
+    else head(0, (uint64_t)value);
+  }
+  void beginArray(size_t count) { head(4, count); }
+  void beginMap(size_t pairs) { head(5, pairs); }
+  void null() { put(0xF6); }
+
+  size_t length() const { return len; }
+  bool overflowed() const { return overflow; }
+
+private:
+  // Major type and argument in the shortest form
+  void head(uint8_t major, uint64_t arg) {
+    uint8_t mt = major << 5;
+    if (arg < 24) {
+      put(mt | (uint8_t)arg);
+    } else if (arg <= 0xFF) {
+      put(mt | 24);
+      put((uint8_t)arg);
+    } else if (arg <= 0xFFFF) {
+      put(mt | 25);
+      putBe(arg, 2);
+    } else if (arg <= 0xFFFFFFFFULL) {
+      put(mt | 26);
+      putBe(arg, 4);
+    } else {
+      put(mt | 27);
+      putBe(arg, 8);
+    }
+  }
+
+  void putBe(uint64_t v, uint8_t bytes) {
+    while (bytes--) put((uint8_t)(v >> (8 * bytes)));
+  }
+
+  void put(uint8_t b) {
+    if (len < cap) buf[len++] = b;
+    else overflow = true;
+  }
+
+  uint8_t *buf;
+  size_t cap;
+  size_t len = 0;
+  bool overflow = false;
+};
+
+/**
+ * Minimal CBOR reader: definite-length items only, which is all
+ * CborWriter produces. Every call returns false on malformed or
+ * truncated input and leaves the reader failed.
+ */
+class CborReader {
+public:
+  CborReader(const uint8_t *data, size_t size) : p(data), end(data + size) {}
+
+  bool uinteger(uint64_t &value) {
+    uint8_t major;
+    return head(major, value) && (major == 0 || fail());
+  }
+  bool integer(int64_t &value) {
+    uint8_t major;
+    uint64_t arg;
+    if (!head(major, arg) || major > 1 || arg > (uint64_t)INT64_MAX) return fail();
+    value = major == 0 ? (int64_t)arg : -1 - (int64_t)arg;
+    return true;
+  }
+  // Integer, or null reported as isNull
+  bool integerOrNull(int64_t &value, bool &isNull) {
+    isNull = p < end && *p == 0xF6;
+    if (isNull) {
+      p++;
+      return true;
+    }
+    return integer(value);
+  }
+  bool beginArray(uint64_t &count) {
+    uint8_t major;
+    return head(major, count) && (major == 4 || fail());
+  }
+  bool beginMap(uint64_t &pairs) {
+    uint8_t major;
+    return head(major, pairs) && (major == 5 || fail());
+  }
+
+  // Step over one complete item of any type
+  bool skip() { return skipItem(0); }
+
+  bool atEnd() const { return p == end; }
+  bool failed() const { return bad; }
+
+private:
+  bool head(uint8_t &major, uint64_t &arg) {
+    if (bad || p >= end) return fail();
+    uint8_t ib = *p++;
+    major = ib >> 5;
+    uint8_t info = ib & 0x1F;
+    if (info < 24) {
+      arg = info;
+      return true;
+    }
+    if (info > 27) return fail();                 // Indefinite length or reserved
+    uint8_t bytes = 1 << (info - 24);
+    if ((size_t)(end - p) < bytes) return fail();
+    arg = 0;
+    while (bytes--) arg = (arg << 8) | *p++;
+    return true;
+  }
+
+  bool skipItem(uint8_t depth) {
+    uint8_t major;
+    uint64_t arg;
+    if (depth > SAUNA_CBOR_MAX_DEPTH || !head(major, arg)) return fail();
+    switch (major) {
+      case 2: case 3:                             // Byte / text string
+        if ((uint64_t)(end - p) < arg) return fail();
+        p += arg;
+        return true;
+      case 4: case 5: {                           // Array / map
+        uint64_t items = major == 5 ? arg * 2 : arg;
+        if (items > (uint64_t)(end - p)) return fail();   // Each item is at least a byte
+        for (uint64_t i = 0; i < items; i++) {
+          if (!skipItem(depth + 1)) return false;
+        }
+        return true;
+      }
+      case 6:                                     // Tag, then its item
+        return skipItem(depth + 1);
+      default:                                    // Integers, simple values, floats
+        return true;
+    }
+  }
+
+  bool fail() {
+    bad = true;
+    return false;
+  }
+
+  const uint8_t *p;
+  const uint8_t *end;
+  bool bad = false;
+};
+
+// Decoded /data readings, temperatures in °C
+struct SaunaReadings {
+  uint32_t version;
+  uint32_t seq;
+  uint32_t time;
+  float temperature;
+  int16_t humidity;
+  uint32_t sessionMinutes;
+  int16_t readyMinutes;    // -1 when unknown
+  int16_t coolMinutes;     // -1 when unknown
+  uint8_t etaConfidence;
+  size_t count;            // History points
+  uint32_t times[SAUNA_CBOR_MAX_POINTS];
+  float temps[SAUNA_CBOR_MAX_POINTS];
+  int16_t hums[SAUNA_CBOR_MAX_POINTS];
+  uint8_t sensorCount;     // 0 with a single sensor
+  uint32_t sensorValid;    // Bit i: sensor i has a reading
+  float sensorTemps[SAUNA_CBOR_MAX_SENSORS];
+  int16_t sensorHums[SAUNA_CBOR_MAX_SENSORS];
+  bool hasStats;           // Session analytics present (keys 14..21)
+  bool statsActive;
+  float meanTemp;          // °C
+  float tempSd;            // °C
+  uint32_t above60Minutes;
+  uint32_t above80Minutes;
+  uint32_t humidityMinutes;  // %·min
+  uint32_t heatDose;       // °C·min
+  uint16_t throws;
+};
+
+namespace sauna_cbor_detail {
+
+// Delta-encoded array: first value absolute, the rest relative to the previous
+template <typename T, typename Convert>
+bool readDeltas(CborReader &r, T *out, size_t &count, Convert convert) {
+  uint64_t n;
+  if (!r.beginArray(n) || n > SAUNA_CBOR_MAX_POINTS) return false;
+  int64_t value = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    int64_t delta;
+    if (!r.integer(delta)) return false;
+    value += delta;
+    out[i] = convert(value);
+  }
+  count = n;
+  return true;
+}
+
+// Per-sensor array, null for a sensor without a reading (cleared in *valid)
+template <typename T, typename Convert>
+bool readSensors(CborReader &r, T *out, uint8_t &count, uint32_t *valid, Convert convert) {
+  uint64_t n;
+  if (!r.beginArray(n) || n > SAUNA_CBOR_MAX_SENSORS) return false;
+  for (uint64_t i = 0; i < n; i++) {
+    int64_t value = 0;
+    bool isNull;
+    if (!r.integerOrNull(value, isNull)) return false;
+    out[i] = convert(value);
+    if (isNull) *valid &= ~(1UL << i);
+  }
+  count = (uint8_t)n;
+  return true;
+}
+
+inline int16_t minutesOrUnknown(int64_t v, bool isNull) {
+  return isNull || v < 0 || v > INT16_MAX ? -1 : (int16_t)v;
+}
+
+}  // namespace sauna_cbor_detail
+
+/**
+ * Decode a /data CBOR body. Returns false on malformed input, a
+ * version newer than SAUNA_CBOR_VERSION or more history points than
+ * SAUNA_CBOR_MAX_POINTS.
+ */
+inline bool decodeSaunaReadings(const uint8_t *data, size_t size, SaunaReadings &out) {
+  using namespace sauna_cbor_detail;
+  memset(&out, 0, sizeof(out));
+  out.readyMinutes = out.coolMinutes = -1;
+
+  CborReader r(data, size);
+  uint64_t pairs;
+  if (!r.beginMap(pairs)) return false;
+  size_t times = 0, temps = 0, hums = 0;
+  uint8_t sensorTemps = 0, sensorHums = 0;
+  out.sensorValid = 0xFFFFFFFFUL;
+  for (uint64_t i = 0; i < pairs; i++) {
+    uint64_t key, u = 0;
+    int64_t v = 0;
+    bool isNull;
+    if (!r.uinteger(key)) return false;
+    bool ok;
+    switch (key) {
+      case SAUNA_CBOR_KEY_VERSION:
+        ok = r.uinteger(u) && u <= SAUNA_CBOR_VERSION;
+        out.version = (uint32_t)u;
+        break;
+      case SAUNA_CBOR_KEY_SEQ:
+        ok = r.uinteger(u);
+        out.seq = (uint32_t)u;
+        break;
+      case SAUNA_CBOR_KEY_TIME:
+        ok = r.uinteger(u);
+        out.time = (uint32_t)u;
+        break;
+      case SAUNA_CBOR_KEY_TEMPERATURE:
+        ok = r.integer(v);
+        out.temperature = v / 10.0f;
+        break;
+      case SAUNA_CBOR_KEY_HUMIDITY:
+        ok = r.integer(v);
+        out.humidity = (int16_t)v;
+        break;
+      case SAUNA_CBOR_KEY_SESSION:
+        ok = r.uinteger(u);
+        out.sessionMinutes = (uint32_t)u;
+        break;
+      case SAUNA_CBOR_KEY_READY_IN:
+        ok = r.integerOrNull(v, isNull);
+        out.readyMinutes = minutesOrUnknown(v, isNull);
+        break;
+      case SAUNA_CBOR_KEY_COOL_IN:
+        ok = r.integerOrNull(v, isNull);
+        out.coolMinutes = minutesOrUnknown(v, isNull);
+        break;
+      case SAUNA_CBOR_KEY_ETA_CONFIDENCE:
+        ok = r.uinteger(u);
+        out.etaConfidence = u > 100 ? 100 : (uint8_t)u;
+        break;
+      case SAUNA_CBOR_KEY_TIMES:
+        ok = readDeltas(r, out.times, times, [](int64_t x) { return (uint32_t)x; });
+        break;
+      case SAUNA_CBOR_KEY_TEMPS:
+        ok = readDeltas(r, out.temps, temps, [](int64_t x) { return x / 10.0f; });
+        break;
+      case SAUNA_CBOR_KEY_HUMS:
+        ok = readDeltas(r, out.hums, hums, [](int64_t x) { return (int16_t)x; });
+        break;
+      case SAUNA_CBOR_KEY_SENSOR_TEMPS:
+        ok = readSensors(r, out.sensorTemps, sensorTemps, &out.sensorValid,
+                         [](int64_t x) { return x / 10.0f; });
+        break;
+      case SAUNA_CBOR_KEY_SENSOR_HUMS:
+        ok = readSensors(r, out.sensorHums, sensorHums, &out.sensorValid,
+                         [](int64_t x) { return (int16_t)x; });
+        break;
+      case SAUNA_CBOR_KEY_STATS_ACTIVE:
+        ok = r.uinteger(u);
+        out.hasStats = true;
+        out.statsActive = u != 0;
+        break;
+      case SAUNA_CBOR_KEY_MEAN_TEMP:
+        ok = r.integer(v);
+        out.meanTemp = v / 10.0f;
+        break;
+      case SAUNA_CBOR_KEY_TEMP_SD:
+        ok = r.uinteger(u);
+        out.tempSd = u / 10.0f;
+        break;
+      case SAUNA_CBOR_KEY_ABOVE_60:
+        ok = r.uinteger(u);
+        out.above60Minutes = (uint32_t)u;
+        break;
+      case SAUNA_CBOR_KEY_ABOVE_80:
+        ok = r.uinteger(u);
+        out.above80Minutes = (uint32_t)u;
+        break;
+      case SAUNA_CBOR_KEY_HUMIDITY_MINUTES:
+        ok = r.uinteger(u);
+        out.humidityMinutes = (uint32_t)u;
+        break;
+      case SAUNA_CBOR_KEY_HEAT_DOSE:
+        ok = r.uinteger(u);
+        out.heatDose = (uint32_t)u;
+        break;
+      case SAUNA_CBOR_KEY_THROWS:
+        ok = r.uinteger(u);
+        out.throws = u > 0xFFFF ? 0xFFFF : (uint16_t)u;
+        break;
+      default:
+        ok = r.skip();
+        break;
+    }
+    if (!ok) return false;
+  }
+  // The three history arrays must agree
+  if ((times && temps && times != temps) || (times && hums && times != hums) ||
+      (temps && hums && temps != hums)) {
+    return false;
+  }
+  out.count = times ? times : temps ? temps : hums;
+  if (sensorTemps != sensorHums) return false;
+  out.sensorCount = sensorTemps;
+  out.sensorValid = sensorTemps ? out.sensorValid & (0xFFFFFFFFUL >> (32 - sensorTemps)) : 0;
+  return out.version > 0 && r.atEnd();
+}
+
+#endif
@@ -0,0 +1,87 @@
+"""
+Build step for the web dashboard.
+
+Inlines the scripts referenced from web/index.html, minifies the result,
+gzips it and writes include/dashboard.h with the bytes as a flash-resident
+array plus a content-hash ETag. Runs as a PlatformIO pre-build script and
+can also be run by hand:
+
+    python scripts/build_dashboard.py
+"""
+import gzip
+import hashlib
+import os
+import re
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+WEB_DIR = os.path.join(PROJECT_DIR, "web")
+OUTPUT = os.path.join(PROJECT_DIR, "include", "dashboard.h")
+
+
+def inline_scripts(html):
+    """Replace <script src='x.js'></script> with the file contents"""
+    def repl(match):
+        with open(os.path.join(WEB_DIR, match.group(1)), encoding="utf-8") as f:
+            return "<script>\n" + f.read() + "\n</script>"
+    return re.sub(r"<script src=['\"]([^'\"]+)['\"]></script>", repl, html)
+
+
+def minify(text):
+    """Conservative minifier: drops comments, indentation and blank lines.
+    Line breaks are kept so JavaScript semicolon insertion is unaffected."""
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    lines = []
+    for line in text.splitlines():
+        line = line.strip()
+        if not line or line.startswith("//"):
+            continue
+        lines.append(line)
+    return "\n".join(lines)
+
+
+def render_header(data, etag):
+    rows = []
+    for i in range(0, len(data), 16):
+        rows.append("  " + ",".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return (
+        "#ifndef DASHBOARD_H\n"
+        "#define DASHBOARD_H\n"
+        "\n"
+        "// Generated by scripts/build_dashboard.py from web/ - do not edit\n"
+        "\n"
+        "#define DASHBOARD_ETAG \"\\\"%s\\\"\"\n"
+        "\n"
+        "static const size_t DASHBOARD_HTML_GZ_LEN = %d;\n"
+        "static const uint8_t DASHBOARD_HTML_GZ[] PROGMEM = {\n"
+        "%s\n"
+        "};\n"
+        "\n"
+        "#endif\n"
+    ) % (etag, len(data), "\n".join(rows))
+
+
+def build():
+    with open(os.path.join(WEB_DIR, "index.html"), encoding="utf-8") as f:
+        page = minify(inline_scripts(f.read())).encode("utf-8")
+
+    # mtime=0 keeps the output (and therefore the ETag) reproducible
+    data = gzip.compress(page, compresslevel=9, mtime=0)
+    etag = hashlib.sha1(data).hexdigest()[:16]
+    header = render_header(data, etag)
+
+    # Only touch the header when it changes to avoid needless rebuilds
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, encoding="utf-8") as f:
+            if f.read() == header:
+                return
+    with open(OUTPUT, "w", encoding="utf-8") as f:
+        f.write(header)
+    print("Dashboard: %d bytes -> %d bytes gzip, ETag %s" % (len(page), len(data), etag))
+
+
+build()
@@ -0,0 +1,134 @@
+"""
+Compress a firmware image for the /ota endpoint (include/ota_update.h).
+
+Writes <image>.gz (gzip, DEFLATE window of --gzip-window-bits) and
+<image>.hs (heatshrink behind the 4-byte "HS" header) next to the
+image, and prints the sizes, the SHA-256 the device checks, and the
+upload command. The gzip window must not exceed the device's
+OTA_GZIP_WINDOW_BITS, the heatshrink one OTA_HEATSHRINK_MAX_WINDOW_BITS.
+
+    python scripts/compress_firmware.py
+    python scripts/compress_firmware.py .pio/build/lolin_c3_mini/firmware.bin --hs-window-bits 12
+"""
+import argparse
+import hashlib
+import os
+import sys
+import zlib
+
+DEFAULT_IMAGE = os.path.join(".pio", "build", "lolin_c3_mini", "firmware.bin")
+HASH_CHAIN = 48        # Candidates tried per position; more is smaller and slower
+
+
+def gzip_image(data, window_bits):
+    """gzip member whose back-references stay within 2^window_bits bytes"""
+    compressor = zlib.compressobj(9, zlib.DEFLATED, 16 + window_bits, 9)
+    return compressor.compress(data) + compressor.flush()
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.count = 0
+
+    def write(self, value, bits):
+        self.acc = (self.acc << bits) | value
+        self.count += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.out.append((self.acc >> self.count) & 0xFF)
+        self.acc &= (1 << self.count) - 1
+
+    def finish(self):
+        if self.count:
+            self.out.append((self.acc << (8 - self.count)) & 0xFF)
+        return bytes(self.out)
+
+
+def heatshrink_image(data, window_bits, lookahead_bits):
+    """Greedy LZSS in heatshrink's bit format, with the "HS" header"""
+    window = 1 << window_bits
+    lookahead = 1 << lookahead_bits
+    # A back-reference has to be cheaper than the literals it replaces
+    min_len = max(3, (1 + window_bits + lookahead_bits) // 9 + 1)
+    bits = BitWriter()
+    chains = {}
+    n = len(data)
+    i = 0
+
+    def insert(pos):
+        if pos + 3 <= n:
+            chain = chains.setdefault(data[pos:pos + 3], [])
+            chain.append(pos)
+            if len(chain) > 2 * HASH_CHAIN:
+                del chain[:HASH_CHAIN]
+
+    while i < n:
+        best_len, best_off = 0, 0
+        limit = min(lookahead, n - i)
+        chain = chains.get(data[i:i + 3]) if limit >= 3 else None
+        if chain:
+            for pos in reversed(chain[-HASH_CHAIN:]):
+                offset = i - pos
+                if offset > window:
+                    break
+                length = 3
+                while length < limit and data[pos + length] == data[i + length]:
+                    length += 1
+                if length > best_len:
+                    best_len, best_off = length, offset
+                    if length == limit:
+                        break
+        if best_len >= min_len:
+            bits.write(0, 1)
+            bits.write(best_off - 1, window_bits)
+            bits.write(best_len - 1, lookahead_bits)
+            for pos in range(i, i + best_len):
+                insert(pos)
+            i += best_len
+        else:
+            bits.write(1, 1)
+            bits.write(data[i], 8)
+            insert(i)
+            i += 1
+    return b"HS" + bytes([window_bits, lookahead_bits]) + bits.finish()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("image", nargs="?", default=DEFAULT_IMAGE)
+    parser.add_argument("--gzip-window-bits", type=int, default=15, choices=range(9, 16))
+    parser.add_argument("--hs-window-bits", type=int, default=11, choices=range(4, 16))
+    parser.add_argument("--hs-lookahead-bits", type=int, default=4)
+    parser.add_argument("--host", default="sauna.local")
+    parser.add_argument("--link-kbps", type=float, default=120.0,
+                        help="upload rate used for the time estimate, KB/s")
+    args = parser.parse_args()
+    if not 3 <= args.hs_lookahead_bits < args.hs_window_bits:
+        parser.error("--hs-lookahead-bits must be at least 3 and below --hs-window-bits")
+
+    with open(args.image, "rb") as f:
+        data = f.read()
+    if not data or data[0] != 0xE9:
+        print(f"warning: {args.image} does not start with the ESP image magic", file=sys.stderr)
+    digest = hashlib.sha256(data).hexdigest()
+
+    outputs = [
+        (args.image + ".gz", gzip_image(data, args.gzip_window_bits)),
+        (args.image + ".hs", heatshrink_image(data, args.hs_window_bits, args.hs_lookahead_bits)),
+    ]
+    raw_s = len(data) / 1024 / args.link_kbps
+    print(f"{args.image}: {len(data)} bytes, ~{raw_s:.1f} s at {args.link_kbps:g} KB/s")
+    for path, body in outputs:
+        with open(path, "wb") as f:
+            f.write(body)
+        secs = len(body) / 1024 / args.link_kbps
+        print(f"{path}: {len(body)} bytes ({100.0 * len(body) / len(data):.1f}%), "
+              f"~{secs:.1f} s, saves ~{raw_s - secs:.1f} s")
+    print(f"sha256 {digest}")
+    print(f"curl -F image=@{outputs[0][0]} 'http://{args.host}/ota?sha256={digest}'")
+
+
+if __name__ == "__main__":
+    main()
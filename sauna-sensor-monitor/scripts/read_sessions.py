@@ -0,0 +1,76 @@
+"""
+Host-side reader for the session log (include/session_log.h).
+
+Reads a sessions.bin pulled off the device (or written by the native
+simulator with --session-log) and prints the sessions as a table or CSV.
+Records failing their CRC are reported and skipped.
+
+    python scripts/read_sessions.py sessions.bin
+    python scripts/read_sessions.py sessions.bin --from 2025-01-01 --to 2025-02-01 --csv
+"""
+import argparse
+import bisect
+import datetime
+import struct
+import sys
+import zlib
+
+RECORD = struct.Struct("<IIhHBBHI")  # start, duration, peak, hum, throws, above80, dose, crc
+assert RECORD.size == 20
+
+
+def parse_date(text):
+    """YYYY-MM-DD (UTC) or raw epoch seconds"""
+    if text.isdigit():
+        return int(text)
+    day = datetime.datetime.strptime(text, "%Y-%m-%d").replace(tzinfo=datetime.timezone.utc)
+    return int(day.timestamp())
+
+
+def read_log(path):
+    """Yield (index, start, duration_s, peak_c, humidity, throws, above80_min, heat_dose)
+    for each valid record; records written before the analytics existed read as 0"""
+    with open(path, "rb") as f:
+        data = f.read()
+    whole = len(data) // RECORD.size
+    if len(data) % RECORD.size:
+        print(f"warning: {len(data) % RECORD.size} trailing bytes (torn write)", file=sys.stderr)
+    for i in range(whole):
+        chunk = data[i * RECORD.size:(i + 1) * RECORD.size]
+        start, duration, peak, hum, throws, above80, dose, crc = RECORD.unpack(chunk)
+        if zlib.crc32(chunk[:16]) != crc:
+            print(f"warning: record {i} fails CRC, skipped", file=sys.stderr)
+            continue
+        yield i, start, duration, peak / 100.0, hum / 100.0, throws, above80, dose
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("log", help="session log file (sessions.bin)")
+    parser.add_argument("--from", dest="since", type=parse_date, default=0,
+                        help="first start date, YYYY-MM-DD or epoch")
+    parser.add_argument("--to", dest="until", type=parse_date, default=2**32 - 1,
+                        help="last start date (exclusive), YYYY-MM-DD or epoch")
+    parser.add_argument("--csv", action="store_true", help="print CSV instead of a table")
+    args = parser.parse_args()
+
+    records = list(read_log(args.log))
+    starts = [r[1] for r in records]  # Sorted on the device, same lookup as lowerBound()
+    selected = records[bisect.bisect_left(starts, args.since):bisect.bisect_left(starts, args.until)]
+
+    if args.csv:
+        print("start_utc,start_epoch,duration_min,peak_c,mean_humidity,throws,above80_min,heat_dose")
+    for _, start, duration, peak, hum, throws, above80, dose in selected:
+        when = datetime.datetime.fromtimestamp(start, datetime.timezone.utc).strftime("%Y-%m-%d %H:%M")
+        if args.csv:
+            print(f"{when},{start},{duration / 60:.1f},{peak:.1f},{hum:.1f},{throws},{above80},{dose}")
+        else:
+            print(f"{when}  {duration // 60:4d} min  peak {peak:5.1f}°C  humidity {hum:4.1f}%  "
+                  f"{above80:3d} min >80°C  dose {dose:5d}°C·min  {throws:2d} throws")
+    if not args.csv:
+        total = sum(r[2] for r in selected)
+        print(f"{len(selected)} sessions, {total / 3600:.1f} h in total")
+
+
+if __name__ == "__main__":
+    main()
@@ -3,6 +3,28 @@
 *************************************************************/
 #include <Arduino.h>
 #include "images.h"         // For OLED display images
+#include "history.h"        // Multi-resolution sensor history
+#include "dashboard.h"      // Gzipped web dashboard, generated from web/
+#include "data_json.h"      // Allocation-free /data and live-update JSON
+#include "data_cbor.h"      // Binary /data body for collectors
+#include "response_cache.h" // /data built once per sample, shared by all clients
+#include "snapshot.h"       // Seqlock-protected latest sensor sample
+#include "rtos_port.h"      // Tasks, queues and drift-free delays
+#include "wifi_manager.h"   // Non-blocking WiFi state machine
+#include "oled_diff.h"      // Changed-region tracking for the OLED
+#include "sauna_state.h"    // Session detection logic
+#include "hal_esp32.h"      // Sensor, display, clock and network HAL
+#include "session_log.h"    // Append-only session records on flash
+#include "history_export.h" // Chunked CSV/binary history export
+#include "power_mode.h"     // Adaptive sampling and low-power idle
+#include "eta_model.h"      // Heat-up / cool-down prediction
+#include "mqtt_publisher.h" // MQTT publishing with store-and-forward
+#include "metrics.h"        // Runtime performance counters for /metrics
+#include "trace_recorder.h" // Hot-path timeline for /trace
+#include "ota_update.h"     // Compressed, streaming firmware updates for /ota
+#include "boot_timing.h"    // Boot phase timeline, late NTP sync
+#include "session_stats.h"  // Per-session analytics, steam-throw detection
+#include "task_graph.h"     // Sensor, display and network tasks and their hand-offs
 #include "secrets.h"         // Contains WIFI_SSID, WIFI_PASS, BLYNK_AUTH_TOKEN
 
 #include <SPI.h>
@@ -17,6 +39,8 @@
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
 #include <ElegantOTA.h>     // OTA update functionality
+#include <LittleFS.h>        // Flash filesystem for the session log
+#include <memory>
 
 #include <time.h>            // For NTP time synchronization
 
@@ -32,32 +56,164 @@
 #define SCREEN_ADDRESS 0x3C     // I2C address for OLED display
 #define SDA_PIN 6              // OLED SDA pin
 #define SCL_PIN 7              // OLED SCL pin
+#define OLED_PAGES (SCREEN_HEIGHT / 8)  // SSD1306 pages of 8 pixel rows
+
+// SHT2x sensors; with more than one, sensor i sits on port i of a TCA9548A
+#ifndef SENSOR_COUNT
+#define SENSOR_COUNT 1
+#endif
+#ifndef SENSOR_MUX_ADDRESS
+#define SENSOR_MUX_ADDRESS 0x70
+#endif
 
 /*************************************************************
   Global Objects
 *************************************************************/
-SHT2x sht;                      // For SHT temperature/humidity sensors
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
 AsyncWebServer server(80);      // Web server for OTA updates and file access
+AsyncEventSource events("/events");  // Server-Sent Events push channel for live readings
+
+// Hardware abstraction, everything below the application logic goes through these
+Esp32Clock clockHal;
+Esp32Sensor sensorHals[SENSOR_COUNT];    // One SHT2x driver per sensor, all on Wire
+Esp32Tca9548a sensorMux(Wire, SENSOR_MUX_ADDRESS);  // Only used with several sensors
+SensorPort sensorPorts[SENSOR_COUNT];
+static_assert(SENSOR_COUNT >= 1 && SENSOR_COUNT <= SENSOR_MAX_CHANNELS &&
+              SENSOR_COUNT <= Esp32Tca9548a::PORTS, "SENSOR_COUNT must be 1..8");
+Esp32Display displayHal(display, Wire, SCREEN_ADDRESS);
+Esp32Network networkHal(WIFI_SSID, WIFI_PASS);
+Esp32Power powerHal;
 
 // State variables
 bool pinState = false;          // Tracks toggling state
-bool wifi_connected = false;
-unsigned long last_wifi_attempt = 0;
+volatile bool wifi_connected = false;
+bool network_services_started = false;  // Web server, OTA and NTP, started on first GOT_IP
 
 // OTA update variables
 unsigned long ota_progress_millis = 0;
+volatile int8_t otaPercent = -1;        // Progress bar in the status area, -1 when no update runs
+volatile bool otaScreenHeld = false;    // Reboot message is up, display task leaves the screen alone
+Esp32Firmware firmwareHal;
+OtaUpdate otaUpdate(firmwareHal);       // /ota uploads, decompressed and hashed on the fly
+AsyncWebServerRequest *otaRequest = nullptr;  // Upload that owns otaUpdate (AsyncTCP task)
+bool otaSucceeded = false;
+volatile uint32_t otaRebootAt = 0;      // millis() to restart at after a good /ota upload, 0 = none
+const uint32_t OTA_REBOOT_DELAY_MS = 1000;    // Lets the response reach the uploader first
+
+// OLED partial updates: only changed page/column windows are sent
+OledDiff<SCREEN_WIDTH, OLED_PAGES> oledDiff;
+size_t lastFlushBytes = 0;              // I2C bytes sent by the last flushDisplay()
+const uint32_t THROW_BANNER_MS = 10000; // Status line announces a steam throw this long
+
+// WiFi state machine, driven from the network task by events from networkHal
+WifiManager wifiManager(WIFI_BACKOFF_BASE, WIFI_RETRY_INTERVAL, WIFI_CONNECT_TIMEOUT);
+
+// Sauna session state, sensor task only; other tasks read saunaSnapshot
+SaunaState sauna;
+SeqLock<SaunaStatus> saunaSnapshot;
+
+// "Ready in" / "cool in" prediction, fitted by the sensor task, read by display and web
+EtaModel etaModel;
+SeqLock<EtaPrediction> etaSnapshot;
+
+// Running / last finished session analytics, updated by the sensor task, read by display and web
+SessionStats sessionStats;
+SeqLock<SessionSummary> sessionSnapshot;
+
+// Latest sample, published by the acquisition stage and read everywhere else
+SeqLock<SensorSnapshot> sensorSnapshot;
+uint32_t lastAcquireMicros = 0;          // Bus time of the last SHT2x reads
+AsyncAcquisition acquisition;            // Batched SHT2x conversions, I2C free while converting
+
+// Sensor history (raw / 1 min / 15 min tiers), written by the sensor task, read by web handlers.
+// ~99 KB: the raw tier is a compressed archive of every sample (series_store.h for its span).
+// A mutex, not a spinlock: raw reads decode the archive (a seek and up to a block),
+// too long to mask interrupts for. Priority inheritance bounds the sensor task's wait.
+History history;
+RtosMutex historyMutex;
+
+// /history export cursors carry a per-boot id, since sequence numbers restart at boot
+uint32_t bootId = 0;
+
+// /data bodies of the latest sample, one per format; AsyncTCP task only
+ResponseCache dataJsonCache(0, 'j');
+ResponseCache dataCborCache(0, 'c');
+static_assert(DATA_JSON_BUFFER_SIZE <= RESPONSE_CACHE_BODY_MAX &&
+              DATA_CBOR_BUFFER_SIZE <= RESPONSE_CACHE_BODY_MAX, "/data body does not fit the cache");
+
+// Network task cadence (task layout in task_graph.h)
+const uint32_t NETWORK_POLL_MS = 25;     // OTA/WiFi housekeeping cadence
+const uint32_t NETWORK_IDLE_POLL_MS = 250; // Longer in idle mode so the CPU can sleep
 
-// Timing settings
-const unsigned long WIFI_RETRY_INTERVAL = 60000;  // Try to reconnect WiFi every minute
-const unsigned long WIFI_CONNECT_TIMEOUT = 10000; // 10 seconds timeout for WiFi connection
+RtosMutex i2cMutex;                      // Serializes Wire between sensor, display and OTA screens
+extern TaskGraph tasks;                  // Sensor, display and network tasks, defined under Tasks
 
-// Sauna state variables
-bool saunaActive = false;          // True if sauna session is active
-bool crossed20   = false;          // True if we've crossed 20°C
-unsigned long timeCrossed20 = 0;   // When we first crossed 20°C
-unsigned long saunaStartTime = 0;  // When the sauna session started
-float highestTempDuringSession = 0.0;
+// Finished sessions, kept on LittleFS across reboots
+SessionLog sessionLog;
+#define SESSION_LOG_PATH "/littlefs/sessions.bin"
+const size_t SESSIONS_DEFAULT_LIMIT = 100;  // Records per /sessions page
+const size_t SESSIONS_MAX_LIMIT = 1000;
+SessionRecord pendingSession;            // Ended before NTP synced, start still in uptime seconds
+bool sessionPending = false;
+
+// Boot timeline for the serial log and /metrics; the clock sync that
+// turns readings stamped in uptime into epoch seconds
+BootTimeline bootTimeline;
+ClockSync clockSync;                     // Sensor task only
+
+// MQTT is enabled by defining MQTT_HOST (and optionally MQTT_PORT, MQTT_USER, MQTT_PASS) in secrets.h
+#ifdef MQTT_HOST
+#ifndef MQTT_PORT
+#define MQTT_PORT 1883
+#endif
+#ifndef MQTT_USER
+#define MQTT_USER nullptr
+#define MQTT_PASS nullptr
+#endif
+#define MQTT_QUEUE_PATH "/littlefs/mqtt_queue.bin"
+const uint32_t MQTT_HEALTH_INTERVAL_MS = 60000;
+Esp32Mqtt mqttHal(MQTT_HOST, MQTT_PORT);
+MqttQueue mqttQueue;                     // Readings wait here (RAM, then flash) while the broker is away
+MqttPublisher mqtt(mqttHal, mqttQueue);
+char mqttDeviceId[16];                   // "sauna-" + the low MAC bytes, names topics and HA entities
+#endif
+
+#if METRICS_ENABLED
+// Runtime performance counters, served as Prometheus text by /metrics.
+// Each histogram is written by one task only (see metrics.h).
+LatencyHistogram metricSensorIteration;  // Sensor task work per sample, conversion waits excluded
+LatencyHistogram metricDisplayIteration; // Display task work per redraw, including the I2C lock wait
+LatencyHistogram metricNetworkIteration; // Network task work per wake-up, queue wait excluded
+LatencyHistogram metricSht2x;            // SHT2x bus time per sample
+LatencyHistogram metricOledFlush;        // OLED partial flush
+LatencyHistogram metricDraw;             // draw(): render plus flush
+#endif
+
+#if TRACE_ENABLED
+// Timeline of the last TRACE_EVENTS hot-path events, written by every task
+TraceRecorder<TRACE_EVENTS> tracer;
+#endif
+
+#if METRICS_ENABLED || TRACE_ENABLED
+// HTTP routes timed by the server middleware
+enum HttpRoute { HTTP_ROUTE_ROOT, HTTP_ROUTE_DATA, HTTP_ROUTE_UPDATE, HTTP_ROUTE_OTHER, HTTP_ROUTES };
+const char *const HTTP_ROUTE_TRACE_NAMES[HTTP_ROUTES] = {
+  "http /", "http /data", "http /update", "http other"
+};
+#endif
+#if METRICS_ENABLED
+LatencyHistogram metricRoutes[HTTP_ROUTES];    // Handler time per route, AsyncTCP task
+const char *const METRIC_ROUTE_LABELS[HTTP_ROUTES] = {
+  "route=\"/\"", "route=\"/data\"", "route=\"/update\"", "route=\"other\""
+};
+#endif
+
+// Sampling rate and radio/display power follow the sauna: slow and dim when cold.
+// Other tasks read mode, period and slope from powerSnapshot; powerMutex guards
+// the time and duty-cycle accounting every task adds to.
+PowerManager power;
+RtosMutex powerMutex;
+SeqLock<PowerStatus> powerSnapshot;      // Written by the sensor task in updatePowerMode()
 
 /*************************************************************
   FUNCTION Declarations
@@ -66,19 +222,50 @@ float highestTempDuringSession = 0.0;
 void onOTAStart();
 void onOTAProgress(size_t current, size_t final);
 void onOTAEnd(bool success);
+void handle_ota_upload(AsyncWebServerRequest *request, const String &filename, size_t index,
+                       uint8_t *data, size_t len, bool final);
 
 // WiFi and server functions
-void check_wifi_connection();            // Check and attempt to reconnect WiFi
+void service_wifi_connection();          // Advance the WiFi state machine, never blocks
+void start_network_services();           // NTP, web server and OTA on first connection
 void setup_web_server();                 // Setup web server routes
+uint32_t query_u32(AsyncWebServerRequest *request, const char *name, uint32_t fallback);
+#if METRICS_ENABLED || TRACE_ENABLED
+HttpRoute http_route(const String &url);
+#endif
+#if METRICS_ENABLED
+void write_metrics(Print &out);
+#endif
 
 // Display and sensor functions
-void draw(float temperature, float humidity);
+void draw(const SensorSnapshot &sample);
+void flushDisplay(void);
 void printLocalTime(void);
-float readTemperature(void);
-float readHumidity(void);
+SensorSnapshot acquireSensor(bool quick = false);
+void markBoot(const char *phase);
+
+// Tasks
+void serviceNetwork(void);
+void logStatus(const SensorSnapshot &sample);
+#if TRACE_ENABLED
+void dumpTrace(Print &out);
+#endif
 
 // Application logic
-void updateSaunaState(float currentTemp);
+void updateSaunaState(float currentTemp, float humidity, float spread);
+void updateEta(void);
+void updatePowerMode(float currentTemp);
+void logSession(void);
+uint32_t sessionMinutes(void);
+void recordHistory(float temperature, float humidity);
+void onClockSynced(size_t rebased);
+size_t readHistory(HistoryTier tier, uint32_t seq, HistoryPoint *out, size_t max, uint32_t *first);
+size_t buildDataJson(char *buf, size_t len, const SensorSnapshot &sample,
+                     size_t points, size_t stride);
+size_t buildDataCbor(uint8_t *buf, size_t len, const SensorSnapshot &sample,
+                     size_t points, size_t stride);
+bool wants_cbor(AsyncWebServerRequest *request);
+void publishSample(const SensorSnapshot &sample);
 
 /*************************************************************
   OTA CALLBACK IMPLEMENTATIONS
@@ -87,37 +274,27 @@ void updateSaunaState(float currentTemp);
  * Called when OTA update begins
  */
 void onOTAStart() {
+  TRACE_SCOPE(tracer, "ota_start");
   Serial.println("OTA update started!");
-  // Show update status on display
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setCursor(0, 0);
-  display.println("OTA Update Started");
-  display.display();
+  sessionLog.flush();     // Nothing pending may be lost to the reboot
+  ota_progress_millis = millis();
+  otaPercent = 0;
+  tasks.wakeDisplay();   // Readings stay up, the progress bar takes the status line
 }
 
 /**
  * Called periodically during OTA update process
  */
 void onOTAProgress(size_t current, size_t final) {
+  TRACE_SCOPE(tracer, "ota_progress");
   // Log progress every 1 second
   if (millis() - ota_progress_millis > 1000) {
     ota_progress_millis = millis();
     Serial.printf("OTA Progress: %u of %u bytes (%.1f%%)\n", 
-                 current, final, (current * 100.0) / final);
-    
-    // Update progress on display
-    display.clearDisplay();
-    display.setTextSize(1);
-    display.setCursor(0, 0);
-    display.println("OTA Update Progress:");
-    display.printf("%.1f%%\n", (current * 100.0) / final);
-    
-    // Draw progress bar
-    int barWidth = (current * 100) / final;
-    display.drawRect(14, 30, 100, 10, SSD1306_WHITE);
-    display.fillRect(14, 30, barWidth, 10, SSD1306_WHITE);
-    display.display();
+                 current, final, final ? (current * 100.0) / final : 0.0);
+    // Only the bar changes, so the partial flush sends a few bytes instead of a frame
+    otaPercent = final ? (current * 100) / final : 0;
+    tasks.wakeDisplay();
   }
 }
 
@@ -125,423 +302,507 @@ void onOTAProgress(size_t current, size_t final) {
  * Called when OTA update completes
  */
 void onOTAEnd(bool success) {
-  if (success) {
-    Serial.println("OTA update completed successfully!");
-    display.clearDisplay();
-    display.setTextSize(1);
-    display.setCursor(0, 0);
-    display.println("OTA Update Complete!");
-    display.println("Rebooting...");
-    display.display();
-  } else {
+  TRACE_SCOPE(tracer, "ota_end");
+  otaPercent = -1;
+  if (!success) {
     Serial.println("Error during OTA update!");
-    display.clearDisplay();
-    display.setTextSize(1);
-    display.setCursor(0, 0);
-    display.println("OTA Update Failed!");
-    display.display();
+    tasks.wakeDisplay();
+    return;
+  }
+  Serial.println("OTA update completed successfully!");
+  otaScreenHeld = true;
+  RtosLock lock(i2cMutex);
+  oledDiff.invalidate();  // Full-screen writes below bypass flushDisplay()
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  display.println("OTA Update Complete!");
+  display.println("Rebooting...");
+  display.display();
+}
+
+/**
+ * /ota upload body. Each piece goes straight through the decompressor
+ * and hash into the inactive partition, on the AsyncTCP task, so the
+ * sensor and display tasks carry on. The request handler reports.
+ */
+void handle_ota_upload(AsyncWebServerRequest *request, const String &filename, size_t index,
+                       uint8_t *data, size_t len, bool final) {
+  if (index == 0) {
+    if (otaRequest) {                   // Another upload owns the partition
+      if (otaRequest == request) otaUpdate.abort("one image per upload");
+      return;
+    }
+    otaRequest = request;
+    otaSucceeded = false;
+    request->onDisconnect([request]() {
+      if (otaRequest != request) return;
+      otaUpdate.abort("upload interrupted");
+      otaRequest = nullptr;
+      onOTAEnd(false);
+    });
+    uint8_t sha[SHA256_DIGEST_LEN];
+    bool haveSha = request->hasParam("sha256");
+    bool shaOk = haveSha && parseSha256Hex(request->getParam("sha256")->value().c_str(), sha);
+    if (!otaUpdate.begin(millis(), shaOk ? sha : nullptr)) return;
+    if (haveSha && !shaOk) {
+      otaUpdate.abort("sha256 must be 64 hex digits");
+      return;
+    }
+    onOTAStart();
   }
+  if (request != otaRequest || !otaUpdate.active()) return;
+
+  if (len) otaUpdate.write(data, len);
+  if (!final) {
+    if (otaUpdate.active()) onOTAProgress(otaUpdate.received(), request->contentLength());
+    else onOTAEnd(false);
+    return;
+  }
+  otaSucceeded = otaUpdate.finish(millis());
+  Serial.printf("OTA %s: %lu bytes %s -> %lu byte image in %lu ms, ~%lu ms of transfer saved\n",
+                otaSucceeded ? "done" : "failed", (unsigned long)otaUpdate.received(),
+                OTA_FORMAT_NAMES[otaUpdate.format()], (unsigned long)otaUpdate.written(),
+                (unsigned long)otaUpdate.elapsedMs(), (unsigned long)otaUpdate.savedMs());
+  if (otaSucceeded) otaRebootAt = (millis() + OTA_REBOOT_DELAY_MS) | 1;
+  onOTAEnd(otaSucceeded);
 }
 
 /*************************************************************
   Web Server Setup
 *************************************************************/
 void setup_web_server() {
-  // Root page with enhanced interface
+  // Root page: prebuilt, gzipped dashboard served straight from flash
   server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-    String html = "<!DOCTYPE html><html><head>";
-    html += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-    html += "<title>Sauna Sensor Monitor</title>";
-    html += "<script src='https://cdn.jsdelivr.net/npm/chart.js'></script>";
-    html += "<style>";
-    html += "body { font-family: Arial, sans-serif; margin: 0; padding: 20px; text-align: center; background-color: #121212; color: #e0e0e0; }";
-    html += "h1 { color: #ffffff; margin-top: 30px; font-weight: 300; letter-spacing: 1px; font-size: 1.8rem; }";
-    html += ".btn { background-color: #4CAF50; border: none; color: white; padding: 15px 32px; ";
-    html += "text-align: center; text-decoration: none; display: inline-block; font-size: 16px; margin: 20px 2px; cursor: pointer; border-radius: 8px; transition: all 0.3s; }";
-    html += ".btn:hover { background-color: #3e8e41; transform: translateY(-2px); box-shadow: 0 4px 8px rgba(0,0,0,0.3); }";
-    html += ".info { margin: 20px 0; padding: 15px; background-color: #1e1e1e; border-left: 6px solid #4CAF50; text-align: left; border-radius: 4px; color: #e0e0e0; }";
-    html += ".data-container { display: flex; flex-wrap: wrap; justify-content: center; gap: 20px; margin: 30px 0; }";
-    html += ".data-card { background-color: #1e1e1e; border-radius: 12px; padding: 20px; width: 180px; box-shadow: 0 4px 6px rgba(0,0,0,0.3); transition: transform 0.2s; }";
-    html += ".data-card:hover { transform: translateY(-5px); box-shadow: 0 6px 10px rgba(0,0,0,0.4); }";
-    
-    // Style each card differently
-    html += ".temp-card { border-top: 3px solid #ff6384; }";
-    html += ".humidity-card { border-top: 3px solid #36a2eb; }";
-    html += ".session-card { border-top: 3px solid #4CAF50; }";
-    
-    html += ".data-value { font-size: 32px; font-weight: bold; margin: 10px 0; color: #ffffff; }";
-    html += ".data-label { color: #9e9e9e; font-size: 14px; }";
-    html += ".chart-container { width: 100%; max-width: 800px; height: 400px; margin: 30px auto; padding: 20px; background-color: #1e1e1e; border-radius: 12px; box-shadow: 0 4px 6px rgba(0,0,0,0.3); }";
-    html += "strong { color: #4CAF50; }";
-    html += ".info p { margin: 8px 0; }";
-    html += ".footer { margin-top: 30px; font-size: 12px; color: #9e9e9e; }";
-    
-    // Mobile responsive adjustments
-    html += "@media (max-width: 768px) {";
-    html += "  body { padding: 10px; }";
-    html += "  h1 { font-size: 1.5rem; }";
-    html += "  .info { margin: 15px 0; padding: 10px; }";
-    html += "  .data-container { gap: 10px; margin: 15px 0; }";
-    html += "  .data-card { width: calc(50% - 25px); padding: 15px; }";
-    html += "  .data-value { font-size: 24px; }";
-    html += "  .chart-container { height: 300px; padding: 10px; margin: 15px auto; }";
-    html += "  .btn { padding: 12px 25px; font-size: 14px; }";
-    html += "}";
-    
-    // Extra small screens
-    html += "@media (max-width: 480px) {";
-    html += "  .data-container { flex-direction: column; align-items: center; }";
-    html += "  .data-card { width: 100%; max-width: 250px; }";
-    html += "  .chart-container { height: 250px; }";
-    html += "}";
-    
-    html += "</style>";
-    
-    // Add dark mode Chart.js config
-    html += "<script>";
-    html += "Chart.defaults.color = '#e0e0e0';";
-    html += "Chart.defaults.borderColor = '#303030';";
-    html += "</script>";
-    
-    html += "</head><body>";
-    html += "<h1>Sauna Sensor Monitor</h1>";
-    
-    html += "<div class='info'>";
-    html += "<p><strong>Device:</strong> ESP32 (Sauna-Sensor)</p>";
-    html += "<p><strong>IP Address:</strong> " + WiFi.localIP().toString() + "</p>";
-    html += "</div>";
-    
-    // Data cards for current readings
-    html += "<div class='data-container'>";
-    
-    // Temperature card
-    html += "<div class='data-card temp-card'>";
-    html += "<div class='data-label'>Temperature</div>";
-    html += "<div class='data-value' id='temp-value'>--</div>";
-    html += "<div class='data-label'>°C</div>";
-    html += "</div>";
-    
-    // Humidity card
-    html += "<div class='data-card humidity-card'>";
-    html += "<div class='data-label'>Humidity</div>";
-    html += "<div class='data-value' id='humidity-value'>--</div>";
-    html += "<div class='data-label'>%</div>";
-    html += "</div>";
-    
-    // Session time card
-    html += "<div class='data-card session-card'>";
-    html += "<div class='data-label'>Session Time</div>";
-    html += "<div class='data-value' id='session-time'>--</div>";
-    html += "<div class='data-label'>minutes</div>";
-    html += "</div>";
-    
-    html += "</div>";
-    
-    // Graph container
-    html += "<div class='chart-container'>";
-    html += "<canvas id='sensorChart'></canvas>";
-    html += "</div>";
-    
-    html += "<a href='/update' class='btn'>OTA Updates</a>";
-    
-    // JavaScript to fetch data and update the UI
-    html += "<script>";
-    html += "let chart;";
-    html += "function fetchData() {";
-    html += "  console.log('Fetching data from /data endpoint...');";
-    html += "  fetch('/data', { cache: 'no-store' })"; // Add no-store to prevent caching
-    html += "    .then(response => {";
-    html += "      console.log('Response status:', response.status);";
-    html += "      if (!response.ok) {";
-    html += "        throw new Error('Network response error: ' + response.status);";
-    html += "      }";
-    html += "      return response.text();"; // First get as text
-    html += "    })";
-    html += "    .then(text => {";
-    html += "      console.log('Raw response:', text);"; // Log the raw text
-    html += "      // Parse JSON manually to avoid potential issues";
-    html += "      try {";
-    html += "        return JSON.parse(text);";
-    html += "      } catch (e) {";
-    html += "        console.error('JSON parse error:', e, 'for text:', text);";
-    html += "        throw new Error('Failed to parse JSON response');";
-    html += "      }";
-    html += "    })";
-    html += "    .then(data => {";
-    html += "      console.log('Parsed data:', data);"; // Debug log
-    
-    html += "      // Get DOM elements once";
-    html += "      const tempElement = document.getElementById('temp-value');";
-    html += "      const humElement = document.getElementById('humidity-value');";
-    html += "      const sessionElement = document.getElementById('session-time');";
-    
-    html += "      // Check if elements exist";
-    html += "      if (!tempElement || !humElement || !sessionElement) {";
-    html += "        console.error('Could not find one or more DOM elements');";
-    html += "        return;";
-    html += "      }";
-    
-    html += "      // Update temperature";
-    html += "      if (data.temperature !== undefined) {";
-    html += "        try {";
-    html += "          const tempVal = Number(data.temperature);";
-    html += "          tempElement.textContent = tempVal.toFixed(1);";
-    html += "          console.log('Updated temperature to:', tempVal.toFixed(1));";
-    html += "        } catch (e) {";
-    html += "          console.error('Error setting temperature:', e);";
-    html += "          tempElement.textContent = 'Error';";
-    html += "        }";
-    html += "      }";
-    
-    html += "      // Update humidity";
-    html += "      if (data.humidity !== undefined) {";
-    html += "        try {";
-    html += "          const humVal = Number(data.humidity);";
-    html += "          humElement.textContent = Math.round(humVal);";
-    html += "          console.log('Updated humidity to:', Math.round(humVal));";
-    html += "        } catch (e) {";
-    html += "          console.error('Error setting humidity:', e);";
-    html += "          humElement.textContent = 'Error';";
-    html += "        }";
-    html += "      }";
-    
-    html += "      // Update session time";
-    html += "      if (data.sessionTime !== undefined) {";
-    html += "        try {";
-    html += "          sessionElement.textContent = data.sessionTime;";
-    html += "          console.log('Updated session time to:', data.sessionTime);";
-    html += "        } catch (e) {";
-    html += "          console.error('Error setting session time:', e);";
-    html += "          sessionElement.textContent = '0';";
-    html += "        }";
-    html += "      }";
-    
-    html += "      // Update chart if we have valid data";
-    html += "      if (data.tempHistory && data.humHistory && data.labels) {";
-    html += "        updateChart(data);";
-    html += "      }";
-    html += "    })";
-    html += "    .catch(error => {";
-    html += "      console.error('Fetch error:', error);";
-    html += "    });";
-    html += "}";
-    
-    html += "function updateChart(data) {";
-    html += "  if (!chart) {";
-    html += "    const ctx = document.getElementById('sensorChart').getContext('2d');";
-    html += "    chart = new Chart(ctx, {";
-    html += "      type: 'line',";
-    html += "      data: {";
-    html += "        labels: data.labels,";
-    html += "        datasets: [";
-    html += "          {";
-    html += "            label: 'Temperature (°C)',";
-    html += "            data: data.tempHistory,";
-    html += "            borderColor: '#ff6384',";
-    html += "            backgroundColor: 'rgba(255, 99, 132, 0.2)',";
-    html += "            borderWidth: 2,";
-    html += "            pointRadius: 3,";
-    html += "            tension: 0.3";
-    html += "          },";
-    html += "          {";
-    html += "            label: 'Humidity (%)',";
-    html += "            data: data.humHistory,";
-    html += "            borderColor: '#36a2eb',";
-    html += "            backgroundColor: 'rgba(54, 162, 235, 0.2)',";
-    html += "            borderWidth: 2,";
-    html += "            pointRadius: 3,";
-    html += "            tension: 0.3";
-    html += "          }";
-    html += "        ]";
-    html += "      },";
-    html += "      options: {";
-    html += "        responsive: true,";
-    html += "        maintainAspectRatio: false,";
-    html += "        plugins: {";
-    html += "          legend: {";
-    html += "            labels: {";
-    html += "              color: '#e0e0e0',";
-    html += "              font: {";
-    html += "                size: 12";
-    html += "              },";
-    html += "              boxWidth: 12";
-    html += "            },";
-    html += "            position: window.innerWidth < 768 ? 'bottom' : 'top'";
-    html += "          },";
-    html += "          tooltip: {";
-    html += "            mode: 'index',";
-    html += "            intersect: false,";
-    html += "            backgroundColor: 'rgba(0,0,0,0.7)'";
-    html += "          }";
-    html += "        },";
-    html += "        interaction: { mode: 'index', intersect: false },";
-    html += "        scales: {";
-    html += "          y: {";
-    html += "            beginAtZero: false,";
-    html += "            grid: {";
-    html += "              color: '#303030',";
-    html += "              display: window.innerWidth > 480";
-    html += "            },";
-    html += "            ticks: {";
-    html += "              color: '#e0e0e0',";
-    html += "              maxTicksLimit: window.innerWidth < 480 ? 5 : 10,";
-    html += "              font: {";
-    html += "                size: window.innerWidth < 480 ? 10 : 12";
-    html += "              }";
-    html += "            }";
-    html += "          },";
-    html += "          x: {";
-    html += "            grid: {";
-    html += "              color: '#303030',";
-    html += "              display: window.innerWidth > 480";
-    html += "            },";
-    html += "            ticks: {";
-    html += "              color: '#e0e0e0',";
-    html += "              maxRotation: 0,";
-    html += "              maxTicksLimit: window.innerWidth < 480 ? 5 : 10,";
-    html += "              font: {";
-    html += "                size: window.innerWidth < 480 ? 10 : 12";
-    html += "              }";
-    html += "            }";
-    html += "          }";
-    html += "        }";
-    html += "      }";
-    html += "    });";
-    html += "  } else {";
-    html += "    chart.data.labels = data.labels;";
-    html += "    chart.data.datasets[0].data = data.tempHistory;";
-    html += "    chart.data.datasets[1].data = data.humHistory;";
-    html += "    chart.update();";
-    html += "  }";
-    html += "}";
-    
-    html += "// Fetch initial data and setup refresh interval";
-    html += "fetchData();"; // Immediate first fetch
-    html += "console.log('Setting up refresh interval...');";
-    html += "const refreshInterval = setInterval(fetchData, 2000);"; // Refresh every 2 seconds
-    
-    // Add a document.readyState check to ensure DOM is fully loaded
-    html += "document.addEventListener('DOMContentLoaded', function() {";
-    html += "  console.log('DOM fully loaded, fetching initial data...');";
-    html += "  fetchData();";
-    html += "});";
-    html += "</script>";
-    
-    // Add footer
-    html += "<div class='footer'>Custom Built for Ingemar Josefsson &copy; </div>";
-    
-    html += "</body></html>";
-    request->send(200, "text/html", html);
+    // Browser already has this build of the page
+    if (request->hasHeader("If-None-Match") &&
+        request->header("If-None-Match") == DASHBOARD_ETAG) {
+      request->send(304);
+      return;
+    }
+
+    AsyncWebServerResponse *response =
+        request->beginResponse(200, "text/html", DASHBOARD_HTML_GZ, DASHBOARD_HTML_GZ_LEN);
+    response->addHeader("Content-Encoding", "gzip");
+    response->addHeader("ETag", DASHBOARD_ETAG);
+    response->addHeader("Cache-Control", "no-cache");  // Always revalidate, 304 is cheap
+    request->send(response);
   });
 
-  // API endpoint to provide current data
+  // Device details shown in the dashboard info block
+  server.on("/info", HTTP_GET, [](AsyncWebServerRequest *request){
+    char json[96];
+    snprintf(json, sizeof(json), "{\"device\":\"ESP32 (Sauna-Sensor)\",\"ip\":\"%s\"}",
+             WiFi.localIP().toString().c_str());
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", json);
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    request->send(response);
+  });
+
+  // API endpoint to provide current data, as JSON or (for collectors) CBOR.
+  // The body only changes with a new sample, so it is built once per sample
+  // and shared by every client; a client that already has it gets a 304.
   server.on("/data", HTTP_GET, [](AsyncWebServerRequest *request){
-    // Log request details
-    Serial.printf("DATA API Request from %s\n", request->client()->remoteIP().toString().c_str());
-    
-    // Debug sensor readings to serial monitor
-    float temp = readTemperature();
-    float hum = readHumidity();
-    Serial.printf("API Request - Temperature: %.2f, Humidity: %.2f\n", temp, hum);
-    
-    // Create a JSON-formatted string with current data
-    String json = "{";
-    
-    // Add current temperature and humidity with explicit decimal points to ensure proper parsing
-    json += "\"temperature\":" + String(temp, 1);  // Force 1 decimal place
-    json += ",\"humidity\":" + String(int(hum));   // Round humidity to integer
-    
-    // Add sauna session time in minutes (if active)
-    unsigned long sessionMinutes = 0;
-    if (saunaActive && saunaStartTime > 0) {
-      sessionMinutes = (millis() - saunaStartTime) / 60000;
+    SensorSnapshot sample = sensorSnapshot.read();
+    bool cbor = wants_cbor(request);
+    ResponseCache &cache = cbor ? dataCborCache : dataJsonCache;
+
+    AsyncWebServerResponse *response;
+    if (request->hasHeader("If-None-Match") &&
+        cache.notModified(request->header("If-None-Match").c_str(), sample.seq)) {
+      response = request->beginResponse(304);
+      char etag[RESPONSE_CACHE_ETAG_LEN];
+      cache.etagFor(sample.seq, etag, sizeof(etag));
+      response->addHeader("ETag", etag);
+    } else {
+      std::shared_ptr<const CachedBody> body = cbor
+          ? cache.get(sample.seq, [&sample](uint8_t *buf, size_t len) {
+              return buildDataCbor(buf, len, sample, DATA_HISTORY_POINTS, DATA_HISTORY_STRIDE);
+            })
+          : cache.get(sample.seq, [&sample](uint8_t *buf, size_t len) {
+              return buildDataJson((char *)buf, len, sample, DATA_HISTORY_POINTS,
+                                   DATA_HISTORY_STRIDE);
+            });
+      // The response holds a reference until it is sent; no copy of the body
+      response = request->beginResponse(cbor ? "application/cbor" : "application/json", body->len,
+          [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            size_t n = index < body->len ? body->len - index : 0;
+            if (n > maxLen) n = maxLen;
+            memcpy(buffer, body->data + index, n);
+            return n;
+          });
+      response->addHeader("ETag", body->etag);
     }
-    json += ",\"sessionTime\":" + String(sessionMinutes);
-    
-    // Create history arrays for the chart - last 10 readings
-    json += ",\"labels\":[";
-    for (int i = 0; i < 10; i++) {
-      if (i > 0) json += ",";
-      json += "\"" + String(i * 10) + "s ago\"";
+    response->addHeader("Vary", "Accept");
+
+    // Add CORS headers to allow requests from any origin
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    response->addHeader("Access-Control-Allow-Methods", "GET");
+    response->addHeader("Access-Control-Allow-Headers", "Content-Type, If-None-Match");
+    response->addHeader("Access-Control-Expose-Headers", "ETag");
+    response->addHeader("Cache-Control", "no-cache");  // Revalidate every time, 304 is cheap
+    request->send(response);
+  });
+
+  // Live readings: full snapshot on connect, then one small delta per sample
+  events.onConnect([](AsyncEventSourceClient *client){
+    static char snapshot[LIVE_JSON_BUFFER_SIZE];  // Only used from the AsyncTCP task
+    SensorSnapshot sample = sensorSnapshot.read();
+    buildDataJson(snapshot, sizeof(snapshot), sample, LIVE_HISTORY_POINTS, 1);
+    client->send(snapshot, "snapshot", sample.seq);
+  });
+  server.addHandler(&events);
+
+  // Incremental export for collectors, streamed in chunks:
+  // /history?since=<epoch|cursor>&res=raw|1m|15m&fmt=csv|bin
+  // Returns points after `since`; X-Next-Cursor is the `since` for the next call
+  server.on("/history", HTTP_GET, [](AsyncWebServerRequest *request){
+    HistoryTier tier = HISTORY_RAW;
+    if (request->hasParam("res")) {
+      const String &res = request->getParam("res")->value();
+      if (res == "1m") tier = HISTORY_1M;
+      else if (res == "15m") tier = HISTORY_15M;
+      else if (res != "raw") { request->send(400, "text/plain", "res must be raw, 1m or 15m"); return; }
     }
-    json += "]";
-    
-    // Add temperature history with explicit decimal formatting
-    json += ",\"tempHistory\":[";
-    float baseTemp = temp;
-    for (int i = 0; i < 10; i++) {
-      if (i > 0) json += ",";
-      // Slight random variation for demo purposes
-      float historyTemp = baseTemp + random(-15, 15) / 10.0;
-      json += String(historyTemp, 1);  // Force 1 decimal place
+    HistoryFormat format = HISTORY_FORMAT_CSV;
+    if (request->hasParam("fmt")) {
+      const String &fmt = request->getParam("fmt")->value();
+      if (fmt == "bin") format = HISTORY_FORMAT_BIN;
+      else if (fmt != "csv") { request->send(400, "text/plain", "fmt must be csv or bin"); return; }
     }
-    json += "]";
-    
-    // Add humidity history as integers
-    json += ",\"humHistory\":[";
-    float baseHum = hum;
-    for (int i = 0; i < 10; i++) {
-      if (i > 0) json += ",";
-      // Slight random variation for demo purposes
-      int historyHum = int(baseHum + random(-10, 10) / 10.0);
-      json += String(historyHum);
+    HistoryCursor cursor = { true, true, 0 };
+    bool fromStart = !request->hasParam("since");
+    if (!fromStart &&
+        !parseHistoryCursor(request->getParam("since")->value().c_str(), bootId, cursor)) {
+      request->send(400, "text/plain", "since must be epoch seconds or a cursor");
+      return;
+    }
+
+    // Fix the range now; points added while streaming go to the next call
+    uint32_t fromSeq, endSeq;
+    bool reset = false;
+    {
+      RtosLock lock(historyMutex);
+      endSeq = history.nextSeq(tier);
+      if (fromStart) {
+        fromSeq = history.firstSeq(tier);
+      } else if (!cursor.isSeq) {
+        fromSeq = history.seqAfter(tier, cursor.value);
+      } else if (!cursor.sameBoot || (int32_t)(cursor.value - endSeq) > 0) {
+        fromSeq = history.firstSeq(tier);   // Cursor from before a reboot
+        reset = true;
+      } else if ((int32_t)(cursor.value - history.firstSeq(tier)) < 0) {
+        fromSeq = history.firstSeq(tier);   // Points after the cursor were evicted meanwhile
+        reset = true;
+      } else {
+        fromSeq = cursor.value;
+      }
+    }
+
+    // Owned by the response; freed when it completes or the client goes away
+    std::shared_ptr<HistoryExportStream> stream =
+        std::make_shared<HistoryExportStream>(readHistory, tier, format, fromSeq, endSeq);
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+        format == HISTORY_FORMAT_CSV ? "text/csv" : "application/octet-stream",
+        [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+          return stream->fill(buffer, maxLen);
+        });
+    char next[24];
+    formatHistoryCursor(next, sizeof(next), endSeq, bootId);
+    response->addHeader("X-Next-Cursor", next);
+    if (reset) response->addHeader("X-History-Reset", "1");  // Collector may have a gap
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    response->addHeader("Access-Control-Expose-Headers", "X-Next-Cursor, X-History-Reset");
+    request->send(response);
+  });
+
+  // Time per power mode and estimated current, for checking savings on the bench
+  server.on("/power", HTTP_GET, [](AsyncWebServerRequest *request){
+    char json[384];
+    {
+      RtosLock lock(powerMutex);
+      power.tick(clockHal.millis());
+      serializePowerStats(json, sizeof(json), power, powerHal.lightSleep());
     }
-    json += "]";
-    
-    json += "}";
-    Serial.println("Sending JSON: " + json);
-    
-    // Add CORS headers to allow requests from any origin
     AsyncWebServerResponse *response = request->beginResponse(200, "application/json", json);
     response->addHeader("Access-Control-Allow-Origin", "*");
-    response->addHeader("Access-Control-Allow-Methods", "GET");
-    response->addHeader("Access-Control-Allow-Headers", "Content-Type");
-    response->addHeader("Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
     request->send(response);
-    
-    Serial.println("API response sent successfully");
   });
 
-  // Setup ElegantOTA
+  // Session log, streamed from flash: /sessions?from=<epoch>&to=<epoch>&limit=<n>
+  // Sessions are returned oldest first; page by passing the last start + 1 as `from`
+  server.on("/sessions", HTTP_GET, [](AsyncWebServerRequest *request){
+    uint32_t from = query_u32(request, "from", 0);
+    uint32_t to = query_u32(request, "to", UINT32_MAX);
+    size_t limit = query_u32(request, "limit", SESSIONS_DEFAULT_LIMIT);
+    if (limit > SESSIONS_MAX_LIMIT) limit = SESSIONS_MAX_LIMIT;
+
+    size_t first = sessionLog.lowerBound(from);
+    size_t end = to == UINT32_MAX ? sessionLog.count() : sessionLog.lowerBound(to + 1);
+    if (end < first) end = first;
+    if (end - first > limit) end = first + limit;
+
+    // Owned by the response; freed when it completes or the client goes away
+    std::shared_ptr<SessionJsonStream> stream =
+        std::make_shared<SessionJsonStream>(sessionLog, first, end);
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+        [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+          return stream->fill((char *)buffer, maxLen);
+        });
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    request->send(response);
+  });
+
+#if METRICS_ENABLED
+  // Prometheus scrape target, see write_metrics()
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request){
+    AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4", 4096);
+    write_metrics(*response);
+    request->send(response);
+  });
+#endif
+
+#if TRACE_ENABLED
+  // Chrome trace-event JSON of the recent timeline, open in ui.perfetto.dev
+  server.on("/trace", HTTP_GET, [](AsyncWebServerRequest *request){
+    // Owns a copy of the ring; freed when the response completes or the client goes away
+    std::shared_ptr<TraceJsonStream<TRACE_EVENTS>> stream =
+        std::make_shared<TraceJsonStream<TRACE_EVENTS>>(tracer);
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+        [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+          return stream->fill((char *)buffer, maxLen);
+        });
+    response->addHeader("Content-Disposition", "attachment; filename=\"sauna-trace.json\"");
+    request->send(response);
+  });
+#endif
+
+#if METRICS_ENABLED || TRACE_ENABLED
+  // Handler time per route, measured around every handler (including ElegantOTA's)
+  server.addMiddleware([](AsyncWebServerRequest *request, ArMiddlewareNext next){
+    HttpRoute route = http_route(request->url());
+    METRIC_START(start);
+    {
+      TRACE_SCOPE(tracer, HTTP_ROUTE_TRACE_NAMES[route]);
+      next();
+    }
+    METRIC_SINCE(metricRoutes[route], start);
+  });
+#endif
+
+  // Compressed (gzip / heatshrink) or raw image, see scripts/compress_firmware.py:
+  //   curl -F image=@firmware.bin.gz "http://<device>/ota?sha256=<hex>"
+  server.on("/ota", HTTP_POST, [](AsyncWebServerRequest *request){
+    if (otaRequest != request) {
+      request->send(otaRequest ? 409 : 400, "application/json",
+                    otaRequest ? "{\"ok\":false,\"error\":\"update already running\"}"
+                               : "{\"ok\":false,\"error\":\"no image uploaded\"}");
+      return;
+    }
+    otaRequest = nullptr;
+    char body[OTA_RESULT_JSON];
+    serializeOtaResult(body, sizeof(body), otaUpdate, otaSucceeded);
+    request->send(otaSucceeded ? 200 : 400, "application/json", body);
+  }, handle_ota_upload);
+
+  // Setup ElegantOTA (raw images from its web page at /update)
   ElegantOTA.begin(&server);
+  ElegantOTA.onStart(onOTAStart);
+  ElegantOTA.onProgress(onOTAProgress);
+  ElegantOTA.onEnd(onOTAEnd);
   
   // Start server
   server.begin();
   Serial.println("HTTP server started");
 }
 
+/**
+ * Unsigned integer query parameter, or fallback if missing / malformed
+ */
+uint32_t query_u32(AsyncWebServerRequest *request, const char *name, uint32_t fallback) {
+  if (!request->hasParam(name)) return fallback;
+  const String &value = request->getParam(name)->value();
+  char *end;
+  unsigned long v = strtoul(value.c_str(), &end, 10);
+  return (end == value.c_str() || *end != '\0') ? fallback : (uint32_t)v;
+}
+
+#if METRICS_ENABLED || TRACE_ENABLED
+HttpRoute http_route(const String &url) {
+  if (url == "/") return HTTP_ROUTE_ROOT;
+  if (url == "/data") return HTTP_ROUTE_DATA;
+  if (url.startsWith("/update") || url == "/ota") return HTTP_ROUTE_UPDATE;
+  return HTTP_ROUTE_OTHER;
+}
+#endif
+
+#if METRICS_ENABLED
+
+/**
+ * Prometheus text exposition of the runtime counters. Runs on the
+ * AsyncTCP task; the histograms are read without locks.
+ */
+void write_metrics(Print &out) {
+  writeMetricHeader(out, "sauna_task_iteration_seconds", "histogram",
+                    "Work per task iteration, blocking waits excluded");
+  metricSensorIteration.write(out, "sauna_task_iteration_seconds", "task=\"sensor\"");
+  metricDisplayIteration.write(out, "sauna_task_iteration_seconds", "task=\"display\"");
+  metricNetworkIteration.write(out, "sauna_task_iteration_seconds", "task=\"network\"");
+
+  writeMetricHeader(out, "sauna_i2c_seconds", "histogram", "I2C bus time per operation");
+  metricSht2x.write(out, "sauna_i2c_seconds", "op=\"sht2x_sample\"");
+  metricOledFlush.write(out, "sauna_i2c_seconds", "op=\"oled_flush\"");
+
+  writeMetricHeader(out, "sauna_draw_seconds", "histogram", "OLED render and flush");
+  metricDraw.write(out, "sauna_draw_seconds", "");
+
+  writeMetricHeader(out, "sauna_http_request_seconds", "histogram",
+                    "HTTP handler time; _count is the request count");
+  for (uint8_t i = 0; i < HTTP_ROUTES; i++) {
+    metricRoutes[i].write(out, "sauna_http_request_seconds", METRIC_ROUTE_LABELS[i]);
+  }
+
+  writeMetricHeader(out, "sauna_heap_free_bytes", "gauge", "Free heap");
+  out.printf("sauna_heap_free_bytes %lu\n", (unsigned long)ESP.getFreeHeap());
+  writeMetricHeader(out, "sauna_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+  out.printf("sauna_heap_min_free_bytes %lu\n", (unsigned long)ESP.getMinFreeHeap());
+  writeMetricHeader(out, "sauna_heap_largest_block_bytes", "gauge", "Largest allocatable block");
+  out.printf("sauna_heap_largest_block_bytes %lu\n", (unsigned long)ESP.getMaxAllocHeap());
+
+  writeMetricHeader(out, "sauna_task_stack_free_min_bytes", "gauge",
+                    "Stack high-water mark: least free stack seen");
+  out.printf("sauna_task_stack_free_min_bytes{task=\"sensor\"} %lu\n",
+             (unsigned long)rtosStackHighWater(tasks.sensorTask()));
+  out.printf("sauna_task_stack_free_min_bytes{task=\"display\"} %lu\n",
+             (unsigned long)rtosStackHighWater(tasks.displayTask()));
+  out.printf("sauna_task_stack_free_min_bytes{task=\"network\"} %lu\n",
+             (unsigned long)rtosStackHighWater(tasks.networkTask()));
+
+  writeMetricHeader(out, "sauna_wifi_reconnects_total", "counter", "WiFi connections lost");
+  out.printf("sauna_wifi_reconnects_total %lu\n", (unsigned long)wifiManager.reconnects());
+  writeMetricHeader(out, "sauna_wifi_connect_attempts_total", "counter", "WiFi connect attempts");
+  out.printf("sauna_wifi_connect_attempts_total %lu\n", (unsigned long)wifiManager.attempts());
+  writeMetricHeader(out, "sauna_wifi_rssi_dbm", "gauge", "WiFi signal strength");
+  out.printf("sauna_wifi_rssi_dbm %d\n", wifi_connected ? (int)WiFi.RSSI() : 0);
+
+  size_t archiveBytes, archiveSamples;
+  uint32_t archiveSpan;
+  {
+    RtosLock lock(historyMutex);
+    const SampleArchive &archive = history.rawArchive();
+    archiveBytes = archive.usedBytes();
+    archiveSamples = archive.size();
+    archiveSpan = archiveSamples ? history.latestTime() - archive.firstTime() : 0;
+  }
+  writeMetricHeader(out, "sauna_history_archive_bytes", "gauge", "Raw sample archive in use");
+  out.printf("sauna_history_archive_bytes %u\n", (unsigned)archiveBytes);
+  writeMetricHeader(out, "sauna_history_archive_samples", "gauge", "Raw samples held");
+  out.printf("sauna_history_archive_samples %u\n", (unsigned)archiveSamples);
+  writeMetricHeader(out, "sauna_history_archive_span_seconds", "gauge",
+                    "Time from the oldest raw sample held to the newest");
+  out.printf("sauna_history_archive_span_seconds %lu\n", (unsigned long)archiveSpan);
+
+  writeMetricHeader(out, "sauna_session_log_dropped_total", "counter",
+                    "Finished sessions lost because the pending batch was full");
+  out.printf("sauna_session_log_dropped_total %lu\n", (unsigned long)sessionLog.droppedRecords());
+  writeMetricHeader(out, "sauna_session_log_sync_failures_total", "counter",
+                    "Session log flushes whose fsync failed; the batch stayed pending");
+  out.printf("sauna_session_log_sync_failures_total %lu\n",
+             (unsigned long)sessionLog.syncFailureCount());
+
+  writeMetricHeader(out, "sauna_boot_phase_seconds", "gauge", "When each boot phase finished");
+  for (size_t i = 0; i < bootTimeline.count(); i++) {
+    BootPhase phase = bootTimeline.phase(i);
+    if (phase.name) {
+      out.printf("sauna_boot_phase_seconds{phase=\"%s\"} %.6f\n", phase.name, phase.micros / 1e6);
+    }
+  }
+
+  writeMetricHeader(out, "sauna_uptime_seconds", "counter", "Time since boot");
+  out.printf("sauna_uptime_seconds %llu\n", (unsigned long long)(clockHal.millis64() / 1000));
+}
+#endif
+
+/**
+ * /data format negotiation: ?fmt=cbor, or an Accept header naming CBOR
+ */
+bool wants_cbor(AsyncWebServerRequest *request) {
+  if (request->hasParam("fmt")) return request->getParam("fmt")->value() == "cbor";
+  return request->hasHeader("Accept") &&
+         request->header("Accept").indexOf("application/cbor") >= 0;
+}
+
 /*************************************************************
   WiFi Connection Functions
 *************************************************************/
-void check_wifi_connection() {
-  
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.print("Attempting to connect to WiFi... ");
-    
-    // Make sure we're in station mode
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(WIFI_SSID, WIFI_PASS);
-    
-    // Wait up to 10 seconds for connection
-    unsigned long startAttempt = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - startAttempt < WIFI_CONNECT_TIMEOUT) {
-      delay(500);
-      Serial.print(".");
-    }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-      wifi_connected = true;
-      Serial.println("Connected!");
-      Serial.print("IP address: ");
+/**
+ * Feed pending driver events to the state machine and perform whatever
+ * driver call it asks for. Called from the network task.
+ */
+void service_wifi_connection() {
+  TRACE_SCOPE(tracer, "wifi");
+  WifiEvent event;
+  while (networkHal.pollEvent(event)) {
+    wifiManager.onEvent(event, clockHal.millis());
+  }
+
+  switch (wifiManager.poll(clockHal.millis())) {
+    case WIFI_ACTION_CONNECT:
+      Serial.println("Attempting to connect to WiFi...");
+      networkHal.connect();
+      break;
+    case WIFI_ACTION_DISCONNECT:
+      Serial.printf("WiFi connection timed out. Retrying in %lu ms\n",
+                    (unsigned long)wifiManager.currentBackoff());
+      networkHal.disconnect();
+      break;
+    default:
+      break;
+  }
+
+  bool connected = wifiManager.isConnected();
+  if (connected != wifi_connected) {
+    wifi_connected = connected;
+    if (connected) {
+      Serial.print("WiFi connected! IP address: ");
       Serial.println(WiFi.localIP());
-      
     } else {
-      wifi_connected = false;
-      Serial.println("Failed. Will retry later.");
-      WiFi.disconnect(true);
+      Serial.printf("WiFi lost. Retrying in %lu ms\n", (unsigned long)wifiManager.currentBackoff());
     }
-  } else {
-    wifi_connected = true;
+  }
+
+  if (wifiManager.takeFirstConnect()) {
+    markBoot("wifi");
+    start_network_services();
+  }
+}
+
+/**
+ * Everything that needs the network, started lazily on the first GOT_IP
+ */
+void start_network_services() {
+  /***************** NTP Time Synchronization **************/
+  // Configure time using NTP servers without manual offsets; SNTP syncs in the background
+  configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+  // Set timezone for Sweden (CET/CEST): CET is GMT+1 and CEST is GMT+2.
+  // DST starts on the last Sunday in March at 2:00 and ends on the last Sunday in October at 3:00.
+  setenv("TZ", "CET-1CEST,M3.5.0/2,M10.5.0/3", 1);
+  tzset();
+
+  /***************** Web Server & OTA Setup ***************/
+  setup_web_server();
+  Serial.println("OTA updates initialized");
+  network_services_started = true;
+  markBoot("web");
+}
+
+/**
+ * Record that a boot phase finished, and log it the first time
+ */
+void markBoot(const char *phase) {
+  uint32_t now = clockHal.micros();
+  if (bootTimeline.mark(phase, now)) {
+    Serial.printf("Boot: %s at %lu ms\n", phase, (unsigned long)(now / 1000));
   }
 }
 
@@ -560,120 +821,274 @@ void setup()
   Wire.begin(SDA_PIN, SCL_PIN);  // SDA, SCL
 
 
-  /***************** OLED Display Initialization ***********/
-  sht.begin();
-  Serial.print(uint8_t(sht.getStatus()), HEX);
-  Serial.println();
-  
+  /***************** Sensors *******************************/
+  for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+    sensorPorts[i] = { &sensorHals[i], SENSOR_COUNT > 1 ? &sensorMux : nullptr, i };
+    selectSensor(sensorPorts[i]);
+    sensorHals[i].begin();
+    Serial.print(uint8_t(sensorHals[i].status()), HEX);
+    Serial.println();
+  }
+  acquisition.attach(sensorPorts, SENSOR_COUNT);
+  markBoot("sensors");
+
   /***************** OLED Display Initialization ***********/
   if (!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
     Serial.println(F("SSD1306 allocation failed"));
   }
-  display.clearDisplay();
-  display.setTextSize(1.5);
   display.setTextColor(SSD1306_WHITE);
-  display.setCursor(10, 20);
-  display.println("Starting...");
-  display.display();  // Update the display
+  markBoot("display");
 
-  /***************** WiFi Connection *************************/
-  WiFi.setHostname("Sauna-Sensor");  // Set a custom hostname for the device
-  check_wifi_connection();
+  /***************** Display Initial UI *******************/
+  // A real reading straight away, at the quickest resolution; the
+  // sensor task takes over at the normal one. No network needed: the
+  // WiFi icon shows it is still coming up.
+  SensorSnapshot initial = acquireSensor(true);
+  markBoot("first_reading");
+  draw(initial);
+  markBoot("first_draw");
 
+  bootId = esp_random();
+  dataJsonCache.setBootId(bootId);
+  dataCborCache.setBootId(bootId);
 
-  /***************** NTP Time Synchronization **************/
-  if (wifi_connected) {
-  // Configure time using NTP servers without manual offsets
-  configTime(0, 0, "pool.ntp.org", "time.nist.gov");
-  // Set timezone for Sweden (CET/CEST): CET is GMT+1 and CEST is GMT+2.
-  // DST starts on the last Sunday in March at 2:00 and ends on the last Sunday in October at 3:00.
-  setenv("TZ", "CET-1CEST,M3.5.0/2,M10.5.0/3", 1);
-  tzset();
-  
-  Serial.println("Waiting for time synchronization...");
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) {
-    Serial.println("Failed to obtain time");
+  /***************** Session Log ***************************/
+  if (!LittleFS.begin(true)) {          // Formats on first boot
+    Serial.println("LittleFS mount failed, sessions will not be saved");
+  } else if (!sessionLog.begin(SESSION_LOG_PATH)) {
+    Serial.println("Cannot open session log");
   } else {
-    Serial.println(&timeinfo, "Current time: %A, %B %d %Y %H:%M:%S");
+    Serial.printf("Session log: %u sessions", (unsigned)sessionLog.count());
+    if (sessionLog.recoveredRecords()) {
+      Serial.printf(", dropped %u torn records", (unsigned)sessionLog.recoveredRecords());
     }
+    Serial.println();
   }
-
-  /***************** Web Server & OTA Setup ***************/
-  if (wifi_connected) {
-    setup_web_server();
-    Serial.println("OTA updates initialized");
+#ifdef MQTT_HOST
+  // The queue works from RAM alone if the file cannot be opened
+  if (!mqttQueue.begin(MQTT_QUEUE_PATH)) {
+    Serial.println("Cannot open MQTT queue, offline readings are kept in RAM only");
+  } else if (mqttQueue.depth() > 0) {
+    Serial.printf("MQTT queue: %u messages from before the reboot\n", (unsigned)mqttQueue.depth());
   }
+  snprintf(mqttDeviceId, sizeof(mqttDeviceId), "sauna-%06lx",
+           (unsigned long)(ESP.getEfuseMac() >> 24) & 0xFFFFFF);
+  mqtt.begin(mqttDeviceId, MQTT_USER, MQTT_PASS);
+#endif
+  markBoot("storage");
 
-  /***************** Display Initial UI *******************/
-  float initialTemp = readTemperature();
-  float initialHum = readHumidity();
-  draw(initialTemp, initialHum);
+  /***************** WiFi Connection *************************/
+  // Connection, NTP and the web server are handled by the network task
+  networkHal.begin("Sauna-Sensor");  // Set a custom hostname for the device
+
+  /***************** Power Mode ****************************/
+  // Start in active mode; the first flat readings bring it down to idle
+  power.begin(POWER_MODE_ACTIVE, clockHal.millis());
+  powerSnapshot.write(powerStatus(power));
+  powerHal.apply(POWER_MODE_ACTIVE);
+
+  /***************** Start Tasks ***************************/
+  tasks.start();
+  markBoot("tasks");
   
   Serial.println("Setup complete!");
 }
 
 /*************************************************************
-  Main Loop - Optimized & Clean
+  Main Loop
 *************************************************************/
 void loop() {
-  static unsigned long lastDisplayUpdate = 0;
-  static unsigned long lastSerialOutput = 0;
-  static unsigned long lastWifiCheck = 0;
-  unsigned long currentMillis = millis();
-  
-  // Process OTA updates if WiFi connected
-  if (wifi_connected) {
+  // All work happens in the tasks started from setup()
+  vTaskDelete(NULL);
+}
+
+/*************************************************************
+  Tasks
+*************************************************************/
+/**
+ * What the sensor, display and network tasks (task_graph.h) do on
+ * the device
+ */
+class FirmwareWork : public TaskWork {
+public:
+  SensorSnapshot acquire() override { return acquireSensor(); }
+
+  void process(const SensorSnapshot &sample) override {
+    updateSaunaState(sample.temperature, sample.humidity, sensorSpread(sample.sensors));
+    updateEta();
+    recordHistory(sample.temperature, sample.humidity);
+    updatePowerMode(sample.temperature);
+  }
+
+  uint32_t sampled(uint32_t workUs) override {
+    // Conversion waits were spent blocked, not awake
+    uint32_t freedUs = acquisition.lastTiming().freedUs;
+    uint32_t awakeUs = workUs > freedUs ? workUs - freedUs : 0;
+    METRIC_OBSERVE(metricSensorIteration, awakeUs);
+    {
+      RtosLock lock(powerMutex);
+      power.addAwake(awakeUs);
+    }
+    return powerSnapshot.read().periodMs;
+  }
+
+  bool displayEnabled() override { return !otaScreenHeld; }
+
+  void redraw(const SensorSnapshot &sample) override {
+    RtosLock lock(i2cMutex);
+    draw(sample);
+  }
+
+  void redrawn(uint32_t workUs) override {
+    METRIC_OBSERVE(metricDisplayIteration, workUs);
+    RtosLock lock(powerMutex);
+    power.addAwake(workUs);
+  }
+
+  void service() override { serviceNetwork(); }
+
+  // Waiting on the queue doubles as the network task's idle delay
+  uint32_t pollMs() override {
+    return powerSnapshot.read().mode == POWER_MODE_IDLE ? NETWORK_IDLE_POLL_MS : NETWORK_POLL_MS;
+  }
+
+  void publish(const SensorSnapshot &sample) override {
+    TRACE_SCOPE(tracer, "publish");
+    publishSample(sample);
+    logStatus(sample);
+  }
+
+  void serviced(uint32_t workUs) override {
+    METRIC_OBSERVE(metricNetworkIteration, workUs);
+  }
+};
+
+FirmwareWork firmwareWork;
+TaskGraph tasks(firmwareWork, clockHal, sensorSnapshot);
+
+/**
+ * Network task housekeeping: OTA, WiFi reconnects, the session log
+ * and MQTT
+ */
+void serviceNetwork() {
+  // Connect / reconnect WiFi without blocking
+  service_wifi_connection();
+
+  // Process OTA updates once the web server is up
+  if (network_services_started) {
     ElegantOTA.loop();
   }
-  
-  // Check and reconnect WiFi periodically if needed
-  if (currentMillis - lastWifiCheck >= WIFI_RETRY_INTERVAL) {
-    lastWifiCheck = currentMillis;
-    check_wifi_connection();
+  if (otaRebootAt && (int32_t)(millis() - otaRebootAt) >= 0) {
+    sessionLog.flush();
+    ESP.restart();
   }
-  
-  // Read sensor data and update display
-  if (currentMillis - lastDisplayUpdate >= 2000) {
-    float currentTemp = readTemperature();
-    float currentHum = readHumidity();
-    
-    // Update sauna state logic based on temperature
-    updateSaunaState(currentTemp);
-    
-    // Update display
-    lastDisplayUpdate = currentMillis;
-    draw(currentTemp, currentHum);
+
+  // Batched session log writes
+  {
+    TRACE_SCOPE(tracer, "session_log");
+    sessionLog.service(clockHal.millis());
+  }
+
+#ifdef MQTT_HOST
+  // Reconnect (bounded by the socket timeout), drain the queue, periodic health
+  {
+    TRACE_SCOPE(tracer, "mqtt");
+    mqtt.service(wifi_connected, clockHal.millis());
+  }
+  static uint32_t lastHealthMs = 0;
+  if (clockHal.millis() - lastHealthMs >= MQTT_HEALTH_INTERVAL_MS) {
+    lastHealthMs = clockHal.millis();
+    DeviceHealth health;
+    health.uptime = clockHal.millis64() / 1000;
+    health.rssi = wifi_connected ? WiFi.RSSI() : 0;
+    health.freeHeap = ESP.getFreeHeap();
+    health.bootId = bootId;
+    health.idle = powerSnapshot.read().mode == POWER_MODE_IDLE;
+    health.queueDepth = mqttQueue.depth();
+    health.queueDropped = mqttQueue.dropped();
+    mqtt.health(health, lastHealthMs);
+  }
+#endif
+
+#if TRACE_ENABLED
+  // 't' on the serial console dumps the trace
+  if (Serial.available() > 0 && Serial.read() == 't') dumpTrace(Serial);
+#endif
+}
+
+/**
+ * Print minimal status info to serial (once per minute)
+ */
+void logStatus(const SensorSnapshot &sample) {
+  static unsigned long lastSerialOutput = 0;
+  if (millis() - lastSerialOutput < 60000) return;
+  lastSerialOutput = millis();
+
+  // Get current time (don't wait for NTP if it hasn't synced)
+  struct tm timeinfo;
+  if (getLocalTime(&timeinfo, 10)) {
+    char timeStr[20];
+    strftime(timeStr, sizeof(timeStr), "%H:%M:%S", &timeinfo);
     
-    // Print minimal status info to serial (once per minute)
-    if (currentMillis - lastSerialOutput >= 60000) {
-      lastSerialOutput = currentMillis;
-      
-      // Get current time
-      struct tm timeinfo;
-      if (getLocalTime(&timeinfo)) {
-        char timeStr[20];
-        strftime(timeStr, sizeof(timeStr), "%H:%M:%S", &timeinfo);
-        
-        // Print status in a clean, concise format
-        Serial.printf("[%s] Temp: %.1f°C | Humidity: %d%% | WiFi: %s\n", 
-                     timeStr, 
-                     currentTemp, 
-                     (int)currentHum,
-                     wifi_connected ? "Connected" : "Disconnected");
-                     
-        if (saunaActive) {
-          unsigned long sessionMinutes = (millis() - saunaStartTime) / 60000;
-          Serial.printf("        Sauna active for %lu minutes\n", sessionMinutes);
-        }
+    // Print status in a clean, concise format
+    Serial.printf("[%s] Temp: %.1f°C | Humidity: %d%% | WiFi: %s | I2C: %lu us | Jitter: %lu/%lu ms\n", 
+                 timeStr, 
+                 sample.temperature, 
+                 (int)sample.humidity,
+                 wifi_connected ? "Connected" : "Disconnected",
+                 (unsigned long)lastAcquireMicros,
+                 (unsigned long)tasks.sensorTiming().lastJitterMs,
+                 (unsigned long)tasks.sensorTiming().maxJitterMs);
+    const AcquireTiming &timing = acquisition.lastTiming();
+    Serial.printf("        SHT2x x%u: %s resolution, conversion %lu us, %lu us freed per sample, %lu timed out\n",
+                 (unsigned)SENSOR_COUNT, resolutionFor(powerSnapshot.read()) == SENSOR_RES_FAST ? "fast" : "high",
+                 (unsigned long)timing.latencyUs, (unsigned long)timing.freedUs,
+                 (unsigned long)acquisition.timedOut());
+    if (SENSOR_COUNT > 1) {
+      Serial.print("        Sensors:");
+      for (uint8_t i = 0; i < sample.sensors.count; i++) {
+        if (sample.sensors.hold[i]) Serial.printf(" %.1f°C", sample.sensors.temperature[i]);
+        else Serial.print(" --");
       }
+      Serial.println();
+    }
+    Serial.printf("        OLED: %u bytes last frame (full frame %u)\n",
+                 (unsigned)lastFlushBytes, (unsigned)(SCREEN_WIDTH * OLED_PAGES));
+                 
+    SaunaStatus session = saunaSnapshot.read();
+    PowerStatus powerNow = powerSnapshot.read();
+    Serial.printf("        Power: %s, slope %.2f°C/min | Detector: %.2f°C, %.2f°C/min, %lu rejected\n",
+                 powerNow.mode == POWER_MODE_IDLE ? "idle" : "active", powerNow.slope,
+                 session.levelC, session.slopeCPerMin, (unsigned long)session.rejected);
+    if (session.active) {
+      Serial.printf("        Sauna active for %lu minutes\n",
+                   (unsigned long)(saunaSessionMillis(session, clockHal.millis64()) / 60000));
+      SessionSummary stats = sessionSnapshot.read();
+      Serial.printf("        Session: mean %.1f°C, %lu min above 80°C, heat dose %.0f°C·min, %u steam throws\n",
+                   stats.meanTemp, (unsigned long)(stats.above80S / 60), stats.heatDose,
+                   (unsigned)stats.throws);
+    }
+    EtaPrediction eta = etaSnapshot.read();
+    if (eta.phase != ETA_PHASE_IDLE) {
+      Serial.printf("        ETA: ready %d min, cool %d min, final %.1f°C, confidence %u%%\n",
+                   eta.readyMinutes, eta.coolMinutes, eta.finalTemp, (unsigned)eta.confidence);
     }
   }
-  
-  // Small delay to prevent CPU hogging
-  delay(25);
 }
 
+#if TRACE_ENABLED
+/**
+ * Write the trace as Chrome trace-event JSON, e.g. to Serial. Save the
+ * output to a .json file and open it in ui.perfetto.dev.
+ */
+void dumpTrace(Print &out) {
+  std::unique_ptr<TraceJsonStream<TRACE_EVENTS>> stream(new TraceJsonStream<TRACE_EVENTS>(tracer));
+  char buf[256];
+  size_t len;
+  while ((len = stream->fill(buf, sizeof(buf))) > 0) out.write((const uint8_t *)buf, len);
+}
+#endif
+
 void printLocalTime(void) {
     
   struct tm timeinfo;
@@ -685,90 +1100,276 @@ void printLocalTime(void) {
 
 }
 
-// Implement actual temperature reading from SHT2x sensor
-float readTemperature() { 
-  // Read from SHT2x sensor
-  sht.read();
-  float temp = sht.getTemperature();
-  
-  // Check if reading is valid (not NaN or infinite)
-  if (isnan(temp) || isinf(temp)) {
-    Serial.println("Error reading temperature from sensor!");
-    // Return a fallback value
-    return 25.0;
+/*************************************************************
+  Sensor Acquisition
+*************************************************************/
+/**
+ * Take one sample of every sensor (quick: at the lowest resolution,
+ * whatever the power mode): temperature conversions run on all
+ * sensors at once, then humidity, with the split request/collect calls
+ * (AsyncAcquisition). i2cMutex is held only for each short bus
+ * transaction and the task sleeps through the conversions (up to
+ * ~115 ms at high resolution, however many sensors), so the display
+ * can use the bus in between. The result is published to
+ * sensorSnapshot; invalid readings keep the last good values and are
+ * flagged with valid = false when no sensor could be read.
+ */
+SensorSnapshot acquireSensor(bool quick) {
+  TRACE_SCOPE(tracer, "sensor_read");
+  static SensorSnapshot last = { 25.0, 50.0, 0, 0, 0, false, {} };  // Fallback until first good read
+
+  SensorResolution resolution = quick ? SENSOR_RES_FAST : resolutionFor(powerSnapshot.read());
+  {
+    RtosLock lock(i2cMutex);
+    acquisition.setResolution(resolution);
+    acquisition.start(clockHal);
   }
-  
-  // Serial.printf("Temperature read: %.2f°C\n", temp);
-  return temp;
-}
+  for (;;) {
+    rtosDelay(acquisition.waitMs());
+    RtosLock lock(i2cMutex);
+    if (acquisition.step(clockHal) == AsyncAcquisition::DONE) break;
+  }
+  lastAcquireMicros = acquisition.lastTiming().busUs;
+  METRIC_OBSERVE(metricSht2x, lastAcquireMicros);
 
-// Implement actual humidity reading from SHT2x sensor
-float readHumidity() {
-  // Read from SHT2x sensor
-  sht.read();
-  float humidity = sht.getHumidity();
-  
-  // Check if reading is valid (not NaN or infinite)
-  if (isnan(humidity) || isinf(humidity) || humidity < 0 || humidity > 100) {
-    Serial.println("Error reading humidity from sensor!");
-    // Return a fallback value
-    return 50.0;
+  SensorSnapshot sample = acquisition.result(clockHal, last);
+  uint32_t missing = ((1UL << SENSOR_COUNT) - 1) & ~sample.sensors.validMask;
+  if (!sample.valid) {
+    Serial.println("Error reading from sensor!");
+  } else if (missing) {
+    Serial.printf("Error reading from sensors %lx!\n", (unsigned long)missing);
   }
-  
-  // Serial.printf("Humidity read: %.2f%%\n", humidity);
-  return humidity;
+
+  sensorSnapshot.write(sample);
+  last = sample;
+  return sample;
 }
 
 /*************************************************************
-  updateSaunaState(currentTemp)
-  - 1) If temperature rises from 20°C to 30°C within 15 mins => sauna on
-  - 2) Track session time
-  - 3) If temp drops below 30% of highest recorded => sauna off
+  History
 *************************************************************/
-void updateSaunaState(float currentTemp) {
-  unsigned long now = millis();
-
-  // If sauna is NOT active, watch for 20→30°C jump within 15 min
-  if (!saunaActive) {
-    // Check crossing 20°C
-    if (!crossed20 && currentTemp >= 20.0) {
-      crossed20 = true;
-      timeCrossed20 = now;
+/**
+ * Append one sample to the history, timestamped with the system clock.
+ * Until NTP has synced that is seconds since boot; the first sample
+ * with a real date moves the earlier ones onto the epoch.
+ */
+void recordHistory(float temperature, float humidity) {
+  uint32_t now = clockHal.epoch();
+  bool synced = clockSync.update(now, clockHal.millis64() / 1000);
+  size_t rebased = 0;
+  {
+    RtosLock lock(historyMutex);
+    // Once per boot; a few thousand additions at most
+    if (synced) rebased = history.rebase(CLOCK_SYNC_MIN_EPOCH, clockSync.offsetS());
+    history.add(now, temperature, humidity);
+  }
+  if (synced) onClockSynced(rebased);
+}
+
+/**
+ * The clock has just synced: log it and the session that could not be
+ * logged without it
+ */
+void onClockSynced(size_t rebased) {
+  markBoot("clock_sync");
+  Serial.printf("Clock synced, %u history points restamped\n", (unsigned)rebased);
+  if (sessionPending) {
+    sessionPending = false;
+    pendingSession.start = clockSync.toEpoch(pendingSession.start);
+    if (!sessionLog.append(pendingSession, clockHal.millis())) {
+      Serial.println("Session log append failed");
     }
-    // If we crossed 20°C, check if we've reached 30°C
-    if (crossed20 && currentTemp >= 30.0) {
-      // Did it happen within 15 minutes (900,000 ms)?
-      if ((now - timeCrossed20) <= 900000UL) {
-        saunaActive = true;
-        saunaStartTime = now;
-        highestTempDuringSession = currentTemp;
-        Serial.println("Sauna session started!");
+  }
+}
+
+/**
+ * HistoryReader for the /history export: one batch under the lock
+ */
+size_t readHistory(HistoryTier tier, uint32_t seq, HistoryPoint *out, size_t max, uint32_t *first) {
+  RtosLock lock(historyMutex);
+  return history.readSeq(tier, seq, out, max, first);
+}
+
+/*************************************************************
+  Data Serialization
+*************************************************************/
+/**
+ * Write the /data JSON body into buf without touching the heap, with
+ * `points` history entries taken every `stride` raw samples.
+ * Returns the body length (truncated if buf is too small).
+ * Called from the AsyncTCP task only (shares a static scratch buffer).
+ */
+size_t buildDataJson(char *buf, size_t len, const SensorSnapshot &sample,
+                     size_t points, size_t stride) {
+  // History arrays for the chart - last readings from the raw tier
+  static HistoryPoint historyPoints[LIVE_HISTORY_POINTS];
+  if (points > LIVE_HISTORY_POINTS) points = LIVE_HISTORY_POINTS;
+  size_t count;
+  {
+    RtosLock lock(historyMutex);   // Past the recent ring, tail() decodes the archive
+    count = history.tail(HISTORY_RAW, points, stride, historyPoints);
+  }
+
+  SessionSummary stats = sessionSnapshot.read();
+  return serializeData(buf, len, sample.temperature, sample.humidity, sessionMinutes(),
+                       etaSnapshot.read(), historyPoints, count, clockHal.epoch(), &sample.sensors,
+                       &stats);
+}
+
+/**
+ * Write the /data CBOR body (data_cbor.h), same content and history
+ * selection as buildDataJson(). AsyncTCP task only, like buildDataJson().
+ */
+size_t buildDataCbor(uint8_t *buf, size_t len, const SensorSnapshot &sample,
+                     size_t points, size_t stride) {
+  static HistoryPoint historyPoints[DATA_HISTORY_POINTS];
+  if (points > DATA_HISTORY_POINTS) points = DATA_HISTORY_POINTS;
+  size_t count;
+  {
+    RtosLock lock(historyMutex);   // Past the recent ring, tail() decodes the archive
+    count = history.tail(HISTORY_RAW, points, stride, historyPoints);
+  }
+
+  SessionSummary stats = sessionSnapshot.read();
+  return serializeDataCbor(buf, len, sample.seq, sample.temperature, sample.humidity,
+                           sessionMinutes(), etaSnapshot.read(), historyPoints, count,
+                           clockHal.epoch(), &sample.sensors, &stats);
+}
+
+/**
+ * Broadcast a new sample once to every connected dashboard and hand it
+ * to the MQTT batcher
+ */
+void publishSample(const SensorSnapshot &sample) {
+  SaunaStatus session = saunaSnapshot.read();
+  uint32_t minutes = saunaSessionMillis(session, clockHal.millis64()) / 60000;
+#ifdef MQTT_HOST
+  mqtt.sample(sample.seq, sample.timestamp, sample.temperature, sample.humidity, session.active,
+              minutes, etaSnapshot.read().readyMinutes, powerSnapshot.read().periodMs, clockHal.millis());
+#endif
+  if (events.count() == 0) return;
+
+  char json[SAMPLE_JSON_BUFFER_SIZE];
+  serializeSample(json, sizeof(json), sample.seq, sample.temperature, sample.humidity,
+                  minutes, clockHal.epoch(), &sample.sensors);
+  events.send(json, "sample", sample.seq);
+}
+
+/*************************************************************
+  Sauna Session
+*************************************************************/
+/**
+ * Run session detection (sauna_state.h) and the session analytics
+ * (session_stats.h) on a new reading (the sensors' aggregate and their
+ * spread) and log session start / end and steam throws
+ */
+void updateSaunaState(float currentTemp, float humidity, float spread) {
+  TRACE_SCOPE(tracer, "sauna_state");
+  uint64_t nowMs = clockHal.millis64();
+  SaunaEvent event = updateSaunaState(sauna, currentTemp, humidity, nowMs, spread);
+  saunaSnapshot.write(saunaStatus(sauna));
+  bool thrown = sessionStats.update(sauna, event, currentTemp, humidity, nowMs);
+  const SessionSummary &stats = sessionStats.summary();
+  sessionSnapshot.write(stats);
+  if (thrown) {
+    Serial.printf("Steam throw #%u: humidity +%.0f%%\n", (unsigned)stats.throws, stats.lastThrowRise);
+  }
+
+  switch (event) {
+    case SAUNA_EVENT_STARTED:
+      Serial.println("Sauna session started!");
+#ifdef MQTT_HOST
+      mqtt.event(SAUNA_EVENT_STARTED, sauna, clockHal.epoch(), clockHal.millis());
+#endif
+      break;
+    case SAUNA_EVENT_ENDED:
+      Serial.printf("Sauna session ended. Duration (ms): %lu, detected %lu s after cool-down began\n",
+                    (unsigned long)sauna.lastDuration, (unsigned long)(sauna.lastDetectDelay / 1000));
+      if (SENSOR_COUNT > 1) {
+        Serial.printf("Largest bench-to-floor difference: %.1f°C\n", sauna.lastPeakSpread);
       }
-      // Reset the 20°C flag whether or not it met the 15-min condition
-      crossed20 = false;
-    }
+      Serial.printf("Mean %.1f°C (sd %.1f), %lu min above 60°C, %lu above 80°C, "
+                    "heat dose %.0f°C·min, %.0f%%·min humidity, %u steam throws\n",
+                    stats.meanTemp, stats.tempStdDev, (unsigned long)(stats.above60S / 60),
+                    (unsigned long)(stats.above80S / 60), stats.heatDose, stats.humidityMinutes,
+                    (unsigned)stats.throws);
+      logSession();
+#ifdef MQTT_HOST
+      mqtt.event(SAUNA_EVENT_ENDED, sauna, clockHal.epoch(), clockHal.millis(), &stats);
+#endif
+      break;
+    default:
+      break;
   }
-  // If sauna is active, track highest temp and check for cooldown
-  else {
-    if (currentTemp > highestTempDuringSession) {
-      highestTempDuringSession = currentTemp;
-    }
-    // If temp falls to 30% of highest recorded, consider sauna off
-    float offThreshold = 0.30 * highestTempDuringSession;
-    if (currentTemp <= offThreshold) {
-      saunaActive = false;
-      unsigned long sessionDuration = now - saunaStartTime;
-      Serial.print("Sauna session ended. Duration (ms): ");
-      Serial.println(sessionDuration);
-
-      // Reset tracking
-      highestTempDuringSession = 0.0;
-      crossed20 = false;
-    }
+}
+
+/**
+ * Refit the heat-up / cool-down model on the detector's smoothed
+ * temperature and publish the prediction
+ */
+void updateEta() {
+  TRACE_SCOPE(tracer, "eta");
+  etaModel.update(sauna, clockHal.millis64());
+  etaSnapshot.write(etaModel.prediction());
+}
+
+/**
+ * Pick the power mode from the temperature trend and the session state.
+ * Called from the sensor task after updateSaunaState().
+ */
+void updatePowerMode(float currentTemp) {
+  bool changed;
+  PowerStatus status;
+  {
+    RtosLock lock(powerMutex);
+    changed = power.update(currentTemp, sauna, clockHal.millis());
+    status = powerStatus(power);
+  }
+  powerSnapshot.write(status);   // The slope moves even when the mode does not
+  if (!changed) return;
+
+  bool idle = status.mode == POWER_MODE_IDLE;
+  Serial.println(idle ? "Power: idle (slow sampling, modem sleep)" : "Power: active (heat-up)");
+  powerHal.apply(status.mode);
+  RtosLock lock(i2cMutex);
+  displayHal.setDimmed(idle);
+}
+
+/**
+ * Append the session that just ended to the session log. Needs the
+ * wall clock, the log is ordered by start time: before NTP has synced
+ * the session waits in pendingSession (the last one only).
+ */
+void logSession() {
+  uint32_t now = clockHal.epoch();
+  SessionRecord rec;
+  rec.duration = sauna.lastDuration / 1000;
+  rec.start = now - (sauna.lastDetectDelay + sauna.lastDuration) / 1000;
+  rec.peakTemp = sauna.lastPeakTemp;
+  rec.meanHumidity = sauna.lastMeanHumidity;
+  setSessionRecordStats(rec, sessionStats.summary());
+  if (!clockSync.isSynced()) {
+    Serial.println("Clock not synced, session logged once it is");
+    pendingSession = rec;
+    sessionPending = true;
+    return;
+  }
+  if (!sessionLog.append(rec, clockHal.millis())) {
+    Serial.println("Session log append failed");
   }
 }
 
-void draw(float temperature, float humidity) {
+/**
+ * Minutes since the current session started, 0 when no session.
+ * Any task.
+ */
+uint32_t sessionMinutes() {
+  return saunaSessionMillis(saunaSnapshot.read(), clockHal.millis64()) / 60000;
+}
+
+void draw(const SensorSnapshot &sample) {
+  TRACE_SCOPE(tracer, "draw");
+  METRIC_START(drawStart);
   display.clearDisplay();
   
   // Draw border
@@ -783,7 +1384,7 @@ void draw(float temperature, float humidity) {
   display.drawBitmap(8, 6, TEMP_ICON, 16, 16, SSD1306_WHITE);
   display.setTextSize(2);
   display.setCursor(28, 6);
-  display.print(temperature, 1);
+  display.print(sample.temperature, 1);
   display.setTextSize(2);
   display.print(" C");
   
@@ -794,27 +1395,81 @@ void draw(float temperature, float humidity) {
   display.drawBitmap(8, 34, DROP_ICON, 16, 16, SSD1306_WHITE);
   display.setTextSize(2);
   display.setCursor(28, 34);
-  display.print(int(humidity));
+  display.print(int(sample.humidity));
   display.print(" %");
+
+  // Several sensors: hottest minus coldest (bench versus floor) beside the humidity
+  if (sample.sensors.count > 1) {
+    display.setTextSize(1);
+    display.setCursor(100, 36);
+    display.print("dT");
+    display.setCursor(100, 45);
+    display.print(sensorSpread(sample.sensors), 1);
+  }
   
   // Show sauna session info in a dedicated bottom area
-  if (saunaActive) {
+  SaunaStatus session = saunaSnapshot.read();
+  EtaPrediction eta = etaSnapshot.read();
+  const char *approx = eta.confidence < 50 ? "~" : "";   // Model still settling
+  int8_t ota = otaPercent;
+  if (ota >= 0) {
+    // Firmware update running: its progress takes the status line
+    display.drawLine(0, 54, display.width(), 54, SSD1306_WHITE);
+    display.setTextSize(1);
+    display.setCursor(3, 56);
+    display.printf("OTA %d%%", ota);
+    display.drawRect(48, 56, 76, 6, SSD1306_WHITE);
+    display.fillRect(49, 57, 74 * ota / 100, 4, SSD1306_WHITE);
+  } else if (session.active) {
     // Bottom status bar with enough clearance from humidity reading
     display.drawLine(0, 54, display.width(), 54, SSD1306_WHITE);
     
     display.setTextSize(1);
     display.setCursor(3, 56);
-    display.print("SAUNA ON ");
     
     // Calculate session time
-    unsigned long sessionMin = (millis() - saunaStartTime) / 60000;
-    unsigned long sessionSec = ((millis() - saunaStartTime) % 60000) / 1000;
+    uint64_t now = clockHal.millis64();
+    uint32_t elapsed = saunaSessionMillis(session, now);
+    unsigned long sessionMin = elapsed / 60000;
+    unsigned long sessionSec = (elapsed % 60000) / 1000;
+    SessionSummary stats = sessionSnapshot.read();
     
-    display.print(sessionMin);
-    display.print(":");
-    if (sessionSec < 10) display.print("0");
-    display.print(sessionSec);
+    // "ON 12:34 READY ~8m" while still heating up, then "ON 12:34 AVG 78C L3"
+    // (session mean, steam throws); "LOYLY #3 +12%" right after a throw
+    if (stats.active && stats.throws > 0 && now - stats.lastThrowMs < THROW_BANNER_MS) {
+      display.printf("LOYLY #%u +%.0f%%", (unsigned)stats.throws, stats.lastThrowRise);
+    } else {
+      display.print("ON ");
+      display.print(sessionMin);
+      display.print(":");
+      if (sessionSec < 10) display.print("0");
+      display.print(sessionSec);
+      if (eta.readyMinutes > 0) {
+        display.printf(" READY %s%dm", approx, eta.readyMinutes);
+      } else if (stats.active) {
+        display.printf(" AVG %.0fC", stats.meanTemp);
+        if (stats.throws > 0) display.printf(" L%u", (unsigned)stats.throws);
+      }
+    }
+  } else if (eta.coolMinutes > 0) {
+    display.drawLine(0, 54, display.width(), 54, SSD1306_WHITE);
+    display.setTextSize(1);
+    display.setCursor(3, 56);
+    display.printf("COOLING %s%dm", approx, eta.coolMinutes);
   }
 
-    display.display();
+  flushDisplay();
+  METRIC_SINCE(metricDraw, drawStart);
+}
+
+/**
+ * Send only the parts of the framebuffer that changed since the last
+ * flush, using SSD1306 column/page addressing. Skips the bus entirely
+ * when the frame is unchanged.
+ */
+void flushDisplay() {
+  TRACE_SCOPE(tracer, "oled_flush");
+  METRIC_START(flushStart);
+  lastFlushBytes = flushFrame(oledDiff, displayHal);
+  METRIC_SINCE(metricOledFlush, flushStart);
 }
\ No newline at end of file
@@ -0,0 +1,162 @@
+#ifndef MQTT_POSIX_H
+#define MQTT_POSIX_H
+
+/*************************************************************
+  Minimal MQTT 3.1.1 client over POSIX sockets (simulator only)
+
+  Just enough for MqttHal: CONNECT with a retained last will,
+  QoS 0 PUBLISH and PINGREQ keepalive, so the simulator can replay
+  a trace into a real broker (e.g. a local mosquitto).
+*************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "hal.h"
+
+class PosixMqtt : public MqttHal {
+public:
+  PosixMqtt(const char *host, uint16_t port) : host(host), port(port) {}
+  ~PosixMqtt() override { closeSocket(); }
+
+  bool connect(const char *clientId, const char *user, const char *pass,
+               const char *willTopic, const char *willPayload) override {
+    closeSocket();
+    if (!openSocket()) return false;
+
+    uint8_t packet[512];
+    size_t len = 0;
+    putString(packet, len, "MQTT");
+    packet[len++] = 4;                                  // Protocol level 3.1.1
+    uint8_t flags = 0x02 | 0x04 | 0x20;                 // Clean session, retained will, QoS 0
+    if (user) flags |= 0x80;
+    if (pass) flags |= 0x40;
+    packet[len++] = flags;
+    packet[len++] = 0;
+    packet[len++] = KEEPALIVE_S;
+    putString(packet, len, clientId);
+    putString(packet, len, willTopic);
+    putString(packet, len, willPayload);
+    if (user) putString(packet, len, user);
+    if (pass) putString(packet, len, pass);
+    if (!sendPacket(0x10, packet, len, nullptr, 0)) return false;
+
+    // CONNACK: 0x20 0x02 <session present> <return code>
+    uint8_t ack[4];
+    if (!readExact(ack, sizeof(ack), 5000) || ack[0] != 0x20 || ack[3] != 0) {
+      closeSocket();
+      return false;
+    }
+    lastSend = time(nullptr);
+    return true;
+  }
+
+  bool connected() override { return fd >= 0; }
+
+  bool publish(const char *topic, const uint8_t *payload, size_t len, bool retain) override {
+    if (fd < 0) return false;
+    uint8_t head[2 + 128];
+    size_t headLen = 0;
+    putString(head, headLen, topic);
+    return sendPacket(retain ? 0x31 : 0x30, head, headLen, payload, len);
+  }
+
+  void loop() override {
+    if (fd < 0) return;
+    // Discard whatever the broker sends (PINGRESP); notice a closed socket
+    struct pollfd p = { fd, POLLIN, 0 };
+    while (poll(&p, 1, 0) > 0) {
+      uint8_t buf[64];
+      if (recv(fd, buf, sizeof(buf), 0) <= 0) {
+        closeSocket();
+        return;
+      }
+    }
+    if (time(nullptr) - lastSend >= KEEPALIVE_S / 2) sendPacket(0xC0, nullptr, 0, nullptr, 0);
+  }
+
+private:
+  static const uint8_t KEEPALIVE_S = 60;
+
+  bool openSocket() {
+    char service[8];
+    snprintf(service, sizeof(service), "%u", (unsigned)port);
+    struct addrinfo hints = {};
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *res;
+    if (getaddrinfo(host, service, &hints, &res) != 0) return false;
+    for (struct addrinfo *a = res; a && fd < 0; a = a->ai_next) {
+      fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0) closeSocket();
+    }
+    freeaddrinfo(res);
+    return fd >= 0;
+  }
+
+  void closeSocket() {
+    if (fd >= 0) close(fd);
+    fd = -1;
+  }
+
+  static void putString(uint8_t *buf, size_t &len, const char *s) {
+    size_t n = strlen(s);
+    buf[len++] = n >> 8;
+    buf[len++] = n;
+    memcpy(buf + len, s, n);
+    len += n;
+  }
+
+  bool sendPacket(uint8_t type, const uint8_t *head, size_t headLen,
+                  const uint8_t *body, size_t bodyLen) {
+    uint8_t fixed[5];
+    size_t fixedLen = 0;
+    size_t remaining = headLen + bodyLen;
+    fixed[fixedLen++] = type;
+    do {
+      uint8_t digit = remaining % 128;
+      remaining /= 128;
+      fixed[fixedLen++] = digit | (remaining ? 0x80 : 0);
+    } while (remaining);
+    if (!sendAll(fixed, fixedLen) || !sendAll(head, headLen) || !sendAll(body, bodyLen)) {
+      closeSocket();
+      return false;
+    }
+    lastSend = time(nullptr);
+    return true;
+  }
+
+  bool sendAll(const uint8_t *data, size_t len) {
+    while (len > 0) {
+      ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+      if (n <= 0) return false;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  bool readExact(uint8_t *buf, size_t len, int timeoutMs) {
+    while (len > 0) {
+      struct pollfd p = { fd, POLLIN, 0 };
+      if (poll(&p, 1, timeoutMs) <= 0) return false;
+      ssize_t n = recv(fd, buf, len, 0);
+      if (n <= 0) return false;
+      buf += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  const char *host;
+  uint16_t port;
+  int fd = -1;
+  time_t lastSend = 0;
+};
+
+#endif
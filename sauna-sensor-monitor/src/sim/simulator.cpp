@@ -0,0 +1,2080 @@
+/*************************************************************
+  Trace-replay simulator (native env)
+
+  Replays recorded temperature / humidity traces through the same
+  code the firmware runs: AsyncAcquisition, updateSaunaState(), the
+  session analytics, the heat-up / cool-down prediction, the MQTT publisher and its
+  store-and-forward queue, the power mode, the history and the /data and live-update serializers.
+  Every /data CBOR body is decoded again and compared with its input.
+  Before the traces, the WiFi state machine is run against
+  MockNetwork through connect, a long access point outage and a
+  short drop; backoff, timeouts and reconnect times are checked.
+  The History tiers and the OLED diff have their own unit tests
+  in test/ (pio test -e native).
+  Rows that fall between two samples of the current power mode
+  are skipped, as the device would not have read them. The mock clock
+  jumps from sample to sample, so a week of operation replays in
+  seconds.
+
+  Trace format (CSV, one sample per line):
+    time_s,temperature,humidity
+  - time_s is seconds since the start of the trace
+  - an empty field means the sensor read failed, "nan" or an out
+    of range value is passed through as the sensor returned it
+  - "# start_millis=N" starts the millis() clock at N (wraparound)
+  - "# start_epoch=N" sets the wall clock at time_s = 0
+  - "# ntp_sync_s=N" leaves the wall clock at seconds since boot
+    until time_s = N, as before NTP syncs; the run fails unless the
+    history is all on the epoch and in order afterwards
+  - "# expect_sessions=N" makes the run fail unless N sessions end
+  - "# expect_throws=N" makes the run fail unless N steam throws are
+    detected; the live session analytics are always checked against
+    a double-precision recomputation
+  - "# heater_on_s=N" / "# heater_off_s=N" give the true heater times;
+    the run fails if a session is detected too late or dated too
+    far from them
+
+  Usage: simulator [--repeat N] [--quiet] [--session-log FILE] [--bench]
+                   [--mqtt HOST[:PORT]] [--timeline FILE] [--sensors N]
+                   [--ota IMAGE] [--tasks] [trace.csv ...]
+  Without traces, replays the canned ones in traces/. With
+  --session-log, finished sessions are appended to FILE in the
+  device's session log format (read it with scripts/read_sessions.py).
+  MQTT goes to a mock broker that is unreachable for the second
+  hour of the first repetition; the run fails unless every reading
+  arrives exactly once and in order. With --mqtt the messages go to
+  a real broker instead (no outage), e.g. a local mosquitto:
+    mosquitto_sub -t 'sauna/#' -t 'homeassistant/#' -v
+  --sensors N reads each row through N mock sensors behind a mock
+  mux (up to SIM_MAX_SENSORS), stratified around the trace value so
+  their mean is the trace, with one sensor failing every
+  SIM_SENSOR_FAIL_EVERY rows.
+  --ota IMAGE streams IMAGE and the IMAGE.gz / IMAGE.hs made by
+  scripts/compress_firmware.py through OtaUpdate into a mock
+  partition, in upload-sized and in uneven pieces, and checks the
+  written image and its SHA-256; corrupted, truncated and wrongly
+  hashed uploads must be refused. Reports sizes, decode throughput
+  and the transfer time saved at SIM_OTA_LINK_KBPS.
+  --tasks runs the firmware's sensor, display and network tasks
+  (task_graph.h) on pthreads for SIM_TASK_RUN_MS with synthetic
+  samples and a thread reading the snapshot as the web handlers do;
+  fails on a torn snapshot, a sample out of order or one lost other
+  than at the full queue.
+  --bench times the session detector and the prediction model alone
+  on each trace, the session analytics per sample in a session, the trace recorder per event, the /data JSON and
+  CBOR bodies (size, encode and decode time; the JSON also built by
+  String-style concatenation, with its heap allocations per body),
+  the raw sample archive
+  (bytes per sample, append / read / seek time), and /data under load
+  (BENCH_CLIENTS polling clients, with and without the response cache),
+  History alone (add with its rollups, tail, seqAfter and query per
+  tier), the session log over five years of sessions (append, batch
+  flush, date lookup, /sessions streaming), OLED bus bytes per frame against a full frame, and the time to sample 1 to BENCH_MAX_SENSORS timed mock sensors one
+  after another versus batched. --timeline writes
+  the recorder's last SIM_TIMELINE_EVENTS events (real CPU time, not
+  simulated time) as Chrome trace JSON, for ui.perfetto.dev. The prediction accuracy is reported against the
+  times the trace actually reached the ready and cooled temperatures.
+*************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#define SENSOR_MAX_CHANNELS 16    // Room for the sensor scaling benchmark
+
+#include "hal_mock.h"
+#include "sauna_state.h"
+#include "history.h"
+#include "data_json.h"
+#include "data_cbor.h"
+#include "response_cache.h"
+#include "session_log.h"
+#include "power_mode.h"
+#include "eta_model.h"
+#include "mqtt_publisher.h"
+#include "mqtt_posix.h"
+#include "trace_recorder.h"
+#include "ota_update.h"
+#include "boot_timing.h"
+#include "session_stats.h"
+#include "task_graph.h"
+#include "wifi_manager.h"
+
+/*************************************************************
+  Definitions
+*************************************************************/
+const uint32_t LIVE_SNAPSHOT_INTERVAL_S = 3600;   // One dashboard connect per simulated hour
+
+const uint32_t DEFAULT_START_EPOCH = 1735689600UL;  // 2025-01-01 00:00 UTC
+const size_t MAX_TRACE_SAMPLES = 200000;
+
+// Detection limits checked against heater_on_s / heater_off_s
+const uint32_t MAX_START_DELAY_S = 180;   // Heater on -> session started event
+const uint32_t MAX_END_DELAY_S = 900;     // Heater off -> session ended event
+const uint32_t MAX_DATING_ERROR_S = 120;  // Reported start / end vs the heater times
+const uint32_t BENCH_UPDATES = 20000000;
+const size_t MAX_PREDICTIONS = 8192;
+const uint32_t MQTT_OUTAGE_START_S = 3600;   // Mock broker away for the second hour
+const uint32_t MQTT_OUTAGE_END_S = 7200;
+const uint32_t MQTT_HEALTH_INTERVAL_S = 600;
+const char *MQTT_QUEUE_PATH = "mqtt_queue.sim.bin";
+const uint8_t ETA_MIN_CONFIDENCE = 50;    // Predictions scored for accuracy
+const size_t SIM_TIMELINE_EVENTS = 65536;
+const uint32_t BENCH_TRACE_EVENTS = 10000000;
+const uint32_t BENCH_DATA_BODIES = 200000;
+const uint32_t BENCH_CLIENTS = 10;
+const uint32_t BENCH_POLLS_PER_SAMPLE = 2;   // Clients poll every second, samples every 2 s
+const uint8_t SIM_MAX_SENSORS = 8;           // As the firmware: one TCA9548A
+const uint32_t SIM_SENSOR_FAIL_EVERY = 50;
+const float SIM_STRATIFY_BASE = 20.0f;       // Sensors spread around the trace above this
+const uint8_t BENCH_MAX_SENSORS = 16;        // Two muxes' worth
+const size_t SIM_OTA_SEGMENT = 1436;         // Upload pieces as AsyncWebServer hands them over
+const double SIM_OTA_LINK_KBPS = 120.0;      // Upload rate for the transfer time estimate
+const size_t SIM_OTA_MAX_IMAGE = 4u << 20;
+const uint32_t BENCH_ARCHIVE_SAMPLES = 2000000;  // Appends timed, the archive wraps many times
+const uint32_t BENCH_ARCHIVE_SEEKS = 20000;
+const uint32_t BENCH_HISTORY_SAMPLES = 2000000;  // 2 s adds, every tier rolls over
+const uint32_t BENCH_HISTORY_QUERIES = 20000;
+const uint32_t BENCH_SESSION_DAYS = 5 * 365;   // A session a day for five years
+const char *BENCH_SESSION_PATH = "session_log.bench.bin";
+const uint32_t BENCH_SESSION_LOOKUPS = 20000;
+const uint32_t BENCH_SESSION_STREAMS = 20;     // Whole-log /sessions responses
+const size_t BENCH_SESSION_PIECE = 1436;       // Response buffer AsyncWebServer asks to fill
+const float STATS_TOLERANCE = 0.05f;          // °C / relative, streaming vs recomputed analytics
+const uint8_t SIM_OLED_WIDTH = 128;          // The firmware's SSD1306
+const uint8_t SIM_OLED_PAGES = 8;
+const uint32_t SIM_WIFI_POLL_MS = 100;        // Network task wake-ups during the WiFi scenario
+const uint32_t SIM_WIFI_ANSWER_MS = 1500;     // Driver's GOT_IP or DISCONNECTED after an attempt
+const uint32_t SIM_WIFI_OUTAGE_START_MS = 60000;   // Access point away, long enough for the cap
+const uint32_t SIM_WIFI_OUTAGE_END_MS = 360000;
+const uint32_t SIM_WIFI_DROP_MS = 480000;     // Short drop with the access point still there
+const uint32_t SIM_WIFI_RUN_MS = 540000;
+const uint32_t SIM_TASK_PERIOD_MS = 2;        // --tasks: sample period, the tasks run in real time
+const uint32_t SIM_TASK_POLL_MS = 5;          // Network task queue wait
+const uint32_t SIM_TASK_RUN_MS = 2000;
+const uint32_t SIM_TASK_STALL_EVERY = 100;    // Network task stalls every 100 published samples
+const uint32_t SIM_TASK_STALL_MS = 30;        // Long enough to overflow the sample queue
+
+const char *CANNED_TRACES[] = {
+  "traces/normal_session.csv",
+  "traces/slow_heatup.csv",
+  "traces/sensor_dropout.csv",
+  "traces/millis_wraparound.csv",
+  "traces/loyly_session.csv",
+};
+
+struct TraceSample {
+  uint32_t time;      // Seconds since trace start
+  float temperature;
+  float humidity;
+  bool readOk;        // False when the row had an empty field
+};
+
+struct Trace {
+  TraceSample *samples;
+  size_t count;
+  uint32_t startMillis;
+  uint32_t startEpoch;
+  int expectSessions;  // -1 when the trace makes no claim
+  int expectThrows;
+  int64_t heaterOn;    // Seconds, -1 when unknown
+  int64_t heaterOff;
+  int64_t ntpSync;     // Seconds, -1 when the clock is set from the start
+};
+
+struct RunStats {
+  uint32_t samples;
+  uint32_t invalid;
+  uint32_t sessions;
+  uint32_t skipped;       // Rows not sampled because of the idle period
+  uint32_t truncated;     // Serializations that did not fit their buffer
+  uint64_t jsonBytes;
+  uint32_t simSeconds;
+  int64_t startDelay;     // Seconds from heater on to the started event (first session)
+  int64_t endDelay;       // Seconds from heater off to the ended event
+  int64_t startError;     // Reported start - heater on
+  int64_t endError;       // Reported end - heater off
+  uint32_t mqttMessages;  // Reading batches delivered
+  uint32_t mqttGaps;      // Readings missing, duplicated or out of order
+  uint32_t mqttPeakQueue;
+  uint64_t dataJsonBytes;   // /data bodies, JSON and CBOR
+  uint64_t dataCborBytes;
+  uint32_t cborMismatches;  // CBOR bodies that did not decode to their input
+  uint32_t restamped;       // History points moved onto the epoch at the clock sync
+  uint32_t badTimes;        // History points before 2020 or out of order at the end
+  uint32_t archiveMismatches; // Raw points whose archive copy differs from the recent ring
+  uint32_t throws;          // Steam throws detected
+  uint32_t statsErrors;     // Samples whose live analytics differ from the recomputation
+};
+
+/**
+ * Scores "done in N minutes" predictions once the real time is known
+ */
+struct EtaScore {
+  uint32_t made[MAX_PREDICTIONS];       // Sim seconds when predicted
+  uint32_t predicted[MAX_PREDICTIONS];  // Predicted sim seconds of arrival
+  size_t count;
+  int64_t actual;                       // Sim seconds of arrival, -1 until reached
+
+  void reset() { count = 0; actual = -1; }
+
+  void add(uint32_t now, int16_t minutes, uint8_t confidence) {
+    if (actual >= 0 || minutes <= 0 || confidence < ETA_MIN_CONFIDENCE) return;
+    if (count < MAX_PREDICTIONS) {
+      made[count] = now;
+      predicted[count] = now + minutes * 60;
+      count++;
+    }
+  }
+
+  void print(const char *what) const {
+    if (actual < 0 || count == 0) {
+      printf("  eta %s: %s\n", what, actual < 0 ? "not reached" : "no confident prediction");
+      return;
+    }
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) sum += llabs((int64_t)predicted[i] - actual);
+    printf("  eta %s: reached at %llds, first prediction %llds ahead (%+llds off), "
+           "mean error %.1f min over %u\n", what, (long long)actual,
+           (long long)(actual - made[0]), (long long)((int64_t)predicted[0] - actual),
+           sum / count / 60.0, (unsigned)count);
+  }
+};
+
+/**
+ * Checks the readings arriving at the mock broker: every batch must
+ * start right after the previous one
+ */
+struct MqttCheck {
+  uint32_t nextSeq;
+  bool started;
+  RunStats *stats;
+};
+
+void onMockPublish(const char *topic, const uint8_t *payload, size_t len, bool, void *context) {
+  MqttCheck &check = *(MqttCheck *)context;
+  size_t topicLen = strlen(topic);
+  if (topicLen < 6 || strcmp(topic + topicLen - 6, "/state") != 0) return;
+
+  char text[MQTT_PAYLOAD_MAX + 1];
+  memcpy(text, payload, len);
+  text[len] = '\0';
+  unsigned long seq;
+  const char *t = strstr(text, "\"t\":[");
+  if (sscanf(text, "{\"seq\":%lu", &seq) != 1 || !t) {
+    check.stats->mqttGaps++;
+    return;
+  }
+  uint32_t readings = 1;
+  for (const char *c = t; *c && *c != ']'; c++) readings += *c == ',';
+  if (check.started && seq != check.nextSeq) check.stats->mqttGaps++;
+  check.started = true;
+  check.nextSeq = seq + readings;
+  check.stats->mqttMessages++;
+}
+
+bool quiet = false;
+uint8_t sensorCount = 1;
+const char *mqttHost = nullptr;
+uint16_t mqttPort = 1883;
+SessionLog sessionLog;
+bool sessionLogOpen = false;
+TraceRecorder<SIM_TIMELINE_EVENTS> tracer;  // Same stages as the firmware's trace
+
+/*************************************************************
+  /data Decoding
+*************************************************************/
+/**
+ * Decode a /data CBOR body and compare it with what was encoded
+ */
+bool checkDataCbor(const uint8_t *body, size_t len, const SensorSnapshot &sample,
+                   uint32_t minutes, const EtaPrediction &eta,
+                   const HistoryPoint *points, size_t count, uint32_t now,
+                   const SessionSummary &session) {
+  static SaunaReadings r;
+  if (!decodeSaunaReadings(body, len, r)) return false;
+  if (r.seq != sample.seq || r.time != now || r.count != count ||
+      lroundf(r.temperature * 10) != lroundf(sample.temperature * 10) ||
+      r.humidity != int(sample.humidity) || r.sessionMinutes != minutes ||
+      r.readyMinutes != eta.readyMinutes || r.coolMinutes != eta.coolMinutes ||
+      r.etaConfidence != eta.confidence) {
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (r.times[i] != points[i].time || r.hums[i] != int(points[i].humMean) ||
+        lroundf(r.temps[i] * 10) != lroundf(points[i].tempMean * 10)) {
+      return false;
+    }
+  }
+  const SensorFrame &f = sample.sensors;
+  if (r.sensorCount != (f.count > 1 ? f.count : 0)) return false;
+  for (uint8_t i = 0; i < r.sensorCount; i++) {
+    bool has = f.hold[i] > 0;
+    if (((r.sensorValid >> i & 1) != 0) != has) return false;
+    if (has && (lroundf(r.sensorTemps[i] * 10) != lroundf(f.temperature[i] * 10) ||
+                r.sensorHums[i] != int(f.humidity[i]))) {
+      return false;
+    }
+  }
+  if (r.hasStats != session.valid) return false;
+  return !session.valid ||
+         (r.statsActive == session.active && r.throws == session.throws &&
+          lroundf(r.meanTemp * 10) == lroundf(session.meanTemp * 10) &&
+          lroundf(r.tempSd * 10) == lroundf(session.tempStdDev * 10) &&
+          r.above60Minutes == session.above60S / 60 && r.above80Minutes == session.above80S / 60 &&
+          r.humidityMinutes == (uint32_t)lroundf(session.humidityMinutes) &&
+          r.heatDose == (uint32_t)lroundf(session.heatDose));
+}
+
+// Value after "key": in a JSON body, or null
+const char *jsonValue(const char *json, const char *key) {
+  char pattern[32];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char *p = strstr(json, pattern);
+  return p ? p + strlen(pattern) : nullptr;
+}
+
+// Numbers of a JSON array, as a collector would read them
+template <typename T, typename Parse>
+size_t jsonArray(const char *p, T *out, size_t max, Parse parse) {
+  size_t n = 0;
+  if (!p || *p != '[') return 0;
+  p++;
+  while (*p && *p != ']' && n < max) {
+    char *end;
+    out[n++] = parse(p, &end);
+    p = *end == ',' ? end + 1 : end;
+  }
+  return n;
+}
+
+/**
+ * Collector-style parse of the /data JSON into the same struct the CBOR
+ * decoder fills, for the benchmark. Labels are counted, not parsed.
+ */
+bool parseDataJson(const char *json, SaunaReadings &out) {
+  const char *v;
+  if (!(v = jsonValue(json, "temperature"))) return false;
+  out.temperature = strtof(v, nullptr);
+  if (!(v = jsonValue(json, "humidity"))) return false;
+  out.humidity = strtol(v, nullptr, 10);
+  if (!(v = jsonValue(json, "sessionTime"))) return false;
+  out.sessionMinutes = strtoul(v, nullptr, 10);
+  v = jsonValue(json, "readyIn");
+  out.readyMinutes = !v || *v == 'n' ? -1 : strtol(v, nullptr, 10);
+  v = jsonValue(json, "coolIn");
+  out.coolMinutes = !v || *v == 'n' ? -1 : strtol(v, nullptr, 10);
+  if ((v = jsonValue(json, "etaConfidence"))) out.etaConfidence = strtoul(v, nullptr, 10);
+  if ((v = jsonValue(json, "session")) && *v == '{') {
+    out.hasStats = true;
+    if ((v = jsonValue(json, "meanTemp"))) out.meanTemp = strtof(v, nullptr);
+    if ((v = jsonValue(json, "heatDose"))) out.heatDose = strtoul(v, nullptr, 10);
+    if ((v = jsonValue(json, "throws"))) out.throws = strtoul(v, nullptr, 10);
+  }
+
+  size_t labels = 0;
+  if ((v = jsonValue(json, "labels"))) {
+    for (; *v && *v != ']'; v++) labels += *v == '"';
+  }
+  out.count = jsonArray(jsonValue(json, "tempHistory"), out.temps, SAUNA_CBOR_MAX_POINTS,
+                        [](const char *p, char **end) { return strtof(p, end); });
+  size_t hums = jsonArray(jsonValue(json, "humHistory"), out.hums, SAUNA_CBOR_MAX_POINTS,
+                          [](const char *p, char **end) { return (int16_t)strtol(p, end, 10); });
+  return out.count == hums && out.count == labels / 2;
+}
+
+/*************************************************************
+  Trace Loading
+*************************************************************/
+/**
+ * Parse one value field: empty means no reading
+ */
+bool parseField(const char *field, float &value) {
+  while (*field == ' ') field++;
+  if (*field == '\0' || *field == '\n' || *field == '\r') return false;
+  value = strtof(field, nullptr);  // Accepts "nan"
+  return true;
+}
+
+bool loadTrace(const char *path, Trace &trace) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "Cannot open trace %s\n", path);
+    return false;
+  }
+
+  trace.count = 0;
+  trace.startMillis = 0;
+  trace.startEpoch = DEFAULT_START_EPOCH;
+  trace.expectSessions = trace.expectThrows = -1;
+  trace.heaterOn = trace.heaterOff = trace.ntpSync = -1;
+
+  char line[256];
+  unsigned lineNo = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineNo++;
+    if (line[0] == '#') {
+      unsigned long v;
+      if (sscanf(line, "# start_millis=%lu", &v) == 1) trace.startMillis = v;
+      else if (sscanf(line, "# start_epoch=%lu", &v) == 1) trace.startEpoch = v;
+      else if (sscanf(line, "# expect_sessions=%lu", &v) == 1) trace.expectSessions = (int)v;
+      else if (sscanf(line, "# expect_throws=%lu", &v) == 1) trace.expectThrows = (int)v;
+      else if (sscanf(line, "# heater_on_s=%lu", &v) == 1) trace.heaterOn = v;
+      else if (sscanf(line, "# heater_off_s=%lu", &v) == 1) trace.heaterOff = v;
+      else if (sscanf(line, "# ntp_sync_s=%lu", &v) == 1) trace.ntpSync = v;
+      continue;
+    }
+    if (line[0] < '0' || line[0] > '9') continue;  // Header or blank line
+
+    if (trace.count == MAX_TRACE_SAMPLES) {
+      fprintf(stderr, "%s: more than %u samples\n", path, (unsigned)MAX_TRACE_SAMPLES);
+      break;
+    }
+
+    // Split on commas by hand so empty fields survive
+    char *fields[3] = { line, nullptr, nullptr };
+    char *comma = strchr(line, ',');
+    if (comma) { *comma = '\0'; fields[1] = comma + 1; comma = strchr(fields[1], ','); }
+    if (comma) { *comma = '\0'; fields[2] = comma + 1; }
+    if (!fields[2]) {
+      fprintf(stderr, "%s:%u: expected time_s,temperature,humidity\n", path, lineNo);
+      continue;
+    }
+
+    TraceSample &s = trace.samples[trace.count++];
+    s.time = strtoul(fields[0], nullptr, 10);
+    bool tempOk = parseField(fields[1], s.temperature);
+    bool humOk = parseField(fields[2], s.humidity);
+    s.readOk = tempOk && humOk;
+  }
+  fclose(f);
+  return trace.count > 0;
+}
+
+/*************************************************************
+  Replay
+*************************************************************/
+/**
+ * History points, in any tier, dated before 2020 or before the point
+ * ahead of them
+ */
+uint32_t badHistoryTimes(const History &history) {
+  HistoryPoint points[64];
+  uint32_t bad = 0;
+  for (uint8_t t = HISTORY_RAW; t <= HISTORY_15M; t++) {
+    HistoryTier tier = (HistoryTier)t;
+    uint32_t seq = history.firstSeq(tier);
+    uint32_t prev = 0;
+    size_t n;
+    while ((n = history.readSeq(tier, seq, points, 64, &seq)) > 0) {
+      for (size_t i = 0; i < n; i++) {
+        if (points[i].time < CLOCK_SYNC_MIN_EPOCH || points[i].time < prev) bad++;
+        prev = points[i].time;
+      }
+      seq += n;
+    }
+  }
+  return bad;
+}
+
+/**
+ * Raw points in the archive that differ from their copy in the recent
+ * ring, which tail() reads
+ */
+uint32_t archiveMismatches(const History &history) {
+  HistoryPoint recent[HISTORY_RAW_SLOTS], archived[HISTORY_RAW_SLOTS];
+  size_t n = history.tail(HISTORY_RAW, HISTORY_RAW_SLOTS, 1, recent);
+  uint32_t first;
+  size_t m = history.readSeq(HISTORY_RAW, history.nextSeq(HISTORY_RAW) - n, archived, n, &first);
+  uint32_t bad = (uint32_t)(n - m);
+  for (size_t i = 0; i < m; i++) {
+    bad += recent[i].time != archived[i].time || recent[i].tempMean != archived[i].tempMean ||
+           recent[i].humMean != archived[i].humMean;
+  }
+  return bad;
+}
+
+/**
+ * Session analytics recomputed from plain double-precision sums, to
+ * check the single-precision streaming updates of SessionStats against
+ */
+struct StatsReference {
+  uint64_t lastMs = 0;
+  double weight = 0, sumTemp = 0, sumTemp2 = 0, dose = 0, humidity = 0;
+  uint64_t above60Ms = 0, above80Ms = 0;
+
+  void reset(uint64_t nowMs) {
+    *this = StatsReference();
+    lastMs = nowMs;
+  }
+
+  void add(float temp, float hum, uint64_t nowMs) {
+    uint64_t dt = nowMs - lastMs;
+    if (dt > SESSION_MAX_STEP_MS) dt = SESSION_MAX_STEP_MS;
+    lastMs = nowMs;
+    double w = dt / 1000.0;
+    weight += w;
+    sumTemp += w * temp;
+    sumTemp2 += w * (double)temp * temp;
+    humidity += hum * w / 60.0;
+    if (temp > SESSION_DOSE_BASE_C) dose += (temp - SESSION_DOSE_BASE_C) * w / 60.0;
+    if (temp >= SESSION_HOT_C) above60Ms += dt;
+    if (temp >= SESSION_VERY_HOT_C) above80Ms += dt;
+  }
+
+  bool matches(const SessionSummary &s) const {
+    if (weight <= 0) return true;
+    double mean = sumTemp / weight;
+    double var = sumTemp2 / weight - mean * mean;
+    double sd = var > 0 ? sqrt(var) : 0;
+    auto close = [](double a, double b) {
+      return fabs(a - b) <= STATS_TOLERANCE * (fabs(b) > 1 ? fabs(b) : 1);
+    };
+    return fabs(s.meanTemp - mean) <= STATS_TOLERANCE && fabs(s.tempStdDev - sd) <= STATS_TOLERANCE &&
+           close(s.heatDose, dose) && close(s.humidityMinutes, humidity) &&
+           s.above60S == above60Ms / 1000 && s.above80S == above80Ms / 1000;
+  }
+};
+
+/**
+ * Replay the trace `repeat` times back to back through the firmware
+ * logic. Returns false if an expectation in the trace was not met.
+ */
+bool replayTrace(const char *name, const Trace &trace, unsigned repeat, RunStats &stats) {
+  static History history;  // ~135 KB, keep it off the stack
+  history.clear();
+  static EtaScore readyScore, coolScore;
+  readyScore.reset();
+  coolScore.reset();
+  EtaModel eta;
+
+  // MQTT into the mock broker (or a real one), queue file from scratch
+  remove(MQTT_QUEUE_PATH);
+  MqttQueue mqttQueue;
+  mqttQueue.begin(MQTT_QUEUE_PATH);
+  MockMqtt mockMqtt;
+  PosixMqtt posixMqtt(mqttHost ? mqttHost : "localhost", mqttPort);
+  MqttHal &mqttHal = mqttHost ? (MqttHal &)posixMqtt : (MqttHal &)mockMqtt;
+  MqttCheck mqttCheck = { 0, false, &stats };
+  mockMqtt.onPublish = onMockPublish;
+  mockMqtt.context = &mqttCheck;
+  MqttPublisher mqtt(mqttHal, mqttQueue);
+  mqtt.begin("sim", nullptr, nullptr);
+  uint32_t nextHealth = 0;
+  memset(&stats, 0, sizeof(stats));
+  stats.startDelay = stats.endDelay = stats.startError = stats.endError = -1;
+
+  // Before the NTP sync the wall clock counts seconds since boot
+  MockClock clock(trace.startMillis, trace.ntpSync >= 0 ? 0 : trace.startEpoch);
+  ClockSync clockSync;
+  SessionRecord pendingSession;
+  bool sessionPending = false;
+  MockSensor sensors[SIM_MAX_SENSORS];
+  MockMux mux;
+  SensorPort ports[SIM_MAX_SENSORS];
+  for (uint8_t k = 0; k < sensorCount; k++) {
+    ports[k] = { &sensors[k], sensorCount > 1 ? &mux : nullptr, k };
+  }
+  AsyncAcquisition acquisition;
+  acquisition.attach(ports, sensorCount);
+  SaunaState sauna;
+  SessionStats analytics;
+  StatsReference reference;
+  PowerManager power;
+  power.begin(POWER_MODE_ACTIVE, clock.millis());
+  uint32_t nextSample = 0;
+  SensorSnapshot last = { 25.0, 50.0, 0, 0, 0, false, {} };
+
+  char dataJson[DATA_JSON_BUFFER_SIZE];
+  uint8_t dataCbor[DATA_CBOR_BUFFER_SIZE];
+  char liveJson[LIVE_JSON_BUFFER_SIZE];
+  char sampleJson[SAMPLE_JSON_BUFFER_SIZE];
+  HistoryPoint points[LIVE_HISTORY_POINTS];
+
+  uint32_t traceSpan = trace.samples[trace.count - 1].time + 10;
+  uint32_t simTime = 0;       // Seconds since the replay started
+  uint32_t nextSnapshot = 0;
+
+  for (unsigned r = 0; r < repeat; r++) {
+    uint32_t offset = r * traceSpan;
+    for (size_t i = 0; i < trace.count; i++) {
+      const TraceSample &s = trace.samples[i];
+      uint32_t target = offset + s.time;
+      if (target > simTime) {
+        clock.advanceMillis((target - simTime) * 1000);
+        simTime = target;
+      }
+      if (r == 0 && trace.ntpSync >= 0 && simTime >= trace.ntpSync &&
+          clock.epoch() < CLOCK_SYNC_MIN_EPOCH) {
+        clock.setEpoch(trace.startEpoch + simTime);
+      }
+
+      if (simTime < nextSample) {
+        stats.skipped++;
+        continue;
+      }
+
+      // Bench hotter than the trace, floor colder, same mean
+      for (uint8_t k = 0; k < sensorCount; k++) {
+        float factor = sensorCount > 1 ? 0.7f + 0.6f * k / (sensorCount - 1) : 1.0f;
+        bool failing = sensorCount > 1 && i % SIM_SENSOR_FAIL_EVERY == 0 &&
+                       k == (i / SIM_SENSOR_FAIL_EVERY) % sensorCount;
+        if (s.readOk && !failing) {
+          sensors[k].set(SIM_STRATIFY_BASE + (s.temperature - SIM_STRATIFY_BASE) * factor,
+                         s.humidity);
+        } else {
+          sensors[k].fail();
+        }
+      }
+
+      // Same path as the sensor task (FirmwareWork)
+      TRACE_SCOPE(tracer, "sample");
+      SensorSnapshot sample;
+      {
+        TRACE_SCOPE(tracer, "sensor_read");
+        acquisition.start(clock);
+        while (acquisition.step(clock) != AsyncAcquisition::DONE) {}
+        sample = acquisition.result(clock, last);
+      }
+      last = sample;
+      stats.samples++;
+
+      if (sample.valid) {
+        SaunaEvent event;
+        {
+          TRACE_SCOPE(tracer, "sauna_state");
+          event = updateSaunaState(sauna, sample.temperature, sample.humidity, clock.millis64(),
+                                   sensorSpread(sample.sensors));
+          // Same as the firmware's updateSaunaState()
+          if (analytics.update(sauna, event, sample.temperature, sample.humidity, clock.millis64())) {
+            stats.throws++;
+            if (!quiet) {
+              printf("  %7lus  steam throw #%u (humidity +%.0f%%)\n", (unsigned long)simTime,
+                     (unsigned)analytics.summary().throws, analytics.summary().lastThrowRise);
+            }
+          }
+        }
+        const SessionSummary &summary = analytics.summary();
+        if (event == SAUNA_EVENT_STARTED) reference.reset(clock.millis64());
+        if (sauna.active && sauna.spikes == 0) {
+          reference.add(sample.temperature, sample.humidity, clock.millis64());
+          if (!reference.matches(summary)) stats.statsErrors++;
+        }
+        // Session times relative to the trace start, for the first repetition
+        int64_t startedAt = (int64_t)(sauna.startTime / 1000) - (int64_t)(trace.startMillis / 1000);
+        if (event == SAUNA_EVENT_STARTED) {
+          if (r == 0 && stats.startDelay < 0 && trace.heaterOn >= 0) {
+            stats.startDelay = (int64_t)simTime - trace.heaterOn;
+            stats.startError = startedAt - trace.heaterOn;
+          }
+          mqtt.event(event, sauna, clock.epoch(), clock.millis());
+          if (!quiet) {
+            printf("  %7lus  session started at %.1f°C (dated %llds)\n",
+                   (unsigned long)simTime, sample.temperature, (long long)startedAt);
+          }
+        }
+        if (event == SAUNA_EVENT_ENDED) {
+          stats.sessions++;
+          int64_t endedAt = (int64_t)simTime - sauna.lastDetectDelay / 1000;
+          mqtt.event(event, sauna, clock.epoch(), clock.millis(), &summary);
+          if (r == 0 && stats.endDelay < 0 && trace.heaterOff >= 0) {
+            stats.endDelay = (int64_t)simTime - trace.heaterOff;
+            stats.endError = endedAt - trace.heaterOff;
+          }
+          if (sessionLogOpen) {
+            SessionRecord rec;
+            rec.duration = sauna.lastDuration / 1000;
+            rec.start = clock.epoch() - (sauna.lastDetectDelay + sauna.lastDuration) / 1000;
+            rec.peakTemp = sauna.lastPeakTemp;
+            rec.meanHumidity = sauna.lastMeanHumidity;
+            setSessionRecordStats(rec, summary);
+            if (!clockSync.isSynced() && trace.ntpSync >= 0) {
+              pendingSession = rec;   // As logSession(): logged once the clock is known
+              sessionPending = true;
+            } else if (!sessionLog.append(rec, clock.millis())) {
+              printf("  %7lus  session not logged (starts before the last logged one)\n",
+                     (unsigned long)simTime);
+            }
+          }
+          if (!quiet) {
+            printf("  %7lus  session ended after %lu min (%.1f°C, dated %llds)",
+                   (unsigned long)simTime, (unsigned long)(sauna.lastDuration / 60000),
+                   sample.temperature, (long long)endedAt);
+            if (sensorCount > 1) printf(", spread up to %.1f°C", sauna.lastPeakSpread);
+            printf("\n");
+            printf("  %7s  mean %.1f°C (sd %.1f), %lu min above 60°C, %lu above 80°C, "
+                   "heat dose %.0f°C·min, %.0f%%·min humidity, %u steam throws\n", "",
+                   summary.meanTemp, summary.tempStdDev, (unsigned long)(summary.above60S / 60),
+                   (unsigned long)(summary.above80S / 60), summary.heatDose,
+                   summary.humidityMinutes, (unsigned)summary.throws);
+          }
+        }
+        {
+          TRACE_SCOPE(tracer, "eta");
+          eta.update(sauna, clock.millis64());
+        }
+        if (r == 0) {
+          const EtaPrediction &p = eta.prediction();
+          float level = saunaLevelC(sauna);
+          if (p.phase == ETA_PHASE_HEATING) {
+            readyScore.add(simTime, p.readyMinutes, p.confidence);
+            if (readyScore.actual < 0 && level >= ETA_READY_TEMP) readyScore.actual = simTime;
+          }
+          if (p.phase == ETA_PHASE_COOLING) coolScore.add(simTime, p.coolMinutes, p.confidence);
+          if (coolScore.count > 0 && coolScore.actual < 0 && level <= ETA_COOL_TEMP) {
+            coolScore.actual = simTime;
+          }
+        }
+        // Same as recordHistory()
+        uint32_t uptime = (uint32_t)((clock.millis64() - trace.startMillis) / 1000);
+        if (clockSync.update(sample.timestamp, uptime)) {
+          stats.restamped = history.rebase(CLOCK_SYNC_MIN_EPOCH, clockSync.offsetS());
+          if (sessionPending && sessionLogOpen) {
+            pendingSession.start = clockSync.toEpoch(pendingSession.start);
+            sessionLog.append(pendingSession, clock.millis());
+          }
+          sessionPending = false;
+          if (!quiet && trace.ntpSync >= 0) {
+            printf("  %7lus  clock synced, %u history points restamped\n",
+                   (unsigned long)simTime, (unsigned)stats.restamped);
+          }
+        }
+        history.add(sample.timestamp, sample.temperature, sample.humidity);
+        if (power.update(sample.temperature, sauna, clock.millis()) && !quiet) {
+          printf("  %7lus  power %s (slope %.2f°C/min)\n", (unsigned long)simTime,
+                 power.mode() == POWER_MODE_IDLE ? "idle" : "active", power.slope());
+        }
+      } else {
+        stats.invalid++;
+      }
+
+      uint32_t minutes = saunaSessionMillis(sauna, clock.millis64()) / 60000;
+
+      // Live delta for every sample, /data as a polling dashboard would request it
+      tracer.begin("serialize");
+      size_t len = serializeSample(sampleJson, sizeof(sampleJson), sample.seq,
+                                   sample.temperature, sample.humidity, minutes, clock.epoch(),
+                                   &sample.sensors);
+      stats.jsonBytes += len;
+      if (len >= sizeof(sampleJson) - 1) stats.truncated++;
+
+      size_t count = history.tail(HISTORY_RAW, DATA_HISTORY_POINTS, DATA_HISTORY_STRIDE, points);
+      len = serializeData(dataJson, sizeof(dataJson), sample.temperature, sample.humidity,
+                          minutes, eta.prediction(), points, count, clock.epoch(),
+                          &sample.sensors, &analytics.summary());
+      stats.jsonBytes += len;
+      stats.dataJsonBytes += len;
+      if (len >= sizeof(dataJson) - 1) stats.truncated++;
+
+      // Same reading as /data?fmt=cbor, checked by decoding it again
+      size_t cborLen = serializeDataCbor(dataCbor, sizeof(dataCbor), sample.seq,
+                                         sample.temperature, sample.humidity, minutes,
+                                         eta.prediction(), points, count, clock.epoch(),
+                                         &sample.sensors, &analytics.summary());
+      stats.dataCborBytes += cborLen;
+      if (!checkDataCbor(dataCbor, cborLen, sample, minutes, eta.prediction(), points, count,
+                         clock.epoch(), analytics.summary())) {
+        stats.cborMismatches++;
+      }
+
+      // Full snapshot as sent to a newly connected dashboard
+      if (simTime >= nextSnapshot) {
+        count = history.tail(HISTORY_RAW, LIVE_HISTORY_POINTS, 1, points);
+        len = serializeData(liveJson, sizeof(liveJson), sample.temperature, sample.humidity,
+                            minutes, eta.prediction(), points, count, clock.epoch(),
+                            &sample.sensors, &analytics.summary());
+        stats.jsonBytes += len;
+        if (len >= sizeof(liveJson) - 1) stats.truncated++;
+        nextSnapshot = simTime + LIVE_SNAPSHOT_INTERVAL_S;
+      }
+      tracer.end("serialize");
+      TRACE_SCOPE(tracer, "mqtt");
+      // Same path as publishSample() and the network task
+      mqtt.sample(sample.seq, sample.timestamp, sample.temperature, sample.humidity, sauna.active,
+                  minutes, eta.prediction().readyMinutes, power.periodMs(), clock.millis());
+      if (simTime >= nextHealth) {
+        DeviceHealth health = { simTime, -60, 0, 0, power.mode() == POWER_MODE_IDLE,
+                                (uint32_t)mqttQueue.depth(), mqttQueue.dropped() };
+        mqtt.health(health, clock.millis());
+        nextHealth = simTime + MQTT_HEALTH_INTERVAL_S;
+      }
+      mockMqtt.reachable = r > 0 || simTime < MQTT_OUTAGE_START_S || simTime >= MQTT_OUTAGE_END_S;
+      mqtt.service(true, clock.millis());
+      if (mqttQueue.depth() > stats.mqttPeakQueue) stats.mqttPeakQueue = mqttQueue.depth();
+      if (sessionLogOpen) sessionLog.service(clock.millis());
+
+      nextSample = simTime + power.periodMs() / 1000;
+    }
+  }
+  stats.simSeconds = simTime;
+  stats.badTimes = badHistoryTimes(history);
+  stats.archiveMismatches = archiveMismatches(history);
+  power.tick(clock.millis());
+
+  // Let the queue drain, one network poll per simulated second
+  mockMqtt.reachable = true;
+  for (int i = 0; i < 3600 && (mqttQueue.depth() > 0 || !mqtt.connected()); i++) {
+    clock.advanceMillis(1000);
+    mqtt.service(true, clock.millis());
+  }
+  clock.advanceMillis(MQTT_BATCH_MS);   // Flush the last partial batch
+  for (int i = 0; i < 100 && (i == 0 || mqttQueue.depth() > 0); i++) {
+    mqtt.service(true, clock.millis());
+  }
+  mqttQueue.end();
+  remove(MQTT_QUEUE_PATH);
+  if (!quiet) {
+    uint64_t idle = power.timeInMode(POWER_MODE_IDLE);
+    uint64_t total = idle + power.timeInMode(POWER_MODE_ACTIVE);
+    printf("  power: idle %.0f%% of the time, %u rows skipped, model average %.1f mA\n",
+           total ? 100.0 * idle / total : 0.0, (unsigned)stats.skipped,
+           power.averageCurrentMa(true));
+    readyScore.print("ready");
+    coolScore.print("cooled");
+    printf("  mqtt: %u reading batches, %u connects, peak queue %u, %u dropped\n",
+           (unsigned)stats.mqttMessages, (unsigned)mqtt.connects(),
+           (unsigned)stats.mqttPeakQueue, (unsigned)mqttQueue.dropped());
+    printf("  /data: %.0f bytes JSON, %.0f bytes CBOR on average\n",
+           stats.samples ? (double)stats.dataJsonBytes / stats.samples : 0.0,
+           stats.samples ? (double)stats.dataCborBytes / stats.samples : 0.0);
+  }
+
+  bool ok = true;
+  if (trace.expectSessions >= 0 && stats.sessions != trace.expectSessions * repeat) {
+    printf("  FAIL %s: expected %u sessions, got %u\n", name,
+           (unsigned)(trace.expectSessions * repeat), (unsigned)stats.sessions);
+    ok = false;
+  }
+  if (trace.expectThrows >= 0 && stats.throws != trace.expectThrows * repeat) {
+    printf("  FAIL %s: expected %u steam throws, got %u\n", name,
+           (unsigned)(trace.expectThrows * repeat), (unsigned)stats.throws);
+    ok = false;
+  }
+  if (stats.statsErrors) {
+    printf("  FAIL %s: session analytics off the recomputation at %u samples\n", name,
+           (unsigned)stats.statsErrors);
+    ok = false;
+  }
+  if (trace.heaterOn >= 0 && (stats.startDelay < 0 || stats.startDelay > MAX_START_DELAY_S ||
+                              llabs(stats.startError) > MAX_DATING_ERROR_S)) {
+    printf("  FAIL %s: start detected after %llds, dated %llds off\n", name,
+           (long long)stats.startDelay, (long long)stats.startError);
+    ok = false;
+  }
+  if (trace.heaterOff >= 0 && (stats.endDelay < 0 || stats.endDelay > MAX_END_DELAY_S ||
+                               llabs(stats.endError) > MAX_DATING_ERROR_S)) {
+    printf("  FAIL %s: end detected after %llds, dated %llds off\n", name,
+           (long long)stats.endDelay, (long long)stats.endError);
+    ok = false;
+  }
+  if (!mqttHost && (stats.mqttGaps > 0 || mqttQueue.depth() > 0 || mqttQueue.dropped() > 0)) {
+    printf("  FAIL %s: MQTT lost or reordered readings (%u gaps, %u left, %u dropped)\n", name,
+           (unsigned)stats.mqttGaps, (unsigned)mqttQueue.depth(), (unsigned)mqttQueue.dropped());
+    ok = false;
+  }
+  if (stats.truncated) {
+    printf("  FAIL %s: %u truncated JSON bodies\n", name, (unsigned)stats.truncated);
+    ok = false;
+  }
+  if (stats.cborMismatches) {
+    printf("  FAIL %s: %u /data CBOR bodies did not decode to their input\n", name,
+           (unsigned)stats.cborMismatches);
+    ok = false;
+  }
+  if (stats.archiveMismatches) {
+    printf("  FAIL %s: %u raw points differ between the archive and the recent ring\n", name,
+           (unsigned)stats.archiveMismatches);
+    ok = false;
+  }
+  if (stats.badTimes || (trace.ntpSync >= 0 && !clockSync.isSynced())) {
+    printf("  FAIL %s: %u history points not on the epoch or out of order\n", name,
+           (unsigned)stats.badTimes);
+    ok = false;
+  }
+  return ok;
+}
+
+/*************************************************************
+  OLED
+*************************************************************/
+typedef MockDisplay<SIM_OLED_WIDTH, SIM_OLED_PAGES> SimOled;
+
+void oledFill(uint8_t *frame, int x, int y, int w, int h) {
+  for (int py = y; py < y + h; py++) {
+    for (int px = x; px < x + w; px++) {
+      if (px < 0 || px >= SIM_OLED_WIDTH || py < 0 || py >= SIM_OLED_PAGES * 8) continue;
+      frame[px + (py / 8) * SIM_OLED_WIDTH] |= (uint8_t)(1 << (py & 7));
+    }
+  }
+}
+
+// Stand-in for the GFX font: a fixed 5x7 pattern per character in a 6x8 cell, scaled by size
+void oledText(uint8_t *frame, int x, int y, int size, const char *text) {
+  for (; *text; text++, x += 6 * size) {
+    if (*text == ' ') continue;
+    for (int col = 0; col < 5; col++) {
+      uint32_t bits = ((uint8_t)*text * 31u + col * 17u) * 2654435761u >> 25;
+      for (int row = 0; row < 7; row++) {
+        if (bits & (1u << row)) oledFill(frame, x + col * size, y + row * size, size, size);
+      }
+    }
+  }
+}
+
+/**
+ * The firmware's draw() layout, glyphs standing in for the font and
+ * the icons: border, temperature and humidity in size 2, the status
+ * line below a separator
+ */
+void drawOledFrame(uint8_t *frame, float temp, float hum, const char *status) {
+  char text[16];
+  memset(frame, 0, (size_t)SIM_OLED_WIDTH * SIM_OLED_PAGES);
+  oledFill(frame, 0, 0, SIM_OLED_WIDTH, 1);
+  oledFill(frame, 0, SIM_OLED_PAGES * 8 - 1, SIM_OLED_WIDTH, 1);
+  oledFill(frame, 0, 0, 1, SIM_OLED_PAGES * 8);
+  oledFill(frame, SIM_OLED_WIDTH - 1, 0, 1, SIM_OLED_PAGES * 8);
+
+  oledText(frame, 8, 6, 2, "t");
+  snprintf(text, sizeof(text), "%.1f C", temp);
+  oledText(frame, 28, 6, 2, text);
+  oledFill(frame, 0, 28, SIM_OLED_WIDTH, 1);
+  oledText(frame, 8, 34, 2, "h");
+  snprintf(text, sizeof(text), "%d %%", (int)hum);
+  oledText(frame, 28, 34, 2, text);
+
+  oledFill(frame, 0, 54, SIM_OLED_WIDTH, 1);
+  oledText(frame, 3, 56, 1, status);
+}
+
+/**
+ * OLED bus bytes per frame: a frame per valid trace row in draw()'s
+ * layout, with a session clock in the status line, flushed through
+ * flushFrame() and OledDiff to a MockDisplay, against a full frame.
+ * The glyphs are stand-ins, so this estimates the traffic; the diff
+ * itself is tested in test/test_oled.
+ */
+void benchOled(const Trace &trace) {
+  std::unique_ptr<SimOled> display(new SimOled());
+  OledDiff<SIM_OLED_WIDTH, SIM_OLED_PAGES> diff;
+  uint8_t *frame = display->framebuffer();
+  uint32_t frames = 0, idle = 0;
+  uint64_t bytes = 0;
+  size_t fullBytes = 0;
+  double flushSecs = 0;
+
+  for (size_t i = 0; i < trace.count; i++) {
+    const TraceSample &s = trace.samples[i];
+    if (!s.readOk || !(s.temperature > -100.0f && s.temperature < 200.0f)) continue;
+    char status[24];
+    snprintf(status, sizeof(status), "ON %lu:%02lu", (unsigned long)(s.time / 60),
+             (unsigned long)(s.time % 60));
+    drawOledFrame(frame, s.temperature, s.humidity, status);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t sent = flushFrame(diff, *display);
+    flushSecs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (frames++ == 0) {
+      fullBytes = sent;   // Nothing on the panel yet: the whole frame
+    } else {
+      bytes += sent;
+      idle += sent == 0;
+    }
+  }
+  if (frames < 2) return;
+  printf("  oled: %u frames, %.0f bytes per frame on the bus (full frame %u), %u sent nothing, "
+         "flush %.2f us\n",
+         (unsigned)frames, (double)bytes / (frames - 1), (unsigned)fullBytes, (unsigned)idle,
+         flushSecs * 1e6 / frames);
+}
+
+/*************************************************************
+  WiFi
+*************************************************************/
+// Backoff WifiManager aims for after `failures` timed-out attempts, before jitter
+uint32_t nominalBackoff(uint32_t failures) {
+  uint32_t delay = WIFI_BACKOFF_BASE;
+  for (uint32_t i = 0; i < failures && delay < WIFI_RETRY_INTERVAL; i++) delay *= 2;
+  return delay > WIFI_RETRY_INTERVAL ? WIFI_RETRY_INTERVAL : delay;
+}
+
+/**
+ * The network task's WiFi upkeep, as service_wifi_connection() does it,
+ * against MockNetwork and a scripted access point that answers each
+ * attempt after SIM_WIFI_ANSWER_MS: connect at boot, the access point
+ * gone from SIM_WIFI_OUTAGE_START_MS to SIM_WIFI_OUTAGE_END_MS (the
+ * driver reports every failed attempt as a disconnect), then a short
+ * drop at SIM_WIFI_DROP_MS. Fails unless every backoff is within the
+ * jitter of base * 2^failures, the cap is reached during the outage,
+ * attempts end by timeout only, and the connection is back within one
+ * capped backoff and attempt after each drop.
+ */
+bool checkWifi() {
+  MockNetwork network;
+  WifiManager wifi(WIFI_BACKOFF_BASE, WIFI_RETRY_INTERVAL, WIFI_CONNECT_TIMEOUT);
+  WifiState lastState = wifi.getState();
+  bool answerPending = false;
+  uint32_t attemptAt = 0, failures = 0, firstConnects = 0, badBackoffs = 0, badTimeouts = 0;
+  uint32_t minBackoff = UINT32_MAX, maxBackoff = 0, lostAt = 0, slowestReconnect = 0;
+  bool lost = false;
+
+  for (uint32_t now = 0; now <= SIM_WIFI_RUN_MS; now += SIM_WIFI_POLL_MS) {
+    bool apUp = now < SIM_WIFI_OUTAGE_START_MS || now >= SIM_WIFI_OUTAGE_END_MS;
+    if (now == SIM_WIFI_OUTAGE_START_MS || now == SIM_WIFI_DROP_MS) {
+      network.inject(WIFI_EVENT_DISCONNECTED);
+    }
+    if (answerPending && now - attemptAt >= SIM_WIFI_ANSWER_MS) {
+      answerPending = false;
+      network.inject(apUp ? WIFI_EVENT_GOT_IP : WIFI_EVENT_DISCONNECTED);
+    }
+
+    // Same steps as service_wifi_connection()
+    WifiEvent event;
+    while (network.pollEvent(event)) wifi.onEvent(event, now);
+    WifiAction action = wifi.poll(now);
+    if (action == WIFI_ACTION_CONNECT) {
+      network.connect();
+      answerPending = true;
+      attemptAt = now;
+    } else if (action == WIFI_ACTION_DISCONNECT) {
+      network.disconnect();
+      answerPending = false;
+      failures++;
+      badTimeouts += now - attemptAt < WIFI_CONNECT_TIMEOUT;
+    }
+    firstConnects += wifi.takeFirstConnect();
+
+    WifiState state = wifi.getState();
+    if (state == WIFI_STATE_BACKOFF && lastState != WIFI_STATE_BACKOFF) {
+      uint32_t nominal = nominalBackoff(failures);
+      uint32_t backoff = wifi.currentBackoff();
+      badBackoffs += backoff < nominal - nominal / 4 || backoff > nominal - nominal / 4 + nominal / 2;
+      // A driver disconnect must not end an attempt early
+      badTimeouts += lastState == WIFI_STATE_CONNECTING && action != WIFI_ACTION_DISCONNECT;
+      if (nominal < minBackoff) minBackoff = nominal;
+      if (nominal > maxBackoff) maxBackoff = nominal;
+      if (lastState == WIFI_STATE_CONNECTED) {
+        lost = true;
+        lostAt = now;
+      }
+    }
+    if (state == WIFI_STATE_CONNECTED && lastState != WIFI_STATE_CONNECTED) {
+      failures = 0;
+      if (lost) {
+        uint32_t back = now - (lostAt >= SIM_WIFI_OUTAGE_START_MS && lostAt < SIM_WIFI_OUTAGE_END_MS
+                                   ? SIM_WIFI_OUTAGE_END_MS : lostAt);
+        if (back > slowestReconnect) slowestReconnect = back;
+        lost = false;
+      }
+    }
+    lastState = state;
+  }
+
+  // Worst case: the access point returns just after an attempt started
+  uint32_t reconnectLimit = WIFI_CONNECT_TIMEOUT + WIFI_RETRY_INTERVAL + WIFI_RETRY_INTERVAL / 4 +
+                            SIM_WIFI_ANSWER_MS + SIM_WIFI_POLL_MS;
+  bool ok = wifi.isConnected() && wifi.reconnects() == 2 && firstConnects == 1 &&
+            badBackoffs == 0 && badTimeouts == 0 && maxBackoff == WIFI_RETRY_INTERVAL &&
+            network.connects == wifi.attempts() && slowestReconnect <= reconnectLimit;
+  printf("wifi: %s, %u attempts, %u timed out, backoff %.1f to %.1f s (%u outside the jitter), "
+         "%u reconnects, back %.1f s after the access point at worst, %u first connects\n",
+         ok ? "ok" : "FAILED", (unsigned)network.connects, (unsigned)network.disconnects,
+         minBackoff / 1000.0, maxBackoff / 1000.0, (unsigned)badBackoffs,
+         (unsigned)wifi.reconnects(), slowestReconnect / 1000.0, (unsigned)firstConnects);
+  if (badTimeouts) printf("  FAIL wifi: %u attempts ended before the timeout\n", (unsigned)badTimeouts);
+  return ok;
+}
+
+/*************************************************************
+  Benchmark
+*************************************************************/
+/**
+ * Time updateSaunaState() alone over the trace, then together with the
+ * prediction model, looped to BENCH_UPDATES calls at 2 s spacing
+ */
+void benchDetector(const Trace &trace) {
+  for (int withEta = 0; withEta < 2; withEta++) {
+    SaunaState sauna;
+    EtaModel eta;
+    uint64_t nowMs = 0;
+    uint32_t events = 0;
+    int32_t etaSum = 0;   // Keeps the model from being optimized away
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < BENCH_UPDATES; n++) {
+      const TraceSample &s = trace.samples[n % trace.count];
+      nowMs += 2000;
+      if (!s.readOk || !(s.temperature > -100.0f && s.temperature < 200.0f)) continue;
+      events += updateSaunaState(sauna, s.temperature, s.humidity, nowMs) != SAUNA_EVENT_NONE;
+      if (withEta) {
+        eta.update(sauna, nowMs);
+        etaSum += eta.prediction().readyMinutes;
+      }
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (withEta) {
+      printf("  detector + eta: %.1f ns per update (%u bytes of model state, checksum %ld)\n",
+             wall * 1e9 / BENCH_UPDATES, (unsigned)sizeof(EtaModel), (long)etaSum);
+    } else {
+      printf("  detector: %.1f ns per update (%u updates, %u events, %u bytes of state)\n",
+             wall * 1e9 / BENCH_UPDATES, (unsigned)BENCH_UPDATES, (unsigned)events,
+             (unsigned)sizeof(SaunaState));
+    }
+  }
+
+  // Recorder cost per event, as placed around the firmware's hot paths
+  static TraceRecorder<TRACE_EVENTS> recorder;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < BENCH_TRACE_EVENTS / 2; n++) {
+    recorder.begin("bench");
+    recorder.end("bench");
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("  trace recorder: %.1f ns per event\n", wall * 1e9 / BENCH_TRACE_EVENTS);
+}
+
+/**
+ * Time SessionStats::update() per sample in a session: the samples the
+ * detector counts as in a session, fed at 2 s spacing so the throw
+ * window stays full, looped to BENCH_UPDATES calls
+ */
+void benchSessionStats(const Trace &trace) {
+  static float temps[MAX_TRACE_SAMPLES], hums[MAX_TRACE_SAMPLES];
+  size_t n = 0;
+  SaunaState sauna;
+  uint64_t nowMs = 0;
+  for (size_t i = 0; i < trace.count; i++) {
+    const TraceSample &s = trace.samples[i];
+    nowMs += 2000;
+    if (!s.readOk || !(s.temperature > -100.0f && s.temperature < 200.0f)) continue;
+    updateSaunaState(sauna, s.temperature, s.humidity, nowMs);
+    if (sauna.active && sauna.spikes == 0) {
+      temps[n] = s.temperature;
+      hums[n] = s.humidity;
+      n++;
+    }
+  }
+  if (n == 0) {
+    printf("  session stats: no session in the trace\n");
+    return;
+  }
+
+  SaunaState held;            // Inside a session throughout, no start or end
+  held.active = true;
+  SessionStats stats;
+  stats.update(held, SAUNA_EVENT_STARTED, temps[0], hums[0], 0);
+  uint32_t throws = 0;
+  nowMs = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < BENCH_UPDATES; k++) {
+    nowMs += 2000;
+    throws += stats.update(held, SAUNA_EVENT_NONE, temps[k % n], hums[k % n], nowMs);
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("  session stats: %.1f ns per sample in a session (window of up to %u readings, "
+         "%u bytes of state, checksum %u)\n", wall * 1e9 / BENCH_UPDATES,
+         (unsigned)SESSION_THROW_SLOTS, (unsigned)sizeof(SessionStats), (unsigned)throws);
+}
+
+/**
+ * /data as JSON and as CBOR: body size and encode / decode time, for
+ * the polled body (10 points) and the live snapshot (90 points) built
+ * from the whole trace
+ */
+// Heap use of the String-style baseline
+uint64_t stringAllocations = 0, stringBytes = 0;
+
+template <typename T>
+struct CountingAllocator {
+  typedef T value_type;
+  CountingAllocator() {}
+  template <typename U> CountingAllocator(const CountingAllocator<U> &) {}
+  T *allocate(size_t n) {
+    stringAllocations++;
+    stringBytes += n * sizeof(T);
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t) { ::operator delete(p); }
+  bool operator==(const CountingAllocator &) const { return true; }
+  bool operator!=(const CountingAllocator &) const { return false; }
+};
+
+/**
+ * Stand-in for Arduino's String. It allocates less often than the real
+ * one: capacity grows geometrically where String reallocates to the
+ * exact length on every append that does not fit.
+ */
+typedef std::basic_string<char, std::char_traits<char>, CountingAllocator<char>> SimString;
+
+// String(value, decimals) and String(value)
+SimString simString(float value, int decimals) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+  return SimString(buf);
+}
+SimString simString(long value) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%ld", value);
+  return SimString(buf);
+}
+
+/**
+ * The /data body built the way the handler did before JsonWriter, by
+ * String concatenation, with the fields serializeData() writes now
+ */
+SimString stringData(float temperature, float humidity, uint32_t sessionMinutes,
+                     const EtaPrediction &eta, const HistoryPoint *points, size_t count,
+                     uint32_t now, const SessionSummary *session) {
+  SimString json = "{";
+  json += "\"temperature\":" + simString(temperature, 1);
+  json += ",\"humidity\":" + simString(int(humidity));
+  json += ",\"sessionTime\":" + simString((long)sessionMinutes);
+  json += ",\"readyIn\":" + (eta.readyMinutes < 0 ? SimString("null") : simString(eta.readyMinutes));
+  json += ",\"coolIn\":" + (eta.coolMinutes < 0 ? SimString("null") : simString(eta.coolMinutes));
+  json += ",\"etaConfidence\":" + simString(eta.confidence);
+  if (session && !session->valid) {
+    json += ",\"session\":null";
+  } else if (session) {
+    json += ",\"session\":{\"active\":" + SimString(session->active ? "true" : "false");
+    json += ",\"meanTemp\":" + simString(session->meanTemp, 1);
+    json += ",\"tempSd\":" + simString(session->tempStdDev, 1);
+    json += ",\"above60\":" + simString((long)(session->above60S / 60));
+    json += ",\"above80\":" + simString((long)(session->above80S / 60));
+    json += ",\"humidityMin\":" + simString(lroundf(session->humidityMinutes));
+    json += ",\"heatDose\":" + simString(lroundf(session->heatDose));
+    json += ",\"throws\":" + simString((long)session->throws);
+    json += "}";
+  }
+
+  json += ",\"labels\":[";
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) json += ",";
+    char label[16];
+    formatHistoryLabel(label, sizeof(label), points[i].time, now);
+    json += "\"" + SimString(label) + "\"";
+  }
+  json += "]";
+  json += ",\"tempHistory\":[";
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) json += ",";
+    json += simString(points[i].tempMean, 1);
+  }
+  json += "]";
+  json += ",\"humHistory\":[";
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) json += ",";
+    json += simString(int(points[i].humMean));
+  }
+  json += "]";
+  json += "}";
+  return json;
+}
+
+void benchData(const Trace &trace) {
+  static History history;
+  history.clear();
+  for (size_t i = 0; i < trace.count; i++) {
+    const TraceSample &s = trace.samples[i];
+    if (s.readOk) history.add(trace.startEpoch + s.time, s.temperature, s.humidity);
+  }
+  const TraceSample &end = trace.samples[trace.count - 1];
+  uint32_t now = trace.startEpoch + end.time;
+  EtaPrediction eta = { ETA_PHASE_HEATING, 12, -1, 85.0f, 80 };
+  SessionSummary session = { true, true, 3600, 78.4f, 2.3f, 3000, 1800, 1100.0f, 2400.0f, 3, 0, 12.0f };
+
+  const size_t SHAPES[][2] = { { DATA_HISTORY_POINTS, DATA_HISTORY_STRIDE },
+                               { LIVE_HISTORY_POINTS, 1 } };
+  for (const size_t *shape : SHAPES) {
+    HistoryPoint points[LIVE_HISTORY_POINTS];
+    size_t count = history.tail(HISTORY_RAW, shape[0], shape[1], points);
+    static char json[LIVE_JSON_BUFFER_SIZE];
+    static uint8_t cbor[LIVE_JSON_BUFFER_SIZE];
+    static SaunaReadings decoded;
+    size_t jsonLen = 0, cborLen = 0;
+    uint32_t checksum = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < BENCH_DATA_BODIES; n++) {
+      jsonLen = serializeData(json, sizeof(json), end.temperature, end.humidity, n & 63, eta,
+                              points, count, now, nullptr, &session);
+      checksum += json[jsonLen / 2];
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < BENCH_DATA_BODIES; n++) {
+      cborLen = serializeDataCbor(cbor, sizeof(cbor), n, end.temperature, end.humidity, n & 63,
+                                  eta, points, count, now, nullptr, &session);
+      checksum += cbor[cborLen / 2];
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    bool jsonOk = true, cborOk = true;
+    for (uint32_t n = 0; n < BENCH_DATA_BODIES; n++) {
+      jsonOk &= parseDataJson(json, decoded);
+      checksum += decoded.count;
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < BENCH_DATA_BODIES; n++) {
+      cborOk &= decodeSaunaReadings(cbor, cborLen, decoded);
+      checksum += decoded.count;
+    }
+    auto t4 = std::chrono::steady_clock::now();
+    uint64_t allocations = stringAllocations, allocated = stringBytes;
+    uint32_t differs = 0;
+    for (uint32_t n = 0; n < BENCH_DATA_BODIES; n++) {
+      SimString body = stringData(end.temperature, end.humidity, n & 63, eta, points, count, now,
+                                  &session);
+      checksum += body[body.size() / 2];
+      if (n < 64) {
+        jsonLen = serializeData(json, sizeof(json), end.temperature, end.humidity, n & 63, eta,
+                                points, count, now, nullptr, &session);
+        differs += body.size() != jsonLen || memcmp(body.data(), json, jsonLen) != 0;
+      }
+    }
+    auto t5 = std::chrono::steady_clock::now();
+    allocations = stringAllocations - allocations;
+    allocated = stringBytes - allocated;
+
+    auto ns = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+      return std::chrono::duration<double>(b - a).count() * 1e9 / BENCH_DATA_BODIES;
+    };
+    printf("  /data %u points: JSON %u bytes, encode %.0f ns, parse %.0f ns%s | "
+           "CBOR %u bytes (%.0f%%), encode %.0f ns, decode %.0f ns%s (checksum %lu)\n",
+           (unsigned)count, (unsigned)jsonLen, ns(t0, t1), ns(t2, t3), jsonOk ? "" : " FAILED",
+           (unsigned)cborLen, jsonLen ? 100.0 * cborLen / jsonLen : 0.0, ns(t1, t2), ns(t3, t4),
+           cborOk ? "" : " FAILED", (unsigned long)checksum);
+    printf("  /data %u points: String-style %.0f ns, %.1f allocations (%.0f bytes) per response "
+           "| JsonWriter %.0f ns, no allocations%s\n",
+           (unsigned)count, ns(t4, t5), (double)allocations / BENCH_DATA_BODIES,
+           (double)allocated / BENCH_DATA_BODIES, ns(t0, t1),
+           differs ? " FAILED: the bodies differ" : "");
+  }
+}
+
+/**
+ * Raw sample archive (series_store.h) on the trace's readings: bytes
+ * per sample against the 8 of an uncompressed one, append and
+ * sequential read time, time seeks, and how long the full archive
+ * lasts at the 2 s and 30 s sampling periods. Every sample read back
+ * is compared with its input.
+ */
+void benchArchive(const Trace &trace) {
+  static SampleArchive archive;
+  static SeriesSample input[MAX_TRACE_SAMPLES];
+  size_t n = 0;
+  for (size_t i = 0; i < trace.count; i++) {
+    const TraceSample &s = trace.samples[i];
+    if (!s.readOk || !(s.temperature > -100.0f && s.temperature < 200.0f) ||
+        !(s.humidity >= 0.0f && s.humidity <= 100.0f)) {
+      continue;
+    }
+    // Centi-units, rounded as History does
+    input[n].time = trace.startEpoch + s.time;
+    input[n].temp = (int16_t)lroundf(s.temperature * 100.0f);
+    input[n].hum = (int16_t)lroundf(s.humidity * 100.0f);
+    n++;
+  }
+  if (n == 0) return;
+
+  // Size of the trace on its own
+  archive.clear();
+  for (size_t i = 0; i < n; i++) archive.append(input[i].time, input[i].temp, input[i].hum);
+  double bytesPerSample = (double)archive.usedBytes() / n;
+
+  // Appends: the trace over and over, later each time, so the archive wraps
+  uint32_t span = input[n - 1].time - input[0].time + 10;
+  archive.clear();
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < BENCH_ARCHIVE_SAMPLES; k++) {
+    const SeriesSample &s = input[k % n];
+    archive.append(s.time + (k / n) * span, s.temp, s.hum);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  // Sequential read of everything held, in export-sized batches
+  SeriesSample batch[16];
+  uint32_t seq = archive.firstSeq(), first, mismatches = 0;
+  size_t got, held = 0;
+  while ((got = archive.read(seq, batch, 16, &first)) > 0) {
+    for (size_t i = 0; i < got; i++) {
+      const SeriesSample &e = input[(first + i) % n];
+      uint32_t time = e.time + ((first + i) / n) * span;
+      mismatches += batch[i].time != time || batch[i].temp != e.temp || batch[i].hum != e.hum;
+    }
+    seq = first + got;
+    held += got;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  // Seeks to random times, each followed by one batch
+  uint32_t from = archive.firstTime(), range = input[n - 1].time + (BENCH_ARCHIVE_SAMPLES / n) * span - from;
+  uint32_t sink = 0;
+  for (uint32_t k = 0; k < BENCH_ARCHIVE_SEEKS; k++) {
+    uint32_t after = from + (uint32_t)((uint64_t)k * 2654435761u % range);
+    got = archive.read(archive.seqAfter(after), batch, 16, &first);
+    sink += got ? batch[0].temp : 0;
+  }
+  auto t3 = std::chrono::steady_clock::now();
+
+  // Two exports reading in turns, each from where it stopped
+  uint32_t exportSeq[2] = { archive.firstSeq(), archive.firstSeq() + (uint32_t)(held / 2) };
+  size_t interleaved = 0;
+  for (uint32_t k = 0; k < BENCH_ARCHIVE_SEEKS; k++) {
+    uint32_t &at = exportSeq[k & 1];
+    got = archive.read(at, batch, 16, &first);
+    if (got == 0) at = archive.firstSeq();
+    else at = first + got;
+    interleaved += got;
+    sink += got ? batch[0].temp : 0;
+  }
+  auto t4 = std::chrono::steady_clock::now();
+
+  auto secs = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+    return std::chrono::duration<double>(b - a).count();
+  };
+  printf("  archive: %.2f bytes per sample at the trace's %lu s rows (%.1fx smaller), "
+         "append %.0f ns, read %.0f ns per sample (%.0f ns with two exports in turns), "
+         "seek %.2f us (checksum %lu)\n",
+         bytesPerSample, (unsigned long)(n > 1 ? (input[n - 1].time - input[0].time) / (n - 1) : 0),
+         8.0 / bytesPerSample, secs(t0, t1) * 1e9 / BENCH_ARCHIVE_SAMPLES,
+         secs(t1, t2) * 1e9 / (held ? held : 1), secs(t3, t4) * 1e9 / (interleaved ? interleaved : 1),
+         secs(t2, t3) * 1e6 / BENCH_ARCHIVE_SEEKS,
+         (unsigned long)sink);
+  printf("  archive: %u samples in %u KB, %.1f h at 2 s, %.1f days at 30 s%s\n",
+         (unsigned)held, (unsigned)(SampleArchive::capacityBytes() / 1024), held * 2.0 / 3600,
+         held * 30.0 / 86400, mismatches ? " FAILED" : "");
+}
+
+/**
+ * /data load test: BENCH_CLIENTS clients poll through the trace, as the
+ * web handler would serve them. Uncached, every request builds the body
+ * into a per-request buffer (what AsyncResponseStream allocates on the
+ * device). Cached, the body is built once per sample and shared, and
+ * clients that send back the ETag get a 304.
+ */
+void benchDataCache(const Trace &trace) {
+  static History history;
+  EtaPrediction eta = { ETA_PHASE_IDLE, -1, -1, 0, 0 };
+  HistoryPoint points[DATA_HISTORY_POINTS];
+  char clientEtag[BENCH_CLIENTS][RESPONSE_CACHE_ETAG_LEN] = {};
+  uint64_t sink = 0;
+
+  for (int cached = 0; cached < 2; cached++) {
+    ResponseCache cache(0x5a17a, 'j');
+    history.clear();
+    uint32_t requests = 0, notModified = 0, allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < trace.count; i++) {
+      const TraceSample &s = trace.samples[i];
+      if (s.readOk) history.add(trace.startEpoch + s.time, s.temperature, s.humidity);
+      uint32_t seq = i;
+      uint32_t now = trace.startEpoch + s.time;
+      auto build = [&](uint8_t *buf, size_t len) {
+        size_t count = history.tail(HISTORY_RAW, DATA_HISTORY_POINTS, DATA_HISTORY_STRIDE, points);
+        return serializeData((char *)buf, len, s.temperature, s.humidity, 0, eta,
+                             points, count, now);
+      };
+      for (uint32_t poll = 0; poll < BENCH_POLLS_PER_SAMPLE; poll++) {
+        for (uint32_t c = 0; c < BENCH_CLIENTS; c++) {
+          requests++;
+          if (!cached) {
+            uint8_t body[DATA_JSON_BUFFER_SIZE];
+            size_t len = build(body, sizeof(body));
+            uint8_t *response = new uint8_t[len];
+            allocations++;
+            memcpy(response, body, len);
+            sink += response[len / 2];
+            delete[] response;
+            continue;
+          }
+          if (cache.notModified(clientEtag[c], seq)) {
+            notModified++;
+            continue;
+          }
+          std::shared_ptr<const CachedBody> body = cache.get(seq, build);
+          uint8_t socket[DATA_JSON_BUFFER_SIZE];   // What the response filler copies out
+          memcpy(socket, body->data, body->len);
+          sink += socket[body->len / 2];
+          memcpy(clientEtag[c], body->etag, sizeof(clientEtag[c]));
+        }
+      }
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (cached) allocations = cache.allocations();
+    printf("  /data x%u clients %s: %.0f ns per request, %u builds, %u 304s, "
+           "%.4f allocations per request (sink %llu)\n",
+           (unsigned)BENCH_CLIENTS, cached ? "cached  " : "uncached", wall * 1e9 / requests,
+           cached ? (unsigned)cache.builds() : (unsigned)requests, (unsigned)notModified,
+           (double)allocations / requests, (unsigned long long)sink);
+  }
+}
+
+/**
+ * Simulated time to sample 1..BENCH_MAX_SENSORS timed mock sensors
+ * (SHT2x conversion times, 100 kHz bus, up to eight per mux): one
+ * after another with blocking reads, versus batched by AsyncAcquisition
+ */
+void benchSensors() {
+  for (int fast = 0; fast < 2; fast++) {
+    printf("  sensors, %s resolution: count, sequential ms, batched ms (bus ms, mux switches)\n",
+           fast ? "fast" : "high");
+    for (uint8_t n = 1; n <= BENCH_MAX_SENSORS; n = n < 4 ? n + 1 : n * 2) {
+      MockClock clock;
+      MockSensor sensors[BENCH_MAX_SENSORS];
+      MockMux muxes[2] = { MockMux(&clock), MockMux(&clock) };
+      SensorPort ports[BENCH_MAX_SENSORS];
+      for (uint8_t k = 0; k < n; k++) {
+        sensors[k].timed(&clock);
+        sensors[k].setResolution(fast ? SENSOR_RES_FAST : SENSOR_RES_HIGH);
+        ports[k] = { &sensors[k], n > 1 ? &muxes[k / 8] : nullptr, (uint8_t)(k % 8) };
+      }
+      SensorSnapshot last = { 25.0, 50.0, 0, 0, 0, false, {} };
+
+      uint64_t t0 = clock.millis64();
+      acquireSample(ports, n, clock, last, nullptr);
+      uint64_t sequential = clock.millis64() - t0;
+
+      AsyncAcquisition acquisition;
+      acquisition.attach(ports, n);
+      uint32_t switches = muxes[0].switches + muxes[1].switches;
+      acquisition.start(clock);
+      do {
+        clock.advanceMillis(acquisition.waitMs());   // The sensor task sleeps here
+      } while (acquisition.step(clock) != AsyncAcquisition::DONE);
+      SensorSnapshot sample = acquisition.result(clock, last);
+      const AcquireTiming &timing = acquisition.lastTiming();
+      printf("    %2u  %6llu  %4.0f  (%.1f, %u)%s\n", (unsigned)n, (unsigned long long)sequential,
+             timing.latencyUs / 1000.0, timing.busUs / 1000.0,
+             (unsigned)(muxes[0].switches + muxes[1].switches - switches),
+             sample.sensors.validMask == (uint32_t)((1ULL << n) - 1) ? "" : "  FAIL: not all read");
+    }
+  }
+}
+
+// Synthetic 2 s samples for benchHistory(), centi-units
+int16_t benchTemp(uint32_t k) { return (int16_t)(2000 + k * 37 % 5000); }
+int16_t benchHum(uint32_t k) { return (int16_t)(3000 + k * 11 % 4000); }
+
+/**
+ * History on its own, with synthetic 2 s samples: add() with the
+ * rollups and the archive, tail() as /data and /live use it, and
+ * seqAfter() / query() per tier at pseudo-random times
+ */
+void benchHistory() {
+  const HistoryTier TIERS[3] = { HISTORY_RAW, HISTORY_1M, HISTORY_15M };
+  const char *NAMES[3] = { "raw", "1m", "15m" };
+  std::unique_ptr<History> history(new History());
+  auto secs = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+    return std::chrono::duration<double>(b - a).count();
+  };
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < BENCH_HISTORY_SAMPLES; k++) {
+    history->add(DEFAULT_START_EPOCH + 2 * k, benchTemp(k) / 100.0f, benchHum(k) / 100.0f);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  HistoryPoint out[LIVE_HISTORY_POINTS];
+  uint32_t sink = 0;
+  double tailNs[3];
+  const size_t tailPoints[3] = { DATA_HISTORY_POINTS, LIVE_HISTORY_POINTS, LIVE_HISTORY_POINTS };
+  const size_t tailStride[3] = { DATA_HISTORY_STRIDE, 1, 1 };
+  const HistoryTier tailTier[3] = { HISTORY_RAW, HISTORY_RAW, HISTORY_1M };
+  for (int b = 0; b < 3; b++) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t k = 0; k < BENCH_HISTORY_QUERIES; k++) {
+      sink += (uint32_t)history->tail(tailTier[b], tailPoints[b], tailStride[b], out);
+      sink += out[k % tailPoints[b]].time;
+    }
+    tailNs[b] = secs(start, std::chrono::steady_clock::now()) * 1e9 / BENCH_HISTORY_QUERIES;
+  }
+  printf("  history: add %.0f ns per sample (rollups and archive included), tail %.0f ns "
+         "(/data %u raw), %.0f ns (/live %u raw), %.0f ns (%u 1m)\n",
+         secs(t0, t1) * 1e9 / BENCH_HISTORY_SAMPLES, tailNs[0], (unsigned)DATA_HISTORY_POINTS,
+         tailNs[1], (unsigned)LIVE_HISTORY_POINTS, tailNs[2], (unsigned)LIVE_HISTORY_POINTS);
+
+  for (int t = 0; t < 3; t++) {
+    HistoryTier tier = TIERS[t];
+    uint32_t from = history->point(tier, 0).time;
+    uint32_t range = history->latestTime() - from + 1;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t k = 0; k < BENCH_HISTORY_QUERIES; k++) {
+      sink += history->seqAfter(tier, from + (uint32_t)((uint64_t)k * 2654435761u % range));
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (uint32_t k = 0; k < BENCH_HISTORY_QUERIES; k++) {
+      uint32_t after = from + (uint32_t)((uint64_t)k * 2654435761u % range);
+      size_t n = history->query(tier, after, UINT32_MAX, out, LIVE_HISTORY_POINTS);
+      sink += n ? out[n - 1].time : 0;
+    }
+    auto end = std::chrono::steady_clock::now();
+    printf("  history %s: %u points, seqAfter %.0f ns, query of up to %u points %.2f us "
+           "(checksum %lu)\n",
+           NAMES[t], (unsigned)history->size(tier),
+           secs(start, mid) * 1e9 / BENCH_HISTORY_QUERIES, (unsigned)LIVE_HISTORY_POINTS,
+           secs(mid, end) * 1e6 / BENCH_HISTORY_QUERIES, (unsigned long)sink);
+  }
+}
+
+/**
+ * Session log on a file of BENCH_SESSION_DAYS daily sessions: append()
+ * (queue only) and the service() calls that write a batch with its
+ * fsync, lowerBound() for random dates, and the whole log streamed as
+ * /sessions does with SessionJsonStream::fill()
+ */
+void benchSessionLog() {
+  remove(BENCH_SESSION_PATH);
+  std::unique_ptr<SessionLog> log(new SessionLog());
+  if (!log->begin(BENCH_SESSION_PATH)) {
+    printf("  session log: cannot open %s\n", BENCH_SESSION_PATH);
+    return;
+  }
+  auto secs = [](std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+  };
+
+  std::chrono::steady_clock::duration appendTime{}, flushTime{};
+  uint32_t flushes = 0;
+  for (uint32_t day = 0; day < BENCH_SESSION_DAYS; day++) {
+    SessionRecord rec = { DEFAULT_START_EPOCH + day * 86400 + 64800 + day * 7919 % 7200,
+                          2700 + day * 104729 % 3600, 75.0f + day % 20, 20.0f + day % 15,
+                          (uint8_t)(day % 5), (uint8_t)(day % 40), (uint16_t)(1500 + day % 900) };
+    uint32_t nowMs = day * 1000;
+    auto t0 = std::chrono::steady_clock::now();
+    log->append(rec, nowMs);
+    auto t1 = std::chrono::steady_clock::now();
+    bool full = log->count() % SESSION_LOG_BATCH == 0;
+    log->service(nowMs);
+    auto t2 = std::chrono::steady_clock::now();
+    appendTime += t1 - t0;
+    if (full) {
+      flushTime += t2 - t1;
+      flushes++;
+    }
+  }
+  log->flush();
+  size_t records = log->count();
+
+  uint32_t range = BENCH_SESSION_DAYS * 86400, sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < BENCH_SESSION_LOOKUPS; k++) {
+    sink += (uint32_t)log->lowerBound(DEFAULT_START_EPOCH +
+                                      (uint32_t)((uint64_t)k * 2654435761u % range));
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  char piece[BENCH_SESSION_PIECE];
+  size_t bytes = 0, objects = 0;
+  for (uint32_t n = 0; n < BENCH_SESSION_STREAMS; n++) {
+    SessionJsonStream stream(*log, 0, records);
+    size_t len;
+    while ((len = stream.fill(piece, sizeof(piece))) > 0) {
+      bytes += len;
+      for (size_t i = 0; i < len; i++) objects += piece[i] == '{';
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  printf("  session log: %u records (%u KB), append %.0f ns, batch write + fsync %.1f us, "
+         "lowerBound %.2f us (sink %u)\n",
+         (unsigned)records, (unsigned)(records * SESSION_RECORD_SIZE / 1024),
+         secs(appendTime) * 1e9 / BENCH_SESSION_DAYS, flushes ? secs(flushTime) * 1e6 / flushes : 0.0,
+         secs(t1 - t0) * 1e6 / BENCH_SESSION_LOOKUPS, (unsigned)sink);
+  printf("  session log: whole log as JSON %u bytes, %.0f ns per record, %.2f ms per response "
+         "in %u-byte pieces%s\n",
+         (unsigned)(bytes / BENCH_SESSION_STREAMS), secs(t2 - t1) * 1e9 / (objects ? objects : 1),
+         secs(t2 - t1) * 1e3 / BENCH_SESSION_STREAMS, (unsigned)BENCH_SESSION_PIECE,
+         objects == records * BENCH_SESSION_STREAMS ? "" : " FAILED: records missing");
+  log.reset();
+  remove(BENCH_SESSION_PATH);
+}
+
+/*************************************************************
+  OTA
+*************************************************************/
+// Whole file into a new buffer; 0 if missing or too large
+size_t readFile(const char *path, std::unique_ptr<uint8_t[]> &data) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return 0;
+  data.reset(new uint8_t[SIM_OTA_MAX_IMAGE]);
+  size_t len = fread(data.get(), 1, SIM_OTA_MAX_IMAGE, f);
+  bool whole = fgetc(f) == EOF;
+  fclose(f);
+  return whole ? len : 0;
+}
+
+/**
+ * Feed an upload through OtaUpdate, in pieces of segment bytes or,
+ * with segment 0, of pseudo-random sizes from 1 byte up. Returns the
+ * finish() result; wall gets the time spent in write() and finish().
+ */
+bool streamOta(OtaUpdate &ota, const uint8_t *upload, size_t len, size_t segment,
+               const uint8_t *sha, double &wall) {
+  uint32_t rng = 0x2545f491;
+  auto start = std::chrono::steady_clock::now();
+  bool ok = ota.begin(0, sha);
+  for (size_t pos = 0; ok && pos < len;) {
+    size_t n = segment;
+    if (n == 0) {
+      rng = rng * 1103515245 + 12345;
+      n = 1 + (rng >> 16) % 3000;
+    }
+    if (n > len - pos) n = len - pos;
+    ok = ota.write(upload + pos, n);
+    pos += n;
+  }
+  // Upload time at the link rate, as the device would measure it
+  uint32_t linkMs = (uint32_t)(len / 1024.0 / SIM_OTA_LINK_KBPS * 1000);
+  ok = ota.finish(linkMs) && ok;
+  wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return ok;
+}
+
+/**
+ * IMAGE, IMAGE.gz and IMAGE.hs through the OTA path; false on any
+ * wrong image or accepted bad upload
+ */
+bool checkOta(const char *imagePath) {
+  // FIPS 180-2 test vector first, so a broken hash cannot vouch for itself
+  static const uint8_t ABC_SHA256[SHA256_DIGEST_LEN] = {
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+  };
+  uint8_t digest[SHA256_DIGEST_LEN];
+  Sha256 sha;
+  sha.update((const uint8_t *)"abc", 3);
+  sha.finish(digest);
+  if (memcmp(digest, ABC_SHA256, sizeof(digest)) != 0) {
+    printf("  FAIL: SHA-256 test vector\n");
+    return false;
+  }
+
+  std::unique_ptr<uint8_t[]> image;
+  size_t imageLen = readFile(imagePath, image);
+  if (imageLen == 0) {
+    fprintf(stderr, "Cannot read image %s\n", imagePath);
+    return false;
+  }
+  auto start = std::chrono::steady_clock::now();
+  sha.begin();
+  sha.update(image.get(), imageLen);
+  sha.finish(digest);
+  double shaWall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  char hex[SHA256_HEX_LEN];
+  sha256Hex(digest, hex);
+  double rawSeconds = imageLen / 1024.0 / SIM_OTA_LINK_KBPS;
+  printf("%s: %u bytes, sha256 %s (%.0f MB/s)\n", imagePath, (unsigned)imageLen, hex,
+         imageLen / shaWall / 1e6);
+
+  std::unique_ptr<uint8_t[]> partition(new uint8_t[SIM_OTA_MAX_IMAGE]);
+  MockFirmware firmware(partition.get(), SIM_OTA_MAX_IMAGE);
+  OtaUpdate ota(firmware);
+  bool ok = true;
+  const char *suffixes[] = { "", ".gz", ".hs" };
+  for (const char *suffix : suffixes) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s%s", imagePath, suffix);
+    std::unique_ptr<uint8_t[]> upload;
+    size_t len = readFile(path, upload);
+    if (len == 0) {
+      printf("  %-10s missing (scripts/compress_firmware.py %s)\n", suffix + 1, imagePath);
+      continue;
+    }
+
+    double wall, unevenWall;
+    bool good = streamOta(ota, upload.get(), len, SIM_OTA_SEGMENT, digest, wall) &&
+                firmware.size == imageLen && memcmp(partition.get(), image.get(), imageLen) == 0;
+    char result[OTA_RESULT_JSON];
+    serializeOtaResult(result, sizeof(result), ota, good);
+    bool uneven = streamOta(ota, upload.get(), len, 0, digest, unevenWall) &&
+                  memcmp(partition.get(), image.get(), imageLen) == 0;
+
+    // Each of these must be refused before the image becomes bootable
+    const char *refused = nullptr;
+    uint8_t wrongSha[SHA256_DIGEST_LEN];
+    memcpy(wrongSha, digest, sizeof(wrongSha));
+    wrongSha[0] ^= 1;
+    upload[len / 2] ^= 0x20;
+    if (streamOta(ota, upload.get(), len, SIM_OTA_SEGMENT, digest, unevenWall)) refused = "corrupt";
+    upload[len / 2] ^= 0x20;
+    if (streamOta(ota, upload.get(), len - len / 3, SIM_OTA_SEGMENT, digest, unevenWall) &&
+        len > 100) refused = "truncated";
+    if (streamOta(ota, upload.get(), len, SIM_OTA_SEGMENT, wrongSha, unevenWall)) refused = "wrong hash";
+
+    double seconds = len / 1024.0 / SIM_OTA_LINK_KBPS;
+    printf("  %-10s %8u bytes (%5.1f%%), decode+hash %6.1f MB/s, upload ~%.1f s, saves ~%.1f s%s%s%s\n",
+           OTA_FORMAT_NAMES[ota.format()], (unsigned)len, 100.0 * len / imageLen,
+           imageLen / wall / 1e6, seconds, rawSeconds - seconds,
+           good ? "" : "  FAIL: image differs", uneven ? "" : "  FAIL: uneven pieces",
+           refused ? "  FAIL: accepted a bad upload" : "");
+    if (!quiet) printf("    %s\n", result);
+    if (refused) printf("    accepted the %s upload\n", refused);
+    ok = ok && good && uneven && !refused;
+  }
+  return ok;
+}
+
+/*************************************************************
+  Task Graph
+*************************************************************/
+// Real time for the task graph; the mock clock only moves when told to
+class HostClock : public ClockHal {
+public:
+  uint32_t millis() override { return (uint32_t)millis64(); }
+  uint64_t millis64() override { return elapsedUs() / 1000; }
+  uint32_t micros() override { return (uint32_t)elapsedUs(); }
+  uint32_t epoch() override { return DEFAULT_START_EPOCH + (uint32_t)(elapsedUs() / 1000000); }
+
+private:
+  uint64_t elapsedUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+};
+
+/**
+ * Every field of sample `seq` follows from seq, so a reader can tell a
+ * torn copy from a whole one
+ */
+SensorSnapshot taskSample(uint32_t seq) {
+  SensorSnapshot s = {};
+  s.temperature = 20.0f + (seq % 8000) * 0.01f;
+  s.humidity = (float)(seq % 100);
+  s.timestamp = DEFAULT_START_EPOCH + seq;
+  s.millis = seq * SIM_TASK_PERIOD_MS;
+  s.seq = seq;
+  s.valid = seq % 10 != 0;
+  s.sensors.count = SENSOR_MAX_CHANNELS;
+  s.sensors.validMask = seq;
+  for (uint8_t i = 0; i < SENSOR_MAX_CHANNELS; i++) {
+    s.sensors.temperature[i] = s.temperature + i;
+    s.sensors.humidity[i] = s.humidity - i;
+    s.sensors.hold[i] = (uint8_t)(seq + i);
+  }
+  return s;
+}
+
+bool wholeSample(const SensorSnapshot &s) {
+  if (s.seq == 0) return s.timestamp == 0;   // Nothing published yet
+  SensorSnapshot expect = taskSample(s.seq);
+  return memcmp(&s, &expect, sizeof(s)) == 0;
+}
+
+/**
+ * Stands in for the firmware's task work: the sensor task publishes
+ * synthetic samples, the display and network tasks check what reaches
+ * them. Every SIM_TASK_STALL_EVERY samples the network task stalls,
+ * so the sample queue overflows.
+ */
+class SimTaskWork : public TaskWork {
+public:
+  SimTaskWork(SeqLock<SensorSnapshot> &snapshot) : snapshot(snapshot) {}
+
+  SensorSnapshot acquire() override {
+    SensorSnapshot sample = taskSample(++produced);
+    snapshot.write(sample);
+    return sample;
+  }
+  void process(const SensorSnapshot &) override { processed++; }
+  uint32_t sampled(uint32_t) override { return SIM_TASK_PERIOD_MS; }
+
+  void redraw(const SensorSnapshot &sample) override {
+    if (!wholeSample(sample)) torn++;
+    if (sample.seq < lastDrawn) backwards++;
+    lastDrawn = sample.seq;
+    redraws++;
+  }
+
+  void service() override { services++; }
+  uint32_t pollMs() override { return SIM_TASK_POLL_MS; }
+  void publish(const SensorSnapshot &sample) override {
+    if (!wholeSample(sample)) torn++;
+    if (sample.seq <= lastPublished) backwards++;
+    else skipped += sample.seq - lastPublished - 1;
+    lastPublished = sample.seq;
+    published++;
+    if (published % SIM_TASK_STALL_EVERY == 0) rtosDelay(SIM_TASK_STALL_MS);
+  }
+
+  SeqLock<SensorSnapshot> &snapshot;
+  uint32_t produced = 0, processed = 0;                       // Sensor task
+  uint32_t redraws = 0, lastDrawn = 0;                        // Display task
+  uint32_t services = 0, published = 0, lastPublished = 0, skipped = 0;  // Network task
+  std::atomic<uint32_t> torn{0}, backwards{0};
+};
+
+/**
+ * Start the firmware's three tasks (task_graph.h) on pthreads with a
+ * fourth thread reading the snapshot as the web handlers do. Every
+ * copy must be whole, the display must never go back in time and the
+ * network task must see every sample in order except those counted
+ * as dropped at the full queue.
+ */
+bool checkTasks() {
+  HostClock clock;
+  SeqLock<SensorSnapshot> snapshot;
+  SimTaskWork work(snapshot);
+  TaskGraph graph(work, clock, snapshot);
+
+  std::atomic<bool> reading(true);
+  uint32_t webReads = 0;
+  std::thread web([&]() {
+    while (reading.load(std::memory_order_relaxed)) {
+      if (!wholeSample(snapshot.read())) work.torn++;
+      webReads++;
+    }
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  bool started = graph.start(SIM_TASK_PERIOD_MS);
+  rtosDelay(SIM_TASK_RUN_MS);
+  graph.stop();
+  reading.store(false, std::memory_order_relaxed);
+  web.join();
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // The network task saw the samples in order and missed only those dropped
+  // at the full queue; at most a queue's worth were still waiting at the stop
+  uint32_t dropped = graph.samplesDropped();
+  uint32_t accounted = work.published + dropped;
+  bool handoff = accounted <= work.produced &&
+                 work.produced - accounted <= TASK_SAMPLE_QUEUE && work.skipped <= dropped;
+  bool ok = started && handoff && work.torn == 0 && work.backwards == 0 &&
+            work.processed == work.produced - work.produced / 10 &&
+            work.redraws > 0 && work.services >= work.published && dropped > 0;
+  printf("tasks: %s, %u samples in %.2f s, %u published, %u dropped at the queue, "
+         "%u redraws, %u web reads, %u torn, max jitter %lu ms\n",
+         ok ? "ok" : "FAILED", (unsigned)work.produced, wall, (unsigned)work.published,
+         (unsigned)dropped, (unsigned)work.redraws, (unsigned)webReads, (unsigned)work.torn.load(),
+         (unsigned long)graph.sensorTiming().maxJitterMs);
+  return ok;
+}
+
+/**
+ * Write the recorded timeline as Chrome trace-event JSON
+ */
+bool writeTimeline(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) return false;
+  // ~800 KB copy of the ring, keep it off the stack
+  std::unique_ptr<TraceJsonStream<SIM_TIMELINE_EVENTS>> stream(
+      new TraceJsonStream<SIM_TIMELINE_EVENTS>(tracer));
+  char buf[4096];
+  size_t len;
+  while ((len = stream->fill(buf, sizeof(buf))) > 0) fwrite(buf, 1, len, f);
+  printf("timeline: %u events written to %s\n", (unsigned)stream->eventCount(), path);
+  return fclose(f) == 0;
+}
+
+/*************************************************************
+  Main
+*************************************************************/
+int main(int argc, char **argv) {
+  unsigned repeat = 1;
+  bool bench = false;
+  bool runTasks = false;
+  const char *timelinePath = nullptr;
+  const char *otaImage = nullptr;
+  const char *paths[64];
+  size_t pathCount = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = strtoul(argv[++i], nullptr, 10);
+      if (repeat == 0) repeat = 1;
+    } else if (strcmp(argv[i], "--mqtt") == 0 && i + 1 < argc) {
+      static char host[128];
+      snprintf(host, sizeof(host), "%s", argv[++i]);
+      char *colon = strchr(host, ':');
+      if (colon) {
+        *colon = '\0';
+        mqttPort = strtoul(colon + 1, nullptr, 10);
+      }
+      mqttHost = host;
+    } else if (strcmp(argv[i], "--timeline") == 0 && i + 1 < argc) {
+      timelinePath = argv[++i];
+    } else if (strcmp(argv[i], "--sensors") == 0 && i + 1 < argc) {
+      unsigned long n = strtoul(argv[++i], nullptr, 10);
+      sensorCount = n < 1 ? 1 : n > SIM_MAX_SENSORS ? SIM_MAX_SENSORS : (uint8_t)n;
+    } else if (strcmp(argv[i], "--ota") == 0 && i + 1 < argc) {
+      otaImage = argv[++i];
+    } else if (strcmp(argv[i], "--tasks") == 0) {
+      runTasks = true;
+    } else if (strcmp(argv[i], "--bench") == 0) {
+      bench = true;
+    } else if (strcmp(argv[i], "--quiet") == 0) {
+      quiet = true;
+    } else if (strcmp(argv[i], "--session-log") == 0 && i + 1 < argc) {
+      sessionLogOpen = sessionLog.begin(argv[++i]);
+      if (!sessionLogOpen) {
+        fprintf(stderr, "Cannot open session log %s\n", argv[i]);
+        return 1;
+      }
+    } else if (pathCount < sizeof(paths) / sizeof(paths[0])) {
+      paths[pathCount++] = argv[i];
+    }
+  }
+  if (pathCount == 0) {
+    for (const char *canned : CANNED_TRACES) paths[pathCount++] = canned;
+  }
+
+  unsigned failures = 0;
+  if (!checkWifi()) failures++;
+
+  static TraceSample samples[MAX_TRACE_SAMPLES];
+  Trace trace = {};
+  trace.samples = samples;
+
+  for (size_t p = 0; p < pathCount; p++) {
+    if (!loadTrace(paths[p], trace)) {
+      failures++;
+      continue;
+    }
+    printf("%s (%u samples x %u)\n", paths[p], (unsigned)trace.count, repeat);
+
+    RunStats stats;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = replayTrace(paths[p], trace, repeat, stats);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok) failures++;
+
+    printf("  %s: %u sessions, %u steam throws, %u invalid samples, %.1f h simulated in %.3f s "
+           "(%.0fx), %llu JSON bytes\n",
+           ok ? "ok" : "FAILED", (unsigned)stats.sessions, (unsigned)stats.throws,
+           (unsigned)stats.invalid,
+           stats.simSeconds / 3600.0, wall, wall > 0 ? stats.simSeconds / wall : 0.0,
+           (unsigned long long)stats.jsonBytes);
+    if (stats.startDelay >= 0 || stats.endDelay >= 0) {
+      printf("  detection: start +%llds (dated %+llds), end +%llds (dated %+llds)\n",
+             (long long)stats.startDelay, (long long)stats.startError,
+             (long long)stats.endDelay, (long long)stats.endError);
+    }
+    if (bench) {
+      benchOled(trace);
+      benchDetector(trace);
+      benchSessionStats(trace);
+      benchData(trace);
+      benchDataCache(trace);
+      benchArchive(trace);
+    }
+  }
+  if (bench) {
+    benchHistory();
+    benchSessionLog();
+    benchSensors();
+  }
+  if (runTasks && !checkTasks()) failures++;
+  if (otaImage && !checkOta(otaImage)) failures++;
+  if (sessionLogOpen) {
+    sessionLog.flush();
+    printf("session log: %u sessions, %u dropped\n", (unsigned)sessionLog.count(),
+           (unsigned)sessionLog.droppedRecords());
+    if (sessionLog.droppedRecords() > 0) failures++;
+  }
+  if (timelinePath && !writeTimeline(timelinePath)) {
+    fprintf(stderr, "Cannot write timeline %s\n", timelinePath);
+    failures++;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/*************************************************************
+  AsyncAcquisition against timed MockSensors
+
+  A batch completes in about one conversion time, and a sensor
+  whose conversion never finishes fails at its deadline instead
+  of holding the batch: its last value is held, the others are
+  read, and it is back as soon as it answers again.
+  Run with: pio test -e native -f test_acquisition
+*************************************************************/
+#include <unity.h>
+
+#include "hal_mock.h"
+
+const uint8_t SENSORS = 3;
+const uint32_t MAX_STEPS = 1000;   // A batch that never finishes fails instead of hanging
+
+MockClock *clock;
+MockSensor *sensors;
+SensorPort ports[SENSORS];
+AsyncAcquisition *acquisition;
+SensorSnapshot last;
+
+void setUp(void) {
+  clock = new MockClock();
+  sensors = new MockSensor[SENSORS];
+  for (uint8_t i = 0; i < SENSORS; i++) {
+    sensors[i].timed(clock);
+    sensors[i].set(80.0f + i, 10.0f + i);
+    ports[i] = SensorPort{ &sensors[i], nullptr, 0 };
+  }
+  acquisition = new AsyncAcquisition();
+  acquisition->attach(ports, SENSORS);
+  last = SensorSnapshot{ 25.0f, 50.0f, 0, 0, 0, false, {} };
+}
+
+void tearDown(void) {
+  delete acquisition;
+  delete[] sensors;
+  delete clock;
+}
+
+// One sample the way the sensor task takes it: sleep waitMs(), then step()
+SensorSnapshot sample() {
+  acquisition->start(*clock);
+  uint32_t steps = 0;
+  do {
+    clock->advanceMillis(acquisition->waitMs());
+    TEST_ASSERT_LESS_THAN(MAX_STEPS, ++steps);
+  } while (acquisition->step(*clock) != AsyncAcquisition::DONE);
+  last = acquisition->result(*clock, last);
+  return last;
+}
+
+uint32_t worstCaseMs() {
+  return sensors[0].conversionMs(SENSOR_TEMPERATURE) + sensors[0].conversionMs(SENSOR_HUMIDITY);
+}
+
+void test_batch_reads_every_sensor(void) {
+  SensorSnapshot s = sample();
+  TEST_ASSERT_EQUAL_UINT32(0x7, s.sensors.validMask);
+  TEST_ASSERT_TRUE(s.temperature == 81.0f);
+  TEST_ASSERT_TRUE(s.humidity == 11.0f);
+  TEST_ASSERT_LESS_THAN(worstCaseMs() + 10, acquisition->lastTiming().latencyUs / 1000);
+  TEST_ASSERT_EQUAL_UINT32(0, acquisition->timedOut());
+}
+
+void test_stuck_sensor_fails_at_its_deadline(void) {
+  sample();
+  sensors[1].stick(true);
+  SensorSnapshot s = sample();
+
+  // Both channels gave up on it once, each no later than its margin
+  TEST_ASSERT_EQUAL_UINT32(0x5, s.sensors.validMask);
+  TEST_ASSERT_EQUAL_UINT32(2, acquisition->timedOut());
+  TEST_ASSERT_LESS_THAN(worstCaseMs() + 2 * ACQUIRE_DEADLINE_MARGIN_MS + 10,
+                        acquisition->lastTiming().latencyUs / 1000);
+  TEST_ASSERT_TRUE(acquisition->lastTiming().latencyUs / 1000 >=
+                   worstCaseMs() + 2 * ACQUIRE_DEADLINE_MARGIN_MS);
+
+  // Its last reading is held, so the aggregate does not jump
+  TEST_ASSERT_TRUE(s.valid);
+  TEST_ASSERT_EQUAL(SENSOR_HOLD_SAMPLES, s.sensors.hold[1]);
+  TEST_ASSERT_TRUE(s.temperature == 81.0f);
+}
+
+void test_stuck_sensor_drops_out_after_the_hold(void) {
+  sensors[1].set(87.0f, 11.0f);
+  sample();
+  sensors[1].stick(true);
+  for (int n = 0; n < SENSOR_HOLD_SAMPLES; n++) sample();
+  TEST_ASSERT_TRUE(last.temperature == 83.0f);   // Still held
+  sample();
+  TEST_ASSERT_EQUAL(0, last.sensors.hold[1]);
+  TEST_ASSERT_TRUE(last.temperature == 81.0f);   // Mean of sensors 0 and 2
+}
+
+void test_recovered_sensor_is_read_again(void) {
+  sensors[1].stick(true);
+  sample();
+  sensors[1].stick(false);
+  sensors[1].set(90.0f, 20.0f);
+  SensorSnapshot s = sample();
+  TEST_ASSERT_EQUAL_UINT32(0x7, s.sensors.validMask);
+  TEST_ASSERT_TRUE(s.sensors.temperature[1] == 90.0f);
+}
+
+void test_every_sensor_stuck_still_finishes(void) {
+  for (uint8_t i = 0; i < SENSORS; i++) sensors[i].stick(true);
+  SensorSnapshot s = sample();
+  TEST_ASSERT_EQUAL_UINT32(0, s.sensors.validMask);
+  TEST_ASSERT_FALSE(s.valid);
+  TEST_ASSERT_EQUAL_UINT32(2 * SENSORS, acquisition->timedOut());
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_batch_reads_every_sensor);
+  RUN_TEST(test_stuck_sensor_fails_at_its_deadline);
+  RUN_TEST(test_stuck_sensor_drops_out_after_the_hold);
+  RUN_TEST(test_recovered_sensor_is_read_again);
+  RUN_TEST(test_every_sensor_stuck_still_finishes);
+  return UNITY_END();
+}
@@ -0,0 +1,247 @@
+/*************************************************************
+  History tiers
+
+  Fills History with DAYS of synthetic 2 s samples and checks
+  every tier against a recomputation from the samples: rollups,
+  rollover at capacity, contiguous sequence numbers (also across
+  the 2^32 wrap), readSeq() / point() / tail(), seqAfter() around
+  point times, query() ranges and an evicted resume cursor.
+  Run with: pio test -e native -f test_history
+*************************************************************/
+#include <unity.h>
+#include <memory>
+
+#include "history.h"
+#include "data_json.h"
+
+const uint32_t EPOCH = 1735689600UL;   // 2025-01-01 00:00 UTC, on a 15 min boundary
+const uint32_t DAYS = 8;               // Past the 7 days of the 15 min tier
+const uint32_t SAMPLES = DAYS * 86400 / 2;
+// Closed buckets: every minute but the one still filling; quarters up to
+// the one holding the last closed minute
+const uint32_t MINUTES = (SAMPLES * 2 - 1) / 60;
+const uint32_t QUARTERS = (MINUTES - 1) / 15;
+
+const HistoryTier TIERS[3] = { HISTORY_RAW, HISTORY_1M, HISTORY_15M };
+const uint32_t STEPS[3] = { 2, 60, 900 };   // Seconds between points
+const uint32_t POINTS[3] = { SAMPLES, MINUTES, QUARTERS };
+
+History *history;
+uint32_t base;   // Sequence number of the first sample
+
+// Sample k is at EPOCH + 2k, centi-units
+int16_t sampleTemp(uint32_t k) { return (int16_t)(2000 + k * 37 % 5000); }
+int16_t sampleHum(uint32_t k) { return (int16_t)(3000 + k * 11 % 4000); }
+
+void fill(uint32_t firstSeq) {
+  base = firstSeq;
+  history->clear(firstSeq);
+  for (uint32_t k = 0; k < SAMPLES; k++) {
+    history->add(EPOCH + 2 * k, sampleTemp(k) / 100.0f, sampleHum(k) / 100.0f);
+  }
+}
+
+struct Expected {
+  int16_t tMin, tMean, tMax, hMin, hMean, hMax;
+};
+
+// Rollup of minute m (samples 30m .. 30m+29) as History computes it
+Expected expectMinute(uint32_t m) {
+  Expected e = {};
+  int32_t tSum = 0, hSum = 0;
+  for (uint32_t k = m * 30; k < m * 30 + 30; k++) {
+    int16_t t = sampleTemp(k), h = sampleHum(k);
+    bool first = k == m * 30;
+    if (first || t < e.tMin) e.tMin = t;
+    if (first || t > e.tMax) e.tMax = t;
+    if (first || h < e.hMin) e.hMin = h;
+    if (first || h > e.hMax) e.hMax = h;
+    tSum += t;
+    hSum += h;
+  }
+  e.tMean = (int16_t)(tSum / 30);
+  e.hMean = (int16_t)(hSum / 30);
+  return e;
+}
+
+// Quarter q rolled up from its 15 minute rollups
+Expected expectQuarter(uint32_t q) {
+  Expected e = {};
+  int32_t tSum = 0, hSum = 0;
+  for (uint32_t m = q * 15; m < q * 15 + 15; m++) {
+    Expected v = expectMinute(m);
+    bool first = m == q * 15;
+    if (first || v.tMin < e.tMin) e.tMin = v.tMin;
+    if (first || v.tMax > e.tMax) e.tMax = v.tMax;
+    if (first || v.hMin < e.hMin) e.hMin = v.hMin;
+    if (first || v.hMax > e.hMax) e.hMax = v.hMax;
+    tSum += v.tMean;
+    hSum += v.hMean;
+  }
+  e.tMean = (int16_t)(tSum / 15);
+  e.hMean = (int16_t)(hSum / 15);
+  return e;
+}
+
+void assertPoint(const HistoryPoint &p, uint32_t time, const Expected &e) {
+  TEST_ASSERT_EQUAL_UINT32(time, p.time);
+  TEST_ASSERT_TRUE(p.tempMin == e.tMin / 100.0f);
+  TEST_ASSERT_TRUE(p.tempMean == e.tMean / 100.0f);
+  TEST_ASSERT_TRUE(p.tempMax == e.tMax / 100.0f);
+  TEST_ASSERT_TRUE(p.humMin == e.hMin / 100.0f);
+  TEST_ASSERT_TRUE(p.humMean == e.hMean / 100.0f);
+  TEST_ASSERT_TRUE(p.humMax == e.hMax / 100.0f);
+}
+
+/**
+ * seqAfter() of a tier whose point j (sequence base + j) is at
+ * EPOCH + j * step, clamped to the stored range
+ */
+uint32_t expectSeqAfter(HistoryTier tier, uint32_t step, uint32_t after) {
+  uint32_t seq = after < EPOCH ? base : base + (after - EPOCH) / step + 1;
+  if ((int32_t)(seq - history->firstSeq(tier)) < 0) seq = history->firstSeq(tier);
+  if ((int32_t)(seq - history->nextSeq(tier)) > 0) seq = history->nextSeq(tier);
+  return seq;
+}
+
+void setUp(void) {
+  if (!history) history = new History();   // ~100 KB, filled by each test
+}
+
+void tearDown(void) {}
+
+void test_tiers_roll_over_at_capacity(void) {
+  fill(0);
+  for (int t = 0; t < 3; t++) {
+    TEST_ASSERT_EQUAL_UINT32(base + POINTS[t], history->nextSeq(TIERS[t]));
+    TEST_ASSERT_EQUAL_UINT32(history->size(TIERS[t]),
+                             history->nextSeq(TIERS[t]) - history->firstSeq(TIERS[t]));
+  }
+  TEST_ASSERT_EQUAL(HISTORY_1M_SLOTS, history->size(HISTORY_1M));
+  TEST_ASSERT_EQUAL(HISTORY_15M_SLOTS, history->size(HISTORY_15M));
+  TEST_ASSERT_LESS_THAN(SAMPLES, history->size(HISTORY_RAW));   // The archive dropped blocks
+}
+
+void test_rollups_match_samples(void) {
+  fill(0);
+  for (size_t i = 0; i < history->size(HISTORY_1M); i++) {
+    uint32_t m = history->firstSeq(HISTORY_1M) + (uint32_t)i - base;
+    assertPoint(history->point(HISTORY_1M, i), EPOCH + m * 60, expectMinute(m));
+  }
+  for (size_t i = 0; i < history->size(HISTORY_15M); i++) {
+    uint32_t q = history->firstSeq(HISTORY_15M) + (uint32_t)i - base;
+    assertPoint(history->point(HISTORY_15M, i), EPOCH + q * 900, expectQuarter(q));
+  }
+}
+
+void test_raw_read_point_and_tail(void) {
+  fill(0);
+  size_t size = history->size(HISTORY_RAW);
+  std::unique_ptr<HistoryPoint[]> raw(new HistoryPoint[size]);
+  uint32_t first = 0;
+  size_t held = history->readSeq(HISTORY_RAW, history->firstSeq(HISTORY_RAW), raw.get(), size,
+                                 &first);
+  TEST_ASSERT_EQUAL(size, held);
+  TEST_ASSERT_EQUAL_UINT32(history->firstSeq(HISTORY_RAW), first);
+  for (size_t i = 0; i < held; i++) {
+    uint32_t k = first + (uint32_t)i - base;
+    int16_t t = sampleTemp(k), h = sampleHum(k);
+    assertPoint(raw[i], EPOCH + 2 * k, Expected{ t, t, t, h, h, h });
+  }
+
+  // point() agrees with readSeq() over the whole archive
+  for (size_t i = 0; i < held; i += held / 64 + 1) {
+    HistoryPoint p = history->point(HISTORY_RAW, i);
+    TEST_ASSERT_EQUAL_UINT32(raw[i].time, p.time);
+    TEST_ASSERT_TRUE(p.tempMean == raw[i].tempMean);
+  }
+  TEST_ASSERT_EQUAL_UINT32(history->latestTime(), history->point(HISTORY_RAW, held - 1).time);
+
+  // tail() from the recent ring: the newest point last, `stride` samples apart
+  HistoryPoint recent[DATA_HISTORY_POINTS];
+  size_t n = history->tail(HISTORY_RAW, DATA_HISTORY_POINTS, DATA_HISTORY_STRIDE, recent);
+  TEST_ASSERT_EQUAL(DATA_HISTORY_POINTS, n);
+  TEST_ASSERT_EQUAL_UINT32(history->latestTime(), recent[n - 1].time);
+  for (size_t i = 1; i < n; i++) {
+    TEST_ASSERT_EQUAL_UINT32(2 * DATA_HISTORY_STRIDE, recent[i].time - recent[i - 1].time);
+  }
+}
+
+void test_seq_after(void) {
+  fill(0);
+  for (int t = 0; t < 3; t++) {
+    HistoryTier tier = TIERS[t];
+    uint32_t step = STEPS[t];
+    uint32_t oldest = history->point(tier, 0).time;
+    uint32_t newest = history->point(tier, history->size(tier) - 1).time;
+    // Before, at, just after and between stored points, and past the end
+    const uint32_t probes[] = { 0, EPOCH - 1, oldest - 1, oldest, oldest + 1,
+                                oldest + step * 17 + step / 2, newest - 1, newest, newest + 1,
+                                UINT32_MAX - 1 };
+    for (uint32_t after : probes) {
+      TEST_ASSERT_EQUAL_UINT32(expectSeqAfter(tier, step, after), history->seqAfter(tier, after));
+    }
+  }
+}
+
+void test_query_returns_the_range(void) {
+  fill(0);
+  for (int t = 0; t < 3; t++) {
+    HistoryTier tier = TIERS[t];
+    uint32_t from = history->point(tier, 0).time + STEPS[t] * 100 + 1;
+    uint32_t to = from + STEPS[t] * 50;
+    HistoryPoint out[64];
+    size_t n = history->query(tier, from, to, out, 64);
+    TEST_ASSERT_EQUAL(50, n);
+    TEST_ASSERT_TRUE(out[0].time >= from);
+    TEST_ASSERT_TRUE(out[n - 1].time <= to);
+  }
+}
+
+void test_evicted_cursor_restarts_at_oldest(void) {
+  fill(0);
+  for (int t = 0; t < 3; t++) {
+    HistoryTier tier = TIERS[t];
+    HistoryPoint out[1];
+    uint32_t first = 0;
+    size_t n = history->readSeq(tier, history->firstSeq(tier) - 5, out, 1, &first);
+    TEST_ASSERT_EQUAL(1, n);
+    TEST_ASSERT_EQUAL_UINT32(history->firstSeq(tier), first);
+    TEST_ASSERT_EQUAL_UINT32(history->point(tier, 0).time, out[0].time);
+  }
+}
+
+// Once per tier, numbered so that its stored points straddle 2^32
+void test_sequence_wrap(void) {
+  for (int w = 0; w < 3; w++) {
+    fill(0u - (POINTS[w] - 100));
+    TEST_ASSERT_TRUE(history->nextSeq(TIERS[w]) < history->firstSeq(TIERS[w]));
+    for (int t = 0; t < 3; t++) {
+      TEST_ASSERT_EQUAL_UINT32(base + POINTS[t], history->nextSeq(TIERS[t]));
+      TEST_ASSERT_EQUAL_UINT32(history->size(TIERS[t]),
+                               history->nextSeq(TIERS[t]) - history->firstSeq(TIERS[t]));
+      HistoryPoint out[16];
+      uint32_t first = 0;
+      size_t n = history->readSeq(TIERS[t], history->firstSeq(TIERS[t]), out, 16, &first);
+      TEST_ASSERT_EQUAL(16, n);
+      TEST_ASSERT_EQUAL_UINT32(EPOCH + (first - base) * STEPS[t], out[0].time);
+      uint32_t oldest = history->point(TIERS[t], 0).time;
+      TEST_ASSERT_EQUAL_UINT32(expectSeqAfter(TIERS[t], STEPS[t], oldest + STEPS[t] * 9),
+                               history->seqAfter(TIERS[t], oldest + STEPS[t] * 9));
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_tiers_roll_over_at_capacity);
+  RUN_TEST(test_rollups_match_samples);
+  RUN_TEST(test_raw_read_point_and_tail);
+  RUN_TEST(test_seq_after);
+  RUN_TEST(test_query_returns_the_range);
+  RUN_TEST(test_evicted_cursor_restarts_at_oldest);
+  RUN_TEST(test_sequence_wrap);
+  return UNITY_END();
+}
@@ -0,0 +1,173 @@
+/*************************************************************
+  OledDiff and flushFrame() against MockDisplay
+
+  The partial OLED update: only the changed column runs of each
+  8-pixel page go on the bus, unchanged frames send nothing, and
+  after every flush the panel shows exactly the framebuffer.
+  Run with: pio test -e native -f test_oled
+*************************************************************/
+#include <unity.h>
+#include <string.h>
+
+#include "hal_mock.h"
+
+const uint8_t WIDTH = 128;    // The firmware's SSD1306
+const uint8_t PAGES = 8;
+const size_t FRAME_BYTES = (size_t)WIDTH * PAGES;
+const size_t FULL_FRAME_BYTES = PAGES * (8 + WIDTH + 2 * 2);   // MockDisplay framing
+
+typedef MockDisplay<WIDTH, PAGES> Display;
+typedef OledDiff<WIDTH, PAGES> Diff;
+
+Display *display;
+Diff *diff;
+uint8_t *frame;
+
+void setUp(void) {
+  display = new Display();
+  diff = new Diff();
+  frame = display->framebuffer();
+}
+
+void tearDown(void) {
+  delete diff;
+  delete display;
+}
+
+void setPixel(int x, int y) { frame[x + (y / 8) * WIDTH] |= (uint8_t)(1 << (y & 7)); }
+
+bool panelMatches() { return memcmp(display->panelContents(), frame, FRAME_BYTES) == 0; }
+
+void test_first_flush_sends_whole_screen(void) {
+  setPixel(10, 10);
+  TEST_ASSERT_EQUAL(FULL_FRAME_BYTES, flushFrame(*diff, *display));
+  TEST_ASSERT_EQUAL(PAGES, display->windows);
+  TEST_ASSERT_TRUE(panelMatches());
+}
+
+void test_unchanged_frame_sends_nothing(void) {
+  setPixel(3, 40);
+  flushFrame(*diff, *display);
+  uint32_t flushes = display->flushes, windows = display->windows;
+  uint64_t bytes = display->totalBytes;
+
+  TEST_ASSERT_EQUAL(0, flushFrame(*diff, *display));
+  TEST_ASSERT_EQUAL(flushes, display->flushes);   // Not even the flush framing
+  TEST_ASSERT_EQUAL(windows, display->windows);
+  TEST_ASSERT_EQUAL(bytes, display->totalBytes);
+}
+
+void test_one_pixel_sends_one_column(void) {
+  flushFrame(*diff, *display);
+  uint32_t before[PAGES];
+  memcpy(before, display->pageWindows, sizeof(before));
+
+  setPixel(77, 29);   // Page 3
+  size_t sent = flushFrame(*diff, *display);
+  TEST_ASSERT_EQUAL(8 + 1 + 2, sent);
+  for (uint8_t page = 0; page < PAGES; page++) {
+    TEST_ASSERT_EQUAL(before[page] + (page == 3), display->pageWindows[page]);
+  }
+  TEST_ASSERT_TRUE(panelMatches());
+}
+
+void test_unchanged_pages_are_not_written(void) {
+  for (int x = 0; x < WIDTH; x += 3) setPixel(x, (x * 7) % 64);
+  flushFrame(*diff, *display);
+  uint32_t before[PAGES];
+  memcpy(before, display->pageWindows, sizeof(before));
+
+  // Redraw pages 0 and 6 only, as the temperature and status line do
+  memset(frame, 0, WIDTH);
+  for (int x = 30; x < 90; x++) setPixel(x, 3);
+  memset(frame + 6 * WIDTH + 40, 0x5A, 20);
+  flushFrame(*diff, *display);
+  for (uint8_t page = 0; page < PAGES; page++) {
+    bool changed = page == 0 || page == 6;
+    TEST_ASSERT_EQUAL(changed, display->pageWindows[page] != before[page]);
+  }
+  TEST_ASSERT_TRUE(panelMatches());
+}
+
+void test_close_runs_merge_and_far_runs_split(void) {
+  flushFrame(*diff, *display);
+  OledWindow windows[Diff::MAX_WINDOWS];
+  Diff probe;
+  probe.update(frame, windows);
+
+  // Fewer than OLED_DIFF_MIN_GAP unchanged columns between: one window
+  frame[10] = 1;
+  frame[10 + OLED_DIFF_MIN_GAP] = 1;
+  TEST_ASSERT_EQUAL(1, probe.update(frame, windows));
+  TEST_ASSERT_EQUAL(10, windows[0].colStart);
+  TEST_ASSERT_EQUAL(10 + OLED_DIFF_MIN_GAP, windows[0].colEnd);
+
+  // A wider gap: two windows
+  frame[50] = 1;
+  frame[51 + OLED_DIFF_MIN_GAP] = 1;
+  TEST_ASSERT_EQUAL(2, probe.update(frame, windows));
+  TEST_ASSERT_EQUAL(50, windows[0].colStart);
+  TEST_ASSERT_EQUAL(50, windows[0].colEnd);
+  TEST_ASSERT_EQUAL(51 + OLED_DIFF_MIN_GAP, windows[1].colStart);
+}
+
+void test_runs_per_page_are_capped(void) {
+  flushFrame(*diff, *display);
+  for (int x = 0; x < WIDTH; x += OLED_DIFF_MIN_GAP * 2) frame[2 * WIDTH + x] = 0xFF;
+  OledWindow windows[Diff::MAX_WINDOWS];
+  Diff probe;
+  uint8_t blank[FRAME_BYTES] = {};
+  probe.update(blank, windows);
+  TEST_ASSERT_EQUAL(OLED_DIFF_MAX_RUNS_PER_PAGE, probe.update(frame, windows));
+  TEST_ASSERT_EQUAL(0, windows[0].colStart);
+  TEST_ASSERT_EQUAL(WIDTH - OLED_DIFF_MIN_GAP * 2, windows[OLED_DIFF_MAX_RUNS_PER_PAGE - 1].colEnd);
+
+  flushFrame(*diff, *display);
+  TEST_ASSERT_TRUE(panelMatches());
+}
+
+void test_invalidate_resends_whole_screen(void) {
+  flushFrame(*diff, *display);
+  diff->invalidate();   // Something else wrote to the panel
+  TEST_ASSERT_EQUAL(FULL_FRAME_BYTES, flushFrame(*diff, *display));
+}
+
+void test_random_edits_keep_panel_in_sync(void) {
+  flushFrame(*diff, *display);
+  uint32_t rng = 0x2545f491;
+  uint8_t previous[FRAME_BYTES];
+  for (int n = 0; n < 2000; n++) {
+    memcpy(previous, frame, FRAME_BYTES);
+    uint32_t before[PAGES];
+    memcpy(before, display->pageWindows, sizeof(before));
+    int edits = n % 7;   // Sometimes none
+    for (int e = 0; e < edits; e++) {
+      rng = rng * 1103515245 + 12345;
+      frame[(rng >> 8) % FRAME_BYTES] ^= (uint8_t)(rng >> 24);
+    }
+    size_t sent = flushFrame(*diff, *display);
+    TEST_ASSERT_TRUE(panelMatches());
+    bool same = memcmp(previous, frame, FRAME_BYTES) == 0;
+    TEST_ASSERT_EQUAL(same, sent == 0);
+    for (uint8_t page = 0; page < PAGES; page++) {
+      if (memcmp(previous + page * WIDTH, frame + page * WIDTH, WIDTH) == 0) {
+        TEST_ASSERT_EQUAL(before[page], display->pageWindows[page]);
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_first_flush_sends_whole_screen);
+  RUN_TEST(test_unchanged_frame_sends_nothing);
+  RUN_TEST(test_one_pixel_sends_one_column);
+  RUN_TEST(test_unchanged_pages_are_not_written);
+  RUN_TEST(test_close_runs_merge_and_far_runs_split);
+  RUN_TEST(test_runs_per_page_are_capped);
+  RUN_TEST(test_invalidate_resends_whole_screen);
+  RUN_TEST(test_random_edits_keep_panel_in_sync);
+  return UNITY_END();
+}
@@ -0,0 +1,182 @@
+/*
+  minichart.js - tiny canvas line chart for the sauna dashboard.
+
+  Implements the small subset of the Chart.js API the dashboard uses
+  (line charts, labels + datasets, chart.update()) so the page works
+  without internet access. Bundled into the gzipped dashboard asset.
+*/
+(function (global) {
+  'use strict';
+
+  function Chart(ctx, config) {
+    this.ctx = ctx;
+    this.canvas = ctx.canvas;
+    this.data = config.data;
+    this.options = config.options || {};
+    this.hover = -1;
+    var self = this;
+    this.canvas.addEventListener('mousemove', function (e) { self._onHover(e); });
+    this.canvas.addEventListener('mouseleave', function () { self.hover = -1; self.update(); });
+    window.addEventListener('resize', function () { self.update(); });
+    this.update();
+  }
+
+  Chart.defaults = { color: '#666', borderColor: 'rgba(0,0,0,0.1)', font: '12px Arial, sans-serif' };
+
+  function opt(obj, path, fallback) {
+    var v = obj;
+    for (var i = 0; i < path.length; i++) {
+      if (v == null) return fallback;
+      v = v[path[i]];
+    }
+    return v == null ? fallback : v;
+  }
+
+  // Round a span to a 1/2/5 x 10^n step
+  function niceStep(span, maxTicks) {
+    var raw = span / Math.max(1, maxTicks - 1);
+    var mag = Math.pow(10, Math.floor(Math.log(raw) / Math.LN10));
+    var norm = raw / mag;
+    return (norm <= 1 ? 1 : norm <= 2 ? 2 : norm <= 5 ? 5 : 10) * mag;
+  }
+
+  Chart.prototype._layout = function () {
+    var dpr = window.devicePixelRatio || 1;
+    var parent = this.canvas.parentNode;
+    var w = parent.clientWidth - 2 * parseFloat(getComputedStyle(parent).paddingLeft || 0);
+    var h = parent.clientHeight - 2 * parseFloat(getComputedStyle(parent).paddingTop || 0);
+    this.canvas.style.width = w + 'px';
+    this.canvas.style.height = h + 'px';
+    this.canvas.width = Math.round(w * dpr);
+    this.canvas.height = Math.round(h * dpr);
+    this.ctx.setTransform(dpr, 0, 0, dpr, 0, 0);
+    var legendBottom = opt(this.options, ['plugins', 'legend', 'position'], 'top') === 'bottom';
+    this.area = {
+      left: 44, right: w - 10,
+      top: legendBottom ? 10 : 34,
+      bottom: h - (legendBottom ? 54 : 26),
+      legendY: legendBottom ? h - 14 : 12
+    };
+  };
+
+  Chart.prototype._range = function () {
+    var min = Infinity, max = -Infinity;
+    this.data.datasets.forEach(function (ds) {
+      ds.data.forEach(function (v) {
+        v = Number(v);
+        if (isNaN(v)) return;
+        if (v < min) min = v;
+        if (v > max) max = v;
+      });
+    });
+    if (min === Infinity) { min = 0; max = 1; }
+    if (min === max) { min -= 1; max += 1; }
+    var maxTicks = opt(this.options, ['scales', 'y', 'ticks', 'maxTicksLimit'], 8);
+    var step = niceStep(max - min, maxTicks);
+    return { min: Math.floor(min / step) * step, max: Math.ceil(max / step) * step, step: step };
+  };
+
+  Chart.prototype._x = function (i, n) {
+    var a = this.area;
+    return n <= 1 ? (a.left + a.right) / 2 : a.left + (a.right - a.left) * i / (n - 1);
+  };
+
+  Chart.prototype._y = function (v, r) {
+    var a = this.area;
+    return a.bottom - (a.bottom - a.top) * (v - r.min) / (r.max - r.min);
+  };
+
+  Chart.prototype.update = function () {
+    this._layout();
+    var ctx = this.ctx, a = this.area, self = this;
+    var labels = this.data.labels || [];
+    var n = labels.length;
+    var r = this._range();
+    var gridColor = opt(this.options, ['scales', 'y', 'grid', 'color'], Chart.defaults.borderColor);
+    var showGrid = opt(this.options, ['scales', 'y', 'grid', 'display'], true);
+    var textColor = Chart.defaults.color;
+
+    ctx.clearRect(0, 0, this.canvas.width, this.canvas.height);
+    ctx.font = Chart.defaults.font;
+    ctx.lineWidth = 1;
+
+    // Y axis ticks and grid
+    ctx.fillStyle = textColor;
+    ctx.strokeStyle = gridColor;
+    ctx.textAlign = 'right';
+    ctx.textBaseline = 'middle';
+    for (var v = r.min; v <= r.max + r.step / 2; v += r.step) {
+      var y = this._y(v, r);
+      if (showGrid) {
+        ctx.beginPath(); ctx.moveTo(a.left, y); ctx.lineTo(a.right, y); ctx.stroke();
+      }
+      ctx.fillText(+v.toFixed(2), a.left - 6, y);
+    }
+
+    // X axis labels, thinned to maxTicksLimit
+    var maxX = opt(this.options, ['scales', 'x', 'ticks', 'maxTicksLimit'], 10);
+    var every = Math.max(1, Math.ceil(n / maxX));
+    ctx.textAlign = 'center';
+    ctx.textBaseline = 'top';
+    for (var i = 0; i < n; i += every) {
+      ctx.fillText(labels[i], this._x(i, n), a.bottom + 6);
+    }
+
+    // Datasets
+    this.data.datasets.forEach(function (ds) {
+      ctx.strokeStyle = ds.borderColor;
+      ctx.fillStyle = ds.borderColor;
+      ctx.lineWidth = ds.borderWidth || 2;
+      ctx.beginPath();
+      ds.data.forEach(function (val, j) {
+        var px = self._x(j, n), py = self._y(Number(val), r);
+        if (j === 0) ctx.moveTo(px, py); else ctx.lineTo(px, py);
+      });
+      ctx.stroke();
+      var radius = ds.pointRadius == null ? 3 : ds.pointRadius;
+      ds.data.forEach(function (val, j) {
+        ctx.beginPath();
+        ctx.arc(self._x(j, n), self._y(Number(val), r), j === self.hover ? radius + 2 : radius, 0, 2 * Math.PI);
+        ctx.fill();
+      });
+    });
+
+    // Legend
+    var lx = a.left;
+    ctx.textAlign = 'left';
+    ctx.textBaseline = 'middle';
+    this.data.datasets.forEach(function (ds) {
+      ctx.fillStyle = ds.borderColor;
+      ctx.fillRect(lx, a.legendY - 6, 12, 12);
+      ctx.fillStyle = textColor;
+      ctx.fillText(ds.label, lx + 16, a.legendY);
+      lx += ctx.measureText(ds.label).width + 36;
+    });
+
+    // Index-mode tooltip
+    if (this.hover >= 0 && this.hover < n) {
+      var lines = [labels[this.hover]].concat(this.data.datasets.map(function (ds) {
+        return ds.label + ': ' + ds.data[self.hover];
+      }));
+      var tw = 0;
+      lines.forEach(function (l) { tw = Math.max(tw, ctx.measureText(l).width); });
+      var tx = Math.min(this._x(this.hover, n) + 10, a.right - tw - 12);
+      ctx.fillStyle = 'rgba(0,0,0,0.7)';
+      ctx.fillRect(tx, a.top, tw + 12, lines.length * 16 + 8);
+      ctx.fillStyle = '#fff';
+      lines.forEach(function (l, k) { ctx.fillText(l, tx + 6, a.top + 12 + k * 16); });
+    }
+  };
+
+  Chart.prototype._onHover = function (e) {
+    var n = (this.data.labels || []).length;
+    if (!n) return;
+    var rect = this.canvas.getBoundingClientRect();
+    var a = this.area;
+    var i = Math.round((e.clientX - rect.left - a.left) / (a.right - a.left) * (n - 1));
+    i = Math.max(0, Math.min(n - 1, i));
+    if (i !== this.hover) { this.hover = i; this.update(); }
+  };
+
+  global.Chart = Chart;
+})(window);